@@ -0,0 +1,143 @@
+
+#include "bandprocessor.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Bands per thread, more bands balance the load if some threads are slowed down
+	const int BandsPerThread = 4;
+	// Minimum number of rows in a band, so that small images are not split too much
+	const int MinBandHeight = 16;
+}
+
+namespace dolp
+{
+	BandProcessor::BandProcessor(int numThreads)
+	{
+		startWorkers(numThreads);
+	}
+
+	BandProcessor::~BandProcessor()
+	{
+		std::lock_guard run_lck(_run_mtx);
+		stopWorkers();
+	}
+
+	void BandProcessor::setNumThreads(int numThreads)
+	{
+		std::lock_guard run_lck(_run_mtx);
+		stopWorkers();
+		startWorkers(numThreads);
+	}
+
+	int BandProcessor::numThreads() const
+	{
+		return _num_threads;
+	}
+
+	void BandProcessor::startWorkers(int numThreads)
+	{
+		numThreads = (std::max)(numThreads, 1);
+		_num_threads = numThreads;
+
+		// The calling thread of run() is the first thread
+		for (int i = 1; i < numThreads; ++i)
+		{
+			_workers.emplace_back([this] { workerThread(); });
+		}
+	}
+
+	void BandProcessor::stopWorkers()
+	{
+		{
+			std::lock_guard lck(_mtx);
+			_stop = true;
+		}
+		_work_available.notify_all();
+
+		for (auto& t : _workers)
+			t.join();
+
+		_workers.clear();
+		_stop = false;
+	}
+
+	void BandProcessor::run(int height, const BandFunction& func)
+	{
+		std::lock_guard run_lck(_run_mtx);
+
+		int num_bands = (std::min)(static_cast<int>(_workers.size() + 1) * BandsPerThread, height / MinBandHeight);
+		if (_workers.empty() || num_bands <= 1)
+		{
+			func(0, height);
+			return;
+		}
+
+		{
+			// A worker that woke up too late for the previous run may still be checking for bands
+			std::unique_lock lck(_mtx);
+			_done.wait(lck, [this] { return _num_active == 0; });
+
+			_func = &func;
+			_height = height;
+			_num_bands = num_bands;
+			_next_band = 0;
+			_remaining_bands = num_bands;
+			_generation += 1;
+		}
+		_work_available.notify_all();
+
+		processBands();
+
+		// Wait for the bands processed by the workers, and for all workers to leave processBands()
+		std::unique_lock lck(_mtx);
+		_done.wait(lck, [this] { return _remaining_bands == 0 && _num_active == 0; });
+		_func = nullptr;
+	}
+
+	void BandProcessor::processBands()
+	{
+		while (true)
+		{
+			int band = _next_band.fetch_add(1);
+			if (band >= _num_bands)
+				break;
+
+			int first_row = static_cast<int>(static_cast<int64_t>(band) * _height / _num_bands);
+			int end_row = static_cast<int>(static_cast<int64_t>(band + 1) * _height / _num_bands);
+			(*_func)(first_row, end_row);
+
+			if (_remaining_bands.fetch_sub(1) == 1)
+			{
+				std::lock_guard lck(_mtx);
+				_done.notify_all();
+			}
+		}
+	}
+
+	void BandProcessor::workerThread()
+	{
+		std::unique_lock lck(_mtx);
+
+		// Only process runs started after the thread was created
+		uint64_t processed_generation = _generation;
+		while (true)
+		{
+			_work_available.wait(lck, [&] { return _stop || _generation != processed_generation; });
+			if (_stop)
+				break;
+
+			processed_generation = _generation;
+			_num_active += 1;
+			lck.unlock();
+
+			processBands();
+
+			lck.lock();
+			_num_active -= 1;
+			if (_num_active == 0)
+				_done.notify_all();
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dolp
+{
+	/// <summary>
+	/// Processes images in horizontal bands on a persistent set of threads.
+	/// </summary>
+	/// <remarks>
+	/// The calling thread processes bands as well, so numThreads includes the caller.
+	/// The image is split into more bands than threads, which are picked up by the threads as they become idle.
+	/// </remarks>
+	class BandProcessor
+	{
+	public:
+		using BandFunction = std::function<void(int firstRow, int endRow)>;
+
+		explicit BandProcessor(int numThreads);
+		~BandProcessor();
+
+		BandProcessor(const BandProcessor&) = delete;
+		BandProcessor& operator=(const BandProcessor&) = delete;
+
+		/// <summary>
+		/// Changes the number of threads. Waits until a concurrent call to run() completed.
+		/// </summary>
+		void setNumThreads(int numThreads);
+		int numThreads() const;
+
+		/// <summary>
+		/// Splits the rows [0, height) into bands and calls func for every band.
+		/// Returns after all bands were processed.
+		/// </summary>
+		void run(int height, const BandFunction& func);
+
+	private:
+		void startWorkers(int numThreads);
+		void stopWorkers();
+		void workerThread();
+		void processBands();
+
+		// Held for the duration of a run, and while changing the number of threads
+		std::mutex _run_mtx;
+
+		std::mutex _mtx;
+		std::condition_variable _work_available;
+		std::condition_variable _done;
+		uint64_t _generation = 0;
+		int _num_active = 0;
+		bool _stop = false;
+
+		// Describe the current run, only modified while no worker is active
+		const BandFunction* _func = nullptr;
+		int _height = 0;
+		int _num_bands = 0;
+
+		std::atomic<int> _next_band = 0;
+		std::atomic<int> _remaining_bands = 0;
+
+		std::atomic<int> _num_threads = 1;
+		std::vector<std::thread> _workers;
+	};
+}
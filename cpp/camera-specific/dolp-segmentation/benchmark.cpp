@@ -0,0 +1,465 @@
+/*
+ * Copyright The Imaging Source Europe GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Headless benchmark of the dolp-segmentation kernels, which does not require a camera.
+ *
+ * All threshold and temporal filter kernel implementations supported by the CPU and all lookup table visualizations
+ * are run on synthetic or recorded PolarizedADIMono8/PolarizedADIRGB8 frames. The threshold and filter kernels are checked
+ * against the reference implementation, the visualizations against a single unbanded call.
+ * The program returns 1 if any output differs, so that it can be used as a regression check.
+ */
+
+#include "polarizationkernels.h"
+#include "visualization.h"
+#include "bandprocessor.h"
+
+#include <ic4/ic4.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		int width = 2448;
+		int height = 2048;
+		int iterations = 20;
+		int threads = 1;
+
+		// Raw frame with tightly packed rows, synthetic frames are used if empty
+		std::string input;
+		ic4::PixelFormat inputFormat = ic4::PixelFormat::PolarizedADIMono8;
+	};
+
+	void printUsage()
+	{
+		std::printf(
+			"Usage: dolpbenchmark [options]\n"
+			"  --width <pixels>        Width of the synthetic or recorded frames (default 2448)\n"
+			"  --height <pixels>       Height of the synthetic or recorded frames (default 2048)\n"
+			"  --iterations <count>    Number of timed runs per kernel (default 20)\n"
+			"  --threads <count>       Number of threads processing bands (default 1)\n"
+			"  --input <file>          Recorded frame with tightly packed rows, instead of synthetic frames\n"
+			"  --format mono|rgb       Pixel format of the recorded frame, PolarizedADIMono8 or PolarizedADIRGB8 (default mono)\n"
+		);
+	}
+
+	bool parseInt(const char* text, int minValue, int& value)
+	{
+		char* end = nullptr;
+		long v = std::strtol(text, &end, 10);
+		if (end == text || *end != '\0' || v < minValue || v > 65536)
+			return false;
+
+		value = static_cast<int>(v);
+		return true;
+	}
+
+	bool parseArguments(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if (i + 1 >= argc)
+				return false;
+
+			const char* value = argv[++i];
+			if (arg == "--width")
+			{
+				if (!parseInt(value, 1, options.width))
+					return false;
+			}
+			else if (arg == "--height")
+			{
+				if (!parseInt(value, 1, options.height))
+					return false;
+			}
+			else if (arg == "--iterations")
+			{
+				if (!parseInt(value, 1, options.iterations))
+					return false;
+			}
+			else if (arg == "--threads")
+			{
+				if (!parseInt(value, 1, options.threads))
+					return false;
+			}
+			else if (arg == "--input")
+			{
+				options.input = value;
+			}
+			else if (arg == "--format")
+			{
+				if (std::string(value) == "mono")
+					options.inputFormat = ic4::PixelFormat::PolarizedADIMono8;
+				else if (std::string(value) == "rgb")
+					options.inputFormat = ic4::PixelFormat::PolarizedADIRGB8;
+				else
+					return false;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int bytesPerPixel(ic4::PixelFormat format)
+	{
+		return format == ic4::PixelFormat::PolarizedADIMono8 ? 4 : 8;
+	}
+
+	const char* formatName(ic4::PixelFormat format)
+	{
+		return format == ic4::PixelFormat::PolarizedADIMono8 ? "ADIMono8" : "ADIRGB8";
+	}
+
+	const char* reductionName(dolp::ChannelReduction reduction)
+	{
+		switch (reduction)
+		{
+		case dolp::ChannelReduction::Maximum: return "Maximum";
+		case dolp::ChannelReduction::Luminance: return "Luminance";
+		case dolp::ChannelReduction::Average:
+		default: return "Average";
+		}
+	}
+
+	const char* visualizationName(dolp::VisualizationMode mode)
+	{
+		switch (mode)
+		{
+		case dolp::VisualizationMode::DoLPHeatMap: return "LUT DoLPHeatMap";
+		case dolp::VisualizationMode::AoLPHue: return "LUT AoLPHue";
+		case dolp::VisualizationMode::AoLPDoLP: return "LUT AoLPDoLP";
+		case dolp::VisualizationMode::Threshold:
+		default: return "Threshold";
+		}
+	}
+
+	const char* filterName(dolp::TemporalFilterMode mode)
+	{
+		switch (mode)
+		{
+		case dolp::TemporalFilterMode::DoLPAverage: return "Filter Average";
+		case dolp::TemporalFilterMode::Vote: return "Filter Vote";
+		case dolp::TemporalFilterMode::Off:
+		default: return "Filter Off";
+		}
+	}
+
+	/// <summary>
+	/// Fills a frame with random polarization data. The kernels do not branch on the pixel values,
+	/// so uniformly distributed values are as expensive as real scenes, while covering all threshold comparisons.
+	/// </summary>
+	void fillSynthetic(ic4::ImageBuffer& buffer, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+
+		auto rowBytes = static_cast<size_t>(buffer.imageType().width()) * bytesPerPixel(buffer.imageType().pixel_format());
+		for (int y = 0; y < buffer.imageType().height(); ++y)
+		{
+			auto line = static_cast<uint8_t*>(buffer.ptr()) + y * buffer.pitch();
+			for (size_t i = 0; i < rowBytes; ++i)
+				line[i] = static_cast<uint8_t>(rng());
+		}
+	}
+
+	/// <summary>
+	/// Loads a recorded frame, stored as rows without padding, into a buffer of the matching size
+	/// </summary>
+	bool loadRaw(const std::string& fileName, ic4::ImageBuffer& buffer)
+	{
+		std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			std::fprintf(stderr, "Failed to open %s\n", fileName.c_str());
+			return false;
+		}
+
+		auto rowBytes = static_cast<size_t>(buffer.imageType().width()) * bytesPerPixel(buffer.imageType().pixel_format());
+		auto expectedSize = rowBytes * buffer.imageType().height();
+		if (static_cast<size_t>(file.tellg()) != expectedSize)
+		{
+			std::fprintf(stderr, "%s has %lld bytes, expected %zu bytes for a %dx%d %s frame\n",
+				fileName.c_str(), static_cast<long long>(file.tellg()), expectedSize,
+				buffer.imageType().width(), buffer.imageType().height(), formatName(buffer.imageType().pixel_format()));
+			return false;
+		}
+
+		file.seekg(0);
+		for (int y = 0; y < buffer.imageType().height(); ++y)
+		{
+			auto line = static_cast<char*>(buffer.ptr()) + y * buffer.pitch();
+			if (!file.read(line, static_cast<std::streamsize>(rowBytes)))
+				return false;
+		}
+		return true;
+	}
+
+	bool equalImages(const ic4::ImageBuffer& a, const ic4::ImageBuffer& b)
+	{
+		auto rowBytes = static_cast<size_t>(a.imageType().width()) * 4;
+		for (int y = 0; y < a.imageType().height(); ++y)
+		{
+			auto lineA = static_cast<const uint8_t*>(a.ptr()) + y * a.pitch();
+			auto lineB = static_cast<const uint8_t*>(b.ptr()) + y * b.pitch();
+			if (std::memcmp(lineA, lineB, rowBytes) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	void clearImage(ic4::ImageBuffer& buffer)
+	{
+		for (int y = 0; y < buffer.imageType().height(); ++y)
+		{
+			auto line = static_cast<uint8_t*>(buffer.ptr()) + y * buffer.pitch();
+			std::memset(line, 0, static_cast<size_t>(buffer.imageType().width()) * 4);
+		}
+	}
+
+	/// <summary>
+	/// Benchmarks all kernels on one frame
+	/// </summary>
+	class Benchmark
+	{
+	public:
+		Benchmark(const ic4::ImageBuffer& src, const Options& options)
+			: _src(src)
+			, _options(options)
+			, _bandProcessor(options.threads)
+			, _pool(ic4::BufferPool::create(ic4::BufferPool::CacheConfig{ 0, 0 }))
+		{
+			auto dstType = ic4::ImageType(ic4::PixelFormat::BGRa8, src.imageType().width(), src.imageType().height());
+			_reference = _pool->getBuffer(dstType);
+			_dst = _pool->getBuffer(dstType);
+
+			// The filter kernels start from a random state, so that all state values are covered
+			std::mt19937 rng(5678);
+			_initialState.resize(static_cast<size_t>(width()) * height());
+			for (auto& value : _initialState)
+				value = static_cast<uint8_t>(rng());
+		}
+
+		/// <summary>
+		/// Runs all kernels
+		/// </summary>
+		/// <returns>The number of kernels whose output differed</returns>
+		int run()
+		{
+			std::vector<dolp::ChannelReduction> reductions = { dolp::ChannelReduction::Average };
+			if (!isMono())
+				reductions = { dolp::ChannelReduction::Average, dolp::ChannelReduction::Maximum, dolp::ChannelReduction::Luminance };
+
+			int mismatches = 0;
+			for (auto reduction : reductions)
+			{
+				dolp::ThresholdParams params;
+				params.reduction = reduction;
+
+				// The threshold kernels are compared against the scalar implementation
+				auto& reference = dolp::referenceKernels();
+				(isMono() ? reference.adiMono8 : reference.adiRGB8)(srcPtr(), _src.pitch(), dstPtr(*_reference), _reference->pitch(), width(), height(), params);
+
+				for (auto kernels : dolp::supportedKernels())
+				{
+					auto func = isMono() ? kernels->adiMono8 : kernels->adiRGB8;
+					bool ok = measure("Threshold", kernels->name, reduction,
+						[&](int firstRow, int endRow)
+						{
+							func(srcRow(firstRow), _src.pitch(), dstRow(*_dst, firstRow), _dst->pitch(), width(), endRow - firstRow, params);
+						}
+					);
+					mismatches += ok ? 0 : 1;
+				}
+
+				// The filter kernels are compared against the scalar implementation, including the updated state
+				for (auto mode : { dolp::TemporalFilterMode::DoLPAverage, dolp::TemporalFilterMode::Vote })
+				{
+					dolp::TemporalFilterParams filter;
+					filter.mode = mode;
+
+					_referenceState = _initialState;
+					(isMono() ? reference.filteredADIMono8 : reference.filteredADIRGB8)(srcPtr(), _src.pitch(), _referenceState.data(), width(), dstPtr(*_reference), _reference->pitch(), width(), height(), params, filter);
+
+					for (auto kernels : dolp::supportedKernels())
+					{
+						auto func = isMono() ? kernels->filteredADIMono8 : kernels->filteredADIRGB8;
+						bool ok = measure(filterName(mode), kernels->name, reduction,
+							[&](int firstRow, int endRow)
+							{
+								func(srcRow(firstRow), _src.pitch(), stateRow(firstRow), width(), dstRow(*_dst, firstRow), _dst->pitch(), width(), endRow - firstRow, params, filter);
+							},
+							&_referenceState
+						);
+						mismatches += ok ? 0 : 1;
+					}
+				}
+
+				// The visualizations only have one implementation, they are checked for differences caused by the bands
+				for (auto mode : { dolp::VisualizationMode::DoLPHeatMap, dolp::VisualizationMode::AoLPHue, dolp::VisualizationMode::AoLPDoLP })
+				{
+					auto lut = dolp::buildColorLut(mode, params);
+					auto func = isMono() ? dolp::applyColorLutADIMono8 : dolp::applyColorLutADIRGB8;
+					func(srcPtr(), _src.pitch(), dstPtr(*_reference), _reference->pitch(), width(), height(), *lut, params);
+
+					bool ok = measure(visualizationName(mode), "Scalar", reduction,
+						[&](int firstRow, int endRow)
+						{
+							func(srcRow(firstRow), _src.pitch(), dstRow(*_dst, firstRow), _dst->pitch(), width(), endRow - firstRow, *lut, params);
+						}
+					);
+					mismatches += ok ? 0 : 1;
+				}
+			}
+			return mismatches;
+		}
+
+	private:
+		/// <summary>
+		/// Times a kernel on the whole frame, split into bands, and compares its output with the reference image.
+		/// The median of all iterations is reported, which is not affected by single runs disturbed by other processes.
+		/// </summary>
+		/// <param name="referenceState">Expected filter state after the first run, nullptr for kernels without state</param>
+		/// <returns>true if the output matches</returns>
+		bool measure(const char* kernel, const char* implementation, dolp::ChannelReduction reduction, const dolp::BandProcessor::BandFunction& func, const std::vector<uint8_t>* referenceState = nullptr)
+		{
+			clearImage(*_dst);
+			_state = _initialState;
+
+			// The first run fills the caches and is not timed
+			_bandProcessor.run(height(), func);
+			bool ok = equalImages(*_reference, *_dst) && (!referenceState || _state == *referenceState);
+
+			std::vector<double> seconds;
+			for (int i = 0; i < _options.iterations; ++i)
+			{
+				auto start = std::chrono::steady_clock::now();
+				_bandProcessor.run(height(), func);
+				seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+			}
+			std::sort(seconds.begin(), seconds.end());
+			double median = seconds[seconds.size() / 2];
+
+			double pixels = static_cast<double>(width()) * height();
+			// The filter state is read and written
+			double bytes = pixels * (bytesPerPixel(_src.imageType().pixel_format()) + 4 + (referenceState ? 2 : 0));
+
+			std::printf("%-9s %-16s %-7s %-10s %8.3f ns/pixel %8.2f GB/s  %s\n",
+				formatName(_src.imageType().pixel_format()), kernel, implementation, isMono() ? "-" : reductionName(reduction),
+				median * 1e9 / pixels, bytes / median / 1e9, ok ? "OK" : "MISMATCH");
+			return ok;
+		}
+
+		bool isMono() const { return _src.imageType().pixel_format() == ic4::PixelFormat::PolarizedADIMono8; }
+		int width() const { return _src.imageType().width(); }
+		int height() const { return _src.imageType().height(); }
+
+		const uint8_t* srcPtr() const { return static_cast<const uint8_t*>(_src.ptr()); }
+		const uint8_t* srcRow(int y) const { return srcPtr() + y * _src.pitch(); }
+		static uint8_t* dstPtr(ic4::ImageBuffer& buffer) { return static_cast<uint8_t*>(buffer.ptr()); }
+		static uint8_t* dstRow(ic4::ImageBuffer& buffer, int y) { return dstPtr(buffer) + y * buffer.pitch(); }
+		uint8_t* stateRow(int y) { return _state.data() + static_cast<size_t>(y) * width(); }
+
+		const ic4::ImageBuffer& _src;
+		const Options& _options;
+		dolp::BandProcessor _bandProcessor;
+
+		std::shared_ptr<ic4::BufferPool> _pool;
+		std::shared_ptr<ic4::ImageBuffer> _reference;
+		std::shared_ptr<ic4::ImageBuffer> _dst;
+
+		// Filter state with the image width as pitch
+		std::vector<uint8_t> _initialState;
+		std::vector<uint8_t> _referenceState;
+		std::vector<uint8_t> _state;
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!parseArguments(argc, argv, options))
+	{
+		printUsage();
+		return 2;
+	}
+
+	ic4::InitLibraryConfig libraryConfig =
+	{
+		ic4::ErrorHandlerBehavior::Throw,
+		ic4::LogLevel::Warning,
+		ic4::LogLevel::Off,
+		ic4::LogTarget::StdErr
+	};
+	ic4::initLibrary(libraryConfig);
+	// Automatically call exitLibrary when returning from main
+	std::atexit(ic4::exitLibrary);
+
+	try
+	{
+		std::vector<ic4::PixelFormat> formats = { ic4::PixelFormat::PolarizedADIMono8, ic4::PixelFormat::PolarizedADIRGB8 };
+		if (!options.input.empty())
+			formats = { options.inputFormat };
+
+		std::printf("%s frames of %dx%d pixels, %d threads, median of %d runs\n",
+			options.input.empty() ? "Synthetic" : options.input.c_str(), options.width, options.height, options.threads, options.iterations);
+
+		auto pool = ic4::BufferPool::create(ic4::BufferPool::CacheConfig{ 0, 0 });
+
+		int mismatches = 0;
+		for (auto format : formats)
+		{
+			auto src = pool->getBuffer(ic4::ImageType(format, options.width, options.height));
+			if (options.input.empty())
+			{
+				fillSynthetic(*src, 1234);
+			}
+			else if (!loadRaw(options.input, *src))
+			{
+				return 2;
+			}
+
+			Benchmark benchmark(*src, options);
+			mismatches += benchmark.run();
+		}
+
+		if (mismatches > 0)
+		{
+			std::printf("%d kernels produced different output\n", mismatches);
+			return 1;
+		}
+	}
+	catch (const ic4::IC4Exception& ex)
+	{
+		std::fprintf(stderr, "%s\n", ex.what());
+		return 2;
+	}
+
+	return 0;
+}
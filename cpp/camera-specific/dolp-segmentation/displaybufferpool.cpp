@@ -0,0 +1,65 @@
+
+#include "displaybufferpool.h"
+
+#include <algorithm>
+#include <new>
+
+namespace dolp
+{
+	DisplayBufferPool::DisplayBufferPool(size_t numBuffers)
+		: _allocator(std::make_shared<CountingAllocator>())
+		, _pool(ic4::BufferPool::create(_allocator, ic4::BufferPool::CacheConfig{ numBuffers, 0 }))
+		, _num_buffers(numBuffers)
+	{
+	}
+
+	std::shared_ptr<ic4::ImageBuffer> DisplayBufferPool::getBuffer(const ic4::ImageType& imageType)
+	{
+		// The allocator is only called if the pool had no matching buffer in its cache
+		auto allocationsBefore = _allocator->numAllocations();
+		auto buffer = _pool->getBuffer(imageType);
+
+		if (_allocator->numAllocations() != allocationsBefore)
+		{
+			_misses.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			_hits.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		return buffer;
+	}
+
+	size_t DisplayBufferPool::numBuffers() const
+	{
+		return _num_buffers;
+	}
+
+	DisplayBufferPool::Statistics DisplayBufferPool::statistics() const
+	{
+		Statistics stats;
+		stats.hits = _hits.load(std::memory_order_relaxed);
+		stats.misses = _misses.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	bool DisplayBufferPool::CountingAllocator::allocate_buffer(size_t buffer_size, size_t alignment, void** buffer_ptr, void** user_data)
+	{
+		auto align = std::align_val_t{ (std::max)(alignment, alignof(std::max_align_t)) };
+		*buffer_ptr = ::operator new(buffer_size, align, std::nothrow);
+		if (*buffer_ptr == nullptr)
+			return false;
+
+		// Remember the alignment, the memory has to be freed with the same one
+		*user_data = reinterpret_cast<void*>(static_cast<size_t>(align));
+
+		_num_allocations.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	void DisplayBufferPool::CountingAllocator::free_buffer(void* buffer_ptr, void* user_data)
+	{
+		::operator delete(buffer_ptr, std::align_val_t{ reinterpret_cast<size_t>(user_data) }, std::nothrow);
+	}
+}
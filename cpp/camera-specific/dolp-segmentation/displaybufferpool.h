@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace dolp
+{
+	/// <summary>
+	/// Allocates the buffers the processed images are written to, and counts how often a buffer could be reused.
+	/// </summary>
+	/// <remarks>
+	/// Buffers are returned to the pool when the display releases them. If the display holds more buffers
+	/// than the pool caches, the pool has to allocate new buffers, which shows up as misses.
+	///
+	/// The buffers are cached by an ic4::BufferPool, which follows the references the display keeps on them.
+	/// Its memory is allocated by a counting allocator, so a getBuffer() call that allocated is counted as miss,
+	/// every other call as hit. getBuffer() must only be called by one thread, the statistics can be read by any thread.
+	/// </remarks>
+	class DisplayBufferPool
+	{
+	public:
+		struct Statistics
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+		};
+
+		/// <summary>
+		/// Creates a pool
+		/// </summary>
+		/// <param name="numBuffers">Number of buffers that are kept for reuse after the display released them</param>
+		explicit DisplayBufferPool(size_t numBuffers);
+
+		std::shared_ptr<ic4::ImageBuffer> getBuffer(const ic4::ImageType& imageType);
+
+		size_t numBuffers() const;
+		Statistics statistics() const;
+
+	private:
+		/// <summary>
+		/// Allocates the pool's buffers from the heap and counts the allocations
+		/// </summary>
+		class CountingAllocator : public ic4::BufferAllocator
+		{
+		public:
+			bool allocate_buffer(size_t buffer_size, size_t alignment, void** buffer_ptr, void** user_data) final;
+			void free_buffer(void* buffer_ptr, void* user_data) final;
+
+			uint64_t numAllocations() const { return _num_allocations.load(std::memory_order_relaxed); }
+
+		private:
+			std::atomic<uint64_t> _num_allocations = 0;
+		};
+
+		std::shared_ptr<CountingAllocator> _allocator;
+		std::shared_ptr<ic4::BufferPool> _pool;
+		size_t _num_buffers;
+
+		std::atomic<uint64_t> _hits = 0;
+		std::atomic<uint64_t> _misses = 0;
+	};
+}
@@ -0,0 +1,45 @@
+
+#include "drawing.h"
+
+#include <cstring>
+
+namespace
+{
+	inline void setPixel(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, int x, int y, uint32_t color)
+	{
+		if (x >= 0 && y >= 0 && x < width && y < height)
+			std::memcpy(dst + y * dstPitch + x * 4, &color, 4);
+	}
+
+	void drawHorizontalLine(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, int x0, int x1, int y, uint32_t color)
+	{
+		for (int x = x0; x <= x1; ++x)
+			setPixel(dst, dstPitch, width, height, x, y, color);
+	}
+
+	void drawVerticalLine(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, int x, int y0, int y1, uint32_t color)
+	{
+		for (int y = y0; y <= y1; ++y)
+			setPixel(dst, dstPitch, width, height, x, y, color);
+	}
+}
+
+namespace dolp
+{
+	void drawRectangle(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, int x, int y, int rectWidth, int rectHeight, uint32_t color)
+	{
+		int right = x + rectWidth - 1;
+		int bottom = y + rectHeight - 1;
+
+		drawHorizontalLine(dst, dstPitch, width, height, x, right, y, color);
+		drawHorizontalLine(dst, dstPitch, width, height, x, right, bottom, color);
+		drawVerticalLine(dst, dstPitch, width, height, x, y, bottom, color);
+		drawVerticalLine(dst, dstPitch, width, height, right, y, bottom, color);
+	}
+
+	void drawCross(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, int x, int y, int size, uint32_t color)
+	{
+		drawHorizontalLine(dst, dstPitch, width, height, x - size, x + size, y, color);
+		drawVerticalLine(dst, dstPitch, width, height, x, y - size, y + size, color);
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dolp
+{
+	/// <summary>
+	/// Draws the outline of a rectangle into a BGRa8 image, clipped to the image
+	/// </summary>
+	void drawRectangle(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, int x, int y, int rectWidth, int rectHeight, uint32_t color);
+
+	/// <summary>
+	/// Draws a cross centered at (x, y) into a BGRa8 image, clipped to the image
+	/// </summary>
+	void drawCross(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, int x, int y, int size, uint32_t color);
+}
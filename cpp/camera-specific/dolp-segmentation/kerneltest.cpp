@@ -0,0 +1,277 @@
+/*
+ * Copyright The Imaging Source Europe GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Exact-match test of the threshold kernels.
+ *
+ * Every kernel implementation supported by the CPU is run on synthetic PolarizedADIMono8/PolarizedADIRGB8 buffers
+ * and compared against the reference implementation. The widths are not multiples of the vector widths, so that
+ * the scalar tails are covered, and the rows are padded, so that writes beyond the row end are detected.
+ * The thresholds and filter parameters include the limits of their ranges, and the filters are also run without
+ * destination image, which only updates the filter state.
+ * The program returns 1 if any output differs.
+ */
+
+#include "polarizationkernels.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Padding after each row, filled with a pattern that has to stay untouched
+	const int RowPadding = 13;
+	const uint8_t PaddingValue = 0xCD;
+
+	const char* reductionName(dolp::ChannelReduction reduction)
+	{
+		switch (reduction)
+		{
+		case dolp::ChannelReduction::Maximum: return "Maximum";
+		case dolp::ChannelReduction::Luminance: return "Luminance";
+		case dolp::ChannelReduction::Average:
+		default: return "Average";
+		}
+	}
+
+	const char* filterName(dolp::TemporalFilterMode mode)
+	{
+		switch (mode)
+		{
+		case dolp::TemporalFilterMode::DoLPAverage: return "Filter Average";
+		case dolp::TemporalFilterMode::Vote: return "Filter Vote";
+		case dolp::TemporalFilterMode::Off:
+		default: return "Filter Off";
+		}
+	}
+
+	/// <summary>
+	/// Threshold combinations to check for one channel reduction: the defaults, the limits of the range,
+	/// and the parameters used outside of the regions of interest
+	/// </summary>
+	std::vector<dolp::ThresholdParams> thresholdCases(dolp::ChannelReduction reduction)
+	{
+		dolp::ThresholdParams defaults;
+		defaults.reduction = reduction;
+
+		std::vector<dolp::ThresholdParams> result = { defaults };
+		for (int dolpThreshold : { 0, 254, 255 })
+		{
+			for (int intensityThreshold : { 0, 254, 255 })
+			{
+				dolp::ThresholdParams params = defaults;
+				params.dolp = dolpThreshold;
+				params.intensity = intensityThreshold;
+				result.push_back(params);
+			}
+		}
+		result.push_back(dolp::intensityOnlyParams(defaults));
+		return result;
+	}
+
+	/// <summary>
+	/// Temporal filter settings to check: the defaults, the shortest and longest average, and votes over the full history
+	/// </summary>
+	std::vector<dolp::TemporalFilterParams> filterCases()
+	{
+		std::vector<dolp::TemporalFilterParams> result;
+		for (int shift : { 0, 2, 7 })
+		{
+			dolp::TemporalFilterParams filter;
+			filter.mode = dolp::TemporalFilterMode::DoLPAverage;
+			filter.averageShift = shift;
+			result.push_back(filter);
+		}
+
+		dolp::TemporalFilterParams vote;
+		vote.mode = dolp::TemporalFilterMode::Vote;
+		result.push_back(vote);
+
+		for (int required : { 1, 4, 8 })
+		{
+			vote.voteFrames = 8;
+			vote.voteRequired = required;
+			result.push_back(vote);
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// An image with padded rows
+	/// </summary>
+	struct Image
+	{
+		Image(int width, int height, int bytesPerPixel)
+			: pitch(static_cast<ptrdiff_t>(width) * bytesPerPixel + RowPadding)
+			, data(static_cast<size_t>(pitch) * height, PaddingValue)
+		{
+		}
+
+		uint8_t* ptr() { return data.data(); }
+
+		ptrdiff_t pitch;
+		std::vector<uint8_t> data;
+	};
+
+	Image randomImage(int width, int height, int bytesPerPixel, std::mt19937& rng)
+	{
+		Image image(width, height, bytesPerPixel);
+		for (int y = 0; y < height; ++y)
+		{
+			auto line = image.ptr() + y * image.pitch;
+			for (int i = 0; i < width * bytesPerPixel; ++i)
+				line[i] = static_cast<uint8_t>(rng());
+		}
+		return image;
+	}
+
+	/// <summary>
+	/// Runs all kernels on buffers of one size
+	/// </summary>
+	class KernelTest
+	{
+	public:
+		KernelTest(bool mono, int width, int height, uint32_t seed)
+			: _mono(mono)
+			, _width(width)
+			, _height(height)
+			, _rng(seed)
+			, _src(randomImage(width, height, mono ? 4 : 8, _rng))
+			, _initialState(randomImage(width, height, 1, _rng))
+		{
+		}
+
+		/// <summary>
+		/// Compares the threshold kernels of all implementations with the reference implementation
+		/// </summary>
+		/// <returns>The number of kernels whose output differed</returns>
+		int checkThreshold(const dolp::ThresholdParams& params)
+		{
+			auto& reference = dolp::referenceKernels();
+
+			Image expected(_width, _height, 4);
+			(_mono ? reference.adiMono8 : reference.adiRGB8)(_src.ptr(), _src.pitch, expected.ptr(), expected.pitch, _width, _height, params);
+
+			int mismatches = 0;
+			for (auto kernels : dolp::supportedKernels())
+			{
+				Image actual(_width, _height, 4);
+				(_mono ? kernels->adiMono8 : kernels->adiRGB8)(_src.ptr(), _src.pitch, actual.ptr(), actual.pitch, _width, _height, params);
+
+				if (actual.data != expected.data)
+				{
+					report("Threshold", kernels->name, params);
+					mismatches += 1;
+				}
+			}
+			return mismatches;
+		}
+
+		/// <summary>
+		/// Compares the temporal filter kernels of all implementations with the reference implementation,
+		/// including the updated filter state
+		/// </summary>
+		/// <param name="withDst">If false, the kernels are called with dst == nullptr and only update the state</param>
+		/// <returns>The number of kernels whose output differed</returns>
+		int checkFilter(const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter, bool withDst)
+		{
+			auto& reference = dolp::referenceKernels();
+
+			Image expected(_width, _height, 4);
+			Image expectedState = _initialState;
+			(_mono ? reference.filteredADIMono8 : reference.filteredADIRGB8)(_src.ptr(), _src.pitch, expectedState.ptr(), expectedState.pitch,
+				withDst ? expected.ptr() : nullptr, expected.pitch, _width, _height, params, filter);
+
+			int mismatches = 0;
+			for (auto kernels : dolp::supportedKernels())
+			{
+				Image actual(_width, _height, 4);
+				Image actualState = _initialState;
+				(_mono ? kernels->filteredADIMono8 : kernels->filteredADIRGB8)(_src.ptr(), _src.pitch, actualState.ptr(), actualState.pitch,
+					withDst ? actual.ptr() : nullptr, actual.pitch, _width, _height, params, filter);
+
+				// Without destination, both images still contain the padding pattern and have to be equal as well
+				if (actual.data != expected.data || actualState.data != expectedState.data)
+				{
+					report(filterName(filter.mode), kernels->name, params);
+					std::printf("    shift %d, vote %d of %d, %s\n", filter.averageShift, filter.voteRequired, filter.voteFrames, withDst ? "with dst" : "dst == nullptr");
+					mismatches += 1;
+				}
+			}
+			return mismatches;
+		}
+
+	private:
+		void report(const char* kernel, const char* implementation, const dolp::ThresholdParams& params) const
+		{
+			std::printf("MISMATCH %s %s %s %s, %dx%d, DoLP threshold %d, intensity threshold %d\n",
+				_mono ? "ADIMono8" : "ADIRGB8", kernel, implementation, _mono ? "-" : reductionName(params.reduction),
+				_width, _height, params.dolp, params.intensity);
+		}
+
+		bool _mono;
+		int _width;
+		int _height;
+		std::mt19937 _rng;
+		Image _src;
+		Image _initialState;
+	};
+}
+
+int main()
+{
+	// Not multiples of the vector widths, covering the scalar tails of all implementations
+	const int widths[] = { 1, 2, 3, 5, 7, 9, 15, 17, 31, 33, 63, 65, 643 };
+	const int height = 3;
+
+	int numTests = 0;
+	int mismatches = 0;
+	for (bool mono : { true, false })
+	{
+		for (int width : widths)
+		{
+			KernelTest test(mono, width, height, static_cast<uint32_t>(width));
+
+			for (auto reduction : { dolp::ChannelReduction::Average, dolp::ChannelReduction::Maximum, dolp::ChannelReduction::Luminance })
+			{
+				for (auto& params : thresholdCases(reduction))
+				{
+					mismatches += test.checkThreshold(params);
+					numTests += 1;
+
+					for (auto& filter : filterCases())
+					{
+						for (bool withDst : { true, false })
+						{
+							mismatches += test.checkFilter(params, filter, withDst);
+							numTests += 1;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::printf("Implementations:");
+	for (auto kernels : dolp::supportedKernels())
+		std::printf(" %s", kernels->name);
+	std::printf("\n%d tests, %d mismatches\n", numTests, mismatches);
+
+	return mismatches > 0 ? 1 : 0;
+}
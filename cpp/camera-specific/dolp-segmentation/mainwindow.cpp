@@ -24,36 +24,83 @@
 #include <QMessageBox>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
+#include <QGroupBox>
+#include <QFileDialog>
+#include <QDir>
+#include <QApplication>
+#include <QMouseEvent>
 
-struct BGRa8
-{
-	uint8_t Blue;
-	uint8_t Green;
-	uint8_t Red;
-	uint8_t Alpha;
-};
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
 
-struct PolarizedADIMono8
+namespace
 {
-	uint8_t AoLP;
-	uint8_t DoLP;
-	uint8_t Intensity;
-	uint8_t Reserved;
-};
+	const QEvent::Type REGIONS_DETECTED_EVENT = static_cast<QEvent::Type>(QEvent::User + 1);
 
-struct PolarizedADIRGB8
-{
-	uint8_t AoLP;
-	uint8_t DoLPRed;
-	uint8_t DoLPGreen;
-	uint8_t DoLPBlue;
-	uint8_t IntensityRed;
-	uint8_t IntensityGreen;
-	uint8_t IntensityBlue;
-	uint8_t Reserved;
-};
+	/// <summary>
+	/// Passes the regions found in a frame from the sink callback to the GUI thread
+	/// </summary>
+	class RegionsDetectedEvent : public QEvent
+	{
+	public:
+		explicit RegionsDetectedEvent(dolp::RegionList regions)
+			: QEvent(REGIONS_DETECTED_EVENT)
+			, regions(std::move(regions))
+		{
+		}
+
+		dolp::RegionList regions;
+	};
+
+	const QEvent::Type RAW_FRAME_EVENT = static_cast<QEvent::Type>(QEvent::User + 2);
+
+	/// <summary>
+	/// Passes a copy of an unprocessed frame from the sink callback to the GUI thread
+	/// </summary>
+	class RawFrameEvent : public QEvent
+	{
+	public:
+		RawFrameEvent(QByteArray data, int width, int height, bool mono)
+			: QEvent(RAW_FRAME_EVENT)
+			, data(std::move(data))
+			, width(width)
+			, height(height)
+			, mono(mono)
+		{
+		}
+
+		// Rows without padding
+		QByteArray data;
+		int width;
+		int height;
+		bool mono;
+	};
+
+	// Fraction of the frame interval after which region detection stops, so that the sink callback keeps up with the stream
+	const double RegionTimeBudget = 0.8;
+
+	// Buffers for processed images: one being written, one waiting for the display and one being displayed
+	const int DefaultDisplayBuffers = 3;
+
+	// Frames are displayed if at least this fraction of the monitor's refresh interval passed since the last displayed frame,
+	// so that a camera running at the refresh rate is not throttled by timing jitter
+	const double DisplayIntervalTolerance = 0.9;
 
+	// Smaller rectangles dragged on the display are ignored, they are most likely accidental clicks
+	const int MinRoiSize = 4;
 
+	int64_t alignDown(int64_t value, int64_t increment)
+	{
+		return increment > 1 ? value - value % increment : value;
+	}
+
+	int64_t alignUp(int64_t value, int64_t increment)
+	{
+		return alignDown(value + increment - 1, increment);
+	}
+}
 
 MainWindow::MainWindow(QWidget* parent)
 	: QMainWindow(parent)
@@ -66,7 +113,7 @@ MainWindow::MainWindow(QWidget* parent)
 	_queueSink = ic4::QueueSink::create(*this);
 
 	// Create a buffer pool to allocate visualization buffers from
-	_bufferPool = ic4::BufferPool::create(ic4::BufferPool::CacheConfig{ 2, 0 });
+	_displayBufferPool = std::make_shared<dolp::DisplayBufferPool>(DefaultDisplayBuffers);
 
 	// Create the display for the live video
 	try
@@ -81,6 +128,12 @@ MainWindow::MainWindow(QWidget* parent)
 
 	startstopstream();
 	updateControls();
+
+	// Update the statistics and the monitor's refresh rate once per second
+	_statisticsTimer = new QTimer(this);
+	connect(_statisticsTimer, &QTimer::timeout, this, &MainWindow::updateDisplayStatistics);
+	_statisticsTimer->start(1000);
+	updateDisplayStatistics();
 }
 
 MainWindow::~MainWindow()
@@ -104,33 +157,144 @@ void MainWindow::createUI()
 	_VideoWidget->setMinimumSize(640, 480);
 	mainlayout->addWidget(_VideoWidget);
 
+	// ROIs are drawn with the mouse on the display
+	_rubberBand = new QRubberBand(QRubberBand::Rectangle, _VideoWidget);
+	_VideoWidget->installEventFilter(this);
+
 	auto sideLayout = new QVBoxLayout(this);
 
 	_btnDevice = new QPushButton("Device");
 	_btnProperties = new QPushButton("Properties");
 	_btnLiveVideo = new QPushButton("Start");
+	_btnSaveRawFrame = new QPushButton("Save Frame...");
 	_sldThresholdDoLP = new SliderControl("Threshold DoLP", 30, 0, 255, this);
 	_sldThresholdIntensity = new SliderControl("Threshold Intensity", 10.0, 0.0, 255.0, this);
+	_cboChannelReduction = new QComboBox(this);
+	_cboChannelReduction->addItem("Average", QVariant::fromValue(static_cast<int>(dolp::ChannelReduction::Average)));
+	_cboChannelReduction->addItem("Maximum", QVariant::fromValue(static_cast<int>(dolp::ChannelReduction::Maximum)));
+	_cboChannelReduction->addItem("Luminance", QVariant::fromValue(static_cast<int>(dolp::ChannelReduction::Luminance)));
+
+	_cboVisualizationMode = new QComboBox(this);
+	_cboVisualizationMode->addItem("Threshold", QVariant::fromValue(static_cast<int>(dolp::VisualizationMode::Threshold)));
+	_cboVisualizationMode->addItem("DoLP Heat Map", QVariant::fromValue(static_cast<int>(dolp::VisualizationMode::DoLPHeatMap)));
+	_cboVisualizationMode->addItem("AoLP Hue", QVariant::fromValue(static_cast<int>(dolp::VisualizationMode::AoLPHue)));
+	_cboVisualizationMode->addItem("AoLP Hue, DoLP Brightness", QVariant::fromValue(static_cast<int>(dolp::VisualizationMode::AoLPDoLP)));
+
+	auto grpVisualizationMode = new QGroupBox("Visualization", this);
+	auto grpVisualizationModeLayout = new QVBoxLayout(grpVisualizationMode);
+	grpVisualizationModeLayout->addWidget(_cboVisualizationMode);
+	grpVisualizationMode->setMaximumWidth(250);
+
+	// Only used for color cameras
+	auto grpChannelReduction = new QGroupBox("Color Channels", this);
+	auto grpChannelReductionLayout = new QVBoxLayout(grpChannelReduction);
+	grpChannelReductionLayout->addWidget(_cboChannelReduction);
+	grpChannelReduction->setMaximumWidth(250);
+
+	dolp::TemporalFilterParams default_filter;
+	_cboTemporalFilter = new QComboBox(this);
+	_cboTemporalFilter->addItem("Off", QVariant::fromValue(static_cast<int>(dolp::TemporalFilterMode::Off)));
+	_cboTemporalFilter->addItem("DoLP Average", QVariant::fromValue(static_cast<int>(dolp::TemporalFilterMode::DoLPAverage)));
+	_cboTemporalFilter->addItem("Vote (N of M Frames)", QVariant::fromValue(static_cast<int>(dolp::TemporalFilterMode::Vote)));
+	_sldTemporalAverage = new SliderControl("Average Over 2^n Frames", default_filter.averageShift, 1, 7, this);
+	_sldVoteFrames = new SliderControl("Vote Frames (M)", default_filter.voteFrames, 1, 8, this);
+	_sldVotesRequired = new SliderControl("Votes Required (N)", default_filter.voteRequired, 1, 8, this);
+	_sldTemporalAverage->setEnabled(false);
+	_sldVoteFrames->setEnabled(false);
+	_sldVotesRequired->setEnabled(false);
+
+	// Keeps noise from making the marked pixels flicker
+	auto grpTemporalFilter = new QGroupBox("Temporal Filter", this);
+	auto grpTemporalFilterLayout = new QVBoxLayout(grpTemporalFilter);
+	grpTemporalFilterLayout->addWidget(_cboTemporalFilter);
+	grpTemporalFilterLayout->addWidget(_sldTemporalAverage);
+	grpTemporalFilterLayout->addWidget(_sldVoteFrames);
+	grpTemporalFilterLayout->addWidget(_sldVotesRequired);
+	grpTemporalFilter->setMaximumWidth(250);
+
+	_chkDetectRegions = new QCheckBox("Detect Regions", this);
+	_chkExportRegions = new QCheckBox("Export Regions...", this);
+	_chkExportRegions->setEnabled(false);
+	_lblRegions = new QLabel(this);
+
+	auto grpRegions = new QGroupBox("Regions", this);
+	auto grpRegionsLayout = new QVBoxLayout(grpRegions);
+	grpRegionsLayout->addWidget(_chkDetectRegions);
+	grpRegionsLayout->addWidget(_chkExportRegions);
+	grpRegionsLayout->addWidget(_lblRegions);
+	grpRegions->setMaximumWidth(250);
+
+	_btnClearRois = new QPushButton("Clear ROIs", this);
+	_btnApplyRoiToCamera = new QPushButton("Apply ROI to Camera", this);
+	_btnResetCameraRoi = new QPushButton("Reset Camera ROI", this);
+	auto lblRoiHint = new QLabel("Drag on the video to add a ROI,\nright-click a ROI to remove it.", this);
+
+	auto grpRois = new QGroupBox("Regions of Interest", this);
+	auto grpRoisLayout = new QVBoxLayout(grpRois);
+	grpRoisLayout->addWidget(lblRoiHint);
+	grpRoisLayout->addWidget(_btnClearRois);
+	grpRoisLayout->addWidget(_btnApplyRoiToCamera);
+	grpRoisLayout->addWidget(_btnResetCameraRoi);
+	grpRois->setMaximumWidth(250);
+
+	_sldDisplayBuffers = new SliderControl("Display Buffers", DefaultDisplayBuffers, 1, 8, this);
+	_chkLimitDisplayRate = new QCheckBox("Limit to Monitor Refresh Rate", this);
+	_chkLimitDisplayRate->setChecked(_limitDisplayRate);
+	_lblDisplayStatistics = new QLabel(this);
+
+	auto grpDisplay = new QGroupBox("Display", this);
+	auto grpDisplayLayout = new QVBoxLayout(grpDisplay);
+	grpDisplayLayout->addWidget(_chkLimitDisplayRate);
+	grpDisplayLayout->addWidget(_sldDisplayBuffers);
+	grpDisplayLayout->addWidget(_lblDisplayStatistics);
+	grpDisplay->setMaximumWidth(250);
+
+	_sldNumThreads = new SliderControl("Processing Threads", _bandProcessor.numThreads(), 1, (std::max)(1, static_cast<int>(std::thread::hardware_concurrency())), this);
 
 	_btnDevice->setMaximumWidth(100);
 	_btnProperties->setMaximumWidth(100);
 	_btnLiveVideo->setMaximumWidth(100);
+	_btnSaveRawFrame->setMaximumWidth(100);
 	_sldThresholdDoLP->setMaximumWidth(250);
 	_sldThresholdIntensity->setMaximumWidth(250);
+	_sldNumThreads->setMaximumWidth(250);
 
 	connect(_btnDevice, &QPushButton::pressed, this, &MainWindow::onSelectDevice);
 	connect(_btnProperties, &QPushButton::pressed, this, &MainWindow::onDeviceProperties);
 	connect(_btnLiveVideo, &QPushButton::pressed, this, &MainWindow::startstopstream);
+	connect(_btnSaveRawFrame, &QPushButton::pressed, this, &MainWindow::onSaveRawFrame);
 
 	connect(_sldThresholdDoLP, &SliderControl::sliderValueChanged, this, &MainWindow::onThresholdDoLPChanged);
 	connect(_sldThresholdIntensity, &SliderControl::sliderValueChanged, this, &MainWindow::onThresholdIntensityChanged);
+	connect(_sldNumThreads, &SliderControl::sliderValueChanged, this, &MainWindow::onNumThreadsChanged);
+	connect(_cboChannelReduction, &QComboBox::currentIndexChanged, this, &MainWindow::onChannelReductionChanged);
+	connect(_cboVisualizationMode, &QComboBox::currentIndexChanged, this, &MainWindow::onVisualizationModeChanged);
+	connect(_chkDetectRegions, &QCheckBox::toggled, this, &MainWindow::onDetectRegionsToggled);
+	connect(_chkExportRegions, &QCheckBox::toggled, this, &MainWindow::onExportRegionsToggled);
+	connect(_btnClearRois, &QPushButton::pressed, this, &MainWindow::onClearRois);
+	connect(_btnApplyRoiToCamera, &QPushButton::pressed, this, &MainWindow::onApplyRoiToCamera);
+	connect(_btnResetCameraRoi, &QPushButton::pressed, this, &MainWindow::onResetCameraRoi);
+	connect(_sldDisplayBuffers, &SliderControl::sliderValueChanged, this, &MainWindow::onDisplayBuffersChanged);
+	connect(_chkLimitDisplayRate, &QCheckBox::toggled, this, &MainWindow::onLimitDisplayRateToggled);
+	connect(_cboTemporalFilter, &QComboBox::currentIndexChanged, this, &MainWindow::onTemporalFilterModeChanged);
+	connect(_sldTemporalAverage, &SliderControl::sliderValueChanged, this, &MainWindow::onTemporalAverageChanged);
+	connect(_sldVoteFrames, &SliderControl::sliderValueChanged, this, &MainWindow::onVoteFramesChanged);
+	connect(_sldVotesRequired, &SliderControl::sliderValueChanged, this, &MainWindow::onVotesRequiredChanged);
 
 	sideLayout->setAlignment(Qt::AlignTop);
 	sideLayout->addWidget(_btnDevice);
 	sideLayout->addWidget(_btnProperties);
 	sideLayout->addWidget(_btnLiveVideo);
+	sideLayout->addWidget(_btnSaveRawFrame);
+	sideLayout->addWidget(grpVisualizationMode);
 	sideLayout->addWidget(_sldThresholdDoLP);
 	sideLayout->addWidget(_sldThresholdIntensity);
+	sideLayout->addWidget(grpChannelReduction);
+	sideLayout->addWidget(grpTemporalFilter);
+	sideLayout->addWidget(grpRegions);
+	sideLayout->addWidget(grpRois);
+	sideLayout->addWidget(grpDisplay);
+	sideLayout->addWidget(_sldNumThreads);
 
 	mainlayout->addLayout(sideLayout);
 
@@ -184,21 +348,27 @@ void MainWindow::updateControls()
 	if (_grabber.isStreaming())
 	{
 		_btnLiveVideo->setText("Stop");
+		_btnSaveRawFrame->setEnabled(true);
 	}
 	else
 	{
 		_btnLiveVideo->setText("Start");
+		_btnSaveRawFrame->setEnabled(false);
 	}
 
 	if (_grabber.isDeviceValid())
 	{
 		_btnLiveVideo->setEnabled(true);
 		_btnProperties->setEnabled(true);
+		_btnApplyRoiToCamera->setEnabled(true);
+		_btnResetCameraRoi->setEnabled(true);
 	}
 	else
 	{
 		_btnLiveVideo->setEnabled(false);
 		_btnProperties->setEnabled(false);
+		_btnApplyRoiToCamera->setEnabled(false);
+		_btnResetCameraRoi->setEnabled(false);
 		_btnLiveVideo->setText("Start");
 	}
 }
@@ -323,7 +493,11 @@ void MainWindow::startstopstream()
 /// <param name="value">New threshold value</param>
 void MainWindow::onThresholdDoLPChanged(int value)
 {
-	_ThresholdDoLP = value;
+	auto params = _thresholdParams.load();
+	params.dolp = value;
+	_thresholdParams.store(params);
+
+	updateColorLut();
 }
 
 /// <summary>
@@ -332,7 +506,529 @@ void MainWindow::onThresholdDoLPChanged(int value)
 /// <param name="value">New threshold value</param>
 void MainWindow::onThresholdIntensityChanged(int value)
 {
-	_ThresholdIntensity = value;
+	auto params = _thresholdParams.load();
+	params.intensity = value;
+	_thresholdParams.store(params);
+}
+
+/// <summary>
+/// Event handler for the color channels combo box
+/// </summary>
+/// <param name="index">Index of the selected item</param>
+void MainWindow::onChannelReductionChanged(int index)
+{
+	auto params = _thresholdParams.load();
+	params.reduction = static_cast<dolp::ChannelReduction>(_cboChannelReduction->itemData(index).toInt());
+	_thresholdParams.store(params);
+}
+
+/// <summary>
+/// Event handler for the temporal filter combo box. Only the sliders of the selected filter are enabled.
+/// </summary>
+/// <param name="index">Index of the selected item</param>
+void MainWindow::onTemporalFilterModeChanged(int index)
+{
+	auto filter = _temporalFilter.load();
+	filter.mode = static_cast<dolp::TemporalFilterMode>(_cboTemporalFilter->itemData(index).toInt());
+	_temporalFilter.store(filter);
+
+	_sldTemporalAverage->setEnabled(filter.mode == dolp::TemporalFilterMode::DoLPAverage);
+	_sldVoteFrames->setEnabled(filter.mode == dolp::TemporalFilterMode::Vote);
+	_sldVotesRequired->setEnabled(filter.mode == dolp::TemporalFilterMode::Vote);
+}
+
+/// <summary>
+/// Event handler for the averaging slider
+/// </summary>
+/// <param name="value">Each frame contributes 1 / 2^value to the DoLP average</param>
+void MainWindow::onTemporalAverageChanged(int value)
+{
+	auto filter = _temporalFilter.load();
+	filter.averageShift = value;
+	_temporalFilter.store(filter);
+}
+
+/// <summary>
+/// Event handler for the vote frames slider
+/// </summary>
+/// <param name="value">Number of frames that vote</param>
+void MainWindow::onVoteFramesChanged(int value)
+{
+	auto filter = _temporalFilter.load();
+	filter.voteFrames = value;
+	_temporalFilter.store(filter);
+}
+
+/// <summary>
+/// Event handler for the required votes slider
+/// </summary>
+/// <param name="value">Number of frames a pixel has to be above the thresholds in</param>
+void MainWindow::onVotesRequiredChanged(int value)
+{
+	auto filter = _temporalFilter.load();
+	filter.voteRequired = value;
+	_temporalFilter.store(filter);
+}
+
+/// <summary>
+/// Event handler for the visualization combo box
+/// </summary>
+/// <param name="index">Index of the selected item</param>
+void MainWindow::onVisualizationModeChanged(int index)
+{
+	_VisualizationMode = static_cast<dolp::VisualizationMode>(_cboVisualizationMode->itemData(index).toInt());
+	updateColorLut();
+}
+
+/// <summary>
+/// Rebuilds the lookup table of the visualization mode. Called when the mode or the DoLP threshold changes,
+/// so that the sink callback only has to look up the color of each pixel.
+/// </summary>
+void MainWindow::updateColorLut()
+{
+	auto lut = dolp::buildColorLut(_VisualizationMode, _thresholdParams.load());
+
+	std::lock_guard<std::mutex> lock(_colorLutMutex);
+	_colorLut = std::move(lut);
+}
+
+/// <summary>
+/// Returns the lookup table of the visualization mode, or nullptr in threshold mode
+/// </summary>
+std::shared_ptr<const dolp::ColorLut> MainWindow::currentColorLut()
+{
+	std::lock_guard<std::mutex> lock(_colorLutMutex);
+	return _colorLut;
+}
+
+/// <summary>
+/// Event handler for the region detection check box
+/// </summary>
+/// <param name="checked">Whether regions are detected</param>
+void MainWindow::onDetectRegionsToggled(bool checked)
+{
+	_detectRegions = checked;
+
+	_chkExportRegions->setEnabled(checked);
+	if (!checked)
+	{
+		_chkExportRegions->setChecked(false);
+		_lblRegions->clear();
+	}
+}
+
+/// <summary>
+/// Event handler for the region export check box. Asks for the file the regions are written to.
+/// </summary>
+/// <param name="checked">Whether regions are exported</param>
+void MainWindow::onExportRegionsToggled(bool checked)
+{
+	if (!checked)
+	{
+		_regionExportFile.reset();
+		return;
+	}
+
+	auto fileName = QFileDialog::getSaveFileName(this, "Export Regions", {}, "JSON Lines (*.jsonl)");
+	if (fileName.isEmpty())
+	{
+		QSignalBlocker blocker(_chkExportRegions);
+		_chkExportRegions->setChecked(false);
+		return;
+	}
+
+	auto file = std::make_unique<QFile>(fileName);
+	if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		QMessageBox::warning(this, {}, "Failed to open " + fileName);
+
+		QSignalBlocker blocker(_chkExportRegions);
+		_chkExportRegions->setChecked(false);
+		return;
+	}
+
+	_regionExportFile = std::move(file);
+}
+
+/// <summary>
+/// Receives the regions found by the sink callback. Updates the region count and writes the export file.
+/// </summary>
+void MainWindow::customEvent(QEvent* event)
+{
+	if (event->type() == RAW_FRAME_EVENT)
+	{
+		auto frame = static_cast<RawFrameEvent*>(event);
+
+		QFile file(_rawFrameFileName);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(frame->data) != frame->data.size())
+		{
+			QMessageBox::warning(this, {}, "Failed to write " + _rawFrameFileName);
+			return;
+		}
+
+		QMessageBox::information(this, {},
+			QString("Saved %1x%2 %3 frame.\nBenchmark it with:\n\ndolpbenchmark --input \"%4\" --format %5 --width %1 --height %2")
+			.arg(frame->width)
+			.arg(frame->height)
+			.arg(frame->mono ? "PolarizedADIMono8" : "PolarizedADIRGB8")
+			.arg(QDir::toNativeSeparators(_rawFrameFileName))
+			.arg(frame->mono ? "mono" : "rgb")
+		);
+		return;
+	}
+
+	if (event->type() != REGIONS_DETECTED_EVENT)
+		return;
+
+	const auto& list = static_cast<RegionsDetectedEvent*>(event)->regions;
+
+	// Events that were queued before detection was switched off are ignored
+	if (!_chkDetectRegions->isChecked())
+		return;
+
+	auto text = QString("%1 regions, %2 ms").arg(list.regions.size()).arg(list.processing_time_ms, 0, 'f', 1);
+	if (!list.complete)
+		text += QString(" (stopped at row %1)").arg(list.rows_processed);
+	_lblRegions->setText(text);
+
+	if (_regionExportFile)
+	{
+		auto line = dolp::toJsonLine(list);
+		line += '\n';
+		_regionExportFile->write(line.data(), static_cast<qint64>(line.size()));
+	}
+}
+
+/// <summary>
+/// Returns the current ROIs, an empty list if the whole image is processed
+/// </summary>
+std::shared_ptr<const std::vector<dolp::Roi>> MainWindow::currentRois()
+{
+	std::lock_guard<std::mutex> lock(_roiMutex);
+	return _rois;
+}
+
+/// <summary>
+/// Replaces the ROIs. The sink callback picks them up with the next frame.
+/// </summary>
+void MainWindow::setRois(std::vector<dolp::Roi> rois)
+{
+	auto list = std::make_shared<const std::vector<dolp::Roi>>(std::move(rois));
+
+	std::lock_guard<std::mutex> lock(_roiMutex);
+	_rois = std::move(list);
+}
+
+/// <summary>
+/// Maps a position on the display widget to image coordinates.
+/// The display stretches the image to the widget while keeping its aspect ratio (DisplayRenderPosition::StretchCenter).
+/// </summary>
+/// <returns>false if no image size is known yet</returns>
+bool MainWindow::widgetToImage(const QPoint& pos, QPointF& imagePos) const
+{
+	int image_width = _imageWidth;
+	int image_height = _imageHeight;
+	if (image_width <= 0 || image_height <= 0 || _VideoWidget->width() <= 0 || _VideoWidget->height() <= 0)
+		return false;
+
+	double scale = (std::min)(static_cast<double>(_VideoWidget->width()) / image_width, static_cast<double>(_VideoWidget->height()) / image_height);
+	double offset_x = (_VideoWidget->width() - image_width * scale) / 2;
+	double offset_y = (_VideoWidget->height() - image_height * scale) / 2;
+
+	imagePos = QPointF((pos.x() - offset_x) / scale, (pos.y() - offset_y) / scale);
+	return true;
+}
+
+/// <summary>
+/// Draws new ROIs with the left mouse button and removes ROIs with the right mouse button
+/// </summary>
+bool MainWindow::eventFilter(QObject* obj, QEvent* event)
+{
+	if (obj != _VideoWidget)
+		return false;
+
+	switch (event->type())
+	{
+	case QEvent::MouseButtonPress:
+	{
+		auto mouseEvent = static_cast<QMouseEvent*>(event);
+		auto pos = mouseEvent->position().toPoint();
+
+		if (mouseEvent->button() == Qt::LeftButton)
+		{
+			_dragStart = pos;
+			_rubberBand->setGeometry(QRect(pos, QSize()));
+			_rubberBand->show();
+			return true;
+		}
+		if (mouseEvent->button() == Qt::RightButton)
+		{
+			QPointF image_pos;
+			if (!widgetToImage(pos, image_pos))
+				return true;
+
+			// Remove the most recently added ROI under the cursor
+			auto rois = *currentRois();
+			for (auto it = rois.rbegin(); it != rois.rend(); ++it)
+			{
+				if (QRectF(it->x, it->y, it->width, it->height).contains(image_pos))
+				{
+					rois.erase(std::next(it).base());
+					setRois(std::move(rois));
+					break;
+				}
+			}
+			return true;
+		}
+		break;
+	}
+	case QEvent::MouseMove:
+		if (_rubberBand->isVisible())
+		{
+			auto pos = static_cast<QMouseEvent*>(event)->position().toPoint();
+			_rubberBand->setGeometry(QRect(_dragStart, pos).normalized());
+			return true;
+		}
+		break;
+	case QEvent::MouseButtonRelease:
+		if (_rubberBand->isVisible() && static_cast<QMouseEvent*>(event)->button() == Qt::LeftButton)
+		{
+			_rubberBand->hide();
+
+			QPointF p0, p1;
+			auto pos = static_cast<QMouseEvent*>(event)->position().toPoint();
+			if (!widgetToImage(_dragStart, p0) || !widgetToImage(pos, p1))
+				return true;
+
+			int x0 = static_cast<int>(std::floor((std::min)(p0.x(), p1.x())));
+			int y0 = static_cast<int>(std::floor((std::min)(p0.y(), p1.y())));
+			int x1 = static_cast<int>(std::ceil((std::max)(p0.x(), p1.x())));
+			int y1 = static_cast<int>(std::ceil((std::max)(p0.y(), p1.y())));
+
+			dolp::Roi roi = { x0, y0, x1 - x0, y1 - y0 };
+			if (dolp::clipRoi(roi, _imageWidth, _imageHeight) && roi.width >= MinRoiSize && roi.height >= MinRoiSize)
+			{
+				auto rois = *currentRois();
+				rois.push_back(roi);
+				setRois(std::move(rois));
+			}
+			return true;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Removes all ROIs, so that the whole image is processed again
+/// </summary>
+void MainWindow::onClearRois()
+{
+	setRois({});
+}
+
+/// <summary>
+/// Sets the camera's image size and offset to the bounding box of all ROIs, so that only the ROIs are transferred.
+/// </summary>
+void MainWindow::onApplyRoiToCamera()
+{
+	auto rois = currentRois();
+	if (rois->empty())
+	{
+		QMessageBox::information(this, {}, "Drag on the video to define a ROI first.");
+		return;
+	}
+
+	int left = rois->front().x;
+	int top = rois->front().y;
+	int right = rois->front().x + rois->front().width;
+	int bottom = rois->front().y + rois->front().height;
+	for (const auto& roi : *rois)
+	{
+		left = (std::min)(left, roi.x);
+		top = (std::min)(top, roi.y);
+		right = (std::max)(right, roi.x + roi.width);
+		bottom = (std::max)(bottom, roi.y + roi.height);
+	}
+
+	changeCameraRoi(
+		[=](ic4::PropertyMap& map)
+		{
+			// The ROI is relative to the currently transferred image
+			int64_t sensor_x = map[ic4::PropId::OffsetX].getValue() + left;
+			int64_t sensor_y = map[ic4::PropId::OffsetY].getValue() + top;
+
+			map.setValue(ic4::PropId::OffsetAutoCenter, "Off", ic4::Error::Ignore());
+
+			// Reset the offsets first, so that the size is not limited by the current offsets
+			map.setValue(ic4::PropId::OffsetX, 0);
+			map.setValue(ic4::PropId::OffsetY, 0);
+
+			auto setAxis = [&](ic4::PropIdInteger sizeId, ic4::PropIdInteger offsetId, int64_t start, int64_t end)
+			{
+				auto size = map[sizeId];
+				auto offset = map[offsetId];
+
+				// Round the offset down and the size up, so that the whole ROI is transferred
+				int64_t aligned_start = alignDown(start, offset.increment());
+				int64_t new_size = std::clamp(alignUp(end - aligned_start, size.increment()), size.minimum(), size.maximum());
+				map.setValue(sizeId, new_size);
+
+				// The offset's maximum depends on the new size
+				map.setValue(offsetId, std::clamp(aligned_start, offset.minimum(), offset.maximum()));
+			};
+			setAxis(ic4::PropId::Width, ic4::PropId::OffsetX, sensor_x, sensor_x + (right - left));
+			setAxis(ic4::PropId::Height, ic4::PropId::OffsetY, sensor_y, sensor_y + (bottom - top));
+		}
+	);
+}
+
+/// <summary>
+/// Sets the camera back to the full sensor size
+/// </summary>
+void MainWindow::onResetCameraRoi()
+{
+	changeCameraRoi(
+		[](ic4::PropertyMap& map)
+		{
+			map.setValue(ic4::PropId::OffsetX, 0);
+			map.setValue(ic4::PropId::OffsetY, 0);
+			map.setValue(ic4::PropId::Width, map[ic4::PropId::Width].maximum());
+			map.setValue(ic4::PropId::Height, map[ic4::PropId::Height].maximum());
+		}
+	);
+}
+
+/// <summary>
+/// Changes the camera's image size and offset. The image size can not be changed while streaming,
+/// so a running stream is stopped and restarted. The ROIs are removed, because they refer to the old image.
+/// </summary>
+void MainWindow::changeCameraRoi(const std::function<void(ic4::PropertyMap&)>& change)
+{
+	if (!_grabber.isDeviceValid())
+		return;
+
+	bool was_streaming = _grabber.isStreaming();
+	try
+	{
+		if (was_streaming)
+		{
+			_grabber.streamStop();
+		}
+
+		auto map = _grabber.devicePropertyMap();
+		change(map);
+	}
+	catch (const ic4::IC4Exception& ex)
+	{
+		QMessageBox::warning(this, {}, ex.what());
+	}
+
+	setRois({});
+
+	if (was_streaming)
+	{
+		startstopstream();
+	}
+	updateControls();
+}
+
+/// <summary>
+/// Event handler for the display buffers slider. The pool is replaced, buffers of the old pool are freed
+/// after the display released them.
+/// </summary>
+/// <param name="value">New number of buffers</param>
+void MainWindow::onDisplayBuffersChanged(int value)
+{
+	auto pool = std::make_shared<dolp::DisplayBufferPool>(value);
+
+	std::lock_guard<std::mutex> lock(_displayBufferPoolMutex);
+	_displayBufferPool = std::move(pool);
+}
+
+/// <summary>
+/// Returns the pool the processed images are allocated from
+/// </summary>
+std::shared_ptr<dolp::DisplayBufferPool> MainWindow::currentDisplayBufferPool()
+{
+	std::lock_guard<std::mutex> lock(_displayBufferPoolMutex);
+	return _displayBufferPool;
+}
+
+/// <summary>
+/// Event handler for the display rate check box
+/// </summary>
+/// <param name="checked">Whether the display is limited to the monitor's refresh rate</param>
+void MainWindow::onLimitDisplayRateToggled(bool checked)
+{
+	_limitDisplayRate = checked;
+}
+
+/// <summary>
+/// Shows the processed and displayed frame rates and the buffer pool statistics.
+/// Also picks up the refresh rate of the monitor, which changes when the window is moved to another screen.
+/// </summary>
+void MainWindow::updateDisplayStatistics()
+{
+	auto screen = _VideoWidget->screen();
+	double refresh_rate = screen ? screen->refreshRate() : 0.0;
+	_displayIntervalMs = refresh_rate > 0 ? 1000.0 / refresh_rate : 0.0;
+
+	auto now = std::chrono::steady_clock::now();
+	uint64_t processed = _framesProcessed;
+	uint64_t displayed = _framesDisplayed;
+
+	if (_lastStatisticsTime != std::chrono::steady_clock::time_point{})
+	{
+		double seconds = std::chrono::duration<double>(now - _lastStatisticsTime).count();
+		auto stats = currentDisplayBufferPool()->statistics();
+
+		_lblDisplayStatistics->setText(
+			QString("Processed: %1 fps\nDisplayed: %2 fps (%3 Hz)\nBuffers reused: %4, allocated: %5")
+			.arg((processed - _lastFramesProcessed) / seconds, 0, 'f', 1)
+			.arg((displayed - _lastFramesDisplayed) / seconds, 0, 'f', 1)
+			.arg(refresh_rate, 0, 'f', 0)
+			.arg(stats.hits)
+			.arg(stats.misses)
+		);
+	}
+
+	_lastStatisticsTime = now;
+	_lastFramesProcessed = processed;
+	_lastFramesDisplayed = displayed;
+}
+
+/// <summary>
+/// Saves the next unprocessed frame as raw file, which can be loaded by the dolpbenchmark program
+/// </summary>
+void MainWindow::onSaveRawFrame()
+{
+	auto fileName = QFileDialog::getSaveFileName(this, "Save Frame", {}, "Raw Frames (*.raw)");
+	if (fileName.isEmpty())
+		return;
+
+	_rawFrameFileName = fileName;
+	_saveRawFrame = true;
+}
+
+/// <summary>
+/// Event handler for the processing threads slider
+/// </summary>
+/// <param name="value">New number of threads</param>
+void MainWindow::onNumThreadsChanged(int value)
+{
+	_bandProcessor.setNumThreads(value);
+}
+
+/// <summary>
+/// Use one thread per core, up to 8 threads. Beyond that, the processing is usually limited by the memory bandwidth.
+/// </summary>
+int MainWindow::defaultNumThreads()
+{
+	return std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, 8);
 }
 
 /// <summary>
@@ -347,6 +1043,17 @@ bool MainWindow::sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& image
 	// Allocate more buffers than suggested, because we temporarily take some buffers
 	// out of circulation when saving an image or video files.
 	sink.allocAndQueueBuffers(min_buffers_required + 2);
+
+	// A new stream starts, its frame interval is measured again
+	_lastFrameTime = {};
+	_frameIntervalMs = 0;
+	_lastDisplayTime = {};
+
+	// The temporal filter starts over, the previous stream's frames may show something else
+	_filterState.clear();
+
+	_imageWidth = imageType.width();
+	_imageHeight = imageType.height();
 	return true;
 };
 
@@ -359,100 +1066,271 @@ void MainWindow::framesQueued(ic4::QueueSink& sink)
 	// Get current buffer
 	auto buffer = sink.popOutputBuffer();
 
-	// Create destination buffer for transformation
-	auto dest_buffer = _bufferPool->getBuffer(buffer->imageType().with_pixel_format(ic4::PixelFormat::BGRa8));
+	if (_saveRawFrame.exchange(false))
+	{
+		int width = buffer->imageType().width();
+		int height = buffer->imageType().height();
+		bool mono = buffer->imageType().pixel_format() == ic4::PixelFormat::PolarizedADIMono8;
+		auto row_bytes = static_cast<qsizetype>(width) * (mono ? 4 : 8);
+
+		QByteArray data(row_bytes * height, Qt::Uninitialized);
+		for (int y = 0; y < height; ++y)
+		{
+			std::memcpy(data.data() + y * row_bytes, static_cast<const uint8_t*>(buffer->ptr()) + y * buffer->pitch(), row_bytes);
+		}
+		QApplication::postEvent(this, new RawFrameEvent(std::move(data), width, height, mono));
+	}
 
-	// Depending on the source buffer type, call the correct visualization function
-	if (buffer->imageType().pixel_format() == ic4::PixelFormat::PolarizedADIMono8)
+	// Track the frame interval, which limits the time available for region detection
+	auto frame_start = std::chrono::steady_clock::now();
+	if (_lastFrameTime != std::chrono::steady_clock::time_point{})
 	{
-		ThresholdPolarizedADIMono8(*buffer, *dest_buffer);
+		double interval_ms = std::chrono::duration<double, std::milli>(frame_start - _lastFrameTime).count();
+		_frameIntervalMs = _frameIntervalMs > 0 ? 0.9 * _frameIntervalMs + 0.1 * interval_ms : interval_ms;
 	}
-	else
+	_lastFrameTime = frame_start;
+
+	// Take a consistent snapshot of the parameters, which can be changed by the GUI thread at any time
+	auto params = _thresholdParams.load();
+	auto filter = _temporalFilter.load();
+	auto lut = currentColorLut();
+	auto rois = currentRois();
+	const auto& layout = roiLayout(rois, buffer->imageType().width(), buffer->imageType().height());
+
+	// The sliders are independent, more required votes than voting frames would never mark a pixel
+	filter.voteRequired = (std::min)(filter.voteRequired, filter.voteFrames);
+	auto filter_state = temporalFilterState(filter, buffer->imageType().width(), buffer->imageType().height());
+
+	_framesProcessed.fetch_add(1, std::memory_order_relaxed);
+
+	// Frames that can not be shown by the monitor anyway are not converted
+	std::shared_ptr<ic4::ImageBuffer> dest_buffer;
+	if (isDisplayDue(frame_start))
+	{
+		// Create destination buffer for transformation
+		dest_buffer = currentDisplayBufferPool()->getBuffer(buffer->imageType().with_pixel_format(ic4::PixelFormat::BGRa8));
+	}
+
+	// The temporal filter has to see every frame, so its state is also updated if the frame is not displayed
+	if (dest_buffer || filter_state)
+	{
+		// Depending on the source buffer type, call the correct visualization function
+		if (buffer->imageType().pixel_format() == ic4::PixelFormat::PolarizedADIMono8)
+		{
+			ThresholdPolarizedADIMono8(*buffer, dest_buffer.get(), params, filter, filter_state, lut.get(), layout);
+		}
+		else
+		{
+			ThresholdPolarizedADIRGB8(*buffer, dest_buffer.get(), params, filter, filter_state, lut.get(), layout);
+		}
+	}
+
+	// Regions are detected in every frame, also if it is not displayed
+	if (_detectRegions)
 	{
-		ThresholdPolarizedADIRGB8(*buffer, *dest_buffer);
+		detectRegions(*buffer, dest_buffer.get(), params, filter, filter_state, layout, frame_start);
 	}
 
-	// Manually display buffer
-	_display->displayBuffer(dest_buffer);
+	if (dest_buffer)
+	{
+		dolp::drawRois(static_cast<uint8_t*>(dest_buffer->ptr()), dest_buffer->pitch(), buffer->imageType().width(), buffer->imageType().height(), *rois);
+
+		// Manually display buffer
+		_display->displayBuffer(dest_buffer);
+
+		_lastDisplayTime = frame_start;
+		_framesDisplayed.fetch_add(1, std::memory_order_relaxed);
+	}
 }
 
 /// <summary>
-/// Copy pixels from source to destination and mark all pixels with polarized light in red.
+/// Checks whether enough time passed since the last displayed frame for the monitor to show a new frame
 /// </summary>
-/// <param name="src">Polarized mono8 image buffer</param>
-/// <param name="dest">RGB32 (BGRa) output image buffer</param>
-void MainWindow::ThresholdPolarizedADIMono8(const ic4::ImageBuffer& src, ic4::ImageBuffer& dest)
+/// <param name="frameStart">Time the sink callback started processing the frame</param>
+/// <returns>true if the frame should be displayed</returns>
+bool MainWindow::isDisplayDue(std::chrono::steady_clock::time_point frameStart)
 {
-	auto width = src.imageType().width();
-	auto height = src.imageType().height();
+	double interval_ms = _displayIntervalMs;
+	if (!_limitDisplayRate || interval_ms <= 0 || _lastDisplayTime == std::chrono::steady_clock::time_point{})
+		return true;
 
-	auto src_ptr = static_cast<const uint8_t*>(src.ptr());
-	auto src_pitch = src.pitch();
-	auto dst_ptr = static_cast<uint8_t*>(dest.ptr());
-	auto dst_pitch = dest.pitch();
+	double elapsed_ms = std::chrono::duration<double, std::milli>(frameStart - _lastDisplayTime).count();
+	return elapsed_ms >= interval_ms * DisplayIntervalTolerance;
+}
 
-	for (int y = 0; y < height; y++)
+/// <summary>
+/// Returns the temporal filter state for the current frame, or nullptr if the filter is off.
+/// The state is cleared when the filter mode or the image size changes, so that the filter starts over.
+/// Changing the parameters of a mode keeps the state, averages and vote histories remain valid.
+/// </summary>
+uint8_t* MainWindow::temporalFilterState(const dolp::TemporalFilterParams& filter, int width, int height)
+{
+	if (filter.mode == dolp::TemporalFilterMode::Off)
 	{
-		auto pSrcLine = reinterpret_cast<const PolarizedADIMono8*>(src_ptr + y * src_pitch);
-		auto pDestLine = reinterpret_cast<BGRa8*>(dst_ptr + y * dst_pitch);
+		_filterStateMode = filter.mode;
+		return nullptr;
+	}
 
-		for (int x = 0; x < width; x++)
-		{
-			if (pSrcLine[x].DoLP > _ThresholdDoLP && pSrcLine[x].Intensity > _ThresholdIntensity)
-			{
-				pDestLine[x].Blue = 0x00;
-				pDestLine[x].Green = 0x00;
-				pDestLine[x].Red = 0xFF;
-				pDestLine[x].Alpha = 0xFF;
-			}
-			else
-			{
-				pDestLine[x].Blue = pSrcLine[x].Intensity;
-				pDestLine[x].Green = pSrcLine[x].Intensity;
-				pDestLine[x].Red = pSrcLine[x].Intensity;
-				pDestLine[x].Alpha = 0xFF;
-			}
-		}
+	auto size = static_cast<size_t>(width) * height;
+	if (filter.mode != _filterStateMode || width != _filterStateWidth || height != _filterStateHeight || _filterState.size() != size)
+	{
+		_filterState.assign(size, 0);
+		_filterStateMode = filter.mode;
+		_filterStateWidth = width;
+		_filterStateHeight = height;
+	}
+	return _filterState.data();
+}
+
+/// <summary>
+/// Returns the layout of the ROIs for the current image. The layout is only rebuilt when the ROIs or the image size changed.
+/// </summary>
+const dolp::RoiLayout& MainWindow::roiLayout(const std::shared_ptr<const std::vector<dolp::Roi>>& rois, int width, int height)
+{
+	if (rois != _roiLayoutSource || width != _roiLayout.width() || height != _roiLayout.height())
+	{
+		_roiLayout = dolp::RoiLayout(*rois, width, height);
+		_roiLayoutSource = rois;
 	}
+	return _roiLayout;
 }
+
 /// <summary>
-/// Copy pixels from source to destination and mark all pixels with polarized light in red.
+/// Finds the connected areas of polarized pixels, draws them into the output image and sends them to the GUI thread.
+/// Labeling stops when the frame's time budget is used up.
 /// </summary>
-/// <param name="src">Polarized BGR8 image buffer</param>
-/// <param name="dest">RGB32 (BGRa) output image buffer</param>
-void MainWindow::ThresholdPolarizedADIRGB8(const ic4::ImageBuffer& src, ic4::ImageBuffer& dest)
+/// <param name="src">Polarized image buffer</param>
+/// <param name="dest">RGB32 (BGRa) output image buffer, or nullptr if the frame is not displayed</param>
+/// <param name="params">Thresholds of the current frame</param>
+/// <param name="filter">Temporal filter of the current frame</param>
+/// <param name="filterState">Filter state, already updated with the current frame, or nullptr if the filter is off</param>
+/// <param name="layout">Regions of interest, pixels outside are not labeled</param>
+/// <param name="frameStart">Time the sink callback started processing the frame</param>
+void MainWindow::detectRegions(const ic4::ImageBuffer& src, ic4::ImageBuffer* dest, dolp::ThresholdParams params, dolp::TemporalFilterParams filter, const uint8_t* filterState, const dolp::RoiLayout& layout, std::chrono::steady_clock::time_point frameStart)
 {
+	// Until the frame interval is known, assume 30 frames per second
+	double interval_ms = _frameIntervalMs > 0 ? _frameIntervalMs : 33.0;
+	auto budget = std::chrono::duration<double, std::milli>(interval_ms * RegionTimeBudget);
+	auto deadline = frameStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+
+	dolp::RegionList regions;
+	regions.frame_number = src.metaData().device_frame_number;
+	regions.timestamp_ns = src.metaData().device_timestamp_ns;
+
+	auto src_ptr = static_cast<const uint8_t*>(src.ptr());
 	auto width = src.imageType().width();
 	auto height = src.imageType().height();
 
-	auto src_ptr = static_cast<const uint8_t*>(src.ptr());
-	auto src_pitch = src.pitch();
-	auto dst_ptr = static_cast<uint8_t*>(dest.ptr());
-	auto dst_pitch = dest.pitch();
+	// Labels the same pixels as marked on the display. Without filter state, the filter is off and the thresholds are used directly.
+	if (src.imageType().pixel_format() == ic4::PixelFormat::PolarizedADIMono8)
+		_regionLabeler.labelFilteredADIMono8(src_ptr, src.pitch(), filterState, width, layout, params, filter, deadline, regions);
+	else
+		_regionLabeler.labelFilteredADIRGB8(src_ptr, src.pitch(), filterState, width, layout, params, filter, deadline, regions);
 
-	for (int y = 0; y < height; y++)
+	if (dest)
 	{
-		auto pSrcLine = reinterpret_cast<const PolarizedADIRGB8*>(src_ptr + y * src_pitch);
-		auto pDestLine = reinterpret_cast<BGRa8*>(dst_ptr + y * dst_pitch);
+		dolp::drawRegions(static_cast<uint8_t*>(dest->ptr()), dest->pitch(), width, height, regions);
+	}
+
+	QApplication::postEvent(this, new RegionsDetectedEvent(std::move(regions)));
+}
 
-		for (int x = 0; x < width; x++)
+/// <summary>
+/// Copy pixels from source to destination and mark all pixels with polarized light in red,
+/// or color them by the lookup table of the selected visualization mode.
+/// With the temporal filter on, the pixels selected by the filter are marked, and the filter state is updated in the same pass.
+/// </summary>
+/// <param name="src">Polarized mono8 image buffer</param>
+/// <param name="dest">RGB32 (BGRa) output image buffer, or nullptr to only update the filter state</param>
+/// <param name="params">Thresholds of the current frame</param>
+/// <param name="filter">Temporal filter of the current frame</param>
+/// <param name="filterState">Filter state with the image width as pitch, or nullptr if the filter is off</param>
+/// <param name="lut">Lookup table of the visualization mode, or nullptr to mark polarized pixels in red</param>
+/// <param name="layout">Regions of interest, pixels outside only show the intensity</param>
+void MainWindow::ThresholdPolarizedADIMono8(const ic4::ImageBuffer& src, ic4::ImageBuffer* dest, dolp::ThresholdParams params, dolp::TemporalFilterParams filter, uint8_t* filterState, const dolp::ColorLut* lut, const dolp::RoiLayout& layout)
+{
+	auto src_ptr = static_cast<const uint8_t*>(src.ptr());
+	auto dst_ptr = dest ? static_cast<uint8_t*>(dest->ptr()) : nullptr;
+	auto dst_pitch = dest ? dest->pitch() : 0;
+	auto state_pitch = static_cast<ptrdiff_t>(src.imageType().width());
+	auto outside_params = dolp::intensityOnlyParams(params);
+
+	_bandProcessor.run(src.imageType().height(),
+		[&](int firstRow, int endRow)
 		{
-			int avgDoLP = (pSrcLine[x].DoLPRed + pSrcLine[x].DoLPGreen + pSrcLine[x].DoLPBlue) / 3;
-			int avgIntensity = (pSrcLine[x].IntensityRed + pSrcLine[x].IntensityGreen + pSrcLine[x].IntensityBlue) / 3;
-			if (avgDoLP > _ThresholdDoLP && avgIntensity > _ThresholdIntensity)
-			{
-				pDestLine[x].Blue = 0x00;
-				pDestLine[x].Green = 0x00;
-				pDestLine[x].Red = 0xFF;
-				pDestLine[x].Alpha = 0xFF;
-			}
-			else
-			{
-				pDestLine[x].Blue = pSrcLine[x].IntensityBlue;
-				pDestLine[x].Green = pSrcLine[x].IntensityGreen;
-				pDestLine[x].Red = pSrcLine[x].IntensityRed;
-				pDestLine[x].Alpha = 0xFF;
-			}
+			layout.forEachRect(firstRow, endRow,
+				[&](int x, int y, int width, int height, bool inside)
+				{
+					auto rect_src = src_ptr + y * src.pitch() + x * 4;
+					auto rect_dst = dst_ptr ? dst_ptr + y * dst_pitch + x * 4 : nullptr;
+
+					if (!inside)
+					{
+						if (rect_dst)
+							_kernels->adiMono8(rect_src, src.pitch(), rect_dst, dst_pitch, width, height, outside_params);
+						return;
+					}
+
+					// In the lookup table modes, the filter state is only used for region detection
+					if (filterState)
+						_kernels->filteredADIMono8(rect_src, src.pitch(), filterState + y * state_pitch + x, state_pitch, lut ? nullptr : rect_dst, dst_pitch, width, height, params, filter);
+
+					if (rect_dst && lut)
+						dolp::applyColorLutADIMono8(rect_src, src.pitch(), rect_dst, dst_pitch, width, height, *lut, params);
+					else if (rect_dst && !filterState)
+						_kernels->adiMono8(rect_src, src.pitch(), rect_dst, dst_pitch, width, height, params);
+				}
+			);
 		}
-	}
+	);
+}
+
+/// <summary>
+/// Copy pixels from source to destination and mark all pixels with polarized light in red,
+/// or color them by the lookup table of the selected visualization mode.
+/// With the temporal filter on, the pixels selected by the filter are marked, and the filter state is updated in the same pass.
+/// </summary>
+/// <param name="src">Polarized BGR8 image buffer</param>
+/// <param name="dest">RGB32 (BGRa) output image buffer, or nullptr to only update the filter state</param>
+/// <param name="params">Thresholds of the current frame</param>
+/// <param name="filter">Temporal filter of the current frame</param>
+/// <param name="filterState">Filter state with the image width as pitch, or nullptr if the filter is off</param>
+/// <param name="lut">Lookup table of the visualization mode, or nullptr to mark polarized pixels in red</param>
+/// <param name="layout">Regions of interest, pixels outside only show the intensity</param>
+void MainWindow::ThresholdPolarizedADIRGB8(const ic4::ImageBuffer& src, ic4::ImageBuffer* dest, dolp::ThresholdParams params, dolp::TemporalFilterParams filter, uint8_t* filterState, const dolp::ColorLut* lut, const dolp::RoiLayout& layout)
+{
+	auto src_ptr = static_cast<const uint8_t*>(src.ptr());
+	auto dst_ptr = dest ? static_cast<uint8_t*>(dest->ptr()) : nullptr;
+	auto dst_pitch = dest ? dest->pitch() : 0;
+	auto state_pitch = static_cast<ptrdiff_t>(src.imageType().width());
+	auto outside_params = dolp::intensityOnlyParams(params);
+
+	_bandProcessor.run(src.imageType().height(),
+		[&](int firstRow, int endRow)
+		{
+			layout.forEachRect(firstRow, endRow,
+				[&](int x, int y, int width, int height, bool inside)
+				{
+					auto rect_src = src_ptr + y * src.pitch() + x * 8;
+					auto rect_dst = dst_ptr ? dst_ptr + y * dst_pitch + x * 4 : nullptr;
+
+					if (!inside)
+					{
+						if (rect_dst)
+							_kernels->adiRGB8(rect_src, src.pitch(), rect_dst, dst_pitch, width, height, outside_params);
+						return;
+					}
+
+					// In the lookup table modes, the filter state is only used for region detection
+					if (filterState)
+						_kernels->filteredADIRGB8(rect_src, src.pitch(), filterState + y * state_pitch + x, state_pitch, lut ? nullptr : rect_dst, dst_pitch, width, height, params, filter);
+
+					if (rect_dst && lut)
+						dolp::applyColorLutADIRGB8(rect_src, src.pitch(), rect_dst, dst_pitch, width, height, *lut, params);
+					else if (rect_dst && !filterState)
+						_kernels->adiRGB8(rect_src, src.pitch(), rect_dst, dst_pitch, width, height, params);
+				}
+			);
+		}
+	);
 }
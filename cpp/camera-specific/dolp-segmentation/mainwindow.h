@@ -2,14 +2,34 @@
 #define MAINWINDOW_H
 
 #include "sliderctrl.h"
+#include "polarizationkernels.h"
+#include "bandprocessor.h"
+#include "visualization.h"
+#include "seqlock.h"
+#include "regions.h"
+#include "roi.h"
+#include "displaybufferpool.h"
 
 #include <ic4/ic4.h> 
 #include <ic4-interop/interop-Qt.h>
 
 #include <QMainWindow>
 #include <QPushButton>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QLabel>
+#include <QFile>
+#include <QRubberBand>
+#include <QTimer>
 #include <QtGui>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 class MainWindow : public QMainWindow, ic4::QueueSinkListener
 {
 	Q_OBJECT
@@ -21,6 +41,22 @@ public:
 private slots:
 	void onThresholdDoLPChanged(int value);
 	void onThresholdIntensityChanged(int value);
+	void onNumThreadsChanged(int value);
+	void onChannelReductionChanged(int index);
+	void onVisualizationModeChanged(int index);
+	void onDetectRegionsToggled(bool checked);
+	void onExportRegionsToggled(bool checked);
+	void onClearRois();
+	void onApplyRoiToCamera();
+	void onResetCameraRoi();
+	void onDisplayBuffersChanged(int value);
+	void onLimitDisplayRateToggled(bool checked);
+	void updateDisplayStatistics();
+	void onSaveRawFrame();
+	void onTemporalFilterModeChanged(int index);
+	void onTemporalAverageChanged(int value);
+	void onVoteFramesChanged(int value);
+	void onVotesRequiredChanged(int value);
 
 private:
 	bool checkForGenTLProducers();
@@ -28,28 +64,127 @@ private:
 	void onDeviceProperties();
 	void startstopstream();
 	void closeEvent(QCloseEvent* event);
+	void customEvent(QEvent* event) override;
+	bool eventFilter(QObject* obj, QEvent* event) override;
 	void updateControls();
 	void createUI();
 	bool isPolarizationCamera();
 	bool setPolarizationFormat();
-	void ThresholdPolarizedADIMono8(const ic4::ImageBuffer& src, ic4::ImageBuffer& dest);
-	void ThresholdPolarizedADIRGB8(const ic4::ImageBuffer& src, ic4::ImageBuffer& dest);
+	void updateColorLut();
+	std::shared_ptr<const dolp::ColorLut> currentColorLut();
+	std::shared_ptr<const std::vector<dolp::Roi>> currentRois();
+	void setRois(std::vector<dolp::Roi> rois);
+	bool widgetToImage(const QPoint& pos, QPointF& imagePos) const;
+	void changeCameraRoi(const std::function<void(ic4::PropertyMap&)>& change);
+	const dolp::RoiLayout& roiLayout(const std::shared_ptr<const std::vector<dolp::Roi>>& rois, int width, int height);
+	std::shared_ptr<dolp::DisplayBufferPool> currentDisplayBufferPool();
+	bool isDisplayDue(std::chrono::steady_clock::time_point frameStart);
+	uint8_t* temporalFilterState(const dolp::TemporalFilterParams& filter, int width, int height);
+	void detectRegions(const ic4::ImageBuffer& src, ic4::ImageBuffer* dest, dolp::ThresholdParams params, dolp::TemporalFilterParams filter, const uint8_t* filterState, const dolp::RoiLayout& layout, std::chrono::steady_clock::time_point frameStart);
+	void ThresholdPolarizedADIMono8(const ic4::ImageBuffer& src, ic4::ImageBuffer* dest, dolp::ThresholdParams params, dolp::TemporalFilterParams filter, uint8_t* filterState, const dolp::ColorLut* lut, const dolp::RoiLayout& layout);
+	void ThresholdPolarizedADIRGB8(const ic4::ImageBuffer& src, ic4::ImageBuffer* dest, dolp::ThresholdParams params, dolp::TemporalFilterParams filter, uint8_t* filterState, const dolp::ColorLut* lut, const dolp::RoiLayout& layout);
+
+	// Written by the GUI thread, read once per frame by the sink callback
+	dolp::SeqLock<dolp::ThresholdParams> _thresholdParams;
+	dolp::SeqLock<dolp::TemporalFilterParams> _temporalFilter;
+	dolp::VisualizationMode _VisualizationMode = dolp::VisualizationMode::Threshold;
+
+	// Lookup table of the current visualization mode, replaced by the GUI thread and used by the sink callback
+	std::shared_ptr<const dolp::ColorLut> _colorLut;
+	std::mutex _colorLutMutex;
+
+	// The fastest threshold implementation supported by the CPU
+	const dolp::ThresholdKernels* _kernels = &dolp::selectKernels();
+
+	// Region detection is switched on by the GUI thread, the labeler and the frame interval are only used by the sink callback
+	std::atomic<bool> _detectRegions = false;
+	dolp::RegionLabeler _regionLabeler;
+	std::chrono::steady_clock::time_point _lastFrameTime;
+	double _frameIntervalMs = 0;
+
+	// Receives the region lists as JSON lines while exporting, only used by the GUI thread
+	std::unique_ptr<QFile> _regionExportFile;
+
+	// Regions of interest in image coordinates, replaced by the GUI thread and used by the sink callback.
+	// An empty list processes the whole image.
+	std::shared_ptr<const std::vector<dolp::Roi>> _rois = std::make_shared<std::vector<dolp::Roi>>();
+	std::mutex _roiMutex;
+
+	// Layout of the current ROIs, only rebuilt by the sink callback when the ROIs or the image size change
+	std::shared_ptr<const std::vector<dolp::Roi>> _roiLayoutSource;
+	dolp::RoiLayout _roiLayout;
+
+	// Size of the streamed images, used to map mouse positions on the display to image coordinates
+	std::atomic<int> _imageWidth = 0;
+	std::atomic<int> _imageHeight = 0;
+
+	// Shown while a new ROI is dragged on the display
+	QRubberBand* _rubberBand = nullptr;
+	QPoint _dragStart;
+
+	// Allocates the processed images, replaced by the GUI thread when the number of buffers changes
+	std::shared_ptr<dolp::DisplayBufferPool> _displayBufferPool;
+	std::mutex _displayBufferPoolMutex;
+
+	// Frames arriving faster than the monitor refreshes are not converted for display. The interval is updated by the GUI thread,
+	// the time of the last displayed frame is only used by the sink callback.
+	std::atomic<bool> _limitDisplayRate = true;
+	std::atomic<double> _displayIntervalMs = 0;
+	std::chrono::steady_clock::time_point _lastDisplayTime;
+
+	// Counted by the sink callback, shown by the GUI thread
+	std::atomic<uint64_t> _framesProcessed = 0;
+	std::atomic<uint64_t> _framesDisplayed = 0;
+
+	// Values at the previous statistics update, only used by the GUI thread
+	uint64_t _lastFramesProcessed = 0;
+	uint64_t _lastFramesDisplayed = 0;
+	std::chrono::steady_clock::time_point _lastStatisticsTime;
+
+	// One byte of temporal filter state per pixel, pitch is the image width. Only used by the sink callback,
+	// cleared when the filter mode or the image size changes.
+	std::vector<uint8_t> _filterState;
+	dolp::TemporalFilterMode _filterStateMode = dolp::TemporalFilterMode::Off;
+	int _filterStateWidth = 0;
+	int _filterStateHeight = 0;
+
+	// Set by the GUI thread to have the sink callback pass the next unprocessed frame to the GUI thread, which saves it
+	std::atomic<bool> _saveRawFrame = false;
+	QString _rawFrameFileName;
 
-	int _ThresholdDoLP = 30;
-	int _ThresholdIntensity = 10;
+	// Splits the images into bands processed in parallel, the sink callback thread processes bands as well
+	dolp::BandProcessor _bandProcessor{ defaultNumThreads() };
+	static int defaultNumThreads();
 
 	ic4interop::Qt::DisplayWidget* _VideoWidget = nullptr;
 
 	QPushButton* _btnDevice = new QPushButton("Device");
 	QPushButton* _btnProperties = new QPushButton("Properties");
 	QPushButton* _btnLiveVideo = new QPushButton("Start");
+	QPushButton* _btnSaveRawFrame = nullptr;
 	SliderControl* _sldThresholdDoLP = nullptr;
 	SliderControl* _sldThresholdIntensity = nullptr;
+	SliderControl* _sldNumThreads = nullptr;
+	QComboBox* _cboChannelReduction = nullptr;
+	QComboBox* _cboVisualizationMode = nullptr;
+	QCheckBox* _chkDetectRegions = nullptr;
+	QCheckBox* _chkExportRegions = nullptr;
+	QLabel* _lblRegions = nullptr;
+	QPushButton* _btnClearRois = nullptr;
+	QPushButton* _btnApplyRoiToCamera = nullptr;
+	QPushButton* _btnResetCameraRoi = nullptr;
+	SliderControl* _sldDisplayBuffers = nullptr;
+	QCheckBox* _chkLimitDisplayRate = nullptr;
+	QLabel* _lblDisplayStatistics = nullptr;
+	QComboBox* _cboTemporalFilter = nullptr;
+	SliderControl* _sldTemporalAverage = nullptr;
+	SliderControl* _sldVoteFrames = nullptr;
+	SliderControl* _sldVotesRequired = nullptr;
+	QTimer* _statisticsTimer = nullptr;
 
 	ic4::Grabber _grabber;
 	std::shared_ptr<ic4::Display> _display;
 	std::shared_ptr<ic4::QueueSink> _queueSink;
-	std::shared_ptr<ic4::BufferPool> _bufferPool;
 
 	bool sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& imageType, size_t min_buffers_required) final;
 	void framesQueued(ic4::QueueSink& sink) final;
@@ -0,0 +1,302 @@
+
+#include "polarizationkernels.h"
+
+#if defined(DOLP_KERNELS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	struct BGRa8
+	{
+		uint8_t Blue;
+		uint8_t Green;
+		uint8_t Red;
+		uint8_t Alpha;
+	};
+
+	struct PolarizedADIMono8
+	{
+		uint8_t AoLP;
+		uint8_t DoLP;
+		uint8_t Intensity;
+		uint8_t Reserved;
+	};
+
+	struct PolarizedADIRGB8
+	{
+		uint8_t AoLP;
+		uint8_t DoLPRed;
+		uint8_t DoLPGreen;
+		uint8_t DoLPBlue;
+		uint8_t IntensityRed;
+		uint8_t IntensityGreen;
+		uint8_t IntensityBlue;
+		uint8_t Reserved;
+	};
+
+	void ThresholdPolarizedADIMono8(const uint8_t* src_ptr, ptrdiff_t src_pitch, uint8_t* dst_ptr, ptrdiff_t dst_pitch, int width, int height, dolp::ThresholdParams params)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			auto pSrcLine = reinterpret_cast<const PolarizedADIMono8*>(src_ptr + y * src_pitch);
+			auto pDestLine = reinterpret_cast<BGRa8*>(dst_ptr + y * dst_pitch);
+
+			for (int x = 0; x < width; x++)
+			{
+				if (pSrcLine[x].DoLP > params.dolp && pSrcLine[x].Intensity > params.intensity)
+				{
+					pDestLine[x].Blue = 0x00;
+					pDestLine[x].Green = 0x00;
+					pDestLine[x].Red = 0xFF;
+					pDestLine[x].Alpha = 0xFF;
+				}
+				else
+				{
+					pDestLine[x].Blue = pSrcLine[x].Intensity;
+					pDestLine[x].Green = pSrcLine[x].Intensity;
+					pDestLine[x].Red = pSrcLine[x].Intensity;
+					pDestLine[x].Alpha = 0xFF;
+				}
+			}
+		}
+	}
+
+	template<dolp::ChannelReduction R>
+	void ThresholdPolarizedADIRGB8(const uint8_t* src_ptr, ptrdiff_t src_pitch, uint8_t* dst_ptr, ptrdiff_t dst_pitch, int width, int height, const dolp::ReducedThresholds& thresholds)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			auto pSrcLine = reinterpret_cast<const PolarizedADIRGB8*>(src_ptr + y * src_pitch);
+			auto pDestLine = reinterpret_cast<BGRa8*>(dst_ptr + y * dst_pitch);
+
+			for (int x = 0; x < width; x++)
+			{
+				int dolpValue = dolp::reduceChannels<R>(pSrcLine[x].DoLPRed, pSrcLine[x].DoLPGreen, pSrcLine[x].DoLPBlue);
+				int intensityValue = dolp::reduceChannels<R>(pSrcLine[x].IntensityRed, pSrcLine[x].IntensityGreen, pSrcLine[x].IntensityBlue);
+				if (dolpValue > thresholds.dolp && intensityValue > thresholds.intensity)
+				{
+					pDestLine[x].Blue = 0x00;
+					pDestLine[x].Green = 0x00;
+					pDestLine[x].Red = 0xFF;
+					pDestLine[x].Alpha = 0xFF;
+				}
+				else
+				{
+					pDestLine[x].Blue = pSrcLine[x].IntensityBlue;
+					pDestLine[x].Green = pSrcLine[x].IntensityGreen;
+					pDestLine[x].Red = pSrcLine[x].IntensityRed;
+					pDestLine[x].Alpha = 0xFF;
+				}
+			}
+		}
+	}
+
+	void ThresholdPolarizedADIRGB8(const uint8_t* src_ptr, ptrdiff_t src_pitch, uint8_t* dst_ptr, ptrdiff_t dst_pitch, int width, int height, dolp::ThresholdParams params)
+	{
+		auto thresholds = dolp::reducedThresholds(params);
+
+		switch (params.reduction)
+		{
+		case dolp::ChannelReduction::Maximum:
+			ThresholdPolarizedADIRGB8<dolp::ChannelReduction::Maximum>(src_ptr, src_pitch, dst_ptr, dst_pitch, width, height, thresholds);
+			break;
+		case dolp::ChannelReduction::Luminance:
+			ThresholdPolarizedADIRGB8<dolp::ChannelReduction::Luminance>(src_ptr, src_pitch, dst_ptr, dst_pitch, width, height, thresholds);
+			break;
+		case dolp::ChannelReduction::Average:
+		default:
+			ThresholdPolarizedADIRGB8<dolp::ChannelReduction::Average>(src_ptr, src_pitch, dst_ptr, dst_pitch, width, height, thresholds);
+			break;
+		}
+	}
+
+	void MarkPixel(BGRa8& dest, bool marked, uint8_t red, uint8_t green, uint8_t blue)
+	{
+		dest.Blue = marked ? 0x00 : blue;
+		dest.Green = marked ? 0x00 : green;
+		dest.Red = marked ? 0xFF : red;
+		dest.Alpha = 0xFF;
+	}
+
+	// Updates the filter state of a pixel and returns whether it is marked.
+	// dolpValue is the normalized DoLP, dolpAbove and intensityAbove the threshold results of the current frame.
+	uint8_t UpdateFilterState(uint8_t state, int dolpValue, bool dolpAbove, bool intensityAbove, const dolp::TemporalFilterParams& filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Vote)
+			return static_cast<uint8_t>(dolp::updateVoteHistory(state, dolpAbove && intensityAbove, filter.voteFrames));
+
+		return static_cast<uint8_t>(dolp::updateDoLPAverage(state, dolpValue, filter.averageShift));
+	}
+
+	void FilterPolarizedADIMono8(const uint8_t* src_ptr, ptrdiff_t src_pitch, uint8_t* state_ptr, ptrdiff_t state_pitch, uint8_t* dst_ptr, ptrdiff_t dst_pitch, int width, int height, dolp::ThresholdParams params, dolp::TemporalFilterParams filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Off)
+		{
+			if (dst_ptr)
+				ThresholdPolarizedADIMono8(src_ptr, src_pitch, dst_ptr, dst_pitch, width, height, params);
+			return;
+		}
+
+		for (int y = 0; y < height; y++)
+		{
+			auto pSrcLine = reinterpret_cast<const PolarizedADIMono8*>(src_ptr + y * src_pitch);
+			auto pStateLine = state_ptr + y * state_pitch;
+			auto pDestLine = dst_ptr ? reinterpret_cast<BGRa8*>(dst_ptr + y * dst_pitch) : nullptr;
+
+			for (int x = 0; x < width; x++)
+			{
+				bool dolpAbove = pSrcLine[x].DoLP > params.dolp;
+				bool intensityAbove = pSrcLine[x].Intensity > params.intensity;
+
+				pStateLine[x] = UpdateFilterState(pStateLine[x], pSrcLine[x].DoLP, dolpAbove, intensityAbove, filter);
+
+				if (pDestLine)
+				{
+					bool marked = dolp::isMarkedByFilter(pStateLine[x], intensityAbove, params.dolp, filter);
+					MarkPixel(pDestLine[x], marked, pSrcLine[x].Intensity, pSrcLine[x].Intensity, pSrcLine[x].Intensity);
+				}
+			}
+		}
+	}
+
+	template<dolp::ChannelReduction R>
+	void FilterPolarizedADIRGB8(const uint8_t* src_ptr, ptrdiff_t src_pitch, uint8_t* state_ptr, ptrdiff_t state_pitch, uint8_t* dst_ptr, ptrdiff_t dst_pitch, int width, int height, const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		auto thresholds = dolp::reducedThresholds(params);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto pSrcLine = reinterpret_cast<const PolarizedADIRGB8*>(src_ptr + y * src_pitch);
+			auto pStateLine = state_ptr + y * state_pitch;
+			auto pDestLine = dst_ptr ? reinterpret_cast<BGRa8*>(dst_ptr + y * dst_pitch) : nullptr;
+
+			for (int x = 0; x < width; x++)
+			{
+				int dolpValue = dolp::reduceChannels<R>(pSrcLine[x].DoLPRed, pSrcLine[x].DoLPGreen, pSrcLine[x].DoLPBlue);
+				int intensityValue = dolp::reduceChannels<R>(pSrcLine[x].IntensityRed, pSrcLine[x].IntensityGreen, pSrcLine[x].IntensityBlue);
+				bool dolpAbove = dolpValue > thresholds.dolp;
+				bool intensityAbove = intensityValue > thresholds.intensity;
+
+				pStateLine[x] = UpdateFilterState(pStateLine[x], dolp::normalizeChannels<R>(dolpValue), dolpAbove, intensityAbove, filter);
+
+				if (pDestLine)
+				{
+					bool marked = dolp::isMarkedByFilter(pStateLine[x], intensityAbove, params.dolp, filter);
+					MarkPixel(pDestLine[x], marked, pSrcLine[x].IntensityRed, pSrcLine[x].IntensityGreen, pSrcLine[x].IntensityBlue);
+				}
+			}
+		}
+	}
+
+	void FilterPolarizedADIRGB8(const uint8_t* src_ptr, ptrdiff_t src_pitch, uint8_t* state_ptr, ptrdiff_t state_pitch, uint8_t* dst_ptr, ptrdiff_t dst_pitch, int width, int height, dolp::ThresholdParams params, dolp::TemporalFilterParams filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Off)
+		{
+			if (dst_ptr)
+				ThresholdPolarizedADIRGB8(src_ptr, src_pitch, dst_ptr, dst_pitch, width, height, params);
+			return;
+		}
+
+		switch (params.reduction)
+		{
+		case dolp::ChannelReduction::Maximum:
+			FilterPolarizedADIRGB8<dolp::ChannelReduction::Maximum>(src_ptr, src_pitch, state_ptr, state_pitch, dst_ptr, dst_pitch, width, height, params, filter);
+			break;
+		case dolp::ChannelReduction::Luminance:
+			FilterPolarizedADIRGB8<dolp::ChannelReduction::Luminance>(src_ptr, src_pitch, state_ptr, state_pitch, dst_ptr, dst_pitch, width, height, params, filter);
+			break;
+		case dolp::ChannelReduction::Average:
+		default:
+			FilterPolarizedADIRGB8<dolp::ChannelReduction::Average>(src_ptr, src_pitch, state_ptr, state_pitch, dst_ptr, dst_pitch, width, height, params, filter);
+			break;
+		}
+	}
+
+	const dolp::ThresholdKernels scalarKernels = { "Scalar", ThresholdPolarizedADIMono8, ThresholdPolarizedADIRGB8, FilterPolarizedADIMono8, FilterPolarizedADIRGB8 };
+
+#if defined(DOLP_KERNELS_X86)
+	bool cpuSupportsSSE41()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 19)) != 0;
+#else
+		return __builtin_cpu_supports("sse4.1");
+#endif
+	}
+
+	bool cpuSupportsAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// The OS has to save the AVX registers on context switches
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+namespace dolp
+{
+	ReducedThresholds reducedThresholds(const ThresholdParams& params)
+	{
+		switch (params.reduction)
+		{
+		case ChannelReduction::Maximum:
+			return { params.dolp, params.intensity };
+		case ChannelReduction::Luminance:
+			return { LuminanceWeightSum * params.dolp + LuminanceWeightSum - 1, LuminanceWeightSum * params.intensity + LuminanceWeightSum - 1 };
+		case ChannelReduction::Average:
+		default:
+			return { 3 * params.dolp + 2, 3 * params.intensity + 2 };
+		}
+	}
+
+	ThresholdParams intensityOnlyParams(const ThresholdParams& params)
+	{
+		return { 255, 255, params.reduction };
+	}
+
+	const ThresholdKernels& referenceKernels()
+	{
+		return scalarKernels;
+	}
+
+	std::vector<const ThresholdKernels*> supportedKernels()
+	{
+		std::vector<const ThresholdKernels*> result = { &scalarKernels };
+
+#if defined(DOLP_KERNELS_X86)
+		if (cpuSupportsSSE41())
+			result.push_back(&detail::sse41Kernels);
+		if (cpuSupportsAVX2())
+			result.push_back(&detail::avx2Kernels);
+#elif defined(DOLP_KERNELS_NEON)
+		result.push_back(&detail::neonKernels);
+#endif
+
+		return result;
+	}
+
+	const ThresholdKernels& selectKernels()
+	{
+		static const ThresholdKernels& kernels = *supportedKernels().back();
+		return kernels;
+	}
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define DOLP_KERNELS_X86
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define DOLP_KERNELS_NEON
+#endif
+
+namespace dolp
+{
+	/// <summary>
+	/// How the red, green and blue channels of an ADIRGB8 pixel are combined before comparing them against the thresholds
+	/// </summary>
+	enum class ChannelReduction
+	{
+		Average,	// Truncated average of the three channels
+		Maximum,	// Largest of the three channels
+		Luminance,	// Weighted by the channels' contribution to the luminance (BT.601), truncated
+	};
+
+	/// <summary>
+	/// Thresholds for marking pixels with polarized light, both in the range [0, 255]
+	/// </summary>
+	struct ThresholdParams
+	{
+		int dolp = 30;
+		int intensity = 10;
+		ChannelReduction reduction = ChannelReduction::Average;
+	};
+
+	/// <summary>
+	/// Weights of the red, green and blue channels for ChannelReduction::Luminance, adding up to LuminanceWeightSum
+	/// </summary>
+	const int LuminanceWeightRed = 38;
+	const int LuminanceWeightGreen = 75;
+	const int LuminanceWeightBlue = 15;
+	const int LuminanceWeightSum = 128;
+
+	/// <summary>
+	/// Thresholds to compare the unnormalized channel combinations against, so that the kernels do not have to divide.
+	/// For ChannelReduction::Average, the sum of the channels is compared: sum / 3 > t is equivalent to sum > 3 * t + 2.
+	/// For ChannelReduction::Luminance, the weighted sum is compared: wsum / 128 > t is equivalent to wsum > 128 * t + 127.
+	/// For ChannelReduction::Maximum, the thresholds are used unchanged.
+	/// </summary>
+	struct ReducedThresholds
+	{
+		int dolp;
+		int intensity;
+	};
+
+	ReducedThresholds reducedThresholds(const ThresholdParams& params);
+
+	/// <summary>
+	/// Thresholds no pixel can exceed, so that the threshold kernels only copy the intensity.
+	/// Used for the parts of the image outside of the regions of interest.
+	/// </summary>
+	ThresholdParams intensityOnlyParams(const ThresholdParams& params);
+
+	/// <summary>
+	/// Combines the red, green and blue channels of a pixel without normalizing, to be compared against ReducedThresholds
+	/// </summary>
+	template<ChannelReduction R>
+	int reduceChannels(int red, int green, int blue);
+
+	template<>
+	inline int reduceChannels<ChannelReduction::Average>(int red, int green, int blue)
+	{
+		return red + green + blue;
+	}
+
+	template<>
+	inline int reduceChannels<ChannelReduction::Maximum>(int red, int green, int blue)
+	{
+		int max = red > green ? red : green;
+		return max > blue ? max : blue;
+	}
+
+	template<>
+	inline int reduceChannels<ChannelReduction::Luminance>(int red, int green, int blue)
+	{
+		return LuminanceWeightRed * red + LuminanceWeightGreen * green + LuminanceWeightBlue * blue;
+	}
+
+	/// <summary>
+	/// Combination of three channels as selected by R, normalized to [0, 255] like the thresholds
+	/// </summary>
+	template<ChannelReduction R>
+	int normalizeChannels(int reduced)
+	{
+		switch (R)
+		{
+		case ChannelReduction::Maximum:
+			return reduced;
+		case ChannelReduction::Luminance:
+			return reduced / LuminanceWeightSum;
+		case ChannelReduction::Average:
+		default:
+			return reduced / 3;
+		}
+	}
+
+	/// <summary>
+	/// How the threshold results of consecutive frames are combined, to keep noise from making the marked pixels flicker
+	/// </summary>
+	enum class TemporalFilterMode
+	{
+		Off,			// Every frame is thresholded on its own
+		DoLPAverage,	// The (normalized) DoLP is averaged exponentially before comparing it against the threshold
+		Vote,			// A pixel is marked if it was above the thresholds in at least voteRequired of the last voteFrames frames
+	};
+
+	/// <summary>
+	/// Parameters of the temporal filter. The filter state of each pixel is kept in a single byte:
+	/// the DoLP average for TemporalFilterMode::DoLPAverage, one bit per frame for TemporalFilterMode::Vote.
+	/// </summary>
+	struct TemporalFilterParams
+	{
+		TemporalFilterMode mode = TemporalFilterMode::Off;
+		int averageShift = 2;	// Each frame contributes 1 / 2^averageShift to the average, in [0, 7]
+		int voteFrames = 5;		// In [1, 8]
+		int voteRequired = 3;	// In [1, voteFrames]
+	};
+
+	/// <summary>
+	/// Moves the DoLP average a step of 1 / 2^shift of the difference towards value.
+	/// The step is rounded away from zero, so that the average reaches a constant value instead of stopping short of it.
+	/// </summary>
+	inline int updateDoLPAverage(int average, int value, int shift)
+	{
+		int diff = value - average;
+		int round = (1 << shift) - 1;
+		return diff > 0 ? average + ((diff + round) >> shift) : average - ((round - diff) >> shift);
+	}
+
+	/// <summary>
+	/// Shifts the current frame's threshold result into the vote history, keeping the results of the last frames
+	/// </summary>
+	inline int updateVoteHistory(int history, bool above, int frames)
+	{
+		return ((history << 1) | (above ? 1 : 0)) & ((1 << frames) - 1);
+	}
+
+	inline int countVotes(int history)
+	{
+		int count = 0;
+		for (; history != 0; history &= history - 1)
+			count++;
+		return count;
+	}
+
+	/// <summary>
+	/// Whether a pixel is marked, given its updated filter state.
+	/// intensityAbove is the intensity threshold result of the current frame, it is only used by TemporalFilterMode::DoLPAverage.
+	/// </summary>
+	inline bool isMarkedByFilter(int state, bool intensityAbove, int dolpThreshold, const TemporalFilterParams& filter)
+	{
+		if (filter.mode == TemporalFilterMode::Vote)
+			return countVotes(state) >= filter.voteRequired;
+
+		return state > dolpThreshold && intensityAbove;
+	}
+
+	/// <summary>
+	/// Processes a number of rows, converting a polarized ADI image into a BGRa8 image.
+	/// Pixels with DoLP and intensity above the thresholds are painted red, the other pixels show the intensity.
+	/// For ADIRGB8 images, the channels are combined as selected by params.reduction.
+	/// The parameters are passed by value, so that the compiler can keep them in registers regardless of the stores to dst.
+	/// </summary>
+	using ThresholdFunction = void (*)(
+		const uint8_t* src, ptrdiff_t srcPitch,
+		uint8_t* dst, ptrdiff_t dstPitch,
+		int width, int height,
+		ThresholdParams params
+	);
+
+	/// <summary>
+	/// Like ThresholdFunction, but marks the pixels selected by the temporal filter.
+	/// The filter state of each pixel is read, updated and written back in the same pass.
+	/// state points to one byte per pixel at the same position as src. It has to be zeroed when the filter starts.
+	/// dst can be nullptr, then only the state is updated, e.g. for frames that are not displayed.
+	/// With TemporalFilterMode::Off, the function behaves like ThresholdFunction and leaves the state untouched.
+	/// </summary>
+	using TemporalThresholdFunction = void (*)(
+		const uint8_t* src, ptrdiff_t srcPitch,
+		uint8_t* state, ptrdiff_t statePitch,
+		uint8_t* dst, ptrdiff_t dstPitch,
+		int width, int height,
+		ThresholdParams params,
+		TemporalFilterParams filter
+	);
+
+	/// <summary>
+	/// A set of kernel implementations for one instruction set
+	/// </summary>
+	struct ThresholdKernels
+	{
+		const char* name;
+		ThresholdFunction adiMono8;
+		ThresholdFunction adiRGB8;
+		TemporalThresholdFunction filteredADIMono8;
+		TemporalThresholdFunction filteredADIRGB8;
+	};
+
+	/// <summary>
+	/// The scalar implementation, which all other implementations have to match exactly
+	/// </summary>
+	const ThresholdKernels& referenceKernels();
+
+	/// <summary>
+	/// Returns all implementations that are supported by the CPU, starting with the reference implementation
+	/// </summary>
+	std::vector<const ThresholdKernels*> supportedKernels();
+
+	/// <summary>
+	/// Returns the fastest implementation supported by the CPU. The CPU is only checked on the first call.
+	/// </summary>
+	const ThresholdKernels& selectKernels();
+
+	namespace detail
+	{
+		// Implemented in separate translation units, compiled with the required instruction set enabled
+#if defined(DOLP_KERNELS_X86)
+		extern const ThresholdKernels sse41Kernels;
+		extern const ThresholdKernels avx2Kernels;
+#elif defined(DOLP_KERNELS_NEON)
+		extern const ThresholdKernels neonKernels;
+#endif
+	}
+}
@@ -0,0 +1,430 @@
+
+#include "polarizationkernels.h"
+
+#if defined(DOLP_KERNELS_NEON)
+
+#include <arm_neon.h>
+
+namespace
+{
+	inline uint8_t clampThreshold(int value)
+	{
+		return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+	}
+
+	// Stores 16 BGRa8 pixels, replacing the pixels selected by mask with the marker color
+	inline void storeMarked(uint8_t* dst, uint8x16_t red, uint8x16_t green, uint8x16_t blue, uint8x16_t mask)
+	{
+		uint8x16x4_t out;
+		out.val[0] = vbicq_u8(blue, mask);
+		out.val[1] = vbicq_u8(green, mask);
+		out.val[2] = vorrq_u8(red, mask);
+		out.val[3] = vdupq_n_u8(0xFF);
+		vst4q_u8(dst, out);
+	}
+
+	// Stores a single BGRa8 pixel
+	inline void storeMarked(uint8_t* d, int red, int green, int blue, bool marked)
+	{
+		d[0] = marked ? 0x00 : static_cast<uint8_t>(blue);
+		d[1] = marked ? 0x00 : static_cast<uint8_t>(green);
+		d[2] = marked ? 0xFF : static_cast<uint8_t>(red);
+		d[3] = 0xFF;
+	}
+
+	void thresholdADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params)
+	{
+		const uint8_t dolpThreshold = clampThreshold(params.dolp);
+		const uint8_t intensityThreshold = clampThreshold(params.intensity);
+		const uint8x16_t dolpThresholdVec = vdupq_n_u8(dolpThreshold);
+		const uint8x16_t intensityThresholdVec = vdupq_n_u8(intensityThreshold);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto dstLine = dst + y * dstPitch;
+
+			int x = 0;
+			for (; x + 16 <= width; x += 16)
+			{
+				// Deinterleave into AoLP, DoLP, Intensity and Reserved planes
+				uint8x16x4_t px = vld4q_u8(srcLine + x * 4);
+				uint8x16_t mask = vandq_u8(vcgtq_u8(px.val[1], dolpThresholdVec), vcgtq_u8(px.val[2], intensityThresholdVec));
+
+				storeMarked(dstLine + x * 4, px.val[2], px.val[2], px.val[2], mask);
+			}
+
+			for (; x < width; ++x)
+			{
+				auto p = srcLine + x * 4;
+				bool marked = p[1] > dolpThreshold && p[2] > intensityThreshold;
+				storeMarked(dstLine + x * 4, p[2], p[2], p[2], marked);
+			}
+		}
+	}
+
+	inline uint16_t clampReducedThreshold(int value)
+	{
+		return static_cast<uint16_t>(value < 0 ? 0 : (value > 65535 ? 65535 : value));
+	}
+
+	// Combines three channels as selected by R without normalizing, for 8 pixels
+	template<dolp::ChannelReduction R>
+	uint16x8_t reduceChannels(uint8x8_t c0, uint8x8_t c1, uint8x8_t c2);
+
+	template<>
+	inline uint16x8_t reduceChannels<dolp::ChannelReduction::Average>(uint8x8_t c0, uint8x8_t c1, uint8x8_t c2)
+	{
+		return vaddw_u8(vaddl_u8(c0, c1), c2);
+	}
+
+	template<>
+	inline uint16x8_t reduceChannels<dolp::ChannelReduction::Maximum>(uint8x8_t c0, uint8x8_t c1, uint8x8_t c2)
+	{
+		return vmovl_u8(vmax_u8(vmax_u8(c0, c1), c2));
+	}
+
+	template<>
+	inline uint16x8_t reduceChannels<dolp::ChannelReduction::Luminance>(uint8x8_t c0, uint8x8_t c1, uint8x8_t c2)
+	{
+		uint16x8_t sum = vmull_u8(c0, vdup_n_u8(dolp::LuminanceWeightRed));
+		sum = vmlal_u8(sum, c1, vdup_n_u8(dolp::LuminanceWeightGreen));
+		return vmlal_u8(sum, c2, vdup_n_u8(dolp::LuminanceWeightBlue));
+	}
+
+	// Compares the combination of three channels against a threshold
+	template<dolp::ChannelReduction R>
+	inline uint8x16_t reducedAbove(uint8x16_t c0, uint8x16_t c1, uint8x16_t c2, uint16x8_t threshold)
+	{
+		uint16x8_t lo = reduceChannels<R>(vget_low_u8(c0), vget_low_u8(c1), vget_low_u8(c2));
+		uint16x8_t hi = reduceChannels<R>(vget_high_u8(c0), vget_high_u8(c1), vget_high_u8(c2));
+
+		return vcombine_u8(
+			vmovn_u16(vcgtq_u16(lo, threshold)),
+			vmovn_u16(vcgtq_u16(hi, threshold))
+		);
+	}
+
+	// The DoLP and intensity channels of 16 ADIRGB8 pixels
+	struct PlanesRGB8
+	{
+		uint8x16_t dolpRed;
+		uint8x16_t dolpGreen;
+		uint8x16_t dolpBlue;
+		uint8x16_t intensityRed;
+		uint8x16_t intensityGreen;
+		uint8x16_t intensityBlue;
+	};
+
+	inline PlanesRGB8 loadRGB8(const uint8_t* src)
+	{
+		// Deinterleave 16 pixels: vld4q_u8 splits the 8 channels into pairs, vuzpq_u8 separates the pairs
+		uint8x16x4_t a = vld4q_u8(src);
+		uint8x16x4_t b = vld4q_u8(src + 64);
+		uint8x16x2_t aolpRed = vuzpq_u8(a.val[0], b.val[0]);		// AoLP, IntensityRed
+		uint8x16x2_t dolpRedGreen = vuzpq_u8(a.val[1], b.val[1]);	// DoLPRed, IntensityGreen
+		uint8x16x2_t dolpGreenBlue = vuzpq_u8(a.val[2], b.val[2]);	// DoLPGreen, IntensityBlue
+		uint8x16x2_t dolpBlue = vuzpq_u8(a.val[3], b.val[3]);		// DoLPBlue, Reserved
+
+		PlanesRGB8 planes;
+		planes.dolpRed = dolpRedGreen.val[0];
+		planes.dolpGreen = dolpGreenBlue.val[0];
+		planes.dolpBlue = dolpBlue.val[0];
+		planes.intensityRed = aolpRed.val[1];
+		planes.intensityGreen = dolpRedGreen.val[1];
+		planes.intensityBlue = dolpGreenBlue.val[1];
+		return planes;
+	}
+
+	template<dolp::ChannelReduction R>
+	void thresholdADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ReducedThresholds& thresholds)
+	{
+		const uint16_t dolpThreshold = clampReducedThreshold(thresholds.dolp);
+		const uint16_t intensityThreshold = clampReducedThreshold(thresholds.intensity);
+		const uint16x8_t dolpThresholdVec = vdupq_n_u16(dolpThreshold);
+		const uint16x8_t intensityThresholdVec = vdupq_n_u16(intensityThreshold);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto dstLine = dst + y * dstPitch;
+
+			int x = 0;
+			for (; x + 16 <= width; x += 16)
+			{
+				PlanesRGB8 px = loadRGB8(srcLine + x * 8);
+
+				uint8x16_t mask = vandq_u8(
+					reducedAbove<R>(px.dolpRed, px.dolpGreen, px.dolpBlue, dolpThresholdVec),
+					reducedAbove<R>(px.intensityRed, px.intensityGreen, px.intensityBlue, intensityThresholdVec)
+				);
+
+				storeMarked(dstLine + x * 4, px.intensityRed, px.intensityGreen, px.intensityBlue, mask);
+			}
+
+			for (; x < width; ++x)
+			{
+				auto p = srcLine + x * 8;
+				int dolpValue = dolp::reduceChannels<R>(p[1], p[2], p[3]);
+				int intensityValue = dolp::reduceChannels<R>(p[4], p[5], p[6]);
+				bool marked = dolpValue > dolpThreshold && intensityValue > intensityThreshold;
+				storeMarked(dstLine + x * 4, p[4], p[5], p[6], marked);
+			}
+		}
+	}
+
+	void thresholdADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params)
+	{
+		auto thresholds = dolp::reducedThresholds(params);
+
+		switch (params.reduction)
+		{
+		case dolp::ChannelReduction::Maximum:
+			thresholdADIRGB8<dolp::ChannelReduction::Maximum>(src, srcPitch, dst, dstPitch, width, height, thresholds);
+			break;
+		case dolp::ChannelReduction::Luminance:
+			thresholdADIRGB8<dolp::ChannelReduction::Luminance>(src, srcPitch, dst, dstPitch, width, height, thresholds);
+			break;
+		case dolp::ChannelReduction::Average:
+		default:
+			thresholdADIRGB8<dolp::ChannelReduction::Average>(src, srcPitch, dst, dstPitch, width, height, thresholds);
+			break;
+		}
+	}
+
+	// Constants of the temporal filter in all lanes
+	struct FilterVectors
+	{
+		uint8x16_t dolpThreshold;	// Normalized, compared against the DoLP average
+		int8x16_t averageShift;		// Negative, vshlq_u8 shifts right
+		uint8x16_t averageRound;	// 2^averageShift - 1, the bits shifted out
+		uint8x16_t voteMask;		// One bit for each of the last voteFrames frames
+		uint8x16_t voteRequired;
+	};
+
+	inline FilterVectors filterVectors(const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		FilterVectors f;
+		f.dolpThreshold = vdupq_n_u8(clampThreshold(params.dolp));
+		f.averageShift = vdupq_n_s8(static_cast<int8_t>(-filter.averageShift));
+		f.averageRound = vdupq_n_u8(static_cast<uint8_t>((1 << filter.averageShift) - 1));
+		f.voteMask = vdupq_n_u8(static_cast<uint8_t>((1 << filter.voteFrames) - 1));
+		f.voteRequired = vdupq_n_u8(clampThreshold(filter.voteRequired));
+		return f;
+	}
+
+	// Divides by 2^averageShift, rounding up
+	inline uint8x16_t averageStep(uint8x16_t diff, const FilterVectors& f)
+	{
+		uint8x16_t remainder = vminq_u8(vandq_u8(diff, f.averageRound), vdupq_n_u8(1));
+		return vaddq_u8(vshlq_u8(diff, f.averageShift), remainder);
+	}
+
+	// Updates the filter state of 16 pixels and returns the mask of the pixels to mark.
+	// dolp is the normalized DoLP, dolpAbove and intensityAbove are the threshold results of the current frame.
+	template<dolp::TemporalFilterMode F>
+	uint8x16_t updateFilterState(uint8x16_t& state, uint8x16_t dolp, uint8x16_t dolpAbove, uint8x16_t intensityAbove, const FilterVectors& f);
+
+	template<>
+	inline uint8x16_t updateFilterState<dolp::TemporalFilterMode::DoLPAverage>(uint8x16_t& state, uint8x16_t dolp, uint8x16_t /* dolpAbove */, uint8x16_t intensityAbove, const FilterVectors& f)
+	{
+		// One of the saturated differences is zero, the steps are rounded away from zero
+		uint8x16_t up = vqsubq_u8(dolp, state);
+		uint8x16_t down = vqsubq_u8(state, dolp);
+		state = vsubq_u8(vaddq_u8(state, averageStep(up, f)), averageStep(down, f));
+
+		return vandq_u8(vcgtq_u8(state, f.dolpThreshold), intensityAbove);
+	}
+
+	template<>
+	inline uint8x16_t updateFilterState<dolp::TemporalFilterMode::Vote>(uint8x16_t& state, uint8x16_t /* dolp */, uint8x16_t dolpAbove, uint8x16_t intensityAbove, const FilterVectors& f)
+	{
+		uint8x16_t vote = vshrq_n_u8(vandq_u8(dolpAbove, intensityAbove), 7);
+		state = vandq_u8(vorrq_u8(vshlq_n_u8(state, 1), vote), f.voteMask);
+
+		return vcgeq_u8(vcntq_u8(state), f.voteRequired);
+	}
+
+	// Updates the filter state of a single pixel and returns whether it is marked
+	inline bool updateFilterStateScalar(uint8_t& state, int dolp, bool dolpAbove, bool intensityAbove, int dolpThreshold, const dolp::TemporalFilterParams& filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Vote)
+			state = static_cast<uint8_t>(dolp::updateVoteHistory(state, dolpAbove && intensityAbove, filter.voteFrames));
+		else
+			state = static_cast<uint8_t>(dolp::updateDoLPAverage(state, dolp, filter.averageShift));
+
+		return dolp::isMarkedByFilter(state, intensityAbove, dolpThreshold, filter);
+	}
+
+	template<dolp::TemporalFilterMode F>
+	void filterADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		const uint8_t dolpThreshold = clampThreshold(params.dolp);
+		const uint8_t intensityThreshold = clampThreshold(params.intensity);
+		const uint8x16_t dolpThresholdVec = vdupq_n_u8(dolpThreshold);
+		const uint8x16_t intensityThresholdVec = vdupq_n_u8(intensityThreshold);
+		const FilterVectors f = filterVectors(params, filter);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto stateLine = state + y * statePitch;
+			auto dstLine = dst ? dst + y * dstPitch : nullptr;
+
+			int x = 0;
+			for (; x + 16 <= width; x += 16)
+			{
+				uint8x16x4_t px = vld4q_u8(srcLine + x * 4);
+				uint8x16_t s = vld1q_u8(stateLine + x);
+				uint8x16_t mask = updateFilterState<F>(s, px.val[1], vcgtq_u8(px.val[1], dolpThresholdVec), vcgtq_u8(px.val[2], intensityThresholdVec), f);
+				vst1q_u8(stateLine + x, s);
+
+				if (dstLine)
+					storeMarked(dstLine + x * 4, px.val[2], px.val[2], px.val[2], mask);
+			}
+
+			for (; x < width; ++x)
+			{
+				auto p = srcLine + x * 4;
+				bool marked = updateFilterStateScalar(stateLine[x], p[1], p[1] > dolpThreshold, p[2] > intensityThreshold, dolpThreshold, filter);
+
+				if (dstLine)
+					storeMarked(dstLine + x * 4, p[2], p[2], p[2], marked);
+			}
+		}
+	}
+
+	void filterADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params, dolp::TemporalFilterParams filter)
+	{
+		switch (filter.mode)
+		{
+		case dolp::TemporalFilterMode::DoLPAverage:
+			filterADIMono8<dolp::TemporalFilterMode::DoLPAverage>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::TemporalFilterMode::Vote:
+			filterADIMono8<dolp::TemporalFilterMode::Vote>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::TemporalFilterMode::Off:
+		default:
+			if (dst)
+				thresholdADIMono8(src, srcPitch, dst, dstPitch, width, height, params);
+			break;
+		}
+	}
+
+	// Normalizes reduceChannels results of 8 pixels to [0, 255]
+	template<dolp::ChannelReduction R>
+	inline uint8x8_t normalizeChannels(uint16x8_t v)
+	{
+		if (R == dolp::ChannelReduction::Maximum)
+			return vmovn_u16(v);
+		if (R == dolp::ChannelReduction::Luminance)
+			return vshrn_n_u16(v, 7);	// LuminanceWeightSum
+
+		// x / 3 == (x * 21846) >> 16 for x up to 765
+		uint32x4_t lo = vmull_u16(vget_low_u16(v), vdup_n_u16(21846));
+		uint32x4_t hi = vmull_u16(vget_high_u16(v), vdup_n_u16(21846));
+		return vmovn_u16(vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16)));
+	}
+
+	// Like reducedAbove, additionally returning the normalized combination of the channels
+	template<dolp::ChannelReduction R>
+	inline uint8x16_t reducedAbove(uint8x16_t c0, uint8x16_t c1, uint8x16_t c2, uint16x8_t threshold, uint8x16_t& normalized)
+	{
+		uint16x8_t lo = reduceChannels<R>(vget_low_u8(c0), vget_low_u8(c1), vget_low_u8(c2));
+		uint16x8_t hi = reduceChannels<R>(vget_high_u8(c0), vget_high_u8(c1), vget_high_u8(c2));
+
+		normalized = vcombine_u8(normalizeChannels<R>(lo), normalizeChannels<R>(hi));
+		return vcombine_u8(
+			vmovn_u16(vcgtq_u16(lo, threshold)),
+			vmovn_u16(vcgtq_u16(hi, threshold))
+		);
+	}
+
+	template<dolp::ChannelReduction R, dolp::TemporalFilterMode F>
+	void filterADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		auto thresholds = dolp::reducedThresholds(params);
+		const uint16_t dolpThreshold = clampReducedThreshold(thresholds.dolp);
+		const uint16_t intensityThreshold = clampReducedThreshold(thresholds.intensity);
+		const uint16x8_t dolpThresholdVec = vdupq_n_u16(dolpThreshold);
+		const uint16x8_t intensityThresholdVec = vdupq_n_u16(intensityThreshold);
+		const FilterVectors f = filterVectors(params, filter);
+		const int normalizedDoLPThreshold = clampThreshold(params.dolp);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto stateLine = state + y * statePitch;
+			auto dstLine = dst ? dst + y * dstPitch : nullptr;
+
+			int x = 0;
+			for (; x + 16 <= width; x += 16)
+			{
+				PlanesRGB8 px = loadRGB8(srcLine + x * 8);
+
+				uint8x16_t normalizedDoLP;
+				uint8x16_t dolpAbove = reducedAbove<R>(px.dolpRed, px.dolpGreen, px.dolpBlue, dolpThresholdVec, normalizedDoLP);
+				uint8x16_t intensityAbove = reducedAbove<R>(px.intensityRed, px.intensityGreen, px.intensityBlue, intensityThresholdVec);
+
+				uint8x16_t s = vld1q_u8(stateLine + x);
+				uint8x16_t mask = updateFilterState<F>(s, normalizedDoLP, dolpAbove, intensityAbove, f);
+				vst1q_u8(stateLine + x, s);
+
+				if (dstLine)
+					storeMarked(dstLine + x * 4, px.intensityRed, px.intensityGreen, px.intensityBlue, mask);
+			}
+
+			for (; x < width; ++x)
+			{
+				auto p = srcLine + x * 8;
+				int dolpValue = dolp::reduceChannels<R>(p[1], p[2], p[3]);
+				int intensityValue = dolp::reduceChannels<R>(p[4], p[5], p[6]);
+				bool marked = updateFilterStateScalar(stateLine[x], dolp::normalizeChannels<R>(dolpValue), dolpValue > dolpThreshold, intensityValue > intensityThreshold, normalizedDoLPThreshold, filter);
+
+				if (dstLine)
+					storeMarked(dstLine + x * 4, p[4], p[5], p[6], marked);
+			}
+		}
+	}
+
+	template<dolp::ChannelReduction R>
+	void filterADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Vote)
+			filterADIRGB8<R, dolp::TemporalFilterMode::Vote>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+		else
+			filterADIRGB8<R, dolp::TemporalFilterMode::DoLPAverage>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+	}
+
+	void filterADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params, dolp::TemporalFilterParams filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Off)
+		{
+			if (dst)
+				thresholdADIRGB8(src, srcPitch, dst, dstPitch, width, height, params);
+			return;
+		}
+
+		switch (params.reduction)
+		{
+		case dolp::ChannelReduction::Maximum:
+			filterADIRGB8<dolp::ChannelReduction::Maximum>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::ChannelReduction::Luminance:
+			filterADIRGB8<dolp::ChannelReduction::Luminance>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::ChannelReduction::Average:
+		default:
+			filterADIRGB8<dolp::ChannelReduction::Average>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		}
+	}
+}
+
+namespace dolp::detail
+{
+	const ThresholdKernels neonKernels = { "NEON", thresholdADIMono8, thresholdADIRGB8, filterADIMono8, filterADIRGB8 };
+}
+
+#endif
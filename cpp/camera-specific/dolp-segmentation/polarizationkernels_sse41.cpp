@@ -0,0 +1,439 @@
+
+// Compiled with SSE4.1 enabled, only called if the CPU supports it.
+// Do not use standard library templates in this file, their instantiations could be shared with other translation units.
+
+#include "polarizationkernels.h"
+
+#if defined(DOLP_KERNELS_X86)
+
+#include <smmintrin.h>
+
+#include <cstring>
+
+namespace
+{
+	// BGRa values of the marker color and the alpha channel
+	const int MarkerColor = static_cast<int>(0xFFFF0000u);
+	const int AlphaMask = static_cast<int>(0xFF000000u);
+
+	// Replaces the BGRa8 pixels selected by mask with the marker color
+	inline __m128i markPixels(__m128i gray, __m128i mask)
+	{
+		return _mm_blendv_epi8(gray, _mm_set1_epi32(MarkerColor), mask);
+	}
+
+	// Extracts DoLP and intensity of 4 ADIMono8 pixels into 32-bit lanes
+	inline void splitMono8(__m128i px, __m128i& dolp, __m128i& intensity)
+	{
+		const __m128i byteMask = _mm_set1_epi32(0xFF);
+
+		dolp = _mm_and_si128(_mm_srli_epi32(px, 8), byteMask);
+		intensity = _mm_and_si128(_mm_srli_epi32(px, 16), byteMask);
+	}
+
+	// BGRa8 pixels showing the intensity of 4 ADIMono8 pixels
+	inline __m128i grayMono8(__m128i px)
+	{
+		const __m128i grayShuffle = _mm_setr_epi8(2, 2, 2, -1, 6, 6, 6, -1, 10, 10, 10, -1, 14, 14, 14, -1);
+
+		return _mm_or_si128(_mm_shuffle_epi8(px, grayShuffle), _mm_set1_epi32(AlphaMask));
+	}
+
+	// Converts 4 ADIMono8 pixels
+	inline __m128i thresholdMono8(__m128i px, __m128i dolpThreshold, __m128i intensityThreshold)
+	{
+		__m128i dolp, intensity;
+		splitMono8(px, dolp, intensity);
+		__m128i mask = _mm_and_si128(_mm_cmpgt_epi32(dolp, dolpThreshold), _mm_cmpgt_epi32(intensity, intensityThreshold));
+
+		return markPixels(grayMono8(px), mask);
+	}
+
+	void thresholdADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params)
+	{
+		const __m128i dolpThreshold = _mm_set1_epi32(params.dolp);
+		const __m128i intensityThreshold = _mm_set1_epi32(params.intensity);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto dstLine = dst + y * dstPitch;
+
+			int x = 0;
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcLine + x * 4));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dstLine + x * 4), thresholdMono8(px, dolpThreshold, intensityThreshold));
+			}
+
+			// Remaining pixels are loaded one at a time to not read past the end of the line
+			for (; x < width; ++x)
+			{
+				int value;
+				std::memcpy(&value, srcLine + x * 4, 4);
+				__m128i px = _mm_cvtsi32_si128(value);
+				int result = _mm_cvtsi128_si32(thresholdMono8(px, dolpThreshold, intensityThreshold));
+				std::memcpy(dstLine + x * 4, &result, 4);
+			}
+		}
+	}
+
+	// Combines the DoLP and intensity channels of the two pixels in v as selected by R, without normalizing.
+	// Returns DoLP0, Intensity0, DoLP1, Intensity1 in the 32-bit lanes.
+	template<dolp::ChannelReduction R>
+	__m128i reduceRGB8(__m128i v);
+
+	// Multiplies the channels by 8-bit weights and adds the products of each pixel's DoLP and intensity channels
+	inline __m128i weightedSumsRGB8(__m128i v, __m128i weights)
+	{
+		return _mm_madd_epi16(_mm_maddubs_epi16(v, weights), _mm_set1_epi16(1));
+	}
+
+	template<>
+	inline __m128i reduceRGB8<dolp::ChannelReduction::Average>(__m128i v)
+	{
+		return weightedSumsRGB8(v, _mm_setr_epi8(0, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0));
+	}
+
+	template<>
+	inline __m128i reduceRGB8<dolp::ChannelReduction::Luminance>(__m128i v)
+	{
+		const char r = dolp::LuminanceWeightRed;
+		const char g = dolp::LuminanceWeightGreen;
+		const char b = dolp::LuminanceWeightBlue;
+		return weightedSumsRGB8(v, _mm_setr_epi8(0, r, g, b, r, g, b, 0, 0, r, g, b, r, g, b, 0));
+	}
+
+	template<>
+	inline __m128i reduceRGB8<dolp::ChannelReduction::Maximum>(__m128i v)
+	{
+		// Bytes 1 and 4 of each pixel become the maximum of the DoLP and intensity channels
+		__m128i m = _mm_max_epu8(v, _mm_max_epu8(_mm_srli_epi64(v, 8), _mm_srli_epi64(v, 16)));
+		return _mm_shuffle_epi8(m, _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 9, -1, -1, -1, 12, -1, -1, -1));
+	}
+
+	// Combines the DoLP and intensity channels of 4 ADIRGB8 pixels, 2 in each vector, into 32-bit lanes
+	template<dolp::ChannelReduction R>
+	inline void splitRGB8(__m128i v0, __m128i v1, __m128i& dolp, __m128i& intensity)
+	{
+		__m128 r0 = _mm_castsi128_ps(reduceRGB8<R>(v0));
+		__m128 r1 = _mm_castsi128_ps(reduceRGB8<R>(v1));
+
+		dolp = _mm_castps_si128(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0)));
+		intensity = _mm_castps_si128(_mm_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	// BGRa8 pixels showing the intensity channels of 4 ADIRGB8 pixels
+	inline __m128i grayRGB8(__m128i v0, __m128i v1)
+	{
+		const __m128i grayShuffle = _mm_setr_epi8(6, 5, 4, -1, 14, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+		__m128i gray = _mm_unpacklo_epi64(_mm_shuffle_epi8(v0, grayShuffle), _mm_shuffle_epi8(v1, grayShuffle));
+		return _mm_or_si128(gray, _mm_set1_epi32(AlphaMask));
+	}
+
+	// Converts 4 ADIRGB8 pixels, 2 in each vector
+	template<dolp::ChannelReduction R>
+	inline __m128i thresholdRGB8(__m128i v0, __m128i v1, __m128i dolpThreshold, __m128i intensityThreshold)
+	{
+		__m128i dolp, intensity;
+		splitRGB8<R>(v0, v1, dolp, intensity);
+		__m128i mask = _mm_and_si128(_mm_cmpgt_epi32(dolp, dolpThreshold), _mm_cmpgt_epi32(intensity, intensityThreshold));
+
+		return markPixels(grayRGB8(v0, v1), mask);
+	}
+
+	template<dolp::ChannelReduction R>
+	void thresholdADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ReducedThresholds& thresholds)
+	{
+		const __m128i dolpThreshold = _mm_set1_epi32(thresholds.dolp);
+		const __m128i intensityThreshold = _mm_set1_epi32(thresholds.intensity);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto dstLine = dst + y * dstPitch;
+
+			int x = 0;
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcLine + x * 8));
+				__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcLine + x * 8 + 16));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dstLine + x * 4), thresholdRGB8<R>(v0, v1, dolpThreshold, intensityThreshold));
+			}
+
+			for (; x < width; ++x)
+			{
+				__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcLine + x * 8));
+				int result = _mm_cvtsi128_si32(thresholdRGB8<R>(v, v, dolpThreshold, intensityThreshold));
+				std::memcpy(dstLine + x * 4, &result, 4);
+			}
+		}
+	}
+
+	void thresholdADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params)
+	{
+		auto thresholds = dolp::reducedThresholds(params);
+
+		switch (params.reduction)
+		{
+		case dolp::ChannelReduction::Maximum:
+			thresholdADIRGB8<dolp::ChannelReduction::Maximum>(src, srcPitch, dst, dstPitch, width, height, thresholds);
+			break;
+		case dolp::ChannelReduction::Luminance:
+			thresholdADIRGB8<dolp::ChannelReduction::Luminance>(src, srcPitch, dst, dstPitch, width, height, thresholds);
+			break;
+		case dolp::ChannelReduction::Average:
+		default:
+			thresholdADIRGB8<dolp::ChannelReduction::Average>(src, srcPitch, dst, dstPitch, width, height, thresholds);
+			break;
+		}
+	}
+
+	// Constants of the temporal filter in all 32-bit lanes
+	struct FilterVectors
+	{
+		__m128i dolpThreshold;	// Normalized, compared against the DoLP average
+		__m128i averageShift;	// Shift count in the low 64 bits
+		__m128i averageRound;	// 2^averageShift - 1, added to increasing steps
+		__m128i voteMask;		// One bit for each of the last voteFrames frames
+		__m128i voteRequired;	// voteRequired - 1, for _mm_cmpgt_epi32
+	};
+
+	inline FilterVectors filterVectors(const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		FilterVectors f;
+		f.dolpThreshold = _mm_set1_epi32(params.dolp);
+		f.averageShift = _mm_cvtsi32_si128(filter.averageShift);
+		f.averageRound = _mm_set1_epi32((1 << filter.averageShift) - 1);
+		f.voteMask = _mm_set1_epi32((1 << filter.voteFrames) - 1);
+		f.voteRequired = _mm_set1_epi32(filter.voteRequired - 1);
+		return f;
+	}
+
+	// Loads the filter state of 4 pixels into 32-bit lanes
+	inline __m128i loadState4(const uint8_t* state)
+	{
+		int value;
+		std::memcpy(&value, state, 4);
+		return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(value));
+	}
+
+	inline void storeState4(uint8_t* state, __m128i s)
+	{
+		__m128i packed = _mm_packus_epi16(_mm_packus_epi32(s, s), s);
+		int value = _mm_cvtsi128_si32(packed);
+		std::memcpy(state, &value, 4);
+	}
+
+	// Counts the set bits of 32-bit lanes holding values up to 255
+	inline __m128i countBits8(__m128i v)
+	{
+		const __m128i nibbleCounts = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+
+		__m128i low = _mm_shuffle_epi8(nibbleCounts, _mm_and_si128(v, _mm_set1_epi32(0x0F)));
+		__m128i high = _mm_shuffle_epi8(nibbleCounts, _mm_srli_epi32(v, 4));
+		return _mm_add_epi32(low, high);
+	}
+
+	// Updates the filter state of 4 pixels and returns the mask of the pixels to mark.
+	// dolp is the normalized DoLP, dolpAbove and intensityAbove are the threshold results of the current frame.
+	template<dolp::TemporalFilterMode F>
+	__m128i updateFilterState(__m128i& state, __m128i dolp, __m128i dolpAbove, __m128i intensityAbove, const FilterVectors& f);
+
+	template<>
+	inline __m128i updateFilterState<dolp::TemporalFilterMode::DoLPAverage>(__m128i& state, __m128i dolp, __m128i /* dolpAbove */, __m128i intensityAbove, const FilterVectors& f)
+	{
+		// Increasing steps are rounded up, decreasing steps are rounded down by the arithmetic shift
+		__m128i diff = _mm_sub_epi32(dolp, state);
+		__m128i round = _mm_and_si128(_mm_cmpgt_epi32(diff, _mm_setzero_si128()), f.averageRound);
+		state = _mm_add_epi32(state, _mm_sra_epi32(_mm_add_epi32(diff, round), f.averageShift));
+
+		return _mm_and_si128(_mm_cmpgt_epi32(state, f.dolpThreshold), intensityAbove);
+	}
+
+	template<>
+	inline __m128i updateFilterState<dolp::TemporalFilterMode::Vote>(__m128i& state, __m128i /* dolp */, __m128i dolpAbove, __m128i intensityAbove, const FilterVectors& f)
+	{
+		__m128i vote = _mm_srli_epi32(_mm_and_si128(dolpAbove, intensityAbove), 31);
+		state = _mm_and_si128(_mm_or_si128(_mm_slli_epi32(state, 1), vote), f.voteMask);
+
+		return _mm_cmpgt_epi32(countBits8(state), f.voteRequired);
+	}
+
+	// Converts 4 ADIMono8 pixels and updates their filter state
+	template<dolp::TemporalFilterMode F>
+	inline __m128i filterMono8(__m128i px, __m128i& state, __m128i dolpThreshold, __m128i intensityThreshold, const FilterVectors& f)
+	{
+		__m128i dolp, intensity;
+		splitMono8(px, dolp, intensity);
+		__m128i mask = updateFilterState<F>(state, dolp, _mm_cmpgt_epi32(dolp, dolpThreshold), _mm_cmpgt_epi32(intensity, intensityThreshold), f);
+
+		return markPixels(grayMono8(px), mask);
+	}
+
+	template<dolp::TemporalFilterMode F>
+	void filterADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		const __m128i dolpThreshold = _mm_set1_epi32(params.dolp);
+		const __m128i intensityThreshold = _mm_set1_epi32(params.intensity);
+		const FilterVectors f = filterVectors(params, filter);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto stateLine = state + y * statePitch;
+			auto dstLine = dst ? dst + y * dstPitch : nullptr;
+
+			int x = 0;
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcLine + x * 4));
+				__m128i s = loadState4(stateLine + x);
+				__m128i result = filterMono8<F>(px, s, dolpThreshold, intensityThreshold, f);
+				storeState4(stateLine + x, s);
+
+				if (dstLine)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dstLine + x * 4), result);
+			}
+
+			for (; x < width; ++x)
+			{
+				int value;
+				std::memcpy(&value, srcLine + x * 4, 4);
+				__m128i px = _mm_cvtsi32_si128(value);
+				__m128i s = _mm_cvtsi32_si128(stateLine[x]);
+				int result = _mm_cvtsi128_si32(filterMono8<F>(px, s, dolpThreshold, intensityThreshold, f));
+				stateLine[x] = static_cast<uint8_t>(_mm_cvtsi128_si32(s));
+
+				if (dstLine)
+					std::memcpy(dstLine + x * 4, &result, 4);
+			}
+		}
+	}
+
+	void filterADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params, dolp::TemporalFilterParams filter)
+	{
+		switch (filter.mode)
+		{
+		case dolp::TemporalFilterMode::DoLPAverage:
+			filterADIMono8<dolp::TemporalFilterMode::DoLPAverage>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::TemporalFilterMode::Vote:
+			filterADIMono8<dolp::TemporalFilterMode::Vote>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::TemporalFilterMode::Off:
+		default:
+			if (dst)
+				thresholdADIMono8(src, srcPitch, dst, dstPitch, width, height, params);
+			break;
+		}
+	}
+
+	// Normalizes the channel combinations of reduceRGB8 to [0, 255]
+	template<dolp::ChannelReduction R>
+	inline __m128i normalizeRGB8(__m128i v)
+	{
+		switch (R)
+		{
+		case dolp::ChannelReduction::Maximum:
+			return v;
+		case dolp::ChannelReduction::Luminance:
+			return _mm_srli_epi32(v, 7);	// LuminanceWeightSum
+		case dolp::ChannelReduction::Average:
+		default:
+			return _mm_mulhi_epu16(v, _mm_set1_epi32(21846));	// x / 3 == (x * 21846) >> 16 for x up to 765
+		}
+	}
+
+	// Converts 4 ADIRGB8 pixels, 2 in each vector, and updates their filter state
+	template<dolp::ChannelReduction R, dolp::TemporalFilterMode F>
+	inline __m128i filterRGB8(__m128i v0, __m128i v1, __m128i& state, __m128i dolpThreshold, __m128i intensityThreshold, const FilterVectors& f)
+	{
+		__m128i dolp, intensity;
+		splitRGB8<R>(v0, v1, dolp, intensity);
+		__m128i mask = updateFilterState<F>(state, normalizeRGB8<R>(dolp), _mm_cmpgt_epi32(dolp, dolpThreshold), _mm_cmpgt_epi32(intensity, intensityThreshold), f);
+
+		return markPixels(grayRGB8(v0, v1), mask);
+	}
+
+	template<dolp::ChannelReduction R, dolp::TemporalFilterMode F>
+	void filterADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		auto thresholds = dolp::reducedThresholds(params);
+		const __m128i dolpThreshold = _mm_set1_epi32(thresholds.dolp);
+		const __m128i intensityThreshold = _mm_set1_epi32(thresholds.intensity);
+		const FilterVectors f = filterVectors(params, filter);
+
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto stateLine = state + y * statePitch;
+			auto dstLine = dst ? dst + y * dstPitch : nullptr;
+
+			int x = 0;
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcLine + x * 8));
+				__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcLine + x * 8 + 16));
+				__m128i s = loadState4(stateLine + x);
+				__m128i result = filterRGB8<R, F>(v0, v1, s, dolpThreshold, intensityThreshold, f);
+				storeState4(stateLine + x, s);
+
+				if (dstLine)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dstLine + x * 4), result);
+			}
+
+			for (; x < width; ++x)
+			{
+				__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(srcLine + x * 8));
+				__m128i s = _mm_cvtsi32_si128(stateLine[x]);
+				int result = _mm_cvtsi128_si32(filterRGB8<R, F>(v, v, s, dolpThreshold, intensityThreshold, f));
+				stateLine[x] = static_cast<uint8_t>(_mm_cvtsi128_si32(s));
+
+				if (dstLine)
+					std::memcpy(dstLine + x * 4, &result, 4);
+			}
+		}
+	}
+
+	template<dolp::ChannelReduction R>
+	void filterADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const dolp::ThresholdParams& params, const dolp::TemporalFilterParams& filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Vote)
+			filterADIRGB8<R, dolp::TemporalFilterMode::Vote>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+		else
+			filterADIRGB8<R, dolp::TemporalFilterMode::DoLPAverage>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+	}
+
+	void filterADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* state, ptrdiff_t statePitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, dolp::ThresholdParams params, dolp::TemporalFilterParams filter)
+	{
+		if (filter.mode == dolp::TemporalFilterMode::Off)
+		{
+			if (dst)
+				thresholdADIRGB8(src, srcPitch, dst, dstPitch, width, height, params);
+			return;
+		}
+
+		switch (params.reduction)
+		{
+		case dolp::ChannelReduction::Maximum:
+			filterADIRGB8<dolp::ChannelReduction::Maximum>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::ChannelReduction::Luminance:
+			filterADIRGB8<dolp::ChannelReduction::Luminance>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		case dolp::ChannelReduction::Average:
+		default:
+			filterADIRGB8<dolp::ChannelReduction::Average>(src, srcPitch, state, statePitch, dst, dstPitch, width, height, params, filter);
+			break;
+		}
+	}
+}
+
+namespace dolp::detail
+{
+	const ThresholdKernels sse41Kernels = { "SSE4.1", thresholdADIMono8, thresholdADIRGB8, filterADIMono8, filterADIRGB8 };
+}
+
+#endif
@@ -0,0 +1,307 @@
+
+#include "regions.h"
+#include "drawing.h"
+
+#include <algorithm>
+#include <locale>
+#include <sstream>
+#include <type_traits>
+
+namespace
+{
+	// The deadline is checked after this many rows, reading the clock for every row would cost more than the labeling of sparse rows
+	const int DeadlineCheckRows = 16;
+
+	const uint32_t BoxColor = 0xFF00FF00u;
+	const uint32_t CentroidColor = 0xFFFFFF00u;
+	const int CentroidSize = 4;
+}
+
+namespace dolp
+{
+	std::string toJsonLine(const RegionList& list)
+	{
+		// Use the classic locale, so that the decimal separator is always a point
+		std::ostringstream out;
+		out.imbue(std::locale::classic());
+		out.setf(std::ios::fixed);
+		out.precision(2);
+
+		out << "{\"frame_number\":" << list.frame_number
+			<< ",\"timestamp_ns\":" << list.timestamp_ns
+			<< ",\"complete\":" << (list.complete ? "true" : "false")
+			<< ",\"rows_processed\":" << list.rows_processed
+			<< ",\"processing_time_ms\":" << list.processing_time_ms
+			<< ",\"regions\":[";
+
+		for (size_t i = 0; i < list.regions.size(); ++i)
+		{
+			const auto& r = list.regions[i];
+			if (i > 0)
+				out << ',';
+
+			out << "{\"x\":" << r.x << ",\"y\":" << r.y << ",\"width\":" << r.width << ",\"height\":" << r.height
+				<< ",\"area\":" << r.area << ",\"centroid_x\":" << r.centroid_x << ",\"centroid_y\":" << r.centroid_y << '}';
+		}
+
+		out << "]}";
+		return out.str();
+	}
+
+	void drawRegions(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const RegionList& list)
+	{
+		for (const auto& r : list.regions)
+		{
+			drawRectangle(dst, dstPitch, width, height, r.x, r.y, r.width, r.height, BoxColor);
+			drawCross(dst, dstPitch, width, height, static_cast<int>(r.centroid_x + 0.5), static_cast<int>(r.centroid_y + 0.5), CentroidSize, CentroidColor);
+		}
+	}
+
+	RegionLabeler::RegionLabeler(uint64_t minArea)
+		: _min_area(minArea)
+	{
+	}
+
+	void RegionLabeler::setMinArea(uint64_t minArea)
+	{
+		_min_area = minArea;
+	}
+
+	uint64_t RegionLabeler::minArea() const
+	{
+		return _min_area;
+	}
+
+	void RegionLabeler::labelADIMono8(const uint8_t* src, ptrdiff_t srcPitch, const RoiLayout& layout, ThresholdParams params, clock::time_point deadline, RegionList& result)
+	{
+		int dolpThreshold = params.dolp;
+		int intensityThreshold = params.intensity;
+
+		auto isPolarized = [=](int x, int y)
+		{
+			auto p = src + y * srcPitch + x * 4;
+			return p[1] > dolpThreshold && p[2] > intensityThreshold;
+		};
+		label(layout, isPolarized, deadline, result);
+	}
+
+	void RegionLabeler::labelADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, const RoiLayout& layout, ThresholdParams params, clock::time_point deadline, RegionList& result)
+	{
+		auto thresholds = reducedThresholds(params);
+
+		withReduction(params.reduction, [&](auto reduction)
+		{
+			constexpr ChannelReduction R = decltype(reduction)::value;
+
+			auto isPolarized = [=](int x, int y)
+			{
+				auto p = src + y * srcPitch + x * 8;
+				return reduceChannels<R>(p[1], p[2], p[3]) > thresholds.dolp && reduceChannels<R>(p[4], p[5], p[6]) > thresholds.intensity;
+			};
+			label(layout, isPolarized, deadline, result);
+		});
+	}
+
+	void RegionLabeler::labelFilteredADIMono8(const uint8_t* src, ptrdiff_t srcPitch, const uint8_t* state, ptrdiff_t statePitch, const RoiLayout& layout, ThresholdParams params, TemporalFilterParams filter, clock::time_point deadline, RegionList& result)
+	{
+		if (filter.mode == TemporalFilterMode::Off)
+		{
+			labelADIMono8(src, srcPitch, layout, params, deadline, result);
+			return;
+		}
+
+		auto isPolarized = [=](int x, int y)
+		{
+			auto p = src + y * srcPitch + x * 4;
+			return isMarkedByFilter(state[y * statePitch + x], p[2] > params.intensity, params.dolp, filter);
+		};
+		label(layout, isPolarized, deadline, result);
+	}
+
+	void RegionLabeler::labelFilteredADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, const uint8_t* state, ptrdiff_t statePitch, const RoiLayout& layout, ThresholdParams params, TemporalFilterParams filter, clock::time_point deadline, RegionList& result)
+	{
+		if (filter.mode == TemporalFilterMode::Off)
+		{
+			labelADIRGB8(src, srcPitch, layout, params, deadline, result);
+			return;
+		}
+
+		auto thresholds = reducedThresholds(params);
+
+		withReduction(params.reduction, [&](auto reduction)
+		{
+			constexpr ChannelReduction R = decltype(reduction)::value;
+
+			auto isPolarized = [=](int x, int y)
+			{
+				auto p = src + y * srcPitch + x * 8;
+				bool intensityAbove = reduceChannels<R>(p[4], p[5], p[6]) > thresholds.intensity;
+				return isMarkedByFilter(state[y * statePitch + x], intensityAbove, params.dolp, filter);
+			};
+			label(layout, isPolarized, deadline, result);
+		});
+	}
+
+	template<typename Func>
+	void RegionLabeler::withReduction(ChannelReduction reduction, Func func)
+	{
+		// Calls func with the reduction as a compile-time constant, so that the pixel tests are specialized
+		switch (reduction)
+		{
+		case ChannelReduction::Maximum:
+			func(std::integral_constant<ChannelReduction, ChannelReduction::Maximum>());
+			break;
+		case ChannelReduction::Luminance:
+			func(std::integral_constant<ChannelReduction, ChannelReduction::Luminance>());
+			break;
+		case ChannelReduction::Average:
+		default:
+			func(std::integral_constant<ChannelReduction, ChannelReduction::Average>());
+			break;
+		}
+	}
+
+	template<typename IsPolarized>
+	void RegionLabeler::label(const RoiLayout& layout, IsPolarized isPolarized, clock::time_point deadline, RegionList& result)
+	{
+		auto start = clock::now();
+
+		_runs.clear();
+		_parent.clear();
+		result.complete = true;
+
+		// Runs of the previous row are [prev_begin, prev_end)
+		size_t prev_begin = 0;
+		size_t prev_end = 0;
+
+		const auto& stripes = layout.stripes();
+		size_t stripe = 0;
+
+		int y = 0;
+		for (; y < layout.height(); ++y)
+		{
+			if (y % DeadlineCheckRows == 0 && clock::now() > deadline)
+			{
+				result.complete = false;
+				break;
+			}
+
+			while (stripe < stripes.size() && stripes[stripe].y1 <= y)
+				++stripe;
+			if (stripe == stripes.size())
+				break;
+
+			size_t row_begin = _runs.size();
+			size_t prev = prev_begin;
+
+			// Runs can not cross the borders of the merged inside segments, so each segment is scanned on its own
+			for (const auto& seg : stripes[stripe].segments)
+			{
+				if (!seg.inside)
+					continue;
+
+				int x = seg.x0;
+				while (x < seg.x1)
+				{
+					while (x < seg.x1 && !isPolarized(x, y))
+						++x;
+					if (x == seg.x1)
+						break;
+
+					int x0 = x;
+					while (x < seg.x1 && isPolarized(x, y))
+						++x;
+
+					int run = static_cast<int>(_runs.size());
+					_runs.push_back({ x0, x, y });
+					_parent.push_back(run);
+
+					// Skip runs of the previous row that end left of this run, including the diagonal neighbor
+					while (prev < prev_end && _runs[prev].x1 < x0)
+						++prev;
+
+					// Merge with all touching runs. The last one may also touch the next run of this row, so prev is not advanced past it.
+					for (size_t p = prev; p < prev_end && _runs[p].x0 <= x; ++p)
+						unite(static_cast<int>(p), run);
+				}
+			}
+
+			prev_begin = row_begin;
+			prev_end = _runs.size();
+		}
+
+		result.rows_processed = y;
+		collectRegions(result);
+		result.processing_time_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	}
+
+	int RegionLabeler::findRoot(int run)
+	{
+		// Path halving
+		while (_parent[run] != run)
+		{
+			_parent[run] = _parent[_parent[run]];
+			run = _parent[run];
+		}
+		return run;
+	}
+
+	void RegionLabeler::unite(int a, int b)
+	{
+		int ra = findRoot(a);
+		int rb = findRoot(b);
+
+		// The root is always the first run of the region
+		if (ra < rb)
+			_parent[rb] = ra;
+		else if (rb < ra)
+			_parent[ra] = rb;
+	}
+
+	void RegionLabeler::collectRegions(RegionList& result)
+	{
+		result.regions.clear();
+		_accumulators.clear();
+		_region_index.assign(_runs.size(), -1);
+
+		for (int i = 0; i < static_cast<int>(_runs.size()); ++i)
+		{
+			const auto& run = _runs[i];
+			int root = findRoot(i);
+
+			// Roots are visited before the other runs of their region
+			if (root == i)
+			{
+				_region_index[i] = static_cast<int>(_accumulators.size());
+				_accumulators.push_back({ run.x0, run.y, run.x1 - 1, run.y, 0, 0, 0 });
+			}
+
+			auto& acc = _accumulators[_region_index[root]];
+			uint64_t length = run.x1 - run.x0;
+
+			acc.left = (std::min)(acc.left, run.x0);
+			acc.right = (std::max)(acc.right, run.x1 - 1);
+			acc.bottom = run.y;
+			acc.area += length;
+			// Sum of x0 .. x1-1, always an integer
+			acc.sum_x += length * static_cast<uint64_t>(run.x0 + run.x1 - 1) / 2;
+			acc.sum_y += length * static_cast<uint64_t>(run.y);
+		}
+
+		for (const auto& acc : _accumulators)
+		{
+			if (acc.area < _min_area)
+				continue;
+
+			Region r;
+			r.x = acc.left;
+			r.y = acc.top;
+			r.width = acc.right - acc.left + 1;
+			r.height = acc.bottom - acc.top + 1;
+			r.area = acc.area;
+			r.centroid_x = static_cast<double>(acc.sum_x) / acc.area;
+			r.centroid_y = static_cast<double>(acc.sum_y) / acc.area;
+			result.regions.push_back(r);
+		}
+	}
+}
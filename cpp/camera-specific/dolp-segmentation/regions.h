@@ -0,0 +1,135 @@
+#pragma once
+
+#include "polarizationkernels.h"
+#include "roi.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dolp
+{
+	/// <summary>
+	/// A connected area of polarized pixels
+	/// </summary>
+	struct Region
+	{
+		// Bounding box
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+
+		// Number of pixels
+		uint64_t area = 0;
+
+		double centroid_x = 0;
+		double centroid_y = 0;
+	};
+
+	/// <summary>
+	/// The regions found in a frame
+	/// </summary>
+	struct RegionList
+	{
+		uint64_t frame_number = 0;
+		uint64_t timestamp_ns = 0;
+
+		std::vector<Region> regions;
+
+		// false if the time budget ran out. The regions then only cover the first rows_processed rows.
+		bool complete = true;
+		int rows_processed = 0;
+
+		double processing_time_ms = 0;
+	};
+
+	/// <summary>
+	/// Formats a region list as a single line of JSON, without a line break
+	/// </summary>
+	std::string toJsonLine(const RegionList& list);
+
+	/// <summary>
+	/// Draws the bounding boxes and centroids of the regions into a BGRa8 image
+	/// </summary>
+	void drawRegions(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const RegionList& list);
+
+	/// <summary>
+	/// Finds the connected areas of polarized pixels in a polarized ADI image.
+	/// </summary>
+	/// <remarks>
+	/// A pixel is polarized if it is above the thresholds, or marked by the temporal filter, exactly as in the threshold kernels.
+	/// Each row is converted into runs of polarized pixels, and runs that touch a run of the previous row,
+	/// including diagonally, are merged with a union-find structure. The runs are then accumulated into regions.
+	///
+	/// The internal buffers are reused between frames, so a labeler should only be used by one thread.
+	/// </remarks>
+	class RegionLabeler
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		/// <summary>
+		/// Creates a labeler
+		/// </summary>
+		/// <param name="minArea">Smaller regions are not reported, to suppress noise</param>
+		explicit RegionLabeler(uint64_t minArea = 16);
+
+		void setMinArea(uint64_t minArea);
+		uint64_t minArea() const;
+
+		/// <summary>
+		/// Labels the parts of an image inside the regions of interest, the size of the image is taken from the layout.
+		/// If the deadline passes, labeling stops and the result is marked incomplete.
+		/// </summary>
+		void labelADIMono8(const uint8_t* src, ptrdiff_t srcPitch, const RoiLayout& layout, ThresholdParams params, clock::time_point deadline, RegionList& result);
+		void labelADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, const RoiLayout& layout, ThresholdParams params, clock::time_point deadline, RegionList& result);
+
+		/// <summary>
+		/// Labels the pixels marked by the temporal filter instead of the pixels above the thresholds.
+		/// The filter state has to be updated for the current frame by the filtered threshold kernels first, it is only read here.
+		/// </summary>
+		void labelFilteredADIMono8(const uint8_t* src, ptrdiff_t srcPitch, const uint8_t* state, ptrdiff_t statePitch, const RoiLayout& layout, ThresholdParams params, TemporalFilterParams filter, clock::time_point deadline, RegionList& result);
+		void labelFilteredADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, const uint8_t* state, ptrdiff_t statePitch, const RoiLayout& layout, ThresholdParams params, TemporalFilterParams filter, clock::time_point deadline, RegionList& result);
+
+	private:
+		struct Run
+		{
+			int x0;
+			int x1;		// One past the last pixel
+			int y;
+		};
+
+		struct Accumulator
+		{
+			int left;
+			int top;
+			int right;
+			int bottom;
+			uint64_t area;
+			uint64_t sum_x;
+			uint64_t sum_y;
+		};
+
+		// isPolarized(x, y) returns whether the pixel at x, y belongs to a region
+		template<typename IsPolarized>
+		void label(const RoiLayout& layout, IsPolarized isPolarized, clock::time_point deadline, RegionList& result);
+
+		template<typename Func>
+		static void withReduction(ChannelReduction reduction, Func func);
+
+		int findRoot(int run);
+		void unite(int a, int b);
+		void collectRegions(RegionList& result);
+
+		uint64_t _min_area;
+
+		// Indexed by run, _parent holds the union-find forest
+		std::vector<Run> _runs;
+		std::vector<int> _parent;
+		std::vector<int> _region_index;
+		std::vector<Accumulator> _accumulators;
+	};
+}
@@ -0,0 +1,99 @@
+
+#include "roi.h"
+#include "drawing.h"
+
+#include <algorithm>
+
+namespace
+{
+	const uint32_t RoiColor = 0xFF00FFFFu;
+}
+
+namespace dolp
+{
+	bool clipRoi(Roi& roi, int width, int height)
+	{
+		int x0 = (std::max)(roi.x, 0);
+		int y0 = (std::max)(roi.y, 0);
+		int x1 = (std::min)(roi.x + roi.width, width);
+		int y1 = (std::min)(roi.y + roi.height, height);
+
+		if (x0 >= x1 || y0 >= y1)
+			return false;
+
+		roi = { x0, y0, x1 - x0, y1 - y0 };
+		return true;
+	}
+
+	RoiLayout::RoiLayout(const std::vector<Roi>& rois, int width, int height)
+		: _width(width)
+		, _height(height)
+	{
+		std::vector<Roi> clipped;
+		for (auto roi : rois)
+		{
+			if (clipRoi(roi, width, height))
+				clipped.push_back(roi);
+		}
+
+		if (clipped.empty())
+		{
+			if (width > 0 && height > 0)
+				_stripes.push_back({ 0, height, { { 0, width, true } } });
+			return;
+		}
+
+		// The set of ROIs covering a row only changes at the top and bottom edges of the ROIs
+		std::vector<int> edges = { 0, height };
+		for (const auto& roi : clipped)
+		{
+			edges.push_back(roi.y);
+			edges.push_back(roi.y + roi.height);
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		std::vector<std::pair<int, int>> columns;
+		for (size_t i = 0; i + 1 < edges.size(); ++i)
+		{
+			Stripe stripe = { edges[i], edges[i + 1], {} };
+
+			columns.clear();
+			for (const auto& roi : clipped)
+			{
+				if (roi.y <= stripe.y0 && roi.y + roi.height >= stripe.y1)
+					columns.emplace_back(roi.x, roi.x + roi.width);
+			}
+			std::sort(columns.begin(), columns.end());
+
+			// Merge overlapping and adjacent column ranges, and fill the gaps with outside segments
+			int x = 0;
+			for (const auto& [x0, x1] : columns)
+			{
+				if (!stripe.segments.empty() && stripe.segments.back().inside && x0 <= stripe.segments.back().x1)
+				{
+					stripe.segments.back().x1 = (std::max)(stripe.segments.back().x1, x1);
+					x = stripe.segments.back().x1;
+					continue;
+				}
+
+				if (x0 > x)
+					stripe.segments.push_back({ x, x0, false });
+				stripe.segments.push_back({ x0, x1, true });
+				x = x1;
+			}
+			if (x < width)
+				stripe.segments.push_back({ x, width, false });
+
+			_stripes.push_back(std::move(stripe));
+		}
+	}
+
+	void drawRois(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const std::vector<Roi>& rois)
+	{
+		for (const auto& roi : rois)
+		{
+			drawRectangle(dst, dstPitch, width, height, roi.x, roi.y, roi.width, roi.height, RoiColor);
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dolp
+{
+	/// <summary>
+	/// A rectangular region of interest in image coordinates
+	/// </summary>
+	struct Roi
+	{
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+	};
+
+	/// <summary>
+	/// Divides an image into rectangles inside and outside of a set of ROIs.
+	/// </summary>
+	/// <remarks>
+	/// The image is split into horizontal stripes, in which the same columns are inside of a ROI.
+	/// Each stripe is split into segments of columns that are either inside or outside of the ROIs.
+	/// Overlapping ROIs are merged, so that every pixel belongs to exactly one rectangle.
+	/// If there are no ROIs, the whole image is one rectangle inside.
+	/// </remarks>
+	class RoiLayout
+	{
+	public:
+		struct Segment
+		{
+			int x0;
+			int x1;		// One past the last column
+			bool inside;
+		};
+
+		struct Stripe
+		{
+			int y0;
+			int y1;		// One past the last row
+			std::vector<Segment> segments;
+		};
+
+		RoiLayout() = default;
+		RoiLayout(const std::vector<Roi>& rois, int width, int height);
+
+		int width() const { return _width; }
+		int height() const { return _height; }
+		const std::vector<Stripe>& stripes() const { return _stripes; }
+
+		/// <summary>
+		/// Calls func(x, y, width, height, inside) for every rectangle covering the rows [firstRow, endRow)
+		/// </summary>
+		template<typename Func>
+		void forEachRect(int firstRow, int endRow, Func&& func) const
+		{
+			for (const auto& stripe : _stripes)
+			{
+				int y0 = stripe.y0 > firstRow ? stripe.y0 : firstRow;
+				int y1 = stripe.y1 < endRow ? stripe.y1 : endRow;
+				if (y0 >= y1)
+					continue;
+
+				for (const auto& seg : stripe.segments)
+					func(seg.x0, y0, seg.x1 - seg.x0, y1 - y0, seg.inside);
+			}
+		}
+
+	private:
+		int _width = 0;
+		int _height = 0;
+		std::vector<Stripe> _stripes;
+	};
+
+	/// <summary>
+	/// Clips a ROI to the image
+	/// </summary>
+	/// <returns>false if no part of the ROI is inside the image</returns>
+	bool clipRoi(Roi& roi, int width, int height);
+
+	/// <summary>
+	/// Draws the outlines of the ROIs into a BGRa8 image
+	/// </summary>
+	void drawRois(uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const std::vector<Roi>& rois);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace dolp
+{
+	/// <summary>
+	/// Holds a value that is written by one thread and read by other threads without locking.
+	/// </summary>
+	/// <remarks>
+	/// A reader retries if the value is modified while it is being copied, so it always receives a consistent value,
+	/// even if the value consists of multiple fields. Only one thread at a time may call store().
+	/// </remarks>
+	template<typename T>
+	class SeqLock
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "SeqLock requires a trivially copyable type");
+
+	public:
+		explicit SeqLock(const T& value = T{})
+		{
+			store(value);
+		}
+
+		SeqLock(const SeqLock&) = delete;
+		SeqLock& operator=(const SeqLock&) = delete;
+
+		void store(const T& value)
+		{
+			uint32_t words[NumWords] = {};
+			std::memcpy(words, &value, sizeof(T));
+
+			// An odd sequence number marks the value as being modified
+			auto seq = _seq.load(std::memory_order_relaxed);
+			_seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			for (size_t i = 0; i < NumWords; ++i)
+				_data[i].store(words[i], std::memory_order_relaxed);
+
+			_seq.store(seq + 2, std::memory_order_release);
+		}
+
+		T load() const
+		{
+			uint32_t words[NumWords];
+
+			while (true)
+			{
+				auto seq = _seq.load(std::memory_order_acquire);
+				if (seq & 1)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				for (size_t i = 0; i < NumWords; ++i)
+					words[i] = _data[i].load(std::memory_order_relaxed);
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (_seq.load(std::memory_order_relaxed) == seq)
+					break;
+			}
+
+			T value;
+			std::memcpy(&value, words, sizeof(T));
+			return value;
+		}
+
+	private:
+		static constexpr size_t NumWords = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+		std::atomic<uint32_t> _seq = 0;
+		std::atomic<uint32_t> _data[NumWords];
+	};
+}
@@ -0,0 +1,202 @@
+
+#include "visualization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+	const uint32_t AlphaMask = 0xFF000000u;
+
+	uint32_t makeBGRa(int red, int green, int blue)
+	{
+		return AlphaMask | (static_cast<uint32_t>(red) << 16) | (static_cast<uint32_t>(green) << 8) | static_cast<uint32_t>(blue);
+	}
+
+	uint32_t grayBGRa(int intensity)
+	{
+		return AlphaMask | (static_cast<uint32_t>(intensity) * 0x010101u);
+	}
+
+	// Converts a fully saturated color with hue in [0, 360) and value in [0, 1]
+	uint32_t hueToBGRa(double hue, double value)
+	{
+		double h = hue / 60.0;
+		double x = 1.0 - std::abs(std::fmod(h, 2.0) - 1.0);
+
+		double r = 0, g = 0, b = 0;
+		switch (static_cast<int>(h) % 6)
+		{
+		case 0: r = 1; g = x; break;
+		case 1: r = x; g = 1; break;
+		case 2: g = 1; b = x; break;
+		case 3: g = x; b = 1; break;
+		case 4: r = x; b = 1; break;
+		default: r = 1; b = x; break;
+		}
+
+		return makeBGRa(
+			static_cast<int>(std::lround(r * value * 255)),
+			static_cast<int>(std::lround(g * value * 255)),
+			static_cast<int>(std::lround(b * value * 255))
+		);
+	}
+
+	// Heat map from black over purple, red and orange to light yellow, t in [0, 1]
+	uint32_t heatMapBGRa(double t, double brightness)
+	{
+		static const int stops[][3] = {
+			{ 0, 0, 4 },
+			{ 87, 16, 110 },
+			{ 188, 55, 84 },
+			{ 249, 142, 9 },
+			{ 252, 255, 164 },
+		};
+		const int numSegments = static_cast<int>(std::size(stops)) - 1;
+
+		double pos = std::clamp(t, 0.0, 1.0) * numSegments;
+		int i = (std::min)(static_cast<int>(pos), numSegments - 1);
+		double f = pos - i;
+
+		int rgb[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			double v = stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f;
+			rgb[c] = static_cast<int>(std::lround(v * brightness));
+		}
+		return makeBGRa(rgb[0], rgb[1], rgb[2]);
+	}
+
+	// AoLP values [0, 255] cover the angles from 0 to 180 degrees, which is mapped to the full hue circle
+	double aolpToHue(int aolp)
+	{
+		return aolp * 360.0 / 256.0;
+	}
+
+	inline void storePixel(uint8_t* dst, uint32_t value)
+	{
+		std::memcpy(dst, &value, 4);
+	}
+
+	template<dolp::ColorLut::Index I>
+	inline uint32_t lookup(const uint32_t* lut, int dolpValue, int aolpValue)
+	{
+		if constexpr (I == dolp::ColorLut::Index::DoLP)
+			return lut[dolpValue];
+		else
+			return lut[(dolpValue << 8) | aolpValue];
+	}
+
+	template<dolp::ColorLut::Index I>
+	void applyADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const uint32_t* lut, int intensityThreshold)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto dstLine = dst + y * dstPitch;
+
+			for (int x = 0; x < width; x++)
+			{
+				auto p = srcLine + x * 4;
+				int intensity = p[2];
+				uint32_t color = intensity > intensityThreshold ? lookup<I>(lut, p[1], p[0]) : grayBGRa(intensity);
+				storePixel(dstLine + x * 4, color);
+			}
+		}
+	}
+
+	template<dolp::ColorLut::Index I, dolp::ChannelReduction R>
+	void applyADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const uint32_t* lut, int intensityThreshold)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			auto srcLine = src + y * srcPitch;
+			auto dstLine = dst + y * dstPitch;
+
+			for (int x = 0; x < width; x++)
+			{
+				auto p = srcLine + x * 8;
+				int intensity = dolp::normalizeChannels<R>(dolp::reduceChannels<R>(p[4], p[5], p[6]));
+				uint32_t color = intensity > intensityThreshold
+					? lookup<I>(lut, dolp::normalizeChannels<R>(dolp::reduceChannels<R>(p[1], p[2], p[3])), p[0])
+					: makeBGRa(p[4], p[5], p[6]);
+				storePixel(dstLine + x * 4, color);
+			}
+		}
+	}
+
+	template<dolp::ColorLut::Index I>
+	void applyADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const uint32_t* lut, dolp::ThresholdParams params)
+	{
+		switch (params.reduction)
+		{
+		case dolp::ChannelReduction::Maximum:
+			applyADIRGB8<I, dolp::ChannelReduction::Maximum>(src, srcPitch, dst, dstPitch, width, height, lut, params.intensity);
+			break;
+		case dolp::ChannelReduction::Luminance:
+			applyADIRGB8<I, dolp::ChannelReduction::Luminance>(src, srcPitch, dst, dstPitch, width, height, lut, params.intensity);
+			break;
+		case dolp::ChannelReduction::Average:
+		default:
+			applyADIRGB8<I, dolp::ChannelReduction::Average>(src, srcPitch, dst, dstPitch, width, height, lut, params.intensity);
+			break;
+		}
+	}
+}
+
+namespace dolp
+{
+	std::shared_ptr<const ColorLut> buildColorLut(VisualizationMode mode, const ThresholdParams& params)
+	{
+		auto lut = std::make_shared<ColorLut>();
+
+		switch (mode)
+		{
+		case VisualizationMode::DoLPHeatMap:
+			lut->index = ColorLut::Index::DoLP;
+			lut->entries.resize(256);
+			for (int dolp = 0; dolp < 256; ++dolp)
+			{
+				double brightness = dolp > params.dolp ? 1.0 : 1.0 / 3.0;
+				lut->entries[dolp] = heatMapBGRa(dolp / 255.0, brightness);
+			}
+			break;
+		case VisualizationMode::AoLPHue:
+		case VisualizationMode::AoLPDoLP:
+			lut->index = ColorLut::Index::DoLPAoLP;
+			lut->entries.resize(256 * 256);
+			for (int dolp = 0; dolp < 256; ++dolp)
+			{
+				double value = mode == VisualizationMode::AoLPDoLP ? dolp / 255.0 : 1.0;
+				for (int aolp = 0; aolp < 256; ++aolp)
+				{
+					lut->entries[(dolp << 8) | aolp] = dolp > params.dolp ? hueToBGRa(aolpToHue(aolp), value) : AlphaMask;
+				}
+			}
+			break;
+		case VisualizationMode::Threshold:
+		default:
+			return nullptr;
+		}
+
+		return lut;
+	}
+
+	void applyColorLutADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const ColorLut& lut, ThresholdParams params)
+	{
+		if (lut.index == ColorLut::Index::DoLP)
+			applyADIMono8<ColorLut::Index::DoLP>(src, srcPitch, dst, dstPitch, width, height, lut.entries.data(), params.intensity);
+		else
+			applyADIMono8<ColorLut::Index::DoLPAoLP>(src, srcPitch, dst, dstPitch, width, height, lut.entries.data(), params.intensity);
+	}
+
+	void applyColorLutADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const ColorLut& lut, ThresholdParams params)
+	{
+		if (lut.index == ColorLut::Index::DoLP)
+			applyADIRGB8<ColorLut::Index::DoLP>(src, srcPitch, dst, dstPitch, width, height, lut.entries.data(), params);
+		else
+			applyADIRGB8<ColorLut::Index::DoLPAoLP>(src, srcPitch, dst, dstPitch, width, height, lut.entries.data(), params);
+	}
+}
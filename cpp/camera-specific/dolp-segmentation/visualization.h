@@ -0,0 +1,56 @@
+#pragma once
+
+#include "polarizationkernels.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dolp
+{
+	/// <summary>
+	/// How the polarization data is displayed
+	/// </summary>
+	enum class VisualizationMode
+	{
+		Threshold,		// Polarized pixels are painted red, using the threshold kernels
+		DoLPHeatMap,	// DoLP as heat map, values below the DoLP threshold are darkened
+		AoLPHue,		// AoLP as hue, pixels with DoLP below the threshold are black
+		AoLPDoLP,		// AoLP as hue and DoLP as brightness, pixels with DoLP below the threshold are black
+	};
+
+	/// <summary>
+	/// A precomputed mapping from polarization values to BGRa8 colors.
+	/// </summary>
+	/// <remarks>
+	/// All color calculations and the DoLP threshold are contained in the table, so that the per-pixel cost
+	/// is one table lookup regardless of the complexity of the color mapping.
+	/// The table is rebuilt whenever the visualization mode or the DoLP threshold changes.
+	/// </remarks>
+	struct ColorLut
+	{
+		enum class Index
+		{
+			DoLP,		// 256 entries, indexed by DoLP
+			DoLPAoLP,	// 65536 entries, indexed by DoLP * 256 + AoLP
+		};
+
+		Index index = Index::DoLP;
+		std::vector<uint32_t> entries;
+	};
+
+	/// <summary>
+	/// Creates the lookup table for a visualization mode
+	/// </summary>
+	/// <returns>The lookup table, or nullptr for VisualizationMode::Threshold</returns>
+	std::shared_ptr<const ColorLut> buildColorLut(VisualizationMode mode, const ThresholdParams& params);
+
+	/// <summary>
+	/// Converts a number of rows of a polarized ADI image into a BGRa8 image using a lookup table.
+	/// Pixels with an intensity not above the intensity threshold show the intensity instead.
+	/// For ADIRGB8 images, the DoLP and intensity channels are combined as selected by params.reduction.
+	/// </summary>
+	void applyColorLutADIMono8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const ColorLut& lut, ThresholdParams params);
+	void applyColorLutADIRGB8(const uint8_t* src, ptrdiff_t srcPitch, uint8_t* dst, ptrdiff_t dstPitch, int width, int height, const ColorLut& lut, ThresholdParams params);
+}
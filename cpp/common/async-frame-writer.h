@@ -0,0 +1,1034 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined _WIN32
+#include <Windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined __linux__ && defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define IC4_EXAMPLES_HAVE_IO_URING 1
+#endif
+#endif
+
+namespace ic4_examples
+{
+	namespace io
+	{
+		using clock = std::chrono::steady_clock;
+
+		// Image file formats supported by AsyncFrameWriter::save_file
+		enum class FileFormat
+		{
+			Bitmap,
+			Jpeg,
+			Png,
+			Tiff,
+		};
+
+		struct WriteResult
+		{
+			bool success = false;
+			// The job was removed by discard_pending before it was started
+			bool discarded = false;
+			std::string message;
+
+			// File written by save_file, or the raw stream file for append_raw
+			std::string path;
+			// Position of the frame inside the raw stream file, and the number of bytes written
+			uint64_t offset = 0;
+			uint64_t size = 0;
+
+			clock::time_point queued;
+			clock::time_point started;
+			clock::time_point finished;
+		};
+
+		// Header at the beginning of a raw stream file.
+		// Frame n is located at header_size + n * frame_stride, frame_size bytes long, rows are pitch bytes apart.
+		struct RawStreamHeader
+		{
+			char magic[8];			// "IC4RAW1"
+			uint32_t header_size;
+			uint32_t alignment;
+			uint32_t width;
+			uint32_t height;
+			int32_t pixel_format;	// Value of ic4::PixelFormat
+			uint32_t pitch;
+			uint64_t frame_size;
+			uint64_t frame_stride;
+			char image_type[64];	// ic4::to_string(imageType), for information only
+		};
+
+		// Writes image buffers to files in the background, so that a sink callback only has to queue the buffer.
+		//
+		// The writer keeps a reference to every image buffer until it has been written. Releasing that reference
+		// returns a QueueSink buffer back into the sink's free queue, so the number of buffers allocated by the sink
+		// limits the amount of pending writes in addition to Config::max_pending.
+		//
+		// Two kinds of output are supported:
+		// - save_file encodes the image into a file (BMP, JPEG, PNG, TIFF) on a thread pool.
+		// - append_raw appends the unmodified image data to a single raw stream file, each frame starting at an
+		//   aligned offset. On Linux, these writes are submitted in batches through io_uring. If io_uring is not
+		//   available, the thread pool writes the frames using positional writes.
+		//
+		// Completion callbacks are called on the writer's threads.
+		class AsyncFrameWriter
+		{
+		public:
+			using Completion = std::function<void(const WriteResult&)>;
+
+			struct Config
+			{
+				// Number of threads encoding image files/writing raw frames
+				size_t num_threads = (std::max)(2u, std::thread::hardware_concurrency() / 2);
+				// Submitting more frames blocks until one of the pending writes has completed
+				size_t max_pending = 64;
+				// Try to use io_uring for raw stream writes (Linux only)
+				bool use_io_uring = true;
+				// Open raw stream files bypassing the OS page cache (O_DIRECT/FILE_FLAG_NO_BUFFERING)
+				// Frames that are not suitably aligned in memory are copied into aligned bounce buffers.
+				bool direct_io = false;
+				// Alignment of frame offsets inside a raw stream file
+				size_t alignment = 4096;
+				// Frames are split into write requests of at most this size
+				size_t max_request_size = 1024 * 1024;
+			};
+
+			AsyncFrameWriter()
+				: AsyncFrameWriter(Config{})
+			{
+			}
+
+			explicit AsyncFrameWriter(const Config& config)
+				: config_(config)
+			{
+				config_.num_threads = (std::max)(config_.num_threads, size_t(1));
+				config_.max_pending = (std::max)(config_.max_pending, size_t(1));
+
+#if defined IC4_EXAMPLES_HAVE_IO_URING
+				if (config_.use_io_uring)
+				{
+					uring_ = std::make_unique<IoUring>();
+					if (!uring_->init(256))
+					{
+						uring_ = nullptr;
+					}
+					else
+					{
+						reaper_ = std::thread([this] { reaper_thread(); });
+					}
+				}
+#endif
+
+				for (size_t i = 0; i < config_.num_threads; ++i)
+				{
+					workers_.emplace_back([this] { worker_thread(); });
+				}
+			}
+
+			~AsyncFrameWriter()
+			{
+				flush();
+				close_raw_stream();
+
+				{
+					std::lock_guard lck(mtx_);
+					stop_ = true;
+				}
+				job_available_.notify_all();
+
+				for (auto& t : workers_)
+					t.join();
+
+#if defined IC4_EXAMPLES_HAVE_IO_URING
+				if (uring_)
+				{
+					uring_->submit_wakeup();
+					reaper_.join();
+				}
+#endif
+			}
+
+			AsyncFrameWriter(const AsyncFrameWriter&) = delete;
+			AsyncFrameWriter& operator=(const AsyncFrameWriter&) = delete;
+
+			// Name of the mechanism used to write raw frames
+			const char* backend_name() const
+			{
+#if defined IC4_EXAMPLES_HAVE_IO_URING
+				if (uring_)
+					return "io_uring";
+#endif
+				return "thread pool";
+			}
+
+			// Number of frames that were submitted, but have not been completed yet
+			size_t pending() const
+			{
+				return pending_.load();
+			}
+
+			// Maximum number of frames that can be pending, i.e. the number of image buffers the writer may hold
+			size_t max_pending() const
+			{
+				return config_.max_pending;
+			}
+
+			// Queues an image buffer to be saved as an image file.
+			// Blocks while Config::max_pending writes are pending.
+			void save_file(std::shared_ptr<ic4::ImageBuffer> buffer, std::string path, FileFormat format, Completion done = {})
+			{
+				Job job;
+				job.kind = Job::Kind::File;
+				job.buffer = std::move(buffer);
+				job.format = format;
+				job.done = std::move(done);
+				job.result.path = std::move(path);
+
+				enqueue(std::move(job));
+			}
+
+			// Creates a raw stream file to which frames of the specified image type can be appended.
+			bool open_raw_stream(const std::string& path, const ic4::ImageType& image_type, size_t pitch, std::string& message)
+			{
+				close_raw_stream();
+
+				auto stream = std::make_shared<RawStream>();
+				stream->path = path;
+				stream->direct = config_.direct_io;
+
+				auto& hdr = stream->header;
+				std::memset(&hdr, 0, sizeof(hdr));
+				std::memcpy(hdr.magic, "IC4RAW1", 8);
+				hdr.alignment = static_cast<uint32_t>(config_.alignment);
+				hdr.header_size = static_cast<uint32_t>(align_up(sizeof(RawStreamHeader), config_.alignment));
+				hdr.width = static_cast<uint32_t>(image_type.width());
+				hdr.height = static_cast<uint32_t>(image_type.height());
+				hdr.pixel_format = static_cast<int32_t>(image_type.pixel_format());
+				hdr.pitch = static_cast<uint32_t>(pitch);
+				hdr.frame_size = static_cast<uint64_t>(pitch) * image_type.height();
+				hdr.frame_stride = align_up(hdr.frame_size, config_.alignment);
+				auto type_string = ic4::to_string(image_type);
+				std::strncpy(hdr.image_type, type_string.c_str(), sizeof(hdr.image_type) - 1);
+
+				if (!stream->file.open(path, stream->direct, message))
+					return false;
+
+				// The header is written through an aligned buffer, so that it also works with direct I/O
+				auto block = AlignedBlock::allocate(hdr.header_size, config_.alignment);
+				std::memset(block.get(), 0, hdr.header_size);
+				std::memcpy(block.get(), &hdr, sizeof(hdr));
+				if (!stream->file.write_at(block.get(), hdr.header_size, 0, message))
+					return false;
+
+				std::lock_guard lck(mtx_);
+				raw_stream_ = std::move(stream);
+				return true;
+			}
+
+			// Queues an image buffer to be appended to the raw stream file.
+			// Blocks while Config::max_pending writes are pending.
+			bool append_raw(std::shared_ptr<ic4::ImageBuffer> buffer, Completion done = {})
+			{
+				std::shared_ptr<RawStream> stream;
+				{
+					std::lock_guard lck(mtx_);
+					stream = raw_stream_;
+				}
+				if (!stream)
+					return false;
+
+				Job job;
+				job.kind = Job::Kind::Raw;
+				job.buffer = std::move(buffer);
+				job.done = std::move(done);
+				job.stream = stream;
+				job.result.path = stream->path;
+				job.result.size = stream->header.frame_size;
+
+#if defined IC4_EXAMPLES_HAVE_IO_URING
+				if (uring_)
+				{
+					submit_uring(std::move(job));
+					return true;
+				}
+#endif
+				enqueue(std::move(job));
+				return true;
+			}
+
+			// Waits for all pending raw frames and closes the raw stream file
+			void close_raw_stream()
+			{
+				std::shared_ptr<RawStream> stream;
+				{
+					std::lock_guard lck(mtx_);
+					stream = std::move(raw_stream_);
+				}
+				if (!stream)
+					return;
+
+				flush();
+
+				// Make the file size a multiple of the frame stride, so that the last frame can be read the same way as all others
+				stream->file.truncate(stream->header.header_size + stream->num_frames * stream->header.frame_stride);
+				stream->file.close();
+			}
+
+			// Waits until all submitted frames have been written
+			void flush()
+			{
+				std::unique_lock lck(mtx_);
+				job_completed_.wait(lck, [this] { return pending_ == 0; });
+			}
+
+			// Removes all frames that have not been started yet.
+			// Their completion callbacks are called with WriteResult::discarded set.
+			void discard_pending()
+			{
+				std::deque<Job> discarded;
+				{
+					std::lock_guard lck(mtx_);
+					discarded.swap(jobs_);
+				}
+
+				for (auto& job : discarded)
+				{
+					job.result.discarded = true;
+					job.result.message = "Discarded";
+					job.result.started = job.result.finished = clock::now();
+					complete(job);
+				}
+			}
+
+		private:
+			struct AlignedDeleter
+			{
+				void operator()(uint8_t* p) const
+				{
+#if defined _WIN32
+					_aligned_free(p);
+#else
+					std::free(p);
+#endif
+				}
+			};
+
+			struct AlignedBlock
+			{
+				static std::unique_ptr<uint8_t, AlignedDeleter> allocate(size_t size, size_t alignment)
+				{
+#if defined _WIN32
+					return std::unique_ptr<uint8_t, AlignedDeleter>(static_cast<uint8_t*>(_aligned_malloc(size, alignment)));
+#else
+					void* p = nullptr;
+					if (posix_memalign(&p, alignment, size) != 0)
+						p = nullptr;
+					return std::unique_ptr<uint8_t, AlignedDeleter>(static_cast<uint8_t*>(p));
+#endif
+				}
+			};
+
+			// Minimal wrapper around a file that supports writing at arbitrary offsets from multiple threads
+			class NativeFile
+			{
+			public:
+				~NativeFile()
+				{
+					close();
+				}
+
+				bool open(const std::string& path, bool direct, std::string& message)
+				{
+#if defined _WIN32
+					DWORD flags = FILE_ATTRIBUTE_NORMAL | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+					handle_ = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags, nullptr);
+					if (handle_ == INVALID_HANDLE_VALUE)
+					{
+						message = "Failed to create " + path;
+						return false;
+					}
+#else
+					int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined O_DIRECT
+					if (direct)
+						flags |= O_DIRECT;
+#endif
+					fd_ = ::open(path.c_str(), flags, 0644);
+					if (fd_ < 0)
+					{
+						message = "Failed to create " + path + ": " + std::strerror(errno);
+						return false;
+					}
+#endif
+					return true;
+				}
+
+				bool write_at(const void* data, size_t size, uint64_t offset, std::string& message)
+				{
+					auto* p = static_cast<const uint8_t*>(data);
+					while (size > 0)
+					{
+#if defined _WIN32
+						OVERLAPPED ov = {};
+						ov.Offset = static_cast<DWORD>(offset);
+						ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+						DWORD written = 0;
+						DWORD chunk = static_cast<DWORD>((std::min)(size, size_t(1) << 30));
+						if (!WriteFile(handle_, p, chunk, &written, &ov) || written == 0)
+						{
+							message = "WriteFile failed";
+							return false;
+						}
+#else
+						ssize_t written = ::pwrite(fd_, p, size, static_cast<off_t>(offset));
+						if (written < 0 && errno == EINTR)
+							continue;
+						if (written <= 0)
+						{
+							message = std::string("pwrite failed: ") + std::strerror(errno);
+							return false;
+						}
+#endif
+						p += written;
+						size -= written;
+						offset += written;
+					}
+					return true;
+				}
+
+				void truncate(uint64_t size)
+				{
+#if defined _WIN32
+					LARGE_INTEGER pos;
+					pos.QuadPart = static_cast<LONGLONG>(size);
+					if (SetFilePointerEx(handle_, pos, nullptr, FILE_BEGIN))
+						SetEndOfFile(handle_);
+#else
+					if (::ftruncate(fd_, static_cast<off_t>(size)) != 0)
+					{
+						// The file is still readable, just the last frame might be shorter than the frame stride
+					}
+#endif
+				}
+
+				void close()
+				{
+#if defined _WIN32
+					if (handle_ != INVALID_HANDLE_VALUE)
+						CloseHandle(handle_);
+					handle_ = INVALID_HANDLE_VALUE;
+#else
+					if (fd_ >= 0)
+						::close(fd_);
+					fd_ = -1;
+#endif
+				}
+
+#if !defined _WIN32
+				int fd() const { return fd_; }
+#endif
+
+			private:
+#if defined _WIN32
+				HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+				int fd_ = -1;
+#endif
+			};
+
+			struct RawStream
+			{
+				std::string path;
+				bool direct = false;
+				RawStreamHeader header;
+				NativeFile file;
+				uint64_t num_frames = 0;
+			};
+
+			struct Job
+			{
+				enum class Kind { File, Raw };
+
+				Kind kind = Kind::File;
+				std::shared_ptr<ic4::ImageBuffer> buffer;
+				FileFormat format = FileFormat::Bitmap;
+				Completion done;
+				WriteResult result;
+
+				std::shared_ptr<RawStream> stream;
+				std::unique_ptr<uint8_t, AlignedDeleter> bounce;
+			};
+
+			static uint64_t align_up(uint64_t value, uint64_t alignment)
+			{
+				return (value + alignment - 1) / alignment * alignment;
+			}
+
+			// Waits for a free slot and counts the job as pending
+			void reserve_slot(std::unique_lock<std::mutex>& lck)
+			{
+				job_completed_.wait(lck, [this] { return pending_ < config_.max_pending; });
+				pending_ += 1;
+			}
+
+			void enqueue(Job&& job)
+			{
+				{
+					std::unique_lock lck(mtx_);
+					reserve_slot(lck);
+
+					job.result.queued = clock::now();
+					if (job.kind == Job::Kind::Raw)
+						assign_raw_offset(job);
+
+					jobs_.push_back(std::move(job));
+				}
+				job_available_.notify_one();
+			}
+
+			// Has to be called with mtx_ locked, so that frames are placed in submission order
+			static void assign_raw_offset(Job& job)
+			{
+				auto& hdr = job.stream->header;
+				job.result.offset = hdr.header_size + job.stream->num_frames * hdr.frame_stride;
+				job.stream->num_frames += 1;
+			}
+
+			// Returns the data to be written for a raw frame, copying into a bounce buffer if direct I/O requires it
+			static const uint8_t* prepare_raw_data(Job& job, size_t alignment, uint64_t& write_size)
+			{
+				auto& hdr = job.stream->header;
+				auto* data = static_cast<const uint8_t*>(job.buffer->ptr());
+				write_size = hdr.frame_size;
+
+				if (!job.stream->direct)
+					return data;
+
+				// Direct I/O requires aligned memory addresses and write sizes
+				write_size = hdr.frame_stride;
+				bool aligned = (reinterpret_cast<uintptr_t>(data) % alignment) == 0 && hdr.frame_size == hdr.frame_stride;
+				if (aligned)
+					return data;
+
+				job.bounce = AlignedBlock::allocate(hdr.frame_stride, alignment);
+				if (!job.bounce)
+					return nullptr;
+
+				std::memcpy(job.bounce.get(), data, hdr.frame_size);
+				std::memset(job.bounce.get() + hdr.frame_size, 0, hdr.frame_stride - hdr.frame_size);
+
+				// The image data was copied, the sink can have its buffer back right away
+				job.buffer = nullptr;
+				return job.bounce.get();
+			}
+
+			void complete(Job& job)
+			{
+				job.result.finished = (std::max)(job.result.finished, job.result.started);
+
+				// Return the image buffer before calling the completion, so that the buffer is available for new images
+				job.buffer = nullptr;
+				job.bounce = nullptr;
+
+				if (job.done)
+					job.done(job.result);
+
+				{
+					std::lock_guard lck(mtx_);
+					pending_ -= 1;
+				}
+				job_completed_.notify_all();
+			}
+
+			void worker_thread()
+			{
+				while (true)
+				{
+					Job job;
+					{
+						std::unique_lock lck(mtx_);
+						job_available_.wait(lck, [this] { return stop_ || !jobs_.empty(); });
+						if (jobs_.empty())
+							return;
+
+						job = std::move(jobs_.front());
+						jobs_.pop_front();
+					}
+
+					job.result.started = clock::now();
+
+					if (job.kind == Job::Kind::File)
+						run_file_job(job);
+					else
+						run_raw_job(job);
+
+					job.result.finished = clock::now();
+					complete(job);
+				}
+			}
+
+			static void run_file_job(Job& job)
+			{
+				ic4::Error err;
+				const auto& path = job.result.path;
+
+				switch (job.format)
+				{
+				case FileFormat::Bitmap:
+					job.result.success = ic4::imageBufferSaveAsBitmap(*job.buffer, path, {}, err);
+					break;
+				case FileFormat::Jpeg:
+					job.result.success = ic4::imageBufferSaveAsJpeg(*job.buffer, path, {}, err);
+					break;
+				case FileFormat::Png:
+					job.result.success = ic4::imageBufferSaveAsPng(*job.buffer, path, {}, err);
+					break;
+				case FileFormat::Tiff:
+					job.result.success = ic4::imageBufferSaveAsTiff(*job.buffer, path, {}, err);
+					break;
+				}
+
+				if (!job.result.success)
+				{
+					job.result.message = err.message();
+					return;
+				}
+
+				std::error_code ec;
+				auto size = std::filesystem::file_size(path, ec);
+				job.result.size = ec ? 0 : static_cast<uint64_t>(size);
+			}
+
+			void run_raw_job(Job& job)
+			{
+				uint64_t write_size = 0;
+				auto* data = prepare_raw_data(job, config_.alignment, write_size);
+				if (data == nullptr)
+				{
+					job.result.message = "Failed to allocate bounce buffer";
+					return;
+				}
+
+				job.result.success = job.stream->file.write_at(data, write_size, job.result.offset, job.result.message);
+			}
+
+#if defined IC4_EXAMPLES_HAVE_IO_URING
+			// Thin wrapper around the io_uring system calls.
+			// Submissions have to be serialized by the caller, completions are only reaped by the reaper thread.
+			class IoUring
+			{
+			public:
+				~IoUring()
+				{
+					if (sqes_)
+						munmap(sqes_, sqes_size_);
+					if (cq_ptr_ && cq_ptr_ != sq_ptr_)
+						munmap(cq_ptr_, cq_size_);
+					if (sq_ptr_)
+						munmap(sq_ptr_, sq_size_);
+					if (ring_fd_ >= 0)
+						::close(ring_fd_);
+				}
+
+				bool init(unsigned entries)
+				{
+					io_uring_params params = {};
+					ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+					if (ring_fd_ < 0)
+						return false;
+
+					sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+					cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+					bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+					if (single_mmap)
+						sq_size_ = cq_size_ = (std::max)(sq_size_, cq_size_);
+
+					sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+					if (sq_ptr_ == MAP_FAILED)
+					{
+						sq_ptr_ = nullptr;
+						return false;
+					}
+
+					cq_ptr_ = single_mmap ? sq_ptr_ : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+					if (cq_ptr_ == MAP_FAILED)
+					{
+						cq_ptr_ = nullptr;
+						return false;
+					}
+
+					sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+					void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+					if (sqes == MAP_FAILED)
+						return false;
+					sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+					auto* sq = static_cast<uint8_t*>(sq_ptr_);
+					sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+					sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+					sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+					sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+					sq_entries_ = params.sq_entries;
+
+					auto* cq = static_cast<uint8_t*>(cq_ptr_);
+					cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+					cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+					cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+					cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+					cq_entries_ = params.cq_entries;
+
+					return supports_write();
+				}
+
+				unsigned sq_entries() const { return sq_entries_; }
+				unsigned cq_entries() const { return cq_entries_; }
+
+				// Queues a write request, returns false if the submission queue is full
+				bool push_write(int fd, const void* data, unsigned size, uint64_t offset, uint64_t user_data)
+				{
+					auto* sqe = next_sqe();
+					if (!sqe)
+						return false;
+
+					sqe->opcode = IORING_OP_WRITE;
+					sqe->fd = fd;
+					sqe->addr = reinterpret_cast<uint64_t>(data);
+					sqe->len = size;
+					sqe->off = offset;
+					sqe->user_data = user_data;
+					return true;
+				}
+
+				// Passes all queued requests to the kernel in a single system call
+				bool submit()
+				{
+					while (to_submit_ > 0)
+					{
+						int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit_, 0, 0, nullptr, 0));
+						if (ret < 0)
+						{
+							if (errno == EINTR || errno == EAGAIN)
+								continue;
+							return false;
+						}
+						to_submit_ -= ret;
+					}
+					return true;
+				}
+
+				// Submits a no-op request with user_data 0, used to wake up the reaper thread
+				void submit_wakeup()
+				{
+					std::lock_guard lck(submit_mtx);
+					auto* sqe = next_sqe();
+					if (sqe)
+					{
+						sqe->opcode = IORING_OP_NOP;
+						sqe->user_data = 0;
+					}
+					submit();
+				}
+
+				// Blocks until a completion is available, then removes it from the completion queue
+				bool wait_completion(io_uring_cqe& cqe)
+				{
+					while (true)
+					{
+						unsigned head = *cq_head_;
+						unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+						if (head != tail)
+						{
+							cqe = cqes_[head & cq_mask_];
+							__atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+							return true;
+						}
+
+						int ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+						if (ret < 0 && errno != EINTR && errno != EAGAIN)
+							return false;
+					}
+				}
+
+				std::mutex submit_mtx;
+
+			private:
+				// IORING_OP_WRITE was added in Linux 5.6, older kernels fall back to the thread pool
+				bool supports_write()
+				{
+					constexpr unsigned NUM_OPS = 256;
+					std::vector<uint8_t> mem(sizeof(io_uring_probe) + NUM_OPS * sizeof(io_uring_probe_op), 0);
+					auto* probe = reinterpret_cast<io_uring_probe*>(mem.data());
+
+					if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, NUM_OPS) < 0)
+						return false;
+
+					return probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+				}
+
+				io_uring_sqe* next_sqe()
+				{
+					unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+					unsigned tail = *sq_tail_;
+					if (tail - head >= sq_entries_)
+						return nullptr;
+
+					unsigned index = tail & sq_mask_;
+					auto* sqe = &sqes_[index];
+					std::memset(sqe, 0, sizeof(*sqe));
+					sq_array_[index] = index;
+					__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+					to_submit_ += 1;
+					return sqe;
+				}
+
+				int ring_fd_ = -1;
+				void* sq_ptr_ = nullptr;
+				void* cq_ptr_ = nullptr;
+				size_t sq_size_ = 0;
+				size_t cq_size_ = 0;
+				io_uring_sqe* sqes_ = nullptr;
+				size_t sqes_size_ = 0;
+
+				unsigned* sq_head_ = nullptr;
+				unsigned* sq_tail_ = nullptr;
+				unsigned* sq_array_ = nullptr;
+				unsigned sq_mask_ = 0;
+				unsigned sq_entries_ = 0;
+				unsigned to_submit_ = 0;
+
+				unsigned* cq_head_ = nullptr;
+				unsigned* cq_tail_ = nullptr;
+				io_uring_cqe* cqes_ = nullptr;
+				unsigned cq_mask_ = 0;
+				unsigned cq_entries_ = 0;
+			};
+
+			struct UringJob;
+
+			// A single write request, its address is passed to io_uring as user_data
+			struct UringRequest
+			{
+				UringJob* job = nullptr;
+				const uint8_t* data = nullptr;
+				unsigned size = 0;
+				uint64_t offset = 0;
+			};
+
+			// A raw frame in flight in io_uring, consisting of one or more write requests
+			struct UringJob
+			{
+				Job job;
+				std::vector<UringRequest> requests;
+				std::atomic<int> requests_remaining = 0;
+
+				// Set by the first failing request, which is the only one writing the error message
+				std::atomic<bool> failed = false;
+				std::string error;
+
+				void fail(std::string message)
+				{
+					if (!failed.exchange(true))
+						error = std::move(message);
+				}
+			};
+
+			void submit_uring(Job&& job_in)
+			{
+				auto uring_job = std::make_unique<UringJob>();
+				auto& job = uring_job->job;
+				job = std::move(job_in);
+
+				{
+					std::unique_lock lck(mtx_);
+					reserve_slot(lck);
+
+					job.result.queued = clock::now();
+					assign_raw_offset(job);
+				}
+
+				job.result.started = clock::now();
+
+				uint64_t write_size = 0;
+				auto* data = prepare_raw_data(job, config_.alignment, write_size);
+				if (data == nullptr)
+				{
+					job.result.message = "Failed to allocate bounce buffer";
+					job.result.finished = clock::now();
+					complete(job);
+					return;
+				}
+
+				// Split the frame into requests of at most max_request_size bytes, which are submitted together.
+				// Large frames use larger requests, so that a frame always fits into the submission queue.
+				uint64_t request_size = (std::max<uint64_t>)(config_.max_request_size, (write_size + uring_->sq_entries() - 1) / uring_->sq_entries());
+				request_size = align_up((std::min)(request_size, write_size), config_.alignment);
+				int num_requests = static_cast<int>((write_size + request_size - 1) / request_size);
+				uring_job->requests_remaining = num_requests;
+
+				uint64_t offset = job.result.offset;
+				uring_job->requests.resize(num_requests);
+				for (int i = 0; i < num_requests; ++i)
+				{
+					uint64_t pos = i * request_size;
+					auto& request = uring_job->requests[i];
+					request.job = uring_job.get();
+					request.data = data + pos;
+					request.size = static_cast<unsigned>((std::min)(request_size, write_size - pos));
+					request.offset = offset + pos;
+				}
+
+				// The reaper thread owns the job from now on
+				auto* raw_job = uring_job.release();
+				int fd = raw_job->job.stream->file.fd();
+
+				int num_pushed = 0;
+				{
+					std::unique_lock lck(uring_->submit_mtx);
+
+					// Make sure the completion queue cannot overflow
+					uring_space_.wait(lck, [this, num_requests] { return uring_inflight_ + num_requests <= uring_->cq_entries(); });
+
+					for (; num_pushed < num_requests; ++num_pushed)
+					{
+						auto& request = raw_job->requests[num_pushed];
+						if (!uring_->push_write(fd, request.data, request.size, request.offset, reinterpret_cast<uint64_t>(&request)))
+							break;
+
+						uring_inflight_ += 1;
+					}
+
+					uring_->submit();
+				}
+
+				if (num_pushed < num_requests)
+				{
+					// Should not happen, the submission queue is empty after every submit
+					int num_failed = num_requests - num_pushed;
+					raw_job->fail("io_uring submission queue full");
+					if (raw_job->requests_remaining.fetch_sub(num_failed) == num_failed)
+						finish_uring_job(raw_job);
+				}
+			}
+
+			// Called by the reaper thread with submit_mtx locked after a short write, queues the rest of the request again.
+			// The request stays in flight, so the completion queue space it reserved is reused.
+			bool resubmit_remainder(UringRequest& request, unsigned written)
+			{
+				request.data += written;
+				request.size -= written;
+				request.offset += written;
+
+				int fd = request.job->job.stream->file.fd();
+				if (!uring_->push_write(fd, request.data, request.size, request.offset, reinterpret_cast<uint64_t>(&request)))
+					return false;
+
+				return uring_->submit();
+			}
+
+			void finish_uring_job(UringJob* uring_job)
+			{
+				// requests_remaining reaching zero orders all writes to the error message before this point
+				auto& result = uring_job->job.result;
+				result.success = !uring_job->failed;
+				if (!result.success)
+					result.message = uring_job->error;
+
+				result.finished = clock::now();
+				complete(uring_job->job);
+				delete uring_job;
+			}
+
+			void reaper_thread()
+			{
+				while (true)
+				{
+					io_uring_cqe cqe;
+					if (!uring_->wait_completion(cqe))
+						return;
+
+					if (cqe.user_data == 0)
+					{
+						// Wakeup request submitted by the destructor
+						return;
+					}
+
+					auto* request = reinterpret_cast<UringRequest*>(cqe.user_data);
+					UringJob* uring_job = nullptr;
+					{
+						// The request was filled in before the submitter released the lock
+						std::lock_guard lck(uring_->submit_mtx);
+						uring_job = request->job;
+
+						if (cqe.res < 0)
+						{
+							uring_job->fail(std::string("io_uring write failed: ") + std::strerror(-cqe.res));
+						}
+						else if (static_cast<unsigned>(cqe.res) < request->size)
+						{
+							// Short write, e.g. when the disk is full. Continue where the kernel stopped,
+							// unless it did not make any progress.
+							if (cqe.res > 0 && resubmit_remainder(*request, static_cast<unsigned>(cqe.res)))
+								continue;
+
+							uring_job->fail("io_uring short write: " + std::to_string(cqe.res) + " of " + std::to_string(request->size) + " bytes written");
+						}
+
+						uring_inflight_ -= 1;
+					}
+					uring_space_.notify_all();
+
+					if (--uring_job->requests_remaining == 0)
+					{
+						finish_uring_job(uring_job);
+					}
+				}
+			}
+
+			std::unique_ptr<IoUring> uring_;
+			std::thread reaper_;
+			std::condition_variable uring_space_;
+			unsigned uring_inflight_ = 0;
+#endif
+
+			Config config_;
+
+			std::mutex mtx_;
+			std::condition_variable job_available_;
+			std::condition_variable job_completed_;
+			std::deque<Job> jobs_;
+			std::atomic<size_t> pending_ = 0;
+			bool stop_ = false;
+
+			std::shared_ptr<RawStream> raw_stream_;
+
+			std::vector<std::thread> workers_;
+		};
+	}
+}
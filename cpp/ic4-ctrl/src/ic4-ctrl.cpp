@@ -11,6 +11,8 @@
 #include <fmt/core.h>
 #include <fmt/ranges.h>
 
+#include <async-frame-writer.h>
+
 #include <cstdint>
 #include <condition_variable>
 #include <memory>
@@ -424,6 +426,25 @@ static void save_image( std::string id, std::string filename, int count, int tim
 
     g.acquisitionStop();
 
+    auto format = ic4_examples::io::FileFormat::Bitmap;
+    if( image_type == "png" ) {
+        format = ic4_examples::io::FileFormat::Png;
+    }
+    else if( image_type == "tiff" ) {
+        format = ic4_examples::io::FileFormat::Tiff;
+    }
+    else if( image_type == "jpeg" ) {
+        format = ic4_examples::io::FileFormat::Jpeg;
+    }
+    else if( image_type != "bmp" ) {
+        return;
+    }
+
+    // Encode and write the images in parallel
+    std::mutex failed_mtx;
+    std::vector<std::string> failed;
+    ic4_examples::io::AsyncFrameWriter writer;
+
     int idx = 0;
     for( auto && image : images )
     {
@@ -434,18 +455,20 @@ static void save_image( std::string id, std::string filename, int count, int tim
             actual_filename = fmt::vformat( filename, fmt::make_format_args( idx ) );
             idx++;
         }
-        if( image_type == "bmp" ) {
-            ic4::imageBufferSaveAsBitmap( *image, actual_filename, {} );
-        }
-        else if( image_type == "png" ) {
-            ic4::imageBufferSaveAsPng( *image, actual_filename, {} );
-        }
-        else if( image_type == "tiff" ) {
-            ic4::imageBufferSaveAsTiff( *image, actual_filename, {} );
-        }
-        else if( image_type == "jpeg" ) {
-            ic4::imageBufferSaveAsJpeg( *image, actual_filename, {} );
-        }
+        writer.save_file( std::move( image ), actual_filename, format,
+            [&]( const ic4_examples::io::WriteResult& result )
+            {
+                if( !result.success ) {
+                    std::lock_guard lck( failed_mtx );
+                    failed.push_back( fmt::format( "Failed to save '{}': {}", result.path, result.message ) );
+                }
+            } );
+    }
+    writer.flush();
+
+    // Failed saves are reported on stderr, like the other errors
+    for( auto&& msg : failed ) {
+        fmt::print( stderr, "Error: {}\n", msg );
     }
 }
 
@@ -1,17 +1,24 @@
 #include <ic4/ic4.h>
 
 #include <console-helper.h>
+#include <async-frame-writer.h>
 
 #include <iostream>
+#include <mutex>
 
 
 // Define QueueSinkListener-derived class that saves all received frames in bitmap files
+// The files are written by a background thread pool, so that the sink callback returns immediately and
+// no triggers are missed while a file is being written.
 class SaveAsBmpListener : public ic4::QueueSinkListener
 {
 private:
 	std::string path_base_;
 	int counter_;
 
+	std::mutex print_mtx_;
+	ic4_examples::io::AsyncFrameWriter writer_;
+
 public:
 	SaveAsBmpListener(std::string path_base)
 		: path_base_(std::move(path_base))
@@ -19,6 +26,21 @@ public:
 	{
 	}
 
+	// Waits until all queued images have been saved
+	void flush()
+	{
+		writer_.flush();
+	}
+
+	// Inherited via QueueSinkListener, called when the sink is connected to a data stream
+	bool sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& imageType, size_t min_buffers_required) override
+	{
+		// The writer holds on to the buffers of the images that are still being written.
+		// Allocate enough additional buffers for a burst of triggers, so that the sink does not run out of buffers.
+		sink.allocAndQueueBuffers(min_buffers_required + writer_.max_pending());
+		return true;
+	}
+
 	// Inherited via QueueSinkListener, called when there are frames available in the sink's output queue
 	void framesQueued(ic4::QueueSink& sink) override
 	{
@@ -36,18 +58,25 @@ public:
 
 			// Generate a file name for the bitmap file
 			auto file_name = path_base_ + std::to_string(counter_) + ".bmp";
-
-			// Save the image buffer in the bitmap file
-			if (!ic4::imageBufferSaveAsBitmap(*buffer, file_name, {}, err))
-			{
-				std::cerr << "Failed save buffer: " << err.message() << std::endl;
-			}
-			else
-			{
-				std::cout << "Saved image " << file_name << std::endl;
-
-				counter_ += 1;
-			}
+			counter_ += 1;
+
+			// Queue the image buffer to be saved in the bitmap file
+			// The writer keeps the buffer until the file is written, and then returns it to the sink
+			writer_.save_file(std::move(buffer), file_name, ic4_examples::io::FileFormat::Bitmap,
+				[this](const ic4_examples::io::WriteResult& result)
+				{
+					std::lock_guard<std::mutex> lck(print_mtx_);
+
+					if (!result.success)
+					{
+						std::cerr << "Failed save buffer: " << result.message << std::endl;
+					}
+					else
+					{
+						std::cout << "Saved image " << result.path << std::endl;
+					}
+				}
+			);
 		}
 	}
 };
@@ -140,6 +169,9 @@ int main()
 	// We have to call streamStop before exiting the function, because we have the listener defined as a stack variable.
 	grabber.streamStop();
 
+	// Wait for the images that are still being written
+	listener.flush();
+
     // Disable trigger mode
 	if (!map.setValue(ic4::PropId::TriggerMode, "Off", err))
 	{
@@ -0,0 +1,190 @@
+
+#include "burstcapture.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+	// Upper limit for the number of copies waiting to be saved
+	constexpr size_t MAX_PENDING_FRAMES = 1024;
+}
+
+namespace ic4demoapp
+{
+	BurstCapture::BurstCapture(NotifyFunction notify)
+		: _notify(std::move(notify))
+	{
+		// Do not cache unused copies, bursts are rare and can use lots of memory
+		_pool = ic4::BufferPool::create(ic4::BufferPool::CacheConfig{ 0, 0 });
+
+		ic4_examples::io::AsyncFrameWriter::Config config;
+		config.max_pending = MAX_PENDING_FRAMES;
+		_writer = std::make_unique<ic4_examples::io::AsyncFrameWriter>(config);
+	}
+
+	BurstCapture::~BurstCapture()
+	{
+		stop();
+		_writer->flush();
+	}
+
+	bool BurstCapture::start(const Config& config, const ic4::ImageType& imageType)
+	{
+		std::lock_guard lck(_mtx);
+		if (_capturing || _in_flight > 0)
+			return false;
+
+		auto bpp = ic4::getBitsPerPixel(imageType.pixel_format());
+		auto imageSize = (std::max)(static_cast<size_t>(imageType.width() * imageType.height() * bpp / 8), size_t(1));
+
+		_config = config;
+		_max_in_flight = std::clamp(config.memory_limit / imageSize, size_t(1), MAX_PENDING_FRAMES);
+		_start_time = std::chrono::steady_clock::now();
+		_progress = {};
+		_progress.capturing = true;
+		_capturing = true;
+		return true;
+	}
+
+	void BurstCapture::stop()
+	{
+		std::lock_guard lck(_mtx);
+		_capturing = false;
+		_progress.capturing = false;
+	}
+
+	void BurstCapture::addFrame(const ic4::ImageBuffer& buffer)
+	{
+		if (!_capturing.load(std::memory_order_relaxed))
+			return;
+
+		std::filesystem::path path;
+		bool time_over = false;
+		{
+			std::lock_guard lck(_mtx);
+			if (!_capturing)
+				return;
+
+			time_over = isTimeOver();
+			if (time_over)
+			{
+				_capturing = false;
+				_progress.capturing = false;
+			}
+			else
+			{
+				if (_in_flight >= _max_in_flight)
+				{
+					// Saving does not keep up, do not take more memory
+					_progress.skipped += 1;
+					return;
+				}
+
+				char number[24] = {};
+				std::snprintf(number, sizeof(number), "%04llu", static_cast<unsigned long long>(_progress.captured));
+
+				path = _config.path_prefix;
+				path += number;
+				path += fileExtension(_config.format);
+
+				_progress.captured += 1;
+				_in_flight += 1;
+
+				if (_config.max_frames > 0 && _progress.captured >= _config.max_frames)
+				{
+					_capturing = false;
+					_progress.capturing = false;
+				}
+			}
+		}
+
+		if (time_over)
+		{
+			// The last notification may have been sent while still capturing, report the end of the burst
+			notifyProgress();
+			return;
+		}
+
+		ic4::Error err;
+		auto copy = _pool->getBuffer(buffer.imageType(), {}, err);
+		if (!copy || !copy->copyFrom(buffer, ic4::ImageBuffer::CopyOptions::Default, err))
+		{
+			ic4_examples::io::WriteResult result;
+			result.message = err.message();
+			onSaved(result);
+			return;
+		}
+
+		_writer->save_file(std::move(copy), path.string(), _config.format, [this](const ic4_examples::io::WriteResult& result) { onSaved(result); });
+	}
+
+	bool BurstCapture::isBusy() const
+	{
+		std::lock_guard lck(_mtx);
+
+		// Like in progress(), a burst whose time is over is not capturing anymore, even if no frame arrived since
+		return (_capturing && !isTimeOver()) || _in_flight > 0;
+	}
+
+	BurstCapture::Progress BurstCapture::progress() const
+	{
+		_notify_pending = false;
+
+		std::lock_guard lck(_mtx);
+
+		auto progress = _progress;
+		if (progress.capturing && isTimeOver())
+		{
+			// No frame arrived since the time was over
+			progress.capturing = false;
+		}
+		return progress;
+	}
+
+	bool BurstCapture::isTimeOver() const
+	{
+		return _config.duration.count() > 0 && std::chrono::steady_clock::now() - _start_time >= _config.duration;
+	}
+
+	void BurstCapture::notifyProgress() const
+	{
+		if (_notify && !_notify_pending.exchange(true))
+		{
+			_notify();
+		}
+	}
+
+	const char* BurstCapture::fileExtension(ic4_examples::io::FileFormat format)
+	{
+		switch (format)
+		{
+		case ic4_examples::io::FileFormat::Bitmap:	return ".bmp";
+		case ic4_examples::io::FileFormat::Png:		return ".png";
+		case ic4_examples::io::FileFormat::Tiff:	return ".tif";
+		case ic4_examples::io::FileFormat::Jpeg:
+		default:
+			return ".jpg";
+		}
+	}
+
+	void BurstCapture::onSaved(const ic4_examples::io::WriteResult& result)
+	{
+		// Called on the writer's threads
+		{
+			std::lock_guard lck(_mtx);
+			if (result.success)
+			{
+				_progress.saved += 1;
+			}
+			else
+			{
+				_progress.failed += 1;
+				_progress.last_error = result.message;
+			}
+		}
+		_in_flight -= 1;
+
+		notifyProgress();
+	}
+}
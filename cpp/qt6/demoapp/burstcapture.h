@@ -0,0 +1,109 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include "async-frame-writer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// Captures a series of photos and saves them in the background.
+	/// </summary>
+	/// <remarks>
+	/// The frames are copied into buffers from a buffer pool, so that the sink's buffers are returned immediately.
+	/// The copies are encoded into image files by an AsyncFrameWriter.
+	/// </remarks>
+	class BurstCapture
+	{
+	public:
+		struct Config
+		{
+			// The files are named path_prefix + frame number + extension of the file format
+			std::filesystem::path path_prefix;
+			ic4_examples::io::FileFormat format = ic4_examples::io::FileFormat::Jpeg;
+			// Number of frames to capture, 0 = no limit
+			uint32_t max_frames = 10;
+			// Capture all frames arriving in this time, 0 = no limit
+			std::chrono::milliseconds duration = {};
+			// Frames are skipped if the copies waiting to be saved exceed this size
+			size_t memory_limit = 512 * 1024 * 1024;
+		};
+
+		struct Progress
+		{
+			bool capturing = false;
+			uint64_t captured = 0;
+			uint64_t saved = 0;
+			uint64_t failed = 0;
+			uint64_t skipped = 0;
+			std::string last_error;
+		};
+
+		using NotifyFunction = std::function<void()>;
+
+		/// <summary>
+		/// notify is called on the writer's threads when the progress changed.
+		/// It is not called again until progress() was called, so that at most one notification is pending.
+		/// </summary>
+		explicit BurstCapture(NotifyFunction notify);
+		~BurstCapture();
+
+		BurstCapture(const BurstCapture&) = delete;
+		BurstCapture& operator=(const BurstCapture&) = delete;
+
+		/// <summary>
+		/// Starts capturing the following frames. Returns false if the previous burst is still being captured or saved.
+		/// </summary>
+		bool start(const Config& config, const ic4::ImageType& imageType);
+
+		/// <summary>
+		/// Stops capturing. The frames already captured are still saved.
+		/// </summary>
+		void stop();
+
+		/// <summary>
+		/// Copies the frame if a burst is being captured. Called from the sink callback.
+		/// </summary>
+		void addFrame(const ic4::ImageBuffer& buffer);
+
+		/// <summary>
+		/// Returns true while frames are captured or saved
+		/// </summary>
+		bool isBusy() const;
+
+		Progress progress() const;
+
+		static const char* fileExtension(ic4_examples::io::FileFormat format);
+
+	private:
+		void onSaved(const ic4_examples::io::WriteResult& result);
+		// Whether the configured duration has passed, _mtx has to be locked
+		bool isTimeOver() const;
+		void notifyProgress() const;
+
+		NotifyFunction _notify;
+		mutable std::atomic<bool> _notify_pending = false;
+
+		mutable std::mutex _mtx;
+		Config _config;
+		std::chrono::steady_clock::time_point _start_time;
+		size_t _max_in_flight = 1;
+		Progress _progress;
+
+		std::atomic<bool> _capturing = false;
+		std::atomic<size_t> _in_flight = 0;
+
+		std::shared_ptr<ic4::BufferPool> _pool;
+		// Declared last, so that pending writes complete before the other members are destroyed
+		std::unique_ptr<ic4_examples::io::AsyncFrameWriter> _writer;
+	};
+}
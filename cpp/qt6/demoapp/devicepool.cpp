@@ -0,0 +1,134 @@
+
+#include "devicepool.h"
+
+#include <algorithm>
+
+namespace ic4demoapp
+{
+	DevicePool::DevicePool(size_t capacity, GrabberFactory factory, RemovedFunction removed)
+		: _capacity((std::max)(capacity, size_t(1)))
+		, _factory(std::move(factory))
+		, _removed(std::move(removed))
+	{
+		_entries.push_back({ createGrabber() });
+	}
+
+	DevicePool::~DevicePool()
+	{
+		// Close the devices that are not used in reverse order of their use
+		while (_entries.size() > 1)
+		{
+			_entries.back().grabber->deviceClose(ic4::Error::Ignore());
+			_entries.pop_back();
+		}
+	}
+
+	void DevicePool::setCapacity(size_t capacity)
+	{
+		_capacity = (std::max)(capacity, size_t(1));
+		trim();
+	}
+
+	std::unique_ptr<ic4::Grabber> DevicePool::createGrabber() const
+	{
+		if (_factory)
+			return _factory();
+
+		return std::make_unique<ic4::Grabber>();
+	}
+
+	DevicePool::Entry& DevicePool::current()
+	{
+		return _entries.front();
+	}
+
+	const std::vector<DevicePool::Entry>& DevicePool::entries() const
+	{
+		return _entries;
+	}
+
+	void DevicePool::add(std::unique_ptr<ic4::Grabber> grabber)
+	{
+		// Remove grabbers without device, or with a device that was lost
+		for (auto it = _entries.begin(); it != _entries.end(); )
+		{
+			if (it->grabber->isDeviceValid())
+			{
+				++it;
+			}
+			else
+			{
+				it->grabber->deviceClose(ic4::Error::Ignore());
+				if (_removed)
+					_removed(*it);
+				it = _entries.erase(it);
+			}
+		}
+
+		_entries.insert(_entries.begin(), { std::move(grabber) });
+		trim();
+	}
+
+	void DevicePool::activate(const ic4::Grabber& grabber)
+	{
+		auto it = find(&grabber);
+		if (it != _entries.end())
+		{
+			std::rotate(_entries.begin(), it, it + 1);
+		}
+	}
+
+	void DevicePool::remove(const ic4::Grabber* grabber)
+	{
+		auto it = find(grabber);
+		if (it == _entries.end())
+			return;
+
+		bool was_current = it == _entries.begin();
+		removeAt(it);
+
+		if (was_current)
+		{
+			_entries.insert(_entries.begin(), { createGrabber() });
+		}
+	}
+
+	bool DevicePool::contains(const ic4::DeviceInfo& device) const
+	{
+		auto id = deviceId(device);
+
+		return std::any_of(_entries.begin(), _entries.end(),
+			[&](const Entry& entry)
+			{
+				auto info = entry.grabber->deviceInfo(ic4::Error::Ignore());
+				return entry.grabber->isDeviceValid() && deviceId(info) == id;
+			}
+		);
+	}
+
+	std::string DevicePool::deviceId(const ic4::DeviceInfo& device)
+	{
+		return device.modelName(ic4::Error::Ignore()) + " " + device.serial(ic4::Error::Ignore());
+	}
+
+	std::vector<DevicePool::Entry>::iterator DevicePool::find(const ic4::Grabber* grabber)
+	{
+		return std::find_if(_entries.begin(), _entries.end(), [&](const Entry& entry) { return entry.grabber.get() == grabber; });
+	}
+
+	void DevicePool::removeAt(std::vector<Entry>::iterator it)
+	{
+		it->grabber->deviceClose(ic4::Error::Ignore());
+		if (_removed)
+			_removed(*it);
+		_entries.erase(it);
+	}
+
+	void DevicePool::trim()
+	{
+		while (_entries.size() > _capacity)
+		{
+			removeAt(_entries.end() - 1);
+		}
+	}
+}
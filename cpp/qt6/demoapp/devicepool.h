@@ -0,0 +1,87 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class PropertyDialog;
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// Keeps recently used devices open, so that switching between them does not have to reopen the device
+	/// and rebuild its property dialog.
+	/// </summary>
+	/// <remarks>
+	/// The entries are ordered by their last use, the first entry is the current device.
+	/// The current entry always exists, its grabber may have no device opened.
+	/// </remarks>
+	class DevicePool
+	{
+	public:
+		struct Entry
+		{
+			std::unique_ptr<ic4::Grabber> grabber;
+			// Created when the property dialog is first shown for the device, owned by its Qt parent
+			PropertyDialog* property_dialog = nullptr;
+		};
+
+		// Creates the grabbers without device, e.g. to register event handlers
+		using GrabberFactory = std::function<std::unique_ptr<ic4::Grabber>()>;
+		// Called for entries that are removed from the pool, after their device was closed
+		using RemovedFunction = std::function<void(Entry& entry)>;
+
+		DevicePool(size_t capacity, GrabberFactory factory, RemovedFunction removed);
+		~DevicePool();
+
+		DevicePool(const DevicePool&) = delete;
+		DevicePool& operator=(const DevicePool&) = delete;
+
+		void setCapacity(size_t capacity);
+
+		Entry& current();
+		const std::vector<Entry>& entries() const;
+
+		/// <summary>
+		/// Creates a grabber to open a new device in, which can be passed to add()
+		/// </summary>
+		std::unique_ptr<ic4::Grabber> createGrabber() const;
+
+		/// <summary>
+		/// Makes a grabber the current entry. Entries without a valid device are removed,
+		/// and the least recently used devices are closed if the capacity is exceeded.
+		/// </summary>
+		void add(std::unique_ptr<ic4::Grabber> grabber);
+
+		/// <summary>
+		/// Makes an existing entry the current entry
+		/// </summary>
+		void activate(const ic4::Grabber& grabber);
+
+		/// <summary>
+		/// Closes the device of an entry and removes the entry. If it is the current entry, it is replaced by an empty grabber.
+		/// Does nothing if the grabber is not in the pool.
+		/// </summary>
+		void remove(const ic4::Grabber* grabber);
+
+		/// <summary>
+		/// Returns true if the device is opened by any grabber in the pool and not lost
+		/// </summary>
+		bool contains(const ic4::DeviceInfo& device) const;
+
+		static std::string deviceId(const ic4::DeviceInfo& device);
+
+	private:
+		std::vector<Entry>::iterator find(const ic4::Grabber* grabber);
+		void removeAt(std::vector<Entry>::iterator it);
+		void trim();
+
+		size_t _capacity;
+		GrabberFactory _factory;
+		RemovedFunction _removed;
+		std::vector<Entry> _entries;
+	};
+}
@@ -3,6 +3,8 @@
 
 const QEvent::Type GOT_PHOTO_EVENT = static_cast<QEvent::Type>(QEvent::User + 1);
 const QEvent::Type DEVICE_LOST_EVENT = static_cast<QEvent::Type>(QEvent::User + 2);
+const QEvent::Type STATISTICS_CHANGED_EVENT = static_cast<QEvent::Type>(QEvent::User + 3);
+const QEvent::Type BURST_PROGRESS_EVENT = static_cast<QEvent::Type>(QEvent::User + 4);
 
 
 /// <summary>
@@ -30,3 +32,25 @@ private:
 	std::shared_ptr<ic4::ImageBuffer> _imagebuffer;
 
 };
+
+/// <summary>
+/// Is fired from the device lost handler of a grabber
+/// </summary>
+class DeviceLostEvent : public QEvent
+{
+public:
+	DeviceLostEvent(ic4::Grabber* grabber)
+		: QEvent(DEVICE_LOST_EVENT)
+		, _grabber(grabber)
+	{
+	}
+
+	// Only used for comparison, the grabber may have been destroyed since the event was posted
+	ic4::Grabber* grabber() const
+	{
+		return _grabber;
+	}
+
+private:
+	ic4::Grabber* _grabber;
+};
@@ -0,0 +1,392 @@
+
+#include "imagestatistics.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IC4DEMOAPP_STATS_SSE2 1
+#elif defined __aarch64__ || defined _M_ARM64
+#include <arm_neon.h>
+#define IC4DEMOAPP_STATS_NEON 1
+#endif
+
+namespace
+{
+	enum class LumaSource
+	{
+		Unsupported,
+		Mono8,
+		BGRa8,
+		Bayer8,
+	};
+
+	LumaSource lumaSource(ic4::PixelFormat fmt)
+	{
+		switch (fmt)
+		{
+		case ic4::PixelFormat::Mono8:
+			return LumaSource::Mono8;
+		case ic4::PixelFormat::BGRa8:
+			return LumaSource::BGRa8;
+		case ic4::PixelFormat::BayerBG8:
+		case ic4::PixelFormat::BayerGB8:
+		case ic4::PixelFormat::BayerGR8:
+		case ic4::PixelFormat::BayerRG8:
+			return LumaSource::Bayer8;
+		default:
+			return LumaSource::Unsupported;
+		}
+	}
+
+	// Y = (29 * B + 150 * G + 77 * R) / 256, the weights add up to 256
+	void lumaBGRa8(const uint8_t* src, uint8_t* dst, size_t n)
+	{
+		size_t x = 0;
+
+#if defined IC4DEMOAPP_STATS_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i weights = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+		const __m128i round = _mm_set1_epi32(128);
+
+		// Calculates 4 luminance values as 32-bit integers from 4 BGRa pixels
+		auto luma4 = [&](const uint8_t* p)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128 lo = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(px, zero), weights));
+			__m128 hi = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(px, zero), weights));
+			__m128i bg = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i r = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+			return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bg, r), round), 8);
+		};
+
+		for (; x + 16 <= n; x += 16)
+		{
+			const uint8_t* p = src + x * 4;
+			__m128i y01 = _mm_packs_epi32(luma4(p), luma4(p + 16));
+			__m128i y23 = _mm_packs_epi32(luma4(p + 32), luma4(p + 48));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(y01, y23));
+		}
+#elif defined IC4DEMOAPP_STATS_NEON
+		for (; x + 16 <= n; x += 16)
+		{
+			uint8x16x4_t px = vld4q_u8(src + x * 4);
+			uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), vdup_n_u8(29));
+			lo = vmlal_u8(lo, vget_low_u8(px.val[1]), vdup_n_u8(150));
+			lo = vmlal_u8(lo, vget_low_u8(px.val[2]), vdup_n_u8(77));
+			uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), vdup_n_u8(29));
+			hi = vmlal_u8(hi, vget_high_u8(px.val[1]), vdup_n_u8(150));
+			hi = vmlal_u8(hi, vget_high_u8(px.val[2]), vdup_n_u8(77));
+			vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+		}
+#endif
+
+		for (; x < n; ++x)
+		{
+			const uint8_t* p = src + x * 4;
+			dst[x] = static_cast<uint8_t>((29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8);
+		}
+	}
+
+	// Averages the 2x2 blocks of two Bayer rows, n is the number of output pixels
+	void lumaBayer8(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, size_t n)
+	{
+		size_t x = 0;
+
+#if defined IC4DEMOAPP_STATS_SSE2
+		const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+		const __m128i one = _mm_set1_epi16(1);
+
+		// Sums of the horizontal pixel pairs of both rows as 16-bit integers
+		auto pair_sums = [&](size_t offset)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + offset));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + offset));
+			__m128i sum_a = _mm_add_epi16(_mm_and_si128(a, low_bytes), _mm_srli_epi16(a, 8));
+			__m128i sum_b = _mm_add_epi16(_mm_and_si128(b, low_bytes), _mm_srli_epi16(b, 8));
+			return _mm_add_epi16(sum_a, sum_b);
+		};
+
+		for (; x + 16 <= n; x += 16)
+		{
+			__m128i lo = _mm_srli_epi16(_mm_add_epi16(pair_sums(x * 2), _mm_add_epi16(one, one)), 2);
+			__m128i hi = _mm_srli_epi16(_mm_add_epi16(pair_sums(x * 2 + 16), _mm_add_epi16(one, one)), 2);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+		}
+#elif defined IC4DEMOAPP_STATS_NEON
+		for (; x + 16 <= n; x += 16)
+		{
+			uint16x8_t lo = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + x * 2)), vpaddlq_u8(vld1q_u8(row1 + x * 2)));
+			uint16x8_t hi = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + x * 2 + 16)), vpaddlq_u8(vld1q_u8(row1 + x * 2 + 16)));
+			vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+		}
+#endif
+
+		for (; x < n; ++x)
+		{
+			dst[x] = static_cast<uint8_t>((row0[x * 2] + row0[x * 2 + 1] + row1[x * 2] + row1[x * 2 + 1] + 2) >> 2);
+		}
+	}
+
+	struct LaplacianSums
+	{
+		int64_t sum = 0;
+		uint64_t sum_sq = 0;
+		uint64_t count = 0;
+	};
+
+	// Accumulates L = 4 * c[x] - c[x - 1] - c[x + 1] - up[x] - down[x] for x in [1, n - 1)
+	void laplacianRow(const uint8_t* up, const uint8_t* c, const uint8_t* down, size_t n, LaplacianSums& sums)
+	{
+		if (n < 3)
+			return;
+
+		size_t x = 1;
+
+#if defined IC4DEMOAPP_STATS_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi16(1);
+
+		auto load8 = [&](const uint8_t* p) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero); };
+
+		while (x + 8 + 1 <= n)
+		{
+			__m128i sum32 = _mm_setzero_si128();
+			__m128i sq32 = _mm_setzero_si128();
+
+			// |L| <= 1020, so each 32-bit lane can take 512 iterations of two squares without overflowing
+			for (int i = 0; i < 512 && x + 8 + 1 <= n; ++i, x += 8)
+			{
+				__m128i l = _mm_slli_epi16(load8(c + x), 2);
+				l = _mm_sub_epi16(l, load8(c + x - 1));
+				l = _mm_sub_epi16(l, load8(c + x + 1));
+				l = _mm_sub_epi16(l, load8(up + x));
+				l = _mm_sub_epi16(l, load8(down + x));
+
+				sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(l, ones));
+				sq32 = _mm_add_epi32(sq32, _mm_madd_epi16(l, l));
+			}
+
+			alignas(16) int32_t sum_lanes[4];
+			alignas(16) uint32_t sq_lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(sum_lanes), sum32);
+			_mm_store_si128(reinterpret_cast<__m128i*>(sq_lanes), sq32);
+			for (int i = 0; i < 4; ++i)
+			{
+				sums.sum += sum_lanes[i];
+				sums.sum_sq += sq_lanes[i];
+			}
+		}
+#elif defined IC4DEMOAPP_STATS_NEON
+		auto load8 = [](const uint8_t* p) { return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p))); };
+
+		while (x + 8 + 1 <= n)
+		{
+			int32x4_t sum32 = vdupq_n_s32(0);
+			uint32x4_t sq32 = vdupq_n_u32(0);
+
+			// |L| <= 1020, so each 32-bit lane can take 512 iterations of two squares without overflowing
+			for (int i = 0; i < 512 && x + 8 + 1 <= n; ++i, x += 8)
+			{
+				int16x8_t l = vshlq_n_s16(load8(c + x), 2);
+				l = vsubq_s16(l, load8(c + x - 1));
+				l = vsubq_s16(l, load8(c + x + 1));
+				l = vsubq_s16(l, load8(up + x));
+				l = vsubq_s16(l, load8(down + x));
+
+				sum32 = vpadalq_s16(sum32, l);
+				int32x4_t sq = vmull_s16(vget_low_s16(l), vget_low_s16(l));
+				sq = vmlal_s16(sq, vget_high_s16(l), vget_high_s16(l));
+				sq32 = vaddq_u32(sq32, vreinterpretq_u32_s32(sq));
+			}
+
+			sums.sum += vaddvq_s32(sum32);
+			sums.sum_sq += vaddlvq_u32(sq32);
+		}
+#endif
+
+		for (; x + 1 < n; ++x)
+		{
+			int l = 4 * c[x] - c[x - 1] - c[x + 1] - up[x] - down[x];
+			sums.sum += l;
+			sums.sum_sq += static_cast<uint64_t>(l * l);
+		}
+
+		sums.count += n - 2;
+	}
+
+	// Four partial histograms avoid stalls when consecutive pixels fall into the same bin
+	void histogramRow(const uint8_t* p, size_t n, uint32_t (&hist)[4][256])
+	{
+		size_t x = 0;
+		for (; x + 4 <= n; x += 4)
+		{
+			hist[0][p[x + 0]] += 1;
+			hist[1][p[x + 1]] += 1;
+			hist[2][p[x + 2]] += 1;
+			hist[3][p[x + 3]] += 1;
+		}
+		for (; x < n; ++x)
+		{
+			hist[0][p[x]] += 1;
+		}
+	}
+
+	// Provides rows of the luminance image, converting them on demand.
+	// Rows y - 1, y and y + 1 are always in different cache slots.
+	class LumaImage
+	{
+	public:
+		LumaImage(const ic4::ImageBuffer& buffer, LumaSource source)
+			: _data(static_cast<const uint8_t*>(buffer.ptr()))
+			, _pitch(buffer.pitch())
+			, _source(source)
+		{
+			const auto& type = buffer.imageType();
+			_width = type.width();
+			_height = type.height();
+			if (source == LumaSource::Bayer8)
+			{
+				_width /= 2;
+				_height /= 2;
+			}
+
+			if (source != LumaSource::Mono8)
+			{
+				_storage.resize(_width * 3);
+			}
+		}
+
+		size_t width() const { return _width; }
+		size_t height() const { return _height; }
+
+		const uint8_t* row(size_t y)
+		{
+			switch (_source)
+			{
+			case LumaSource::Mono8:
+				return _data + y * _pitch;
+			case LumaSource::BGRa8:
+			case LumaSource::Bayer8:
+			default:
+				break;
+			}
+
+			auto slot = y % 3;
+			uint8_t* dst = _storage.data() + slot * _width;
+			if (_cached_row[slot] != y)
+			{
+				if (_source == LumaSource::BGRa8)
+					lumaBGRa8(_data + y * _pitch, dst, _width);
+				else
+					lumaBayer8(_data + 2 * y * _pitch, _data + (2 * y + 1) * _pitch, dst, _width);
+
+				_cached_row[slot] = y;
+			}
+			return dst;
+		}
+
+	private:
+		const uint8_t* _data;
+		ptrdiff_t _pitch;
+		LumaSource _source;
+		size_t _width = 0;
+		size_t _height = 0;
+
+		std::vector<uint8_t> _storage;
+		size_t _cached_row[3] = { SIZE_MAX, SIZE_MAX, SIZE_MAX };
+	};
+}
+
+namespace ic4demoapp
+{
+	bool calculateImageStatistics(const ic4::ImageBuffer& buffer, size_t maxPixels, ImageStatistics& result)
+	{
+		result = {};
+		result.image_type = buffer.imageType();
+
+		auto source = lumaSource(result.image_type.pixel_format());
+		if (source == LumaSource::Unsupported)
+			return false;
+
+		LumaImage luma(buffer, source);
+		auto width = luma.width();
+		auto height = luma.height();
+		if (width < 3 || height < 3)
+			return false;
+
+		// Analyze evenly spaced rows, excluding the first and last row which lack neighbors for the Laplacian
+		size_t num_rows = std::clamp(maxPixels / width, size_t(1), height - 2);
+		size_t step = (height - 2) / num_rows;
+
+		uint32_t hist[4][256] = {};
+		LaplacianSums lap;
+
+		for (size_t y = 1; y + 1 < height; y += step)
+		{
+			const uint8_t* up = luma.row(y - 1);
+			const uint8_t* c = luma.row(y);
+			const uint8_t* down = luma.row(y + 1);
+
+			histogramRow(c, width, hist);
+			laplacianRow(up, c, down, width, lap);
+
+			result.num_pixels += width;
+		}
+
+		uint64_t weighted_sum = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			result.histogram[i] = hist[0][i] + hist[1][i] + hist[2][i] + hist[3][i];
+			weighted_sum += static_cast<uint64_t>(i) * result.histogram[i];
+		}
+
+		auto n = static_cast<double>(result.num_pixels);
+		result.mean = weighted_sum / n;
+		result.clipped_dark = result.histogram[0] / n;
+		result.clipped_bright = result.histogram[255] / n;
+
+		if (lap.count > 0)
+		{
+			auto mean_l = static_cast<double>(lap.sum) / lap.count;
+			result.focus = static_cast<double>(lap.sum_sq) / lap.count - mean_l * mean_l;
+		}
+
+		result.valid = true;
+		return true;
+	}
+
+	ImageStatisticsStage::ImageStatisticsStage(std::chrono::milliseconds interval, size_t maxPixels)
+		: _interval(interval)
+		, _max_pixels(maxPixels)
+	{
+	}
+
+	std::string ImageStatisticsStage::name() const
+	{
+		return "Image Statistics";
+	}
+
+	std::shared_ptr<ic4::ImageBuffer> ImageStatisticsStage::process(const std::shared_ptr<ic4::ImageBuffer>& buffer, const ChunkValues& /*chunks*/)
+	{
+		// Limit the update rate, the statistics are only for display
+		auto now = std::chrono::steady_clock::now();
+		if (now - _last_update < _interval)
+			return nullptr;
+		_last_update = now;
+
+		ImageStatistics stats;
+		calculateImageStatistics(*buffer, _max_pixels, stats);
+
+		std::lock_guard lck(_mtx);
+		_latest = stats;
+		return nullptr;
+	}
+
+	ImageStatistics ImageStatisticsStage::latest() const
+	{
+		std::lock_guard lck(_mtx);
+		return _latest;
+	}
+}
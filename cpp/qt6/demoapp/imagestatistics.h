@@ -0,0 +1,73 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include "processinggraph.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// Exposure and focus statistics of an image
+	/// </summary>
+	struct ImageStatistics
+	{
+		bool valid = false;
+		ic4::ImageType image_type;
+
+		// Luminance histogram of the analyzed pixels
+		std::array<uint32_t, 256> histogram = {};
+		uint64_t num_pixels = 0;
+		double mean = 0;
+
+		// Fraction of analyzed pixels at 0 or 255
+		double clipped_dark = 0;
+		double clipped_bright = 0;
+
+		// Variance of the Laplacian of the luminance, higher is sharper.
+		// Only comparable between images of the same scene and pixel format.
+		double focus = 0;
+	};
+
+	/// <summary>
+	/// Calculates the statistics of an image.
+	/// </summary>
+	/// <remarks>
+	/// Supports Mono8, BGRa8 and 8-bit Bayer formats. Bayer images are analyzed at half resolution,
+	/// averaging the four pixels of each 2x2 block.
+	///
+	/// To limit the processing time, only every n-th row of the luminance image is analyzed so that at most
+	/// maxPixels pixels are used. The Laplacian of the analyzed rows uses the full resolution neighbors.
+	/// </remarks>
+	/// <returns>false if the pixel format is not supported</returns>
+	bool calculateImageStatistics(const ic4::ImageBuffer& buffer, size_t maxPixels, ImageStatistics& result);
+
+	/// <summary>
+	/// Processing stage calculating ImageStatistics, at most once per interval.
+	/// </summary>
+	class ImageStatisticsStage : public ProcessingStage
+	{
+	public:
+		explicit ImageStatisticsStage(std::chrono::milliseconds interval = std::chrono::milliseconds(100), size_t maxPixels = 512 * 1024);
+
+		std::string name() const override;
+		std::shared_ptr<ic4::ImageBuffer> process(const std::shared_ptr<ic4::ImageBuffer>& buffer, const ChunkValues& chunks) override;
+
+		/// <summary>
+		/// Returns the statistics of the most recently analyzed frame
+		/// </summary>
+		ImageStatistics latest() const;
+
+	private:
+		std::chrono::milliseconds _interval;
+		size_t _max_pixels;
+		std::chrono::steady_clock::time_point _last_update;
+
+		mutable std::mutex _mtx;
+		ImageStatistics _latest;
+	};
+}
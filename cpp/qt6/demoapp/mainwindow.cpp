@@ -34,19 +34,49 @@
 #include <QFileDialog>
 #include <QStandardPaths>
 #include <QClipboard>
-#include <QTimer>
 #include <QKeySequence>
 #include <QSettings>
 #include <QToolTip>
+#include <QDateTime>
 
 #include <filesystem>
 #include <string>
+#include <vector>
 
 MainWindow::MainWindow(const init_options& params, QWidget* parent)
 	: QMainWindow(parent)
+	, _devicePool(
+		1,
+		[this]
+		{
+			auto grabber = std::make_unique<ic4::Grabber>();
+
+			// Add a device lost handler, which also reports devices that are kept open in the background
+			auto* g = grabber.get();
+			grabber->eventAddDeviceLost([this, g](ic4::Grabber&) {
+				QApplication::postEvent(this, new DeviceLostEvent(g));
+			});
+
+			return grabber;
+		},
+		[](ic4demoapp::DevicePool::Entry& entry)
+		{
+			if (entry.property_dialog != nullptr)
+				entry.property_dialog->deleteLater();
+		}
+	)
+	, _grabber(_devicePool.current().grabber.get())
 	, _videowriter(ic4::VideoWriterType::MP4_H264)
+	, _videoRecorder(_videowriter, [this] { return createSegmentWriter(); })
+	, _burstCapture([this] { QApplication::postEvent(this, new QEvent(BURST_PROGRESS_EVENT)); })
+	, _statisticsPublisher(
+		std::chrono::milliseconds(250),
+		std::chrono::minutes(5),
+		[this] { QApplication::postEvent(this, new QEvent(STATISTICS_CHANGED_EVENT)); }
+	)
 {
 	_settings.read();
+	_devicePool.setCapacity(_settings.device_pool_size);
 
 	if (params.show_settings_menu) {
 		_showSettingsMenu = true;
@@ -68,11 +98,6 @@ MainWindow::MainWindow(const init_options& params, QWidget* parent)
 	// Create the sink for accessing images.
 	_queuesink = ic4::QueueSink::create(*this);
 
-	// Add a device lost handler. 
-	_grabber.eventAddDeviceLost([this](ic4::Grabber& g) {
-		QApplication::postEvent(this, new QEvent(DEVICE_LOST_EVENT));
-	});
-
 	// Create the display for the live video
 	try
 	{
@@ -84,6 +109,15 @@ MainWindow::MainWindow(const init_options& params, QWidget* parent)
 		QMessageBox::information(this, {}, ex.what());
 	}
 
+	// Images produced by processing stages are shown instead of the live video
+	_processingGraph.setOverlayCallback(
+		[this](const std::shared_ptr<ic4::ImageBuffer>& overlay)
+		{
+			if (_display)
+				_display->displayBuffer(overlay, ic4::Error::Ignore());
+		}
+	);
+
 	std::filesystem::path deviceSetupFile_value;
 	if (!params.deviceSetupFile.has_value())
 	{
@@ -99,7 +133,7 @@ MainWindow::MainWindow(const init_options& params, QWidget* parent)
 		ic4::Error err;
 
 		// Try to load the last used device.
-		if (!_grabber.deviceOpenFromState(deviceSetupFile_value, err))
+		if (!_grabber->deviceOpenFromState(deviceSetupFile_value, err))
 		{
 			auto message = "Loading last used device failed: " + err.message();
 			QMessageBox::information(this, {}, message.c_str());
@@ -128,9 +162,52 @@ MainWindow::MainWindow(const init_options& params, QWidget* parent)
 
 MainWindow::~MainWindow()
 {
+	stopStreamForShutdown();
+
 	_settings.write();
 }
 
+/// <summary>
+/// Stops the stream and releases the sink before the window is destroyed.
+/// </summary>
+/// <remarks>
+/// framesQueued uses the processing graph, burst capture, video recorder and statistics publisher,
+/// which are destroyed before _devicePool owning the streaming grabber.
+/// </remarks>
+void MainWindow::stopStreamForShutdown()
+{
+	_statisticsPublisher.stopIdleTimer();
+	if (_grabber != nullptr && _grabber->isStreaming())
+	{
+		_grabber->streamStop(ic4::Error::Ignore());
+	}
+	_queuesink = nullptr;
+
+	if (_capturetovideo)
+	{
+		_capturetovideo = false;
+		_videoRecorder.finishFile();
+	}
+	_videoRecorder.clearPreRoll();
+	_burstCapture.stop();
+	_processingGraph.flush();
+}
+
+/// <summary>
+/// Creates the second video writer for segmented recording, using the saved codec configuration.
+/// </summary>
+std::unique_ptr<ic4::VideoWriter> MainWindow::createSegmentWriter()
+{
+	auto writer = std::make_unique<ic4::VideoWriter>(ic4::VideoWriterType::MP4_H264);
+
+	if (std::filesystem::is_regular_file(_codecconfigfile))
+	{
+		writer->propertyMap().deSerialize(_codecconfigfile, ic4::Error::Ignore());
+	}
+
+	return writer;
+}
+
 void MainWindow::showVideoFullScreen()
 {
 	onToggleFullScreen();
@@ -192,6 +269,12 @@ void MainWindow::createUI()
 	_ShootPhotoAct->setShortcut(QKeySequence::Save);
 	connect(_ShootPhotoAct, &QAction::triggered, this, &MainWindow::onShootPhoto);
 
+	// Shoot Photo Burst
+	_ShootBurstAct = new QAction(tr("Shoot photo &burst"), this);
+	_ShootBurstAct->setStatusTip(tr("Shoot a series of photos and save them in the background"));
+	_ShootBurstAct->setEnabled(false);
+	connect(_ShootBurstAct, &QAction::triggered, this, &MainWindow::onShootBurst);
+
 	// Capture Video
 	_recordstartact = new QAction(selector.loadIcon(":/images/recordstart.png"), tr("&Capture video"), this);
 	_recordstartact->setStatusTip(tr("Capture video into MP4 file"));
@@ -294,6 +377,148 @@ void MainWindow::createUI()
 	connect(expertEntry, &QAction::triggered, [this, update_entries] { _settings.default_visibility = ic4::PropVisibility::Expert; update_entries(); });
 	connect(guruEntry, &QAction::triggered, [this, update_entries] { _settings.default_visibility = ic4::PropVisibility::Guru; update_entries(); });
 
+	auto recordQueueMenu = new QMenu(tr("Video &Recording Queue"), this);
+	recordQueueMenu->setStatusTip(tr("Sets how frames are queued for the video encoder"));
+	auto dropOldestEntry = recordQueueMenu->addAction(tr("Drop Oldest Frame When Full"));
+	dropOldestEntry->setCheckable(true);
+	auto blockEntry = recordQueueMenu->addAction(tr("Wait for Encoder When Full"));
+	blockEntry->setCheckable(true);
+	recordQueueMenu->addSeparator();
+	std::vector<std::pair<QAction*, int>> queueLengthEntries;
+	for (int length : { 4, 8, 16, 32 })
+	{
+		auto entry = recordQueueMenu->addAction(tr("%1 Frames").arg(length));
+		entry->setCheckable(true);
+		entry->setStatusTip(tr("Takes effect when the stream is started"));
+		queueLengthEntries.push_back({ entry, length });
+	}
+
+	auto update_record_queue_entries = [this, dropOldestEntry, blockEntry, queueLengthEntries] {
+		dropOldestEntry->setChecked(_settings.record_queue_drop_oldest);
+		blockEntry->setChecked(!_settings.record_queue_drop_oldest);
+		for (auto&& [entry, length] : queueLengthEntries)
+			entry->setChecked(_settings.record_queue_length == length);
+	};
+	update_record_queue_entries();
+
+	connect(dropOldestEntry, &QAction::triggered, [this, update_record_queue_entries] { _settings.record_queue_drop_oldest = true; update_record_queue_entries(); });
+	connect(blockEntry, &QAction::triggered, [this, update_record_queue_entries] { _settings.record_queue_drop_oldest = false; update_record_queue_entries(); });
+	for (auto&& [entry, length] : queueLengthEntries)
+	{
+		connect(entry, &QAction::triggered, [this, length = length, update_record_queue_entries] { _settings.record_queue_length = length; update_record_queue_entries(); });
+	}
+
+	auto recordTimingMenu = new QMenu(tr("Video Recording &Timing"), this);
+	recordTimingMenu->setStatusTip(tr("Sets how frames are placed in the constant frame rate video file"));
+	std::vector<std::pair<QAction*, ic4demoapp::VideoRecorder::TimingMode>> timingEntries = {
+		{ recordTimingMenu->addAction(tr("One Video Frame per Captured Frame")), ic4demoapp::VideoRecorder::TimingMode::FrameCount },
+		{ recordTimingMenu->addAction(tr("Device Timestamps")), ic4demoapp::VideoRecorder::TimingMode::DeviceTimestamp },
+		{ recordTimingMenu->addAction(tr("Arrival Time")), ic4demoapp::VideoRecorder::TimingMode::ArrivalTime },
+	};
+
+	auto update_record_timing_entries = [this, timingEntries] {
+		for (auto&& [entry, mode] : timingEntries)
+			entry->setChecked(_settings.record_timing == static_cast<int>(mode));
+	};
+
+	for (auto&& [entry, mode] : timingEntries)
+	{
+		entry->setCheckable(true);
+		connect(entry, &QAction::triggered, [this, mode = mode, update_record_timing_entries] { _settings.record_timing = static_cast<int>(mode); update_record_timing_entries(); });
+	}
+	update_record_timing_entries();
+
+	auto prerollMenu = new QMenu(tr("Video Recording &Pre-Roll"), this);
+	prerollMenu->setStatusTip(tr("Keeps the most recent frames to be written at the beginning of the next video file"));
+	std::vector<std::pair<QAction*, int>> prerollEntries = {
+		{ prerollMenu->addAction(tr("Off")), 0 },
+		{ prerollMenu->addAction(tr("1 Second")), 1000 },
+		{ prerollMenu->addAction(tr("2 Seconds")), 2000 },
+		{ prerollMenu->addAction(tr("5 Seconds")), 5000 },
+		{ prerollMenu->addAction(tr("10 Seconds")), 10000 },
+	};
+
+	auto update_preroll_entries = [this, prerollEntries] {
+		for (auto&& [entry, duration_ms] : prerollEntries)
+			entry->setChecked(_settings.preroll_duration_ms == duration_ms);
+	};
+
+	for (auto&& [entry, duration_ms] : prerollEntries)
+	{
+		entry->setCheckable(true);
+		entry->setStatusTip(tr("Takes effect when the stream is started, limited to %1 MiB of image buffers").arg(_settings.preroll_memory_mb));
+		connect(entry, &QAction::triggered, [this, duration_ms = duration_ms, update_preroll_entries] { _settings.preroll_duration_ms = duration_ms; update_preroll_entries(); });
+	}
+	update_preroll_entries();
+
+	auto segmentMenu = new QMenu(tr("Video Recording &Segments"), this);
+	segmentMenu->setStatusTip(tr("Splits long recordings into multiple files"));
+	std::vector<std::pair<QAction*, int>> segmentEntries = {
+		{ segmentMenu->addAction(tr("Single File")), 0 },
+		{ segmentMenu->addAction(tr("New File Every Minute")), 1 },
+		{ segmentMenu->addAction(tr("New File Every 5 Minutes")), 5 },
+		{ segmentMenu->addAction(tr("New File Every 15 Minutes")), 15 },
+		{ segmentMenu->addAction(tr("New File Every Hour")), 60 },
+	};
+
+	auto update_segment_entries = [this, segmentEntries] {
+		for (auto&& [entry, duration_min] : segmentEntries)
+			entry->setChecked(_settings.segment_duration_min == duration_min);
+	};
+
+	for (auto&& [entry, duration_min] : segmentEntries)
+	{
+		entry->setCheckable(true);
+		connect(entry, &QAction::triggered, [this, duration_min = duration_min, update_segment_entries] { _settings.segment_duration_min = duration_min; update_segment_entries(); });
+	}
+	update_segment_entries();
+
+	auto burstMenu = new QMenu(tr("Photo &Burst"), this);
+	burstMenu->setStatusTip(tr("Sets the number of photos and the file format of a photo burst"));
+	struct BurstLength { QAction* entry; int frames; int duration_ms; };
+	std::vector<BurstLength> burstLengthEntries = {
+		{ burstMenu->addAction(tr("10 Frames")), 10, 0 },
+		{ burstMenu->addAction(tr("50 Frames")), 50, 0 },
+		{ burstMenu->addAction(tr("100 Frames")), 100, 0 },
+		{ burstMenu->addAction(tr("All Frames for 1 Second")), 0, 1000 },
+		{ burstMenu->addAction(tr("All Frames for 5 Seconds")), 0, 5000 },
+	};
+	burstMenu->addSeparator();
+	std::vector<std::pair<QAction*, ic4_examples::io::FileFormat>> burstFormatEntries = {
+		{ burstMenu->addAction(tr("JPEG")), ic4_examples::io::FileFormat::Jpeg },
+		{ burstMenu->addAction(tr("Bitmap")), ic4_examples::io::FileFormat::Bitmap },
+		{ burstMenu->addAction(tr("Portable Network Graphics")), ic4_examples::io::FileFormat::Png },
+		{ burstMenu->addAction(tr("TIFF")), ic4_examples::io::FileFormat::Tiff },
+	};
+	burstMenu->addSeparator();
+	auto burstDirectoryEntry = burstMenu->addAction(tr("Select Directory..."));
+
+	auto update_burst_entries = [this, burstLengthEntries, burstFormatEntries] {
+		for (auto&& e : burstLengthEntries)
+			e.entry->setChecked(_settings.burst_frames == e.frames && (e.frames > 0 || _settings.burst_duration_ms == e.duration_ms));
+		for (auto&& [entry, format] : burstFormatEntries)
+			entry->setChecked(_settings.burst_format == static_cast<int>(format));
+	};
+
+	for (auto&& e : burstLengthEntries)
+	{
+		e.entry->setCheckable(true);
+		connect(e.entry, &QAction::triggered, [this, e, update_burst_entries] { _settings.burst_frames = e.frames; _settings.burst_duration_ms = e.duration_ms; update_burst_entries(); });
+	}
+	for (auto&& [entry, format] : burstFormatEntries)
+	{
+		entry->setCheckable(true);
+		connect(entry, &QAction::triggered, [this, format = format, update_burst_entries] { _settings.burst_format = static_cast<int>(format); update_burst_entries(); });
+	}
+	connect(burstDirectoryEntry, &QAction::triggered,
+		[this] {
+			auto directory = QFileDialog::getExistingDirectory(this, tr("Select Photo Burst Directory"), QString::fromStdString(_settings.burst_directory));
+			if (!directory.isEmpty())
+				_settings.burst_directory = directory.toStdString();
+		}
+	);
+	update_burst_entries();
+
 	auto deleteDeviceSettingsFile  = new QAction(tr("Delete Device Settings File"), this);
 	deleteDeviceSettingsFile->setStatusTip(tr("Deletes the current device settings file"));
 	connect(deleteDeviceSettingsFile, &QAction::triggered,
@@ -327,6 +552,9 @@ void MainWindow::createUI()
 	// Create the Device Menu
 	auto deviceMenu = menuBar()->addMenu(tr("&Device"));
 	deviceMenu->addAction(_DeviceSelectAct);
+	_recentDevicesMenu = new QMenu(tr("&Recent Devices"), this);
+	connect(_recentDevicesMenu, &QMenu::aboutToShow, this, &MainWindow::updateRecentDevicesMenu);
+	deviceMenu->addMenu(_recentDevicesMenu);
 	deviceMenu->addAction(_DevicePropertiesAct);
     deviceMenu->addAction(_DeviceDriverPropertiesAct);
 	deviceMenu->addAction(_TriggerModeAct);
@@ -340,6 +568,7 @@ void MainWindow::createUI()
 	// Create the Capture Menu
 	auto captureMenu = menuBar()->addMenu(tr("&Capture"));
 	captureMenu->addAction(_ShootPhotoAct);
+	captureMenu->addAction(_ShootBurstAct);
 	captureMenu->addAction(_recordstartact);
 	captureMenu->addAction(_recordpauseact);
 	captureMenu->addAction(_recordstopact);
@@ -351,6 +580,11 @@ void MainWindow::createUI()
 	settingsMenu->addMenu(defaultVisibilityMenu);
 	settingsMenu->addAction(deleteDeviceSettingsFile);
 	settingsMenu->addAction(startStreamOnOpenAction);
+	settingsMenu->addMenu(recordQueueMenu);
+	settingsMenu->addMenu(recordTimingMenu);
+	settingsMenu->addMenu(prerollMenu);
+	settingsMenu->addMenu(segmentMenu);
+	settingsMenu->addMenu(burstMenu);
 	settingsMenu->menuAction()->setVisible(_showSettingsMenu);
 
 	////////////////////////////////////////////////////////////////////////////
@@ -364,6 +598,17 @@ void MainWindow::createUI()
 	fullscreen_menu->addAction(_toggle_visibility_full_screen_tool_bar);
 	fullscreen_menu->addAction(_toggle_visibility_full_screen_status_bar);
 
+	// The statistics panel is hidden initially, the statistics are only calculated while it is visible
+	_statisticsPanel = new ic4demoapp::StatisticsPanel(this);
+	addDockWidget(Qt::RightDockWidgetArea, _statisticsPanel);
+	_statisticsPanel->hide();
+
+	auto statisticsAct = _statisticsPanel->toggleViewAction();
+	statisticsAct->setText(tr("Image &Statistics"));
+	connect(statisticsAct, &QAction::toggled, this, &MainWindow::onToggleImageStatistics);
+	viewMenu->addSeparator();
+	viewMenu->addAction(statisticsAct);
+
 	////////////////////////////////////////////////////////////////////////////
 	// Create the Help Menu
 	auto helpMenu = menuBar()->addMenu(tr("&Help"));
@@ -403,14 +648,15 @@ void MainWindow::createUI()
 	statusBar()->addPermanentWidget(new QLabel("  "));
 	_sbFpsLabel = new QLabel("");
 	statusBar()->addPermanentWidget(_sbFpsLabel);
+	_sbFpsSparkline = new ic4demoapp::SparklineWidget(_statisticsPublisher.historyLength());
+	statusBar()->addPermanentWidget(_sbFpsSparkline);
+	_sbRecordingLabel = new QLabel("");
+	_sbRecordingLabel->setVisible(false);
+	statusBar()->addPermanentWidget(_sbRecordingLabel);
 	statusBar()->addPermanentWidget(new QLabel("  "));
 	_sbCameraLabel = new QLabel(statusBar());
 	statusBar()->addPermanentWidget(_sbCameraLabel);
 
-	_updateStatisticsTimer = new QTimer(this);
-	connect(_updateStatisticsTimer, &QTimer::timeout, this, &MainWindow::onUpdateStatisticsTimer);
-	_updateStatisticsTimer->start(100);
-
 	_VideoWidget->installEventFilter(this);
 	_VideoWidget->setContextMenuPolicy(Qt::ContextMenuPolicy::CustomContextMenu);
 	connect(_VideoWidget, &QWidget::customContextMenuRequested, this, &MainWindow::onDisplayContextMenu);
@@ -429,10 +675,12 @@ void MainWindow::createUI()
 
 void MainWindow::closeEvent(QCloseEvent* ev)
 {
-	if (_grabber.isDeviceValid())
+	if (_grabber->isDeviceValid())
 	{
-		_grabber.deviceSaveState(_devicefile);
+		_grabber->deviceSaveState(_devicefile);
 	}
+
+	stopStreamForShutdown();
 }
 
 void MainWindow::changeEvent(QEvent* ev)
@@ -478,16 +726,67 @@ bool MainWindow::eventFilter(QObject* obj, QEvent* event)
 			break;
 		}
 	}
+	else if (obj == _propertyDialog)
+	{
+		// The dialog shows properties backed by chunk data, which are only updated while it is visible
+		switch (event->type())
+		{
+		case QEvent::Show:
+			_chunkDataForDialog = true;
+			break;
+		case QEvent::Hide:
+			_chunkDataForDialog = false;
+			break;
+		}
+	}
 
 	return false;
 }
 
-void MainWindow::updateStatistics()
+/// <summary>
+/// Queries the stream statistics and queue sizes.
+/// Called from the acquisition thread, or the statistics publisher's idle timer while the stream is running.
+/// </summary>
+ic4demoapp::StatisticsSnapshot MainWindow::collectStatistics(ic4::Error& streamErr)
 {
+	ic4demoapp::StatisticsSnapshot snapshot;
+	snapshot.time = std::chrono::steady_clock::now();
+
+	snapshot.stream = _grabber->streamStatistics(streamErr);
+	snapshot.stream_valid = streamErr.isSuccess();
+
 	ic4::Error err;
-	auto stats = _grabber.streamStatistics(err);
-	if (err.isSuccess())
+	snapshot.queue = _queuesink->queueSizes(err);
+	snapshot.queue_valid = err.isSuccess();
+
+	return snapshot;
+}
+
+void MainWindow::publishStatistics()
+{
+	ic4::Error err;
+	auto snapshot = collectStatistics(err);
+	if (!snapshot.stream_valid)
+	{
+		qWarning().noquote() << "Failed query stream statistics:" << err.message().c_str();
+	}
+
+	snapshot.fps = _fpsCounter.current();
+
+	_statisticsPublisher.publish(snapshot);
+}
+
+void MainWindow::updateStatistics()
+{
+	// Only redraw if the acquisition thread published new values
+	ic4demoapp::StatisticsSnapshot snapshot;
+	if (!_statisticsPublisher.takeSnapshot(snapshot))
+		return;
+
+	if (snapshot.stream_valid)
 	{
+		const auto& stats = snapshot.stream;
+
 		auto text = QString("Frames Delivered: %1 Dropped: %2/%3/%4/%5/%6")
 			.arg(stats.sink_delivered)
 			.arg(stats.device_transmission_error)
@@ -513,15 +812,31 @@ void MainWindow::updateStatistics()
 			.arg(stats.transform_underrun)
 			.arg(stats.sink_underrun);
 
-		if (auto sz = _queuesink->queueSizes(err); err.isSuccess())
+		if (snapshot.queue_valid)
 		{
 			tooltip += QString(
 				"\n"
 				"QueueSink:\n"
 				"  Free Queue: %1\n"
 				"  Output Queue: %2")
-				.arg(sz.free_queue_length)
-				.arg(sz.output_queue_length);
+				.arg(snapshot.queue.free_queue_length)
+				.arg(snapshot.queue.output_queue_length);
+		}
+
+		auto stageStats = _processingGraph.statistics();
+		if (!stageStats.empty())
+		{
+			tooltip += "\nProcessing:";
+			for (auto&& stage : stageStats)
+			{
+				tooltip += QString("\n  %1: %2 processed, %3 skipped, latency %4 ms (mean %5 ms, max %6 ms)")
+					.arg(QString::fromStdString(stage.name))
+					.arg(stage.processed)
+					.arg(stage.skipped)
+					.arg(stage.last_latency_ms, 0, 'f', 1)
+					.arg(stage.mean_latency_ms, 0, 'f', 1)
+					.arg(stage.max_latency_ms, 0, 'f', 1);
+			}
 		}
 
 		_sbStatisticsLabel->setToolTip(tooltip);
@@ -533,24 +848,73 @@ void MainWindow::updateStatistics()
 			QToolTip::showText(cursor_pos, tooltip, _sbStatisticsLabel);
 		}
 	}
-	else
-	{
-		qWarning().noquote() << "Failed query stream statistics:" << err.message().c_str();
-	}
 
 	_sbFpsLabel->setText(
 		QString(
 			"%1 FPS")
-			.arg(_fpsCounter.current(), 0, 'f', 1)
+			.arg(snapshot.fps, 0, 'f', 1)
+	);
+
+	std::vector<ic4demoapp::SparklineWidget::Point> fpsPoints;
+	for (auto&& sample : _statisticsPublisher.history())
+	{
+		fpsPoints.push_back({ sample.time - snapshot.time, sample.fps });
+	}
+	_sbFpsSparkline->setPoints(std::move(fpsPoints));
+	_sbFpsSparkline->setToolTip(
+		QString("Frame rate of the last %1 minutes").arg(_statisticsPublisher.historyLength().count() / 60)
 	);
+
+	if (_videoRecorder.isRecording())
+	{
+		_sbRecordingLabel->setText(
+			QString("  Recording %1 FPS Encoder Backlog: %2/%3 Dropped: %4")
+				.arg(_videoRecorder.effectiveFrameRate(), 0, 'f', 1)
+				.arg(_videoRecorder.backlog())
+				.arg(_videoRecorder.queueCapacity())
+				.arg(_videoRecorder.numDropped())
+		);
+		_sbRecordingLabel->setToolTip(recordingSummaryText());
+	}
+	else if (auto prerollFrames = _videoRecorder.preRollFrames())
+	{
+		_sbRecordingLabel->setText(
+			QString("  Pre-Roll: %1 s")
+				.arg(_videoRecorder.preRollDuration().count() / 1000.0, 0, 'f', 1)
+		);
+		_sbRecordingLabel->setToolTip(
+			QString("%1 frames are kept to be written at the beginning of the next video file").arg(prerollFrames)
+		);
+	}
+	_sbRecordingLabel->setVisible(_videoRecorder.isRecording() || _videoRecorder.preRollFrames() > 0);
 }
 
-void MainWindow::onUpdateStatisticsTimer()
+void MainWindow::onToggleImageStatistics(bool visible)
 {
-	if (!_grabber.isStreaming())
-		return;
+	if (visible && !_imageStatisticsStage)
+	{
+		// The statistics are calculated on the processing graph's thread pool at most 10 times per second,
+		// so that the analysis does not delay the sink callback
+		_imageStatisticsStage = std::make_shared<ic4demoapp::ImageStatisticsStage>();
+		_processingGraph.addStage(_imageStatisticsStage);
 
-	updateStatistics();
+		// The stage keeps a buffer while processing, add it if the stream is already set up
+		if (_grabber->isStreaming() && _queuesink)
+		{
+			auto required = _processingGraph.maxBuffersInUse();
+			if (required > _processingBuffersAllocated)
+			{
+				_queuesink->allocAndQueueBuffers(required - _processingBuffersAllocated, ic4::Error::Ignore());
+				_processingBuffersAllocated = required;
+			}
+		}
+	}
+	else if (!visible && _imageStatisticsStage)
+	{
+		_processingGraph.removeStage(_imageStatisticsStage);
+		_imageStatisticsStage = nullptr;
+		_statisticsPanel->setStatistics({});
+	}
 }
 
 /////////////////////////////////////////////////////////////
@@ -566,7 +930,32 @@ void MainWindow::customEvent(QEvent* event)
 	}
 	else if (event->type() == DEVICE_LOST_EVENT)
 	{
-		onDeviceLost();
+		auto* grabber = static_cast<DeviceLostEvent*>(event)->grabber();
+		if (grabber == _grabber)
+		{
+			onDeviceLost();
+		}
+		else
+		{
+			// A device kept open in the background was lost, no longer offer it
+			_devicePool.remove(grabber);
+		}
+	}
+	else if (event->type() == STATISTICS_CHANGED_EVENT)
+	{
+		updateStatistics();
+
+		// The image statistics and burst progress are refreshed along with the stream statistics
+		if (_imageStatisticsStage)
+		{
+			_statisticsPanel->setStatistics(_imageStatisticsStage->latest());
+		}
+		updateBurstStatus();
+	}
+	else if (event->type() == BURST_PROGRESS_EVENT)
+	{
+		// Photos of a burst can still be saved after the stream was stopped
+		updateBurstStatus();
 	}
 
 	// use more else ifs to handle other custom events
@@ -577,24 +966,25 @@ void MainWindow::customEvent(QEvent* event)
 /// </summary>
 void MainWindow::updateControls()
 {
-	if (!_grabber.isDeviceOpen())
+	if (!_grabber->isDeviceOpen())
 		_sbStatisticsLabel->clear();
 
-	_DevicePropertiesAct->setEnabled(_grabber.isDeviceValid());
-	_DeviceDriverPropertiesAct->setEnabled(_grabber.isDeviceValid());
-	_exportDeviceSettingsAct->setEnabled(_grabber.isDeviceValid());
-	_closeDeviceAct->setEnabled(_grabber.isDeviceOpen());
-	_StartLiveAct->setEnabled(_grabber.isDeviceValid());
-	_StartLiveAct->setChecked(_grabber.isStreaming());
-	_ShootPhotoAct->setEnabled(_grabber.isStreaming());
-	_recordstartact->setEnabled(_grabber.isStreaming());
+	_DevicePropertiesAct->setEnabled(_grabber->isDeviceValid());
+	_DeviceDriverPropertiesAct->setEnabled(_grabber->isDeviceValid());
+	_exportDeviceSettingsAct->setEnabled(_grabber->isDeviceValid());
+	_closeDeviceAct->setEnabled(_grabber->isDeviceOpen());
+	_StartLiveAct->setEnabled(_grabber->isDeviceValid());
+	_StartLiveAct->setChecked(_grabber->isStreaming());
+	_ShootPhotoAct->setEnabled(_grabber->isStreaming());
+	_ShootBurstAct->setEnabled(_grabber->isStreaming());
+	_recordstartact->setEnabled(_grabber->isStreaming());
 
 	updateTriggerControl();
 }
 
 void MainWindow::updateTriggerControl()
 {
-	if (!_grabber.isDeviceValid())
+	if (!_grabber->isDeviceValid())
 	{
 		_TriggerModeAct->setEnabled(false);
 		_TriggerModeAct->setChecked(false);
@@ -622,7 +1012,7 @@ void MainWindow::updateTriggerControl()
 void MainWindow::updateCameraLabel()
 {
 	ic4::Error err;
-	auto deviceInfo = _grabber.deviceInfo(err);
+	auto deviceInfo = _grabber->deviceInfo(err);
 	if (err.isSuccess())
 	{
 		auto text = deviceInfo.modelName() + " " + deviceInfo.serial();
@@ -637,30 +1027,116 @@ void MainWindow::updateCameraLabel()
 /// <summary>
 /// Show the device selection dialog for selecting a camera.
 /// </summary>
+/// <remarks>
+/// The new device is opened in a new grabber, the previous device is kept open in the device pool.
+/// Devices that are already open are not listed, they are selected from the Recent Devices menu.
+/// </remarks>
 void MainWindow::onSelectDevice()
 {	
-	DeviceSelectionDialog cDlg(_VideoWidget, &_grabber);
+	auto grabber = _devicePool.createGrabber();
+
+	DeviceSelectionDialog cDlg(_VideoWidget, grabber.get(), [this](const ic4::DeviceInfo& dev) { return !_devicePool.contains(dev); });
 	if (cDlg.exec() == 1)
 	{
-		if (_propertyDialog != nullptr)
-		{
-			_propertyDialog->updateGrabber(_grabber);
-		}
+		bool propertyDialogVisible = deactivateDevice();
+
+		_devicePool.add(std::move(grabber));
+		activateCurrentDevice();
 
 		prepareNewDeviceOpen();
 
 		onDeviceOpened();
+
+		if (propertyDialogVisible)
+		{
+			onDeviceProperties();
+		}
+	}
+	updateControls();
+}
+
+/// <summary>
+/// Switches to a device that is kept open in the device pool.
+/// Only the stream has to be set up again, the device and its property dialog are reused.
+/// </summary>
+void MainWindow::onSwitchDevice(ic4::Grabber* grabber)
+{
+	if (grabber == _grabber)
+		return;
+
+	bool propertyDialogVisible = deactivateDevice();
+
+	_devicePool.activate(*grabber);
+	activateCurrentDevice();
+
+	onDeviceActivated();
+
+	if (propertyDialogVisible)
+	{
+		onDeviceProperties();
 	}
 	updateControls();
 }
 
+/// <summary>
+/// Stops the stream and hides the property dialog of the current device, before another device becomes the current device.
+/// </summary>
+/// <returns>true if the property dialog was visible</returns>
+bool MainWindow::deactivateDevice()
+{
+	if (_grabber->isStreaming())
+	{
+		startstopstream();
+	}
+
+	bool propertyDialogVisible = _propertyDialog != nullptr && _propertyDialog->isVisible();
+	if (_propertyDialog != nullptr)
+	{
+		_propertyDialog->hide();
+	}
+
+	return propertyDialogVisible;
+}
+
+void MainWindow::activateCurrentDevice()
+{
+	auto& entry = _devicePool.current();
+	_grabber = entry.grabber.get();
+	_propertyDialog = entry.property_dialog;
+}
+
+void MainWindow::updateRecentDevicesMenu()
+{
+	_recentDevicesMenu->clear();
+
+	for (auto&& entry : _devicePool.entries())
+	{
+		auto* grabber = entry.grabber.get();
+
+		ic4::Error err;
+		auto deviceInfo = grabber->deviceInfo(err);
+		if (err.isFailure())
+			continue;
+
+		auto text = deviceInfo.modelName() + " " + deviceInfo.serial();
+		auto action = _recentDevicesMenu->addAction(QString::fromStdString(text));
+		action->setCheckable(true);
+		action->setChecked(grabber == _grabber);
+		connect(action, &QAction::triggered, [this, grabber] { onSwitchDevice(grabber); });
+	}
+
+	if (_recentDevicesMenu->isEmpty())
+	{
+		_recentDevicesMenu->addAction(tr("No devices"))->setEnabled(false);
+	}
+}
 
 void MainWindow::prepareNewDeviceOpen()
 {
 	// This code detects a Polarization camera
 	// If a Polarization camera is detected we set ProcessedPixelFormatEnable to true and then select BGRa8 as the PixelFormat
 
-	auto propMap = _grabber.devicePropertyMap();
+	auto propMap = _grabber->devicePropertyMap();
 
 	auto propProcessedPixelFormatsEnable = propMap.findBoolean("ProcessedPixelFormatsEnable", ic4::Error::Ignore());
 	if (propProcessedPixelFormatsEnable.is_valid())
@@ -698,14 +1174,20 @@ void MainWindow::prepareNewDeviceOpen()
 
 void MainWindow::onDeviceOpened()
 {
-	// Remember the device's property map for later use
-	_devicePropertyMap = _grabber.devicePropertyMap(ic4::Error::Ignore());
-
-	auto triggerMode = _devicePropertyMap.find(ic4::PropId::TriggerMode, ic4::Error::Ignore());
+	// The notification stays registered while the device is kept open in the device pool
+	auto triggerMode = _grabber->devicePropertyMap(ic4::Error::Ignore()).find(ic4::PropId::TriggerMode, ic4::Error::Ignore());
 	if (triggerMode.is_valid()) {
 		triggerMode.eventAddNotification([this](ic4::Property&) { updateTriggerControl(); }, ic4::Error::Ignore());
 	}
 
+	onDeviceActivated();
+}
+
+void MainWindow::onDeviceActivated()
+{
+	// Remember the device's property map for later use
+	_devicePropertyMap = _grabber->devicePropertyMap(ic4::Error::Ignore());
+
 	updateCameraLabel();
 	if (_settings.start_stream_on_open)
 	{
@@ -720,8 +1202,11 @@ void MainWindow::onDeviceProperties()
 {
 	if (_propertyDialog == nullptr)
 	{
-		_propertyDialog = new PropertyDialog(_grabber, _VideoWidget, tr("Device Properties"));
+		// The dialog is kept with the device in the device pool, so that its property tree is not rebuilt when switching devices
+		_propertyDialog = new PropertyDialog(*_grabber, _VideoWidget, tr("Device Properties"));
 		_propertyDialog->setPropVisibility(_settings.default_visibility);
+		_propertyDialog->installEventFilter(this);
+		_devicePool.current().property_dialog = _propertyDialog;
 	}
 
 	_propertyDialog->show();
@@ -729,7 +1214,7 @@ void MainWindow::onDeviceProperties()
 
 void MainWindow::onDeviceDriverProperties()
 {
-    PropertyDialog cDlg(_grabber.driverPropertyMap(), _VideoWidget, tr("Device Driver Properties"));
+    PropertyDialog cDlg(_grabber->driverPropertyMap(), _VideoWidget, tr("Device Driver Properties"));
 	cDlg.setPropVisibility(_settings.default_visibility);
 	
 	cDlg.exec();
@@ -751,26 +1236,43 @@ void MainWindow::startstopstream()
 {
 	try
 	{
-		if (_grabber.isDeviceValid())
+		if (_grabber->isDeviceValid())
 		{
-			if (_grabber.isStreaming())
+			if (_grabber->isStreaming())
 			{
-				_grabber.streamStop();
+				_statisticsPublisher.stopIdleTimer();
+				_grabber->streamStop();
 				if (_capturetovideo)
 				{
 					onStopCaptureVideo();
 				}
+				_videoRecorder.clearPreRoll();
+				_burstCapture.stop();
+				_processingGraph.flush();
 
-				// Update statistics one final time (auto update is disabled while stream is stopped)
+				// Update statistics one final time (no more snapshots are published while stream is stopped)
+				publishStatistics();
 				updateStatistics();
+				updateBurstStatus();
 			}
 			else
 			{
-				auto pixel_format_value = _grabber.devicePropertyMap().find(ic4::PropId::PixelFormat).getIntValue();
+				auto pixel_format_value = _grabber->devicePropertyMap().find(ic4::PropId::PixelFormat).getIntValue();
 
 				if (_display->canRender(ic4::ImageType(ic4::PixelFormat(pixel_format_value)), ic4::Error::Throw()))
 				{
-					_grabber.streamSetup(_queuesink, _display);
+					if (_processingGraph.hasOverlayStages())
+					{
+						// The overlay stages display their results instead of the frames
+						_grabber->streamSetup(_queuesink);
+					}
+					else
+					{
+						_grabber->streamSetup(_queuesink, _display);
+					}
+
+					// Keep the statistics updated when no frames arrive
+					_statisticsPublisher.startIdleTimer([this] { ic4::Error err; return collectStatistics(err); });
 				}
 			}
 		}
@@ -795,6 +1297,7 @@ void MainWindow::onDeviceLost()
 	{
 		onStopCaptureVideo();
 	}
+	_videoRecorder.clearPreRoll();
 	updateCameraLabel();
 	updateControls();
 }
@@ -808,6 +1311,71 @@ void MainWindow::onShootPhoto()
 	_shootPhoto = true;
 }
 
+void MainWindow::onShootBurst()
+{
+	auto directory = QString::fromStdString(_settings.burst_directory);
+	if (directory.isEmpty())
+		directory = QStandardPaths::writableLocation(QStandardPaths::PicturesLocation);
+	QDir(directory).mkpath(".");
+
+	auto prefix = QString("burst_%1_").arg(QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss"));
+
+	ic4demoapp::BurstCapture::Config config;
+#ifdef WIN32
+	config.path_prefix = std::filesystem::path(directory.toStdWString()) / prefix.toStdWString();
+#else
+	config.path_prefix = std::filesystem::path(directory.toStdString()) / prefix.toStdString();
+#endif
+	config.format = static_cast<ic4_examples::io::FileFormat>(_settings.burst_format);
+	config.max_frames = static_cast<uint32_t>((std::max)(_settings.burst_frames, 0));
+	config.duration = std::chrono::milliseconds((std::max)(_settings.burst_duration_ms, 0));
+
+	ic4::Error err;
+	auto imageType = _queuesink->outputImageType(err);
+	if (err.isError())
+	{
+		QMessageBox::critical(this, {}, err.message().c_str());
+		return;
+	}
+
+	if (!_burstCapture.start(config, imageType))
+	{
+		statusBar()->showMessage(tr("The previous photo burst is still being saved"));
+		return;
+	}
+
+	_burstStatusActive = true;
+	updateBurstStatus();
+}
+
+void MainWindow::updateBurstStatus()
+{
+	if (!_burstStatusActive)
+		return;
+
+	// Checked before reading the progress, so that the summary includes the last saved frame
+	bool busy = _burstCapture.isBusy();
+	auto progress = _burstCapture.progress();
+	if (busy)
+	{
+		statusBar()->showMessage(
+			QString("Photo burst: %1 captured, %2 saved")
+				.arg(progress.captured)
+				.arg(progress.saved + progress.failed)
+		);
+		return;
+	}
+
+	_burstStatusActive = false;
+
+	auto text = QString("Photo burst: %1 photos saved").arg(progress.saved);
+	if (progress.skipped > 0)
+		text += QString(", %1 frames skipped").arg(progress.skipped);
+	if (progress.failed > 0)
+		text += QString(", %1 failed: %2").arg(progress.failed).arg(QString::fromStdString(progress.last_error));
+	statusBar()->showMessage(text);
+}
+
 void MainWindow::savePhoto(const ic4::ImageBuffer& imagebuffer)
 {
 	static const QStringList filters(
@@ -886,19 +1454,31 @@ void MainWindow::onStartCaptureVideo()
 		double fps = 25.0;
 		try
 		{
-			fps = _devicePropertyMap.getValueDouble(ic4::PropId::AcquisitionFrameRate);
+			// Devices without a frame rate setting (or in trigger mode) record at the default rate,
+			// the frames' timestamps keep the playback speed correct.
+			ic4::Error fpsErr;
+			auto deviceFps = _devicePropertyMap.getValueDouble(ic4::PropId::AcquisitionFrameRate, fpsErr);
+			if (fpsErr.isSuccess() && deviceFps > 0)
+				fps = deviceFps;
+
 			ic4::ImageType imgtype = _queuesink->outputImageType();
-			_videowriter.beginFile(platformFileName, imgtype, fps);
+			_videoRecorder.setQueueFullPolicy(_settings.record_queue_drop_oldest ? ic4demoapp::VideoRecorder::QueueFullPolicy::DropOldest : ic4demoapp::VideoRecorder::QueueFullPolicy::Block);
+			_videoRecorder.setTimingMode(static_cast<ic4demoapp::VideoRecorder::TimingMode>(_settings.record_timing));
+			_videoRecorder.setPaused(_recordpauseact->isChecked());
+			_videoRecorder.setSegmentation(
+				std::chrono::minutes(_settings.segment_duration_min),
+				static_cast<uint64_t>(_settings.segment_size_mb) * 1024 * 1024,
+				static_cast<uint64_t>(_settings.segment_quota_mb) * 1024 * 1024
+			);
+			_videoRecorder.beginFile(platformFileName, imgtype, fps);
 
 			_capturetovideo = true;
-			_videocapturepause = _recordpauseact->isChecked();
 			_recordstopact->setEnabled(true);
 		}
 		catch (const ic4::IC4Exception& iex)
 		{
-			_videowriter.finishFile();
+			_videoRecorder.finishFile(ic4::Error::Ignore());
 			_capturetovideo = false;
-			_videocapturepause = _recordpauseact->isChecked();
 			_recordstopact->setEnabled(false);
 			_recordstartact->setChecked(false);
 
@@ -914,15 +1494,34 @@ void MainWindow::onStartCaptureVideo()
 
 void MainWindow::onPauseCaptureVideo()
 {
-	_videocapturepause = _recordpauseact->isChecked();
+	_videoRecorder.setPaused(_recordpauseact->isChecked());
 }
 
 void MainWindow::onStopCaptureVideo()
 {
 	_capturetovideo = false;
-	_videowriter.finishFile();
+	// Waits for the encoder to write the queued frames
+	_videoRecorder.finishFile();
 	_recordstartact->setChecked(false);
 	_recordstopact->setEnabled(false);
+
+	statusBar()->showMessage(recordingSummaryText());
+}
+
+QString MainWindow::recordingSummaryText() const
+{
+	auto text = QString("Recorded %1 frames at %2 FPS into a %3 FPS video (%4 repeated, %5 skipped, %6 dropped)")
+		.arg(_videoRecorder.numEncoded())
+		.arg(_videoRecorder.effectiveFrameRate(), 0, 'f', 2)
+		.arg(_videoRecorder.frameRate(), 0, 'f', 2)
+		.arg(_videoRecorder.numDuplicated())
+		.arg(_videoRecorder.numSkipped())
+		.arg(_videoRecorder.numDropped());
+
+	if (_videoRecorder.numSegments() > 1)
+		text += QString(", %1 segments").arg(_videoRecorder.numSegments());
+
+	return text;
 }
 
 void MainWindow::onCodecProperties()
@@ -954,7 +1553,7 @@ void MainWindow::onExportDeviceSettings()
 #endif
 
 		ic4::Error err;
-		if (!_grabber.deviceSaveState(fileName, err))
+		if (!_grabber->deviceSaveState(fileName, err))
 		{
 			QMessageBox::critical(this, {}, err.message().c_str());
 		}
@@ -980,15 +1579,15 @@ void MainWindow::onImportDeviceSettings()
 #endif
 
 		// Stop stream/recording if active
-		if (_grabber.isStreaming())
+		if (_grabber->isStreaming())
 		{
 			startstopstream();
 		}
 
-		_grabber.deviceClose(ic4::Error::Ignore());
+		_grabber->deviceClose(ic4::Error::Ignore());
 
 		ic4::Error err;
-		if (!_grabber.deviceOpenFromState(fileName, err))
+		if (!_grabber->deviceOpenFromState(fileName, err))
 		{
 			QMessageBox::critical(this, {}, err.message().c_str());
 		}
@@ -996,12 +1595,12 @@ void MainWindow::onImportDeviceSettings()
 		if( err.isSuccess() || err.code() == ic4::ErrorCode::Incomplete )
 		{
 			// Remember the device's property map for later use
-			_devicePropertyMap = _grabber.devicePropertyMap(ic4::Error::Ignore());
+			_devicePropertyMap = _grabber->devicePropertyMap(ic4::Error::Ignore());
 
 			// Let the property dialog know a new device was selected
 			if (_propertyDialog != nullptr)
 			{
-				_propertyDialog->updateGrabber(_grabber);
+				_propertyDialog->updateGrabber(*_grabber);
 			}
 
 			// Restart stream
@@ -1015,17 +1614,26 @@ void MainWindow::onImportDeviceSettings()
 
 void MainWindow::onCloseDevice()
 {
-	if (_grabber.isStreaming())
+	if (_grabber->isStreaming())
 	{
 		startstopstream();
 	}
 
 	if (_capturetovideo)
 	{
-		_videowriter.finishFile(ic4::Error::Ignore());
+		_capturetovideo = false;
+		_videoRecorder.finishFile(ic4::Error::Ignore());
 	}
 
-	_grabber.deviceClose(ic4::Error::Ignore());
+	if (_propertyDialog != nullptr)
+	{
+		_propertyDialog->hide();
+	}
+
+	// Replaces the current device with an empty grabber, the other devices are kept open
+	_devicePool.remove(_grabber);
+	activateCurrentDevice();
+
 	_devicePropertyMap = {};
 	_display->displayBuffer(nullptr, ic4::Error::Ignore());
 
@@ -1201,10 +1809,82 @@ bool MainWindow::sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& image
 {
 	// Allocate more buffers than suggested, because we temporarily take some buffers
 	// out of circulation when saving an image or video files.
-	sink.allocAndQueueBuffers(min_buffers_required + 2);
+	// The frames waiting for the video encoder and the pre-roll frames are not copied,
+	// reserve buffers for the whole queue and pre-roll ring.
+	_videoRecorder.setQueueCapacity(_settings.record_queue_length);
+	// The pre-roll ring only needs as many buffers as frames arrive within its duration
+	ic4::Error fpsErr;
+	auto deviceFps = _devicePropertyMap.getValueDouble(ic4::PropId::AcquisitionFrameRate, fpsErr);
+	auto prerollFrames = _videoRecorder.setPreRoll(
+		std::chrono::milliseconds(_settings.preroll_duration_ms),
+		static_cast<size_t>(_settings.preroll_memory_mb) * 1024 * 1024,
+		imageType,
+		fpsErr.isSuccess() ? deviceFps : 0.0
+	);
+	// Each processing stage keeps the frame it is working on.
+	_processingBuffersAllocated = _processingGraph.maxBuffersInUse();
+	sink.allocAndQueueBuffers(min_buffers_required + 2 + _videoRecorder.queueCapacity() + prerollFrames + _processingBuffersAllocated);
 	return true;
 };
 
+/// <summary>
+/// Connects the buffer's chunk data to the device's property map, if the values are needed.
+/// Called from the sink callback.
+/// </summary>
+/// <remarks>
+/// This allows for properties backed by chunk data to be updated.
+/// While the device property dialog is visible, the chunk data is connected at most 10 times per second.
+/// If a processing stage uses chunk values, they are read for every frame.
+/// </remarks>
+ic4demoapp::ChunkValues MainWindow::connectChunkData(const std::shared_ptr<ic4::ImageBuffer>& buffer)
+{
+	ic4demoapp::ChunkValues chunks;
+
+	auto now = std::chrono::steady_clock::now();
+	bool stagesUseChunks = _processingGraph.usesChunkValues();
+	bool dialogUsesChunks = _chunkDataForDialog && now >= _nextChunkDataConnect;
+
+	if (!stagesUseChunks && !dialogUsesChunks)
+	{
+		// Release the buffer that was connected last
+		if (_chunkDataConnected && !_chunkDataForDialog)
+		{
+			_devicePropertyMap.connectChunkData(nullptr, ic4::Error::Ignore());
+			_chunkDataConnected = false;
+		}
+		return chunks;
+	}
+
+	ic4::Error err;
+	if (!_devicePropertyMap.connectChunkData(buffer, err))
+	{
+		qWarning().noquote() << "Failed to connect new buffer to the device's property map:" << err.message().c_str();
+
+		_grabber->devicePropertyMap(ic4::Error::Ignore()).connectChunkData(nullptr, ic4::Error::Ignore());
+		_chunkDataConnected = false;
+		return chunks;
+	}
+
+	_chunkDataConnected = true;
+	if (dialogUsesChunks)
+		_nextChunkDataConnect = now + std::chrono::milliseconds(100);
+
+	if (stagesUseChunks)
+	{
+		// Chunks not sent by the device are left empty
+		ic4::Error chunkErr;
+		auto exposureTime = _devicePropertyMap.getValueDouble(ic4::PropId::ChunkExposureTime, chunkErr);
+		if (chunkErr.isSuccess())
+			chunks.exposure_time = exposureTime;
+
+		auto gain = _devicePropertyMap.getValueDouble(ic4::PropId::ChunkGain, chunkErr);
+		if (chunkErr.isSuccess())
+			chunks.gain = gain;
+	}
+
+	return chunks;
+}
+
 /// <summary>
 /// Listener related: Callback for new frames.
 /// </summary>
@@ -1221,30 +1901,34 @@ void MainWindow::framesQueued(ic4::QueueSink& sink)
 
 	_fpsCounter.notify_frame();
 
-	// Connect the buffer's chunk data to the device's property map
-	// This allows for properties backed by chunk data to be updated
-	if (!_devicePropertyMap.connectChunkData(buffer, err))
+	// Collect the stream statistics for the GUI thread, at most a few times per second
+	if (_statisticsPublisher.isDue(std::chrono::steady_clock::now()))
 	{
-		qWarning().noquote() << "Failed to connect new buffer to the device's property map:" << err.message().c_str();
-
-		_grabber.devicePropertyMap(ic4::Error::Ignore()).connectChunkData(nullptr, ic4::Error::Ignore());
-	}
-		
-	std::lock_guard<std::mutex> guard(_snapphotomutex);
-	if (_shootPhoto)
-	{
-		_shootPhoto = false;
-		// Send an event to the main thread with a reference to 
-		// the main thread of our GUI. 
-		QApplication::postEvent(this, new GotPhotoEvent(buffer));
+		publishStatistics();
 	}
 
-	if (_capturetovideo && !_videocapturepause)
+	// Copies the frame if a photo burst is being captured
+	_burstCapture.addFrame(*buffer);
+
+	// Connecting the chunk data is expensive at high frame rates, only do it if the chunk values are needed
+	auto chunks = connectChunkData(buffer);
+
+	// Pass the frame to the processing stages, which run on the processing graph's thread pool
+	_processingGraph.submit(buffer, chunks);
+
 	{
-		// Save an image into our video file.
-		if (!_videowriter.addFrame(buffer, err))
+		std::lock_guard<std::mutex> guard(_snapphotomutex);
+		if (_shootPhoto)
 		{
-			qWarning().noquote() << "Failed to add frame to video file:" << err.message().c_str();
+			_shootPhoto = false;
+			// Send an event to the main thread with a reference to 
+			// the main thread of our GUI. 
+			QApplication::postEvent(this, new GotPhotoEvent(buffer));
 		}
 	}
+
+	// Queue the image for the encoder thread, which saves it into our video file.
+	// Depending on the settings, this drops the oldest queued frame or waits if the encoder falls behind.
+	// While not recording, the recorder keeps the most recent frames for pre-roll, if enabled.
+	_videoRecorder.addFrame(buffer);
 }
@@ -17,6 +17,14 @@
 #include "PropertyDialog.h"
 #include "settings.h"
 #include "fpscounter.h"
+#include "videorecorder.h"
+#include "burstcapture.h"
+#include "processinggraph.h"
+#include "imagestatistics.h"
+#include "statisticspanel.h"
+#include "statisticspublisher.h"
+#include "sparklinewidget.h"
+#include "devicepool.h"
 
 #include <filesystem>
 
@@ -45,11 +53,13 @@ public:
 
 private:
 	void onSelectDevice();
+	void onSwitchDevice(ic4::Grabber* grabber);
 	void onDeviceProperties();
 	void onDeviceDriverProperties();
 	void onToggleTriggerMode();
 	void startstopstream();
 	void onShootPhoto();
+	void onShootBurst();
 	void onStartCaptureVideo();
 	void onPauseCaptureVideo();
 	void onStopCaptureVideo();
@@ -66,13 +76,22 @@ private:
 	void onFullScreenShowStatusBarToggled(bool checked);
 	void onExitFullScreen();
 	void onDeviceOpened();
+	void onDeviceActivated();
+	bool deactivateDevice();
+	void activateCurrentDevice();
+	void stopStreamForShutdown();
+	void updateRecentDevicesMenu();
 	void updateControls();
 	void updateTriggerControl();
 	void updateCameraLabel();
 	void updateStatistics();
-	void onUpdateStatisticsTimer();
+	ic4demoapp::StatisticsSnapshot collectStatistics(ic4::Error& streamErr);
+	void publishStatistics();
+	QString recordingSummaryText() const;
+	void onToggleImageStatistics(bool visible);
 
 	void createUI();
+	std::unique_ptr<ic4::VideoWriter> createSegmentWriter();
 
 protected:
 	void closeEvent(QCloseEvent* ev) override;
@@ -82,6 +101,8 @@ protected:
 private:
 	void customEvent(QEvent* event);
 	void savePhoto(const ic4::ImageBuffer& imagebuffer);
+	ic4demoapp::ChunkValues connectChunkData(const std::shared_ptr<ic4::ImageBuffer>& buffer);
+	void updateBurstStatus();
 
 	void prepareNewDeviceOpen();
 
@@ -94,7 +115,6 @@ private:
 	std::mutex _snapphotomutex;
 	bool _shootPhoto = false;
 	std::atomic<bool> _capturetovideo = false;
-	std::atomic<bool> _videocapturepause = false;
 
 	QGridLayout* mainLayout = nullptr;
 	ic4interop::Qt::DisplayWidget* _VideoWidget = nullptr;
@@ -107,6 +127,7 @@ private:
 	QAction* _TriggerModeAct = nullptr;
 	QAction* _StartLiveAct = nullptr;
 	QAction* _ShootPhotoAct = nullptr;
+	QAction* _ShootBurstAct = nullptr;
 	QAction* _recordstartact = nullptr;
 	QAction* _recordpauseact = nullptr;
 	QAction* _recordstopact = nullptr;
@@ -119,20 +140,40 @@ private:
 	QAction* _toggle_visibility_full_screen_status_bar = nullptr;
 
 	QAction* _closeDeviceAct = nullptr;
+	QMenu* _recentDevicesMenu = nullptr;
 
 	QLabel* _sbStatisticsLabel = nullptr;
 	QLabel* _sbFpsLabel = nullptr;
+	ic4demoapp::SparklineWidget* _sbFpsSparkline = nullptr;
+	QLabel* _sbRecordingLabel = nullptr;
 	QLabel* _sbCameraLabel = nullptr;
 
-	QTimer* _updateStatisticsTimer = nullptr;
-
 	ic4::PropertyMap _devicePropertyMap;
-	ic4::Grabber _grabber;
+	// Recently used devices, kept open for fast switching
+	ic4demoapp::DevicePool _devicePool;
+	// The current device's grabber, owned by _devicePool
+	ic4::Grabber* _grabber = nullptr;
 	std::shared_ptr<ic4::Display> _display;
 	std::shared_ptr<ic4::QueueSink> _queuesink;
 	ic4::VideoWriter _videowriter;
+	// Encodes the recorded frames on its own thread, has to be destroyed before _videowriter
+	ic4demoapp::VideoRecorder _videoRecorder;
+	ic4demoapp::BurstCapture _burstCapture;
+	bool _burstStatusActive = false;
+	// Processing stages applied to the frames, has to be destroyed before _display
+	ic4demoapp::ProcessingGraph _processingGraph;
+	// Number of buffers allocated for the processing stages when the stream was set up
+	size_t _processingBuffersAllocated = 0;
+
+	ic4demoapp::StatisticsPanel* _statisticsPanel = nullptr;
+	std::shared_ptr<ic4demoapp::ImageStatisticsStage> _imageStatisticsStage;
 
 	PropertyDialog* _propertyDialog = nullptr;
+	std::atomic<bool> _chunkDataForDialog = false;
+
+	// Only used on the acquisition thread
+	bool _chunkDataConnected = false;
+	std::chrono::steady_clock::time_point _nextChunkDataConnect;
 
     bool sinkConnected( ic4::QueueSink& sink, const ic4::ImageType& imageType, size_t min_buffers_required ) final;
     void framesQueued( ic4::QueueSink& sink ) final;
@@ -140,7 +181,10 @@ private:
 	bool _showSettingsMenu = false;
 	bool _preFullscreenMaximized = false;
 
+	// Only used on the acquisition thread, and from the GUI thread while the stream is stopped
 	ic4demoapp::FpsCounter _fpsCounter;
+	// Passes the stream statistics from the acquisition thread to the GUI thread
+	ic4demoapp::StatisticsPublisher _statisticsPublisher;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,176 @@
+
+#include "processinggraph.h"
+
+#include <algorithm>
+
+namespace ic4demoapp
+{
+	ProcessingGraph::ProcessingGraph(size_t numThreads)
+	{
+		numThreads = (std::max)(numThreads, size_t(1));
+		for (size_t i = 0; i < numThreads; ++i)
+		{
+			_workers.emplace_back([this] { workerThread(); });
+		}
+	}
+
+	ProcessingGraph::~ProcessingGraph()
+	{
+		flush();
+
+		{
+			std::lock_guard lck(_mtx);
+			_stop = true;
+		}
+		_job_available.notify_all();
+
+		for (auto& t : _workers)
+			t.join();
+	}
+
+	void ProcessingGraph::addStage(std::shared_ptr<ProcessingStage> stage, bool producesOverlay)
+	{
+		auto slot = std::make_shared<StageSlot>();
+		slot->stats.name = stage->name();
+		slot->stage = std::move(stage);
+		slot->produces_overlay = producesOverlay;
+
+		std::lock_guard lck(_mtx);
+		_stages.push_back(std::move(slot));
+		updateUsesChunkValues();
+	}
+
+	void ProcessingGraph::removeStage(const std::shared_ptr<ProcessingStage>& stage)
+	{
+		std::lock_guard lck(_mtx);
+		_stages.erase(
+			std::remove_if(_stages.begin(), _stages.end(), [&](const auto& slot) { return slot->stage == stage; }),
+			_stages.end()
+		);
+		updateUsesChunkValues();
+	}
+
+	void ProcessingGraph::updateUsesChunkValues()
+	{
+		_uses_chunk_values = std::any_of(_stages.begin(), _stages.end(), [](const auto& slot) { return slot->stage->usesChunkValues(); });
+	}
+
+	void ProcessingGraph::setOverlayCallback(OverlayCallback callback)
+	{
+		std::lock_guard lck(_overlay_mtx);
+		_overlay_callback = std::move(callback);
+	}
+
+	bool ProcessingGraph::empty() const
+	{
+		std::lock_guard lck(_mtx);
+		return _stages.empty();
+	}
+
+	bool ProcessingGraph::hasOverlayStages() const
+	{
+		std::lock_guard lck(_mtx);
+		return std::any_of(_stages.begin(), _stages.end(), [](const auto& slot) { return slot->produces_overlay; });
+	}
+
+	bool ProcessingGraph::usesChunkValues() const
+	{
+		return _uses_chunk_values;
+	}
+
+	size_t ProcessingGraph::maxBuffersInUse() const
+	{
+		std::lock_guard lck(_mtx);
+		return _stages.size();
+	}
+
+	void ProcessingGraph::submit(const std::shared_ptr<ic4::ImageBuffer>& buffer, const ChunkValues& chunks)
+	{
+		auto now = clock::now();
+		size_t num_submitted = 0;
+
+		{
+			std::lock_guard lck(_mtx);
+			for (auto& slot : _stages)
+			{
+				if (slot->busy)
+				{
+					slot->stats.skipped += 1;
+					continue;
+				}
+
+				slot->busy = true;
+				_jobs.push_back({ slot, buffer, chunks, now });
+				num_submitted += 1;
+			}
+		}
+
+		if (num_submitted == 1)
+			_job_available.notify_one();
+		else if (num_submitted > 1)
+			_job_available.notify_all();
+	}
+
+	void ProcessingGraph::flush()
+	{
+		std::unique_lock lck(_mtx);
+		_idle.wait(lck, [this] { return _jobs.empty() && _num_running == 0; });
+	}
+
+	std::vector<ProcessingGraph::StageStatistics> ProcessingGraph::statistics() const
+	{
+		std::lock_guard lck(_mtx);
+
+		std::vector<StageStatistics> result;
+		for (auto& slot : _stages)
+		{
+			result.push_back(slot->stats);
+		}
+		return result;
+	}
+
+	void ProcessingGraph::workerThread()
+	{
+		std::unique_lock lck(_mtx);
+
+		while (true)
+		{
+			_job_available.wait(lck, [this] { return _stop || !_jobs.empty(); });
+			if (_jobs.empty())
+				break;
+
+			auto job = std::move(_jobs.front());
+			_jobs.pop_front();
+			_num_running += 1;
+			lck.unlock();
+
+			auto overlay = job.slot->stage->process(job.buffer, job.chunks);
+			auto finished = clock::now();
+
+			// Return the buffer to the sink as early as possible
+			job.buffer.reset();
+
+			if (overlay && job.slot->produces_overlay)
+			{
+				std::lock_guard overlay_lck(_overlay_mtx);
+				if (_overlay_callback)
+					_overlay_callback(overlay);
+			}
+
+			lck.lock();
+
+			auto latency_ms = std::chrono::duration<double, std::milli>(finished - job.submitted).count();
+			auto& stats = job.slot->stats;
+			stats.processed += 1;
+			stats.last_latency_ms = latency_ms;
+			stats.max_latency_ms = (std::max)(stats.max_latency_ms, latency_ms);
+			job.slot->latency_sum_ms += latency_ms;
+			stats.mean_latency_ms = job.slot->latency_sum_ms / stats.processed;
+
+			job.slot->busy = false;
+			_num_running -= 1;
+			if (_jobs.empty() && _num_running == 0)
+				_idle.notify_all();
+		}
+	}
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// Values read from the chunk data of a frame.
+	/// Only filled in if a processing stage uses them and the device sends the corresponding chunk.
+	/// </summary>
+	struct ChunkValues
+	{
+		// Exposure time in microseconds
+		std::optional<double> exposure_time;
+		// Gain in dB
+		std::optional<double> gain;
+	};
+
+	/// <summary>
+	/// A processing step that is applied to the frames delivered by the sink
+	/// </summary>
+	class ProcessingStage
+	{
+	public:
+		virtual ~ProcessingStage() = default;
+
+		virtual std::string name() const = 0;
+
+		/// <summary>
+		/// Returns true if the stage needs the chunk values of the frames.
+		/// Reading the chunk data costs time for every frame, so it is skipped if no stage needs it.
+		/// </summary>
+		virtual bool usesChunkValues() const { return false; }
+
+		/// <summary>
+		/// Processes a frame. Called on a thread pool thread, never concurrently for the same stage.
+		/// </summary>
+		/// <param name="buffer">The image buffer received from the sink, shared with the other stages and must not be modified</param>
+		/// <param name="chunks">The frame's chunk values, empty unless usesChunkValues() returned true</param>
+		/// <returns>An image to be displayed instead of the frame, or nullptr</returns>
+		virtual std::shared_ptr<ic4::ImageBuffer> process(const std::shared_ptr<ic4::ImageBuffer>& buffer, const ChunkValues& chunks) = 0;
+	};
+
+	/// <summary>
+	/// Passes every frame to a set of processing stages, which run concurrently on a thread pool.
+	/// </summary>
+	/// <remarks>
+	/// The stages receive the sink's image buffer without copying it. A stage that is still busy with a previous frame
+	/// skips the new frame, so that a slow stage does not hold back the stream. While processing, each stage keeps one
+	/// buffer out of the sink's circulation, the sink has to allocate maxBuffersInUse() additional buffers.
+	/// </remarks>
+	class ProcessingGraph
+	{
+	public:
+		struct StageStatistics
+		{
+			std::string name;
+			uint64_t processed = 0;
+			uint64_t skipped = 0;
+			// Time from submitting the frame until the stage finished processing it
+			double last_latency_ms = 0;
+			double mean_latency_ms = 0;
+			double max_latency_ms = 0;
+		};
+
+		using OverlayCallback = std::function<void(const std::shared_ptr<ic4::ImageBuffer>&)>;
+
+		explicit ProcessingGraph(size_t numThreads = (std::max)(2u, std::thread::hardware_concurrency() / 2));
+		~ProcessingGraph();
+
+		ProcessingGraph(const ProcessingGraph&) = delete;
+		ProcessingGraph& operator=(const ProcessingGraph&) = delete;
+
+		/// <summary>
+		/// Registers a stage.
+		/// If producesOverlay is true, the images returned by the stage are passed to the overlay callback.
+		/// </summary>
+		void addStage(std::shared_ptr<ProcessingStage> stage, bool producesOverlay = false);
+
+		/// <summary>
+		/// Unregisters a stage. A frame that is currently being processed by the stage is completed in the background.
+		/// </summary>
+		void removeStage(const std::shared_ptr<ProcessingStage>& stage);
+
+		/// <summary>
+		/// Sets the function receiving the images produced by overlay stages. Called on the thread pool.
+		/// </summary>
+		void setOverlayCallback(OverlayCallback callback);
+
+		bool empty() const;
+		bool hasOverlayStages() const;
+
+		/// <summary>
+		/// Returns true if any stage needs the chunk values. Called from the sink callback for every frame.
+		/// </summary>
+		bool usesChunkValues() const;
+		size_t maxBuffersInUse() const;
+
+		/// <summary>
+		/// Passes a frame to all stages that are not busy. Called from the sink callback.
+		/// </summary>
+		void submit(const std::shared_ptr<ic4::ImageBuffer>& buffer, const ChunkValues& chunks = {});
+
+		/// <summary>
+		/// Waits until all submitted frames were processed.
+		/// </summary>
+		void flush();
+
+		std::vector<StageStatistics> statistics() const;
+
+	private:
+		using clock = std::chrono::steady_clock;
+
+		struct StageSlot
+		{
+			std::shared_ptr<ProcessingStage> stage;
+			bool produces_overlay = false;
+			std::atomic<bool> busy = false;
+
+			// Protected by ProcessingGraph::_mtx
+			StageStatistics stats;
+			double latency_sum_ms = 0;
+		};
+
+		struct Job
+		{
+			std::shared_ptr<StageSlot> slot;
+			std::shared_ptr<ic4::ImageBuffer> buffer;
+			ChunkValues chunks;
+			clock::time_point submitted;
+		};
+
+		void workerThread();
+		void updateUsesChunkValues();
+
+		mutable std::mutex _mtx;
+		std::condition_variable _job_available;
+		std::condition_variable _idle;
+		std::vector<std::shared_ptr<StageSlot>> _stages;
+		std::deque<Job> _jobs;
+		size_t _num_running = 0;
+		bool _stop = false;
+		std::atomic<bool> _uses_chunk_values = false;
+
+		std::mutex _overlay_mtx;
+		OverlayCallback _overlay_callback;
+
+		std::vector<std::thread> _workers;
+	};
+}
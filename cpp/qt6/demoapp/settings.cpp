@@ -3,6 +3,8 @@
 
 #include <QSettings>
 
+#include <algorithm>
+
 void Settings::read()
 {
 	QSettings s;
@@ -25,6 +27,24 @@ void Settings::read()
 
 	show_settings_menu = s.value("show_settings_menu", show_settings_menu).toBool();
 	start_stream_on_open = s.value("start_stream_on_open", start_stream_on_open).toBool();
+
+	record_queue_length = s.value("record_queue_length", record_queue_length).toInt();
+	record_queue_drop_oldest = s.value("record_queue_drop_oldest", record_queue_drop_oldest).toBool();
+	record_timing = std::clamp(s.value("record_timing", record_timing).toInt(), 0, 2);
+
+	preroll_duration_ms = s.value("preroll_duration_ms", preroll_duration_ms).toInt();
+	preroll_memory_mb = s.value("preroll_memory_mb", preroll_memory_mb).toInt();
+
+	segment_duration_min = s.value("segment_duration_min", segment_duration_min).toInt();
+	segment_size_mb = s.value("segment_size_mb", segment_size_mb).toInt();
+	segment_quota_mb = s.value("segment_quota_mb", segment_quota_mb).toInt();
+
+	burst_frames = s.value("burst_frames", burst_frames).toInt();
+	burst_duration_ms = s.value("burst_duration_ms", burst_duration_ms).toInt();
+	burst_format = std::clamp(s.value("burst_format", burst_format).toInt(), 0, 3);
+	burst_directory = s.value("burst_directory", QString::fromStdString(burst_directory)).toString().toStdString();
+
+	device_pool_size = std::clamp(s.value("device_pool_size", device_pool_size).toInt(), 1, 8);
 }
 
 void Settings::write()
@@ -40,4 +60,22 @@ void Settings::write()
 	s.setValue("show_settings_menu", show_settings_menu);
 	s.setValue("start_stream_on_open", start_stream_on_open);
 
+	s.setValue("record_queue_length", record_queue_length);
+	s.setValue("record_queue_drop_oldest", record_queue_drop_oldest);
+	s.setValue("record_timing", record_timing);
+
+	s.setValue("preroll_duration_ms", preroll_duration_ms);
+	s.setValue("preroll_memory_mb", preroll_memory_mb);
+
+	s.setValue("segment_duration_min", segment_duration_min);
+	s.setValue("segment_size_mb", segment_size_mb);
+	s.setValue("segment_quota_mb", segment_quota_mb);
+
+	s.setValue("burst_frames", burst_frames);
+	s.setValue("burst_duration_ms", burst_duration_ms);
+	s.setValue("burst_format", burst_format);
+	s.setValue("burst_directory", QString::fromStdString(burst_directory));
+
+	s.setValue("device_pool_size", device_pool_size);
+
 }
\ No newline at end of file
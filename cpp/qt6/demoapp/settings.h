@@ -3,6 +3,8 @@
 
 #include <ic4/ic4.h>
 
+#include <string>
+
 struct Settings
 {
 	bool start_full_screen = false;
@@ -14,6 +16,34 @@ struct Settings
 	bool show_settings_menu = false;
 	bool start_stream_on_open = true;
 
+	// Number of frames waiting for the video encoder, and whether to drop the oldest frame or
+	// wait for the encoder when the queue is full
+	int record_queue_length = 8;
+	bool record_queue_drop_oldest = true;
+	// ic4demoapp::VideoRecorder::TimingMode
+	int record_timing = 1;
+
+	// Frames kept while not recording, written at the beginning of the next video file.
+	// The number of frames is limited by both the duration and the memory limit.
+	int preroll_duration_ms = 0;
+	int preroll_memory_mb = 512;
+
+	// Segmented recording: a new file is started after the duration or size is reached (0 = no limit).
+	// When the completed segments exceed the quota, the oldest segments of the recording are deleted (0 = no quota).
+	int segment_duration_min = 0;
+	int segment_size_mb = 0;
+	int segment_quota_mb = 0;
+
+	// Photo burst: capture burst_frames frames, or all frames for burst_duration_ms if burst_frames is 0.
+	// The files are saved to burst_directory (Pictures if empty) as ic4_examples::io::FileFormat burst_format.
+	int burst_frames = 10;
+	int burst_duration_ms = 0;
+	int burst_format = 1;
+	std::string burst_directory;
+
+	// Number of devices kept open, so that switching back to a recently used device does not reopen it
+	int device_pool_size = 3;
+
 	void read();
 	void write();
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+
+#include "sparklinewidget.h"
+
+#include <QPainter>
+#include <QPainterPath>
+
+#include <algorithm>
+
+namespace ic4demoapp
+{
+	SparklineWidget::SparklineWidget(std::chrono::seconds timeSpan, QWidget* parent)
+		: QWidget(parent)
+		, _time_span(timeSpan)
+	{
+		setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
+	}
+
+	void SparklineWidget::setPoints(std::vector<Point> points)
+	{
+		_points = std::move(points);
+
+		_max_value = 0;
+		for (auto&& p : _points)
+			_max_value = (std::max)(_max_value, p.value);
+
+		update();
+	}
+
+	QSize SparklineWidget::sizeHint() const
+	{
+		return QSize(100, 16);
+	}
+
+	void SparklineWidget::paintEvent(QPaintEvent* /*ev*/)
+	{
+		if (_points.empty() || _max_value <= 0)
+			return;
+
+		QPainter painter(this);
+		painter.setRenderHint(QPainter::Antialiasing);
+
+		const double w = width() - 1;
+		const double h = height() - 1;
+		const double span = std::chrono::duration<double>(_time_span).count();
+
+		auto to_pos = [&](const Point& p)
+		{
+			double x = w + p.time.count() / span * w;
+			double y = h - p.value / _max_value * h;
+			return QPointF((std::max)(x, 0.0), y);
+		};
+
+		QPainterPath path;
+		path.moveTo(to_pos(_points.front()));
+		for (size_t i = 1; i < _points.size(); ++i)
+		{
+			// Do not connect points across gaps, e.g. while the stream was stopped
+			if (_points[i].time - _points[i - 1].time > std::chrono::seconds(2))
+				path.moveTo(to_pos(_points[i]));
+			else
+				path.lineTo(to_pos(_points[i]));
+		}
+
+		painter.setPen(QPen(palette().windowText(), 1));
+		painter.drawPath(path);
+	}
+}
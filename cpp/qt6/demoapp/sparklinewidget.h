@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QWidget>
+
+#include <chrono>
+#include <vector>
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// A small line chart of a value over time, without axes or labels
+	/// </summary>
+	class SparklineWidget : public QWidget
+	{
+	public:
+		struct Point
+		{
+			// Time relative to the end of the chart, negative values are in the past
+			std::chrono::duration<double> time;
+			double value = 0;
+		};
+
+		explicit SparklineWidget(std::chrono::seconds timeSpan, QWidget* parent = nullptr);
+
+		/// <summary>
+		/// Replaces the displayed points, which have to be sorted by time
+		/// </summary>
+		void setPoints(std::vector<Point> points);
+
+		QSize sizeHint() const override;
+
+	protected:
+		void paintEvent(QPaintEvent* ev) override;
+
+	private:
+		std::chrono::seconds _time_span;
+		std::vector<Point> _points;
+		double _max_value = 0;
+	};
+}
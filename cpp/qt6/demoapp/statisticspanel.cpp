@@ -0,0 +1,128 @@
+
+#include "statisticspanel.h"
+
+#include <QFormLayout>
+#include <QPainter>
+#include <QPainterPath>
+#include <QVBoxLayout>
+
+#include <algorithm>
+#include <cmath>
+
+namespace ic4demoapp
+{
+	HistogramWidget::HistogramWidget(QWidget* parent)
+		: QWidget(parent)
+	{
+		setMinimumSize(256, 100);
+		setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+	}
+
+	void HistogramWidget::setStatistics(const ImageStatistics& stats)
+	{
+		_stats = stats;
+		update();
+	}
+
+	QSize HistogramWidget::sizeHint() const
+	{
+		return QSize(300, 150);
+	}
+
+	void HistogramWidget::paintEvent(QPaintEvent* /*ev*/)
+	{
+		QPainter painter(this);
+		painter.fillRect(rect(), palette().base());
+
+		if (!_stats.valid)
+			return;
+
+		auto max_count = *std::max_element(_stats.histogram.begin(), _stats.histogram.end());
+		if (max_count == 0)
+			return;
+
+		const double w = width();
+		const double h = height();
+		const double scale = h / std::log1p(static_cast<double>(max_count));
+
+		QPainterPath path;
+		path.moveTo(0, h);
+		for (int i = 0; i < 256; ++i)
+		{
+			double y = h - std::log1p(static_cast<double>(_stats.histogram[i])) * scale;
+			path.lineTo(i * w / 256, y);
+			path.lineTo((i + 1) * w / 256, y);
+		}
+		path.lineTo(w, h);
+		path.closeSubpath();
+
+		painter.fillPath(path, palette().text());
+
+		// Mark the clipped ends of the range
+		const double bin_width = (std::max)(w / 256, 2.0);
+		if (_stats.histogram[0] > 0)
+			painter.fillRect(QRectF(0, 0, bin_width, h), QColor(0, 0, 255, 96));
+		if (_stats.histogram[255] > 0)
+			painter.fillRect(QRectF(w - bin_width, 0, bin_width, h), QColor(255, 0, 0, 96));
+	}
+
+	StatisticsPanel::StatisticsPanel(QWidget* parent)
+		: QDockWidget(tr("Image Statistics"), parent)
+	{
+		setObjectName("ImageStatisticsPanel");
+
+		auto widget = new QWidget(this);
+		auto layout = new QVBoxLayout(widget);
+
+		_histogram = new HistogramWidget(widget);
+		layout->addWidget(_histogram);
+
+		auto form = new QFormLayout();
+		_formatLabel = new QLabel(widget);
+		_meanLabel = new QLabel(widget);
+		_clippedLabel = new QLabel(widget);
+		_focusLabel = new QLabel(widget);
+		_focusLabel->setToolTip(tr("Variance of the Laplacian of the luminance, higher values indicate a sharper image.\nOnly comparable between images of the same scene."));
+		form->addRow(tr("Pixel Format:"), _formatLabel);
+		form->addRow(tr("Mean:"), _meanLabel);
+		form->addRow(tr("Clipped:"), _clippedLabel);
+		form->addRow(tr("Focus:"), _focusLabel);
+		layout->addLayout(form);
+
+		setWidget(widget);
+	}
+
+	void StatisticsPanel::setStatistics(const ImageStatistics& stats)
+	{
+		_histogram->setStatistics(stats);
+
+		auto fmt = stats.image_type.pixel_format();
+		if (fmt == ic4::PixelFormat::Unspecified)
+		{
+			_formatLabel->setText(tr("No image"));
+		}
+		else
+		{
+			_formatLabel->setText(QString::fromStdString(ic4::to_string(fmt)));
+		}
+
+		if (!stats.valid)
+		{
+			if (fmt != ic4::PixelFormat::Unspecified)
+				_formatLabel->setText(_formatLabel->text() + tr(" (not supported)"));
+
+			_meanLabel->clear();
+			_clippedLabel->clear();
+			_focusLabel->clear();
+			return;
+		}
+
+		_meanLabel->setText(QString::number(stats.mean, 'f', 1));
+		_clippedLabel->setText(
+			tr("%1 % dark, %2 % bright")
+				.arg(stats.clipped_dark * 100, 0, 'f', 2)
+				.arg(stats.clipped_bright * 100, 0, 'f', 2)
+		);
+		_focusLabel->setText(QString::number(stats.focus, 'f', 0));
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QDockWidget>
+#include <QLabel>
+#include <QWidget>
+
+#include "imagestatistics.h"
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// Draws a luminance histogram, using a logarithmic scale so that small peaks remain visible
+	/// </summary>
+	class HistogramWidget : public QWidget
+	{
+	public:
+		explicit HistogramWidget(QWidget* parent = nullptr);
+
+		void setStatistics(const ImageStatistics& stats);
+
+		QSize sizeHint() const override;
+
+	protected:
+		void paintEvent(QPaintEvent* ev) override;
+
+	private:
+		ImageStatistics _stats;
+	};
+
+	/// <summary>
+	/// Dock widget showing the histogram, clipping and focus score calculated by an ImageStatisticsStage
+	/// </summary>
+	class StatisticsPanel : public QDockWidget
+	{
+	public:
+		explicit StatisticsPanel(QWidget* parent = nullptr);
+
+		void setStatistics(const ImageStatistics& stats);
+
+	private:
+		HistogramWidget* _histogram = nullptr;
+		QLabel* _formatLabel = nullptr;
+		QLabel* _meanLabel = nullptr;
+		QLabel* _clippedLabel = nullptr;
+		QLabel* _focusLabel = nullptr;
+	};
+}
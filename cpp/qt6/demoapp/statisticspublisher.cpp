@@ -0,0 +1,163 @@
+
+#include "statisticspublisher.h"
+
+namespace ic4demoapp
+{
+	uint64_t StatisticsSnapshot::dropped() const
+	{
+		if (!stream_valid)
+			return 0;
+
+		return stream.device_transmission_error
+			+ stream.device_transform_underrun
+			+ stream.device_underrun
+			+ stream.transform_underrun
+			+ stream.sink_underrun;
+	}
+
+	bool StatisticsSnapshot::sameValues(const StatisticsSnapshot& other) const
+	{
+		return stream_valid == other.stream_valid
+			&& stream.device_delivered == other.stream.device_delivered
+			&& stream.device_transmission_error == other.stream.device_transmission_error
+			&& stream.device_transform_underrun == other.stream.device_transform_underrun
+			&& stream.device_underrun == other.stream.device_underrun
+			&& stream.transform_delivered == other.stream.transform_delivered
+			&& stream.transform_underrun == other.stream.transform_underrun
+			&& stream.sink_delivered == other.stream.sink_delivered
+			&& stream.sink_underrun == other.stream.sink_underrun
+			&& stream.sink_ignored == other.stream.sink_ignored
+			&& queue_valid == other.queue_valid
+			&& queue.free_queue_length == other.queue.free_queue_length
+			&& queue.output_queue_length == other.queue.output_queue_length
+			&& fps == other.fps;
+	}
+
+	StatisticsPublisher::StatisticsPublisher(std::chrono::milliseconds interval, std::chrono::seconds historyLength, NotifyFunction notify)
+		: _interval(interval)
+		, _history_length(historyLength)
+		, _notify(std::move(notify))
+	{
+	}
+
+	StatisticsPublisher::~StatisticsPublisher()
+	{
+		stopIdleTimer();
+	}
+
+	bool StatisticsPublisher::isDue(clock::time_point now) const
+	{
+		return now.time_since_epoch().count() >= _next_due.load(std::memory_order_relaxed);
+	}
+
+	void StatisticsPublisher::publish(const StatisticsSnapshot& snapshot)
+	{
+		_next_due = (snapshot.time + _interval).time_since_epoch().count();
+
+		bool changed = false;
+		{
+			std::lock_guard lck(_mtx);
+
+			changed = !snapshot.sameValues(_latest);
+			if (changed)
+			{
+				_latest = snapshot;
+				_latest_taken = false;
+			}
+
+			_history.push_back({ snapshot.time, snapshot.fps, snapshot.stream.sink_delivered, snapshot.dropped() });
+			while (!_history.empty() && _history.front().time + _history_length < snapshot.time)
+			{
+				_history.pop_front();
+			}
+		}
+
+		if (changed && !_notify_pending.exchange(true))
+		{
+			_notify();
+		}
+	}
+
+	bool StatisticsPublisher::takeSnapshot(StatisticsSnapshot& snapshot)
+	{
+		_notify_pending = false;
+
+		std::lock_guard lck(_mtx);
+		if (_latest_taken)
+			return false;
+
+		snapshot = _latest;
+		_latest_taken = true;
+		return true;
+	}
+
+	void StatisticsPublisher::startIdleTimer(CollectFunction collect)
+	{
+		stopIdleTimer();
+
+		_idle_stop = false;
+		_idle_thread = std::thread([this, collect = std::move(collect)] { idleTimerThread(collect); });
+	}
+
+	void StatisticsPublisher::stopIdleTimer()
+	{
+		if (!_idle_thread.joinable())
+			return;
+
+		{
+			std::lock_guard lck(_idle_mtx);
+			_idle_stop = true;
+		}
+		_idle_stop_requested.notify_all();
+		_idle_thread.join();
+	}
+
+	void StatisticsPublisher::idleTimerThread(CollectFunction collect)
+	{
+		std::unique_lock lck(_idle_mtx);
+		while (!_idle_stop_requested.wait_for(lck, _interval, [this] { return _idle_stop; }))
+		{
+			// Frames publish when they find the snapshot due, only step in if they did not for another interval
+			auto now = clock::now();
+			if (!isDue(now - _interval))
+				continue;
+
+			lck.unlock();
+
+			auto snapshot = collect();
+			snapshot.time = now;
+
+			StatisticsSample previous;
+			bool has_previous = false;
+			{
+				std::lock_guard history_lck(_mtx);
+				if (!_history.empty())
+				{
+					previous = _history.back();
+					has_previous = true;
+				}
+			}
+
+			if (has_previous && snapshot.stream_valid && snapshot.time > previous.time && snapshot.stream.sink_delivered >= previous.delivered)
+			{
+				auto dt = std::chrono::duration<double>(snapshot.time - previous.time).count();
+				snapshot.fps = static_cast<double>(snapshot.stream.sink_delivered - previous.delivered) / dt;
+			}
+
+			publish(snapshot);
+
+			lck.lock();
+		}
+	}
+
+	std::vector<StatisticsSample> StatisticsPublisher::history() const
+	{
+		std::lock_guard lck(_mtx);
+		return { _history.begin(), _history.end() };
+	}
+
+	std::chrono::seconds StatisticsPublisher::historyLength() const
+	{
+		return _history_length;
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// Stream statistics collected on the acquisition thread
+	/// </summary>
+	struct StatisticsSnapshot
+	{
+		std::chrono::steady_clock::time_point time;
+
+		bool stream_valid = false;
+		ic4::StreamStatistics stream = {};
+
+		bool queue_valid = false;
+		ic4::QueueSink::QueueSizes queue = {};
+
+		double fps = 0;
+
+		uint64_t dropped() const;
+
+		// Compares the values, ignoring the time
+		bool sameValues(const StatisticsSnapshot& other) const;
+	};
+
+	/// <summary>
+	/// An entry of the statistics time series
+	/// </summary>
+	struct StatisticsSample
+	{
+		std::chrono::steady_clock::time_point time;
+		double fps = 0;
+		uint64_t delivered = 0;
+		uint64_t dropped = 0;
+	};
+
+	/// <summary>
+	/// Passes statistics snapshots from the acquisition thread to the GUI thread.
+	/// </summary>
+	/// <remarks>
+	/// The acquisition thread checks isDue() for every frame, which only reads an atomic, and collects a snapshot
+	/// at most once per interval. The notify function is called only if the values changed, and not again until the
+	/// GUI thread fetched the snapshot with takeSnapshot(), so that at most one notification is pending.
+	///
+	/// If no frame published a snapshot for two intervals, e.g. because the device stopped delivering frames,
+	/// a timer thread started with startIdleTimer() publishes one instead. Its frame rate is calculated from the
+	/// number of delivered frames, so that the statistics do not freeze at the last values.
+	///
+	/// All published snapshots are kept in a time series covering the history length.
+	/// </remarks>
+	class StatisticsPublisher
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		using NotifyFunction = std::function<void()>;
+		using CollectFunction = std::function<StatisticsSnapshot()>;
+
+		StatisticsPublisher(std::chrono::milliseconds interval, std::chrono::seconds historyLength, NotifyFunction notify);
+		~StatisticsPublisher();
+
+		StatisticsPublisher(const StatisticsPublisher&) = delete;
+		StatisticsPublisher& operator=(const StatisticsPublisher&) = delete;
+
+		/// <summary>
+		/// Returns true if the interval since the previous snapshot has passed
+		/// </summary>
+		bool isDue(clock::time_point now) const;
+
+		/// <summary>
+		/// Stores a snapshot and notifies the GUI thread if its values changed
+		/// </summary>
+		void publish(const StatisticsSnapshot& snapshot);
+
+		/// <summary>
+		/// Fetches the latest snapshot. Returns false if it was already fetched before.
+		/// </summary>
+		bool takeSnapshot(StatisticsSnapshot& snapshot);
+
+		/// <summary>
+		/// Starts the timer thread publishing snapshots collected by collect() while no frames arrive.
+		/// The collect function is called on the timer thread, and has to stay valid until stopIdleTimer() returns.
+		/// </summary>
+		void startIdleTimer(CollectFunction collect);
+
+		/// <summary>
+		/// Stops the timer thread, waiting for a running collect() to return
+		/// </summary>
+		void stopIdleTimer();
+
+		std::vector<StatisticsSample> history() const;
+		std::chrono::seconds historyLength() const;
+
+	private:
+		void idleTimerThread(CollectFunction collect);
+
+		const std::chrono::milliseconds _interval;
+		const std::chrono::seconds _history_length;
+		NotifyFunction _notify;
+
+		std::atomic<clock::rep> _next_due = 0;
+		std::atomic<bool> _notify_pending = false;
+
+		mutable std::mutex _mtx;
+		StatisticsSnapshot _latest;
+		bool _latest_taken = true;
+		std::deque<StatisticsSample> _history;
+
+		std::mutex _idle_mtx;
+		std::condition_variable _idle_stop_requested;
+		bool _idle_stop = false;
+		std::thread _idle_thread;
+	};
+}
@@ -0,0 +1,527 @@
+
+#include "videorecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace
+{
+	// Gaps longer than this are not filled with repeated frames, the recording continues
+	// as if the next frame had arrived on time. This covers device timestamp resets and long trigger pauses.
+	constexpr int64_t MAX_GAP_NS = 10'000'000'000;
+
+	int64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+namespace ic4demoapp
+{
+	VideoRecorder::VideoRecorder(ic4::VideoWriter& writer, WriterFactory createWriter)
+		: _writer(writer)
+		, _create_writer(std::move(createWriter))
+	{
+	}
+
+	VideoRecorder::~VideoRecorder()
+	{
+		finishFile(ic4::Error::Ignore());
+	}
+
+	void VideoRecorder::setQueueCapacity(size_t capacity)
+	{
+		_capacity = (std::max)(capacity, size_t(1));
+	}
+
+	bool VideoRecorder::beginFile(const std::filesystem::path& path, const ic4::ImageType& imageType, double frameRate, ic4::Error& err)
+	{
+		finishFile(ic4::Error::Ignore());
+
+		_segment_settings = _next_segment_settings;
+		_segmented = (_segment_settings.max_duration.count() > 0 || _segment_settings.max_bytes > 0) && _create_writer;
+		if (_segmented)
+		{
+			// Create the second writer for every file, so that it picks up changed codec settings
+			_second_writer = _create_writer();
+			_segmented = _second_writer != nullptr;
+		}
+
+		_base_path = path;
+		_image_type = imageType;
+		_current = &_writer;
+		_current_path = _segmented ? segmentPath(1) : path;
+
+		if (!_writer.beginFile(_current_path.native(), imageType, frameRate, err))
+			return false;
+
+		_segment_max_frames = static_cast<uint64_t>(static_cast<double>(_segment_settings.max_duration.count()) * frameRate);
+		_segment_start_written = 0;
+		_segment_next_size_check = 0;
+		_num_segments = 1;
+
+		_num_encoded = 0;
+		_num_dropped = 0;
+		_num_skipped = 0;
+		_num_duplicated = 0;
+		_num_intervals = 0;
+		_interval_sum_ns = 0;
+		_frame_rate = frameRate;
+
+		_file_timing_mode = _timing_mode;
+		_use_device_timestamps = false;
+		_synced = false;
+		_num_written = 0;
+
+		{
+			std::lock_guard lck(_mtx);
+			_queue.clear();
+			_stop = false;
+			_resync = false;
+
+			// Write the pre-roll frames before the frames arriving from now on
+			for (auto& frame : _preroll)
+			{
+				frame.preroll = true;
+				_queue.push_back(std::move(frame));
+			}
+			_num_preroll_queued = _preroll.size();
+			_preroll.clear();
+			_preroll_bytes = 0;
+
+			// Set while locked, so that no frame goes to the pre-roll ring after it was moved into the queue
+			_recording = true;
+		}
+
+		if (_segmented)
+		{
+			_finished_segments.clear();
+			_finished_segments_bytes = 0;
+			_next_segment_index = 1;
+			_segment_stop = false;
+			_spare_state = SpareState::Preparing;
+			_segment_thread = std::thread([this] { segmentWorkerThread(); });
+
+			postSegmentJob([this, writer = _second_writer.get()] { prepareSpare(writer); });
+		}
+
+		_thread = std::thread([this] { encoderThread(); });
+		return true;
+	}
+
+	bool VideoRecorder::addFrame(std::shared_ptr<ic4::ImageBuffer> buffer)
+	{
+		auto arrival_ns = now_ns();
+
+		std::unique_lock lck(_mtx);
+		if (!_recording)
+		{
+			if (_preroll_max_age_ns <= 0)
+				return false;
+
+			addPreRollFrame({ std::move(buffer), arrival_ns });
+			return true;
+		}
+		if (_stop || _paused)
+			return false;
+
+		bool resync = std::exchange(_resync, false);
+
+		auto is_full = [this] { return _queue.size() - _num_preroll_queued >= _capacity; };
+		if (is_full())
+		{
+			if (_policy == QueueFullPolicy::Block)
+			{
+				_frame_taken.wait(lck, [this, is_full] { return _stop || !is_full(); });
+				if (_stop)
+				{
+					_num_dropped += 1;
+					return false;
+				}
+			}
+			else
+			{
+				// Drop the oldest frame after the pre-roll frames
+				auto oldest = _queue.begin() + _num_preroll_queued;
+				while (is_full())
+				{
+					// Keep the resync marker of a dropped frame, so that a pause is not filled with repeated frames
+					resync = resync || oldest->resync;
+					oldest = _queue.erase(oldest);
+					_num_dropped += 1;
+				}
+				if (resync && oldest != _queue.end())
+				{
+					oldest->resync = true;
+					resync = false;
+				}
+			}
+		}
+
+		_queue.push_back({ std::move(buffer), arrival_ns, resync });
+		lck.unlock();
+
+		_frame_queued.notify_one();
+		return true;
+	}
+
+	bool VideoRecorder::finishFile(ic4::Error& err)
+	{
+		if (!_thread.joinable())
+			return false;
+
+		{
+			std::lock_guard lck(_mtx);
+			_stop = true;
+		}
+		_frame_queued.notify_all();
+		_frame_taken.notify_all();
+
+		// The encoder thread writes the remaining frames before it exits
+		_thread.join();
+		_recording = false;
+
+		if (!_segmented)
+			return _current->finishFile(err);
+
+		// Let the segment worker complete the previous segment and the preparation of the next one
+		{
+			std::lock_guard lck(_segment_mtx);
+			_segment_stop = true;
+		}
+		_segment_cv.notify_all();
+		_segment_thread.join();
+
+		// The next segment was not used, remove its empty file
+		if (_spare_state == SpareState::Ready)
+		{
+			_spare->finishFile(ic4::Error::Ignore());
+			std::error_code ec;
+			std::filesystem::remove(_spare_path, ec);
+		}
+		_spare_state = SpareState::None;
+		_spare = nullptr;
+
+		bool result = _current->finishFile(err);
+		onSegmentFinished(_current_path);
+		return result;
+	}
+
+	void VideoRecorder::setSegmentation(std::chrono::seconds maxDuration, uint64_t maxBytes, uint64_t quotaBytes)
+	{
+		_next_segment_settings = { maxDuration, maxBytes, quotaBytes };
+	}
+
+	std::filesystem::path VideoRecorder::segmentPath(uint32_t index) const
+	{
+		char number[16] = {};
+		std::snprintf(number, sizeof(number), "_%04u", index);
+
+		auto file_name = _base_path.stem();
+		file_name += number;
+		file_name += _base_path.extension();
+		return _base_path.parent_path() / file_name;
+	}
+
+	bool VideoRecorder::isSegmentComplete()
+	{
+		auto num_frames = _num_written - _segment_start_written;
+		if (num_frames == 0)
+			return false;
+
+		if (_segment_max_frames > 0 && num_frames >= _segment_max_frames)
+			return true;
+
+		// Querying the file size is a system call, only do it about once per second of video
+		if (_segment_settings.max_bytes > 0 && _num_written >= _segment_next_size_check)
+		{
+			_segment_next_size_check = _num_written + (std::max)(static_cast<uint64_t>(_frame_rate.load()), uint64_t(1));
+
+			std::error_code ec;
+			auto size = std::filesystem::file_size(_current_path, ec);
+			if (!ec && size >= _segment_settings.max_bytes)
+				return true;
+		}
+
+		return false;
+	}
+
+	void VideoRecorder::startNextSegment()
+	{
+		std::unique_lock lck(_segment_mtx);
+
+		// The next segment is usually ready long before it is needed
+		_segment_cv.wait(lck, [this] { return _spare_state != SpareState::Preparing; });
+		if (_spare_state != SpareState::Ready)
+		{
+			// Opening the next segment failed, continue writing into the current one
+			return;
+		}
+
+		auto* finished = _current;
+		auto finished_path = _current_path;
+
+		_current = _spare;
+		_current_path = _spare_path;
+		_spare = nullptr;
+		_spare_state = SpareState::Preparing;
+
+		_segment_start_written = _num_written;
+		_segment_next_size_check = _num_written;
+		_num_segments += 1;
+
+		lck.unlock();
+
+		// Finishing a file can take a while, let the worker do it and then prepare the writer for the segment after the next
+		postSegmentJob([this, finished, finished_path]
+			{
+				finished->finishFile(ic4::Error::Ignore());
+				onSegmentFinished(finished_path);
+				prepareSpare(finished);
+			}
+		);
+	}
+
+	void VideoRecorder::prepareSpare(ic4::VideoWriter* writer)
+	{
+		// Called on the segment worker thread
+		_next_segment_index += 1;
+		auto path = segmentPath(_next_segment_index);
+		bool success = writer->beginFile(path.native(), _image_type, _frame_rate, ic4::Error::Ignore());
+
+		{
+			std::lock_guard lck(_segment_mtx);
+			_spare = writer;
+			_spare_path = path;
+			_spare_state = success ? SpareState::Ready : SpareState::Failed;
+		}
+		_segment_cv.notify_all();
+	}
+
+	void VideoRecorder::onSegmentFinished(const std::filesystem::path& path)
+	{
+		std::error_code ec;
+		auto size = std::filesystem::file_size(path, ec);
+		if (ec)
+			return;
+
+		_finished_segments.emplace_back(path, size);
+		_finished_segments_bytes += size;
+
+		// Delete the oldest segments of this recording when the quota is exceeded, always keeping the most recent one
+		while (_segment_settings.quota_bytes > 0 && _finished_segments_bytes > _segment_settings.quota_bytes && _finished_segments.size() > 1)
+		{
+			auto& [oldest_path, oldest_size] = _finished_segments.front();
+			std::filesystem::remove(oldest_path, ec);
+			_finished_segments_bytes -= oldest_size;
+			_finished_segments.pop_front();
+		}
+	}
+
+	void VideoRecorder::postSegmentJob(std::function<void()> job)
+	{
+		{
+			std::lock_guard lck(_segment_mtx);
+			_segment_jobs.push_back(std::move(job));
+		}
+		_segment_cv.notify_all();
+	}
+
+	void VideoRecorder::segmentWorkerThread()
+	{
+		std::unique_lock lck(_segment_mtx);
+
+		while (true)
+		{
+			_segment_cv.wait(lck, [this] { return _segment_stop || !_segment_jobs.empty(); });
+			if (_segment_jobs.empty())
+				break;
+
+			auto job = std::move(_segment_jobs.front());
+			_segment_jobs.pop_front();
+
+			lck.unlock();
+			job();
+			lck.lock();
+		}
+	}
+
+	size_t VideoRecorder::setPreRoll(std::chrono::milliseconds duration, size_t maxBytes, const ic4::ImageType& imageType, double frameRate)
+	{
+		auto bpp = ic4::getBitsPerPixel(imageType.pixel_format());
+		auto imageSize = (std::max)(static_cast<size_t>(imageType.width() * imageType.height() * bpp / 8), size_t(1));
+
+		// The ring holds the frames arriving within the duration, with a margin for frame rate jitter.
+		// If the frame rate is unknown, only the memory limit applies.
+		auto maxFrames = maxBytes / imageSize;
+		if (frameRate > 0)
+		{
+			auto durationFrames = static_cast<size_t>(std::ceil(std::chrono::duration<double>(duration).count() * frameRate * 1.1)) + 2;
+			maxFrames = (std::min)(maxFrames, durationFrames);
+		}
+
+		std::lock_guard lck(_mtx);
+		_preroll.clear();
+		_preroll_bytes = 0;
+		_preroll_max_age_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+		_preroll_max_bytes = maxBytes;
+		_preroll_max_frames = (_preroll_max_age_ns > 0) ? maxFrames : 0;
+		if (_preroll_max_frames == 0)
+			_preroll_max_age_ns = 0;
+
+		return _preroll_max_frames;
+	}
+
+	void VideoRecorder::clearPreRoll()
+	{
+		std::lock_guard lck(_mtx);
+		_preroll.clear();
+		_preroll_bytes = 0;
+	}
+
+	size_t VideoRecorder::preRollFrames() const
+	{
+		std::lock_guard lck(_mtx);
+		return _preroll.size();
+	}
+
+	std::chrono::milliseconds VideoRecorder::preRollDuration() const
+	{
+		std::lock_guard lck(_mtx);
+		if (_preroll.empty())
+			return {};
+
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(_preroll.back().arrival_ns - _preroll.front().arrival_ns));
+	}
+
+	void VideoRecorder::addPreRollFrame(QueuedFrame&& frame)
+	{
+		// Called with _mtx locked
+		auto bytes = frame.buffer->bufferSize();
+
+		auto too_old = frame.arrival_ns - _preroll_max_age_ns;
+		while (!_preroll.empty() && (_preroll.front().arrival_ns < too_old || _preroll.size() >= _preroll_max_frames || _preroll_bytes + bytes > _preroll_max_bytes))
+		{
+			_preroll_bytes -= _preroll.front().buffer->bufferSize();
+			_preroll.pop_front();
+		}
+
+		if (bytes > _preroll_max_bytes)
+			return;
+
+		_preroll_bytes += bytes;
+		_preroll.push_back(std::move(frame));
+	}
+
+	void VideoRecorder::setPaused(bool paused)
+	{
+		std::lock_guard lck(_mtx);
+		if (_paused && !paused)
+			_resync = true;
+		_paused = paused;
+	}
+
+	size_t VideoRecorder::backlog() const
+	{
+		std::lock_guard lck(_mtx);
+		return _queue.size();
+	}
+
+	double VideoRecorder::effectiveFrameRate() const
+	{
+		auto sum_ns = _interval_sum_ns.load();
+		if (sum_ns <= 0)
+			return 0.0;
+
+		return 1e9 * static_cast<double>(_num_intervals.load()) / static_cast<double>(sum_ns);
+	}
+
+	void VideoRecorder::encoderThread()
+	{
+		std::unique_lock lck(_mtx);
+
+		while (true)
+		{
+			_frame_queued.wait(lck, [this] { return _stop || !_queue.empty(); });
+			if (_queue.empty())
+				break;
+
+			auto frame = std::move(_queue.front());
+			_queue.pop_front();
+			if (frame.preroll)
+				_num_preroll_queued -= 1;
+			lck.unlock();
+			_frame_taken.notify_one();
+
+			encodeFrame(frame);
+
+			// Return the buffer to the sink before waiting for the next frame
+			frame.buffer.reset();
+
+			lck.lock();
+		}
+	}
+
+	void VideoRecorder::encodeFrame(const QueuedFrame& frame)
+	{
+		if (!_synced)
+		{
+			// Device timestamps are used if the first frame has one, mixing both time sources would break the timeline
+			_use_device_timestamps = _file_timing_mode == TimingMode::DeviceTimestamp && frame.buffer->metaData().device_timestamp_ns != 0;
+		}
+
+		int64_t t = _use_device_timestamps ? static_cast<int64_t>(frame.buffer->metaData().device_timestamp_ns) : frame.arrival_ns;
+
+		bool resync = !_synced || frame.resync || t < _prev_ns || t - _prev_ns > MAX_GAP_NS;
+		if (!resync)
+		{
+			_num_intervals += 1;
+			_interval_sum_ns += t - _prev_ns;
+		}
+		_prev_ns = t;
+		_synced = true;
+
+		uint64_t num_copies = 1;
+		if (_file_timing_mode != TimingMode::FrameCount)
+		{
+			const double frame_rate = _frame_rate;
+			if (resync)
+			{
+				// Continue the timeline so that this frame goes into the next slot of the video file
+				_start_ns = t - static_cast<int64_t>(static_cast<double>(_num_written) * 1e9 / frame_rate);
+			}
+
+			// Number of video frames up to and including this frame's slot
+			auto slot = std::llround(static_cast<double>(t - _start_ns) * frame_rate / 1e9);
+			auto end = static_cast<uint64_t>((std::max)(slot, 0ll)) + 1;
+			if (end <= _num_written)
+			{
+				_num_skipped += 1;
+				return;
+			}
+			num_copies = end - _num_written;
+		}
+
+		// Start the next segment with this frame
+		if (_segmented && isSegmentComplete())
+			startNextSegment();
+
+		bool success = true;
+		for (uint64_t i = 0; i < num_copies && success; ++i)
+		{
+			ic4::Error err;
+			success = _current->addFrame(frame.buffer, err);
+		}
+
+		// Advance the timeline even if writing failed, so that the following frames keep their timing
+		_num_written += num_copies;
+		if (success)
+		{
+			_num_encoded += 1;
+			_num_duplicated += num_copies - 1;
+		}
+	}
+}
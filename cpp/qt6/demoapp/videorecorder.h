@@ -0,0 +1,282 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ic4demoapp
+{
+	/// <summary>
+	/// Feeds a VideoWriter from a dedicated encoder thread, so that the sink callback
+	/// only has to queue the image buffers.
+	/// </summary>
+	/// <remarks>
+	/// The queued image buffers are not copied, they are kept out of the sink's circulation
+	/// until they have been encoded. The sink has to allocate queueCapacity() additional buffers.
+	///
+	/// The video file has a constant frame rate. To keep the playback speed correct when the camera
+	/// does not deliver frames at exactly that rate (trigger mode, dropped frames), the recorder can
+	/// place the frames according to their timestamps, repeating or skipping frames as required.
+	///
+	/// While no file is being recorded, the most recent frames can be kept in a pre-roll ring,
+	/// which is written to the beginning of the next file.
+	///
+	/// For long recordings, the output can be split into segment files. The next segment is opened in advance
+	/// on a worker thread using a second VideoWriter, which also finishes the previous segment, so that
+	/// the encoder thread can switch files without delaying the frames.
+	/// </remarks>
+	class VideoRecorder
+	{
+	public:
+		/// <summary>
+		/// What happens if a frame arrives while the queue is full
+		/// </summary>
+		enum class QueueFullPolicy
+		{
+			DropOldest,	// Discard the oldest queued frame, the sink callback never waits
+			Block,		// Wait for the encoder, which can cause the sink to run out of buffers
+		};
+
+		/// <summary>
+		/// How the frames are mapped to the video file's constant frame rate
+		/// </summary>
+		enum class TimingMode
+		{
+			FrameCount,			// Every frame is written once, playback speed depends on the actual frame rate
+			DeviceTimestamp,	// Frames are placed according to the device timestamp, or the arrival time if the device does not provide timestamps
+			ArrivalTime,		// Frames are placed according to the time they arrived in the sink
+		};
+
+		/// <summary>
+		/// Creates an additional VideoWriter with the same codec settings as the main writer
+		/// </summary>
+		using WriterFactory = std::function<std::unique_ptr<ic4::VideoWriter>()>;
+
+		/// <summary>
+		/// Creates a video recorder.
+		/// </summary>
+		/// <param name="writer">The video writer to use</param>
+		/// <param name="createWriter">Creates the second video writer required for segmented recording</param>
+		VideoRecorder(ic4::VideoWriter& writer, WriterFactory createWriter = {});
+		~VideoRecorder();
+
+		VideoRecorder(const VideoRecorder&) = delete;
+		VideoRecorder& operator=(const VideoRecorder&) = delete;
+
+		void setQueueCapacity(size_t capacity);
+		size_t queueCapacity() const { return _capacity; }
+
+		void setQueueFullPolicy(QueueFullPolicy policy) { _policy = policy; }
+
+		/// <summary>
+		/// Configures the pre-roll ring, which keeps frames up to the specified age and total size while not recording.
+		/// The number of frames is derived from the duration and frame rate, a frame rate of 0 means unknown.
+		/// A duration of 0 disables pre-roll. Clears the frames currently kept.
+		/// </summary>
+		/// <returns>The maximum number of frames in the ring, which the sink has to allocate in addition to queueCapacity()</returns>
+		size_t setPreRoll(std::chrono::milliseconds duration, size_t maxBytes, const ic4::ImageType& imageType, double frameRate);
+
+		/// <summary>
+		/// Discards the frames kept for pre-roll, returning them to the sink.
+		/// </summary>
+		void clearPreRoll();
+
+		size_t preRollFrames() const;
+		std::chrono::milliseconds preRollDuration() const;
+
+		/// <summary>
+		/// Configures segmented recording for the next file. A new segment is started when the current one reaches
+		/// maxDuration of video or maxBytes. When the completed segments exceed quotaBytes, the oldest segments of the
+		/// recording are deleted. Limits of 0 are ignored, segmentation is disabled if both maxDuration and maxBytes are 0.
+		/// </summary>
+		/// <remarks>
+		/// The segment files are named after the file passed to beginFile(), with a running number appended.
+		/// </remarks>
+		void setSegmentation(std::chrono::seconds maxDuration, uint64_t maxBytes, uint64_t quotaBytes);
+
+		/// <summary>
+		/// Number of segment files started in the current or most recent recording
+		/// </summary>
+		uint32_t numSegments() const { return _num_segments; }
+
+		/// <summary>
+		/// Sets the timing mode for the next file.
+		/// </summary>
+		void setTimingMode(TimingMode mode) { _timing_mode = mode; }
+
+		/// <summary>
+		/// Creates the video file and starts the encoder thread.
+		/// The frames kept for pre-roll are written first.
+		/// </summary>
+		bool beginFile(const std::filesystem::path& path, const ic4::ImageType& imageType, double frameRate, ic4::Error& err = ic4::Error::Default());
+
+		/// <summary>
+		/// Queues a frame for encoding, or keeps it for pre-roll while not recording. Can be called from any thread.
+		/// Returns false if the frame was discarded.
+		/// </summary>
+		bool addFrame(std::shared_ptr<ic4::ImageBuffer> buffer);
+
+		/// <summary>
+		/// Encodes the remaining queued frames and finishes the video file.
+		/// </summary>
+		bool finishFile(ic4::Error& err = ic4::Error::Default());
+
+		/// <summary>
+		/// Pauses or resumes recording. The time spent in pause is not part of the video.
+		/// </summary>
+		void setPaused(bool paused);
+
+		bool isRecording() const { return _recording; }
+
+		size_t backlog() const;
+
+		/// <summary>
+		/// Number of captured frames that were written to the video file
+		/// </summary>
+		uint64_t numEncoded() const { return _num_encoded; }
+		/// <summary>
+		/// Number of frames that were discarded because the queue was full
+		/// </summary>
+		uint64_t numDropped() const { return _num_dropped; }
+		/// <summary>
+		/// Number of frames that were not written, because a more recent frame was already written for their time slot
+		/// </summary>
+		uint64_t numSkipped() const { return _num_skipped; }
+		/// <summary>
+		/// Number of additional video frames that repeat a captured frame to fill gaps
+		/// </summary>
+		uint64_t numDuplicated() const { return _num_duplicated; }
+
+		/// <summary>
+		/// Frame rate of the video file
+		/// </summary>
+		double frameRate() const { return _frame_rate; }
+
+		/// <summary>
+		/// Frame rate at which the recorded frames were captured, according to their timestamps.
+		/// Returns 0 if not enough frames were recorded yet.
+		/// </summary>
+		double effectiveFrameRate() const;
+
+	private:
+		struct QueuedFrame
+		{
+			std::shared_ptr<ic4::ImageBuffer> buffer;
+			int64_t arrival_ns = 0;
+			bool resync = false;
+			bool preroll = false;
+		};
+
+		struct SegmentSettings
+		{
+			std::chrono::seconds max_duration = {};
+			uint64_t max_bytes = 0;
+			uint64_t quota_bytes = 0;
+		};
+
+		enum class SpareState
+		{
+			None,
+			Preparing,
+			Ready,
+			Failed,
+		};
+
+		void addPreRollFrame(QueuedFrame&& frame);
+		void encoderThread();
+		void encodeFrame(const QueuedFrame& frame);
+
+		std::filesystem::path segmentPath(uint32_t index) const;
+		bool isSegmentComplete();
+		void startNextSegment();
+		void prepareSpare(ic4::VideoWriter* writer);
+		void onSegmentFinished(const std::filesystem::path& path);
+		void postSegmentJob(std::function<void()> job);
+		void segmentWorkerThread();
+
+		ic4::VideoWriter& _writer;
+		WriterFactory _create_writer;
+
+		mutable std::mutex _mtx;
+		std::condition_variable _frame_queued;
+		std::condition_variable _frame_taken;
+		std::deque<QueuedFrame> _queue;
+		bool _stop = false;
+		bool _paused = false;
+		bool _resync = false;
+		// Pre-roll frames are at the front of the queue, and do not count against its capacity
+		size_t _num_preroll_queued = 0;
+
+		std::deque<QueuedFrame> _preroll;
+		size_t _preroll_bytes = 0;
+		int64_t _preroll_max_age_ns = 0;
+		size_t _preroll_max_bytes = 0;
+		size_t _preroll_max_frames = 0;
+
+		std::atomic<size_t> _capacity = 8;
+		std::atomic<QueueFullPolicy> _policy = QueueFullPolicy::DropOldest;
+		std::atomic<TimingMode> _timing_mode = TimingMode::DeviceTimestamp;
+		std::atomic<bool> _recording = false;
+		std::atomic<uint64_t> _num_encoded = 0;
+		std::atomic<uint64_t> _num_dropped = 0;
+		std::atomic<uint64_t> _num_skipped = 0;
+		std::atomic<uint64_t> _num_duplicated = 0;
+		std::atomic<double> _frame_rate = 0;
+
+		// Sum of the intervals between consecutive recorded frames, for effectiveFrameRate()
+		std::atomic<uint64_t> _num_intervals = 0;
+		std::atomic<int64_t> _interval_sum_ns = 0;
+
+		// Encoder thread state for the current file
+		TimingMode _file_timing_mode = TimingMode::FrameCount;
+		bool _use_device_timestamps = false;
+		bool _synced = false;
+		int64_t _start_ns = 0;
+		int64_t _prev_ns = 0;
+		uint64_t _num_written = 0;
+		ic4::VideoWriter* _current = nullptr;
+
+		// Segmented recording settings for the next file
+		SegmentSettings _next_segment_settings;
+
+		// Segmented recording state for the current file, used by the encoder thread
+		SegmentSettings _segment_settings;
+		bool _segmented = false;
+		uint64_t _segment_max_frames = 0;
+		uint64_t _segment_start_written = 0;
+		uint64_t _segment_next_size_check = 0;
+		std::filesystem::path _current_path;
+		std::filesystem::path _base_path;
+		ic4::ImageType _image_type;
+		std::atomic<uint32_t> _num_segments = 0;
+
+		// Second writer, alternating with _writer between the current and the next segment
+		std::unique_ptr<ic4::VideoWriter> _second_writer;
+
+		// Next segment, prepared by the segment worker
+		std::mutex _segment_mtx;
+		std::condition_variable _segment_cv;
+		SpareState _spare_state = SpareState::None;
+		ic4::VideoWriter* _spare = nullptr;
+		std::filesystem::path _spare_path;
+		std::deque<std::function<void()>> _segment_jobs;
+		bool _segment_stop = false;
+
+		// Used by the segment worker only
+		uint32_t _next_segment_index = 0;
+		std::deque<std::pair<std::filesystem::path, uint64_t>> _finished_segments;
+		uint64_t _finished_segments_bytes = 0;
+
+		std::thread _segment_thread;
+		std::thread _thread;
+	};
+}
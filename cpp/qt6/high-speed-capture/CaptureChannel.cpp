@@ -0,0 +1,436 @@
+
+#include "CaptureChannel.h"
+
+#include <QFile>
+#include <QtGlobal>
+
+#include <chrono>
+
+#if defined _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Returns the current system time in nanoseconds since 1970-01-01 UTC
+static int64_t hostTimestampNs()
+{
+	auto now = std::chrono::system_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+// Returns the file extension of image files saved in the specified format
+static const char* fileExtension(CaptureChannel::SaveFormat format)
+{
+	switch (format)
+	{
+	case CaptureChannel::SaveFormat::Bitmap:	return ".bmp";
+	case CaptureChannel::SaveFormat::Tiff:		return ".tiff";
+	case CaptureChannel::SaveFormat::RawStream:	return ".raw";
+	default:									return ".jpeg";
+	}
+}
+
+// Flushes a file that was just written to the storage device
+static bool syncFileToDisk(const QString& filePath)
+{
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadWrite))
+		return false;
+
+#if defined _WIN32
+	return _commit(file.handle()) == 0;
+#else
+	return fsync(file.handle()) == 0;
+#endif
+}
+
+CaptureChannel::CaptureChannel(highspeedcapture::IoScheduler& scheduler, std::function<void()> notify_stats)
+	: _scheduler(scheduler)
+	, _notify_stats(std::move(notify_stats))
+{
+}
+
+CaptureChannel::~CaptureChannel()
+{
+	// Make sure the scheduler no longer pops images from the sink
+	_scheduler.remove_source(this);
+
+	_grabber.streamStop(ic4::Error::Ignore());
+}
+
+QString CaptureChannel::deviceName()
+{
+	auto deviceInfo = _grabber.deviceInfo(ic4::Error::Ignore());
+	if (!deviceInfo.is_valid())
+		return {};
+
+	return QString::fromStdString(deviceInfo.modelName() + " " + deviceInfo.serial());
+}
+
+QString CaptureChannel::directoryName()
+{
+	auto deviceInfo = _grabber.deviceInfo(ic4::Error::Ignore());
+	auto serial = deviceInfo.is_valid() ? deviceInfo.serial() : std::string();
+	if (!serial.empty())
+		return QString::fromStdString(serial);
+
+	return QString::fromStdString(deviceInfo.is_valid() ? deviceInfo.modelName() : "camera");
+}
+
+void CaptureChannel::startCapture(const CaptureSettings& settings)
+{
+	_grabber.streamStop();
+
+	_settings = settings;
+	_raw_stream_opened = false;
+	_raw_stream_failed = false;
+
+	// Create a frame writer for this capture, the thread pool size depends on the number of cameras
+	ic4_examples::io::AsyncFrameWriter::Config config;
+	config.num_threads = settings.num_writer_threads;
+	// The scheduler limits the outstanding writes, submitting never has to block
+	config.max_pending = _scheduler.max_in_flight();
+	_writer = nullptr;
+	_writer = std::make_unique<ic4_examples::io::AsyncFrameWriter>(config);
+
+	// Create a new QueueSink, calling sink event handlers on this
+	_sink = ic4::QueueSink::create(*this);
+
+	// Reset counters
+	_num_processed = 0;
+	_num_failed = 0;
+	_frame_number = 0;
+	_last_dropped = 0;
+	_telemetry.reset();
+
+	{
+		std::lock_guard lck(_error_mtx);
+		_error_message.clear();
+		_capture_failed = false;
+	}
+
+	{
+		std::lock_guard lck(_arrival_mtx);
+		_arrival_times.clear();
+		_num_arrived = 0;
+		_num_popped = 0;
+	}
+
+	// Create the index describing all frames of this capture
+	auto indexPath = QString("%1/capture.idx").arg(settings.directory).toStdU16String();
+	bool indexOpened = false;
+	if (settings.format == SaveFormat::RawStream)
+		indexOpened = _index.open(indexPath, highspeedcapture::StorageRawStream, "capture.raw", {});
+	else
+		indexOpened = _index.open(indexPath, highspeedcapture::StorageImageFiles, "image_", fileExtension(settings.format));
+
+	if (!indexOpened)
+	{
+		qWarning("Failed to create capture index in %s", qPrintable(settings.directory));
+	}
+
+	// Start stream into sink
+	_grabber.streamSetup(_sink, _display);
+
+	// Let the scheduler pick up the images from the sink
+	_scheduler.add_source(this);
+}
+
+void CaptureChannel::stopAcquisition()
+{
+	_grabber.acquisitionStop();
+}
+
+void CaptureChannel::finishCapture()
+{
+	if (_writer)
+	{
+		_writer->flush();
+		_writer->close_raw_stream();
+	}
+
+	// All completions have been called, so the index is complete
+	if (_index.close() && _settings.write_csv_index)
+	{
+		highspeedcapture::CaptureIndexReader reader;
+		if (!reader.open(QString("%1/capture.idx").arg(_settings.directory).toStdU16String())
+			|| !reader.export_csv(QString("%1/capture.csv").arg(_settings.directory).toStdU16String()))
+		{
+			qWarning("Failed to export capture index in %s", qPrintable(_settings.directory));
+		}
+	}
+}
+
+void CaptureChannel::stopCapture(bool restartDisplay)
+{
+	_scheduler.remove_source(this);
+
+	// Remember the statistics, they are reset when the stream is stopped
+	numDropped();
+
+	_grabber.streamStop();
+
+	// Reset sink pointer, indicating no capture in progress
+	_sink = nullptr;
+
+	if (restartDisplay && _grabber.isDeviceValid())
+	{
+		// Restart stream with just display
+		_grabber.streamSetup(_display);
+	}
+}
+
+QString CaptureChannel::errorMessage() const
+{
+	std::lock_guard lck(_error_mtx);
+	return _error_message;
+}
+
+size_t CaptureChannel::numPending() const
+{
+	return _writer ? _writer->pending() : 0;
+}
+
+uint64_t CaptureChannel::numDropped()
+{
+	if (_sink != nullptr)
+	{
+		auto stats = _grabber.streamStatistics(ic4::Error::Ignore());
+		_last_dropped = stats.device_transmission_error + stats.device_underrun + stats.sink_ignored + stats.sink_underrun;
+	}
+	return _last_dropped;
+}
+
+size_t CaptureChannel::queuedFrames() const
+{
+	return _sink->queueSizes().output_queue_length;
+}
+
+bool CaptureChannel::submitNext(std::function<void()> done)
+{
+	using highspeedcapture::WriteTelemetry;
+
+	WriteTelemetry::FrameRecord rec;
+	rec.t[WriteTelemetry::Pop] = WriteTelemetry::clock::now();
+
+	highspeedcapture::CaptureIndexRecord entry = {};
+
+	std::shared_ptr<ic4::ImageBuffer> buffer;
+	{
+		std::lock_guard lck(_arrival_mtx);
+
+		ic4::Error err;
+		buffer = _sink->popOutputBuffer(err);
+		if (buffer == nullptr)
+			return false;
+
+		_num_popped += 1;
+
+		// If framesQueued has not been called for this frame yet, it arrived just now
+		if (_arrival_times.empty())
+		{
+			entry.host_timestamp_ns = hostTimestampNs();
+			_num_arrived += 1;
+		}
+		else
+		{
+			entry.host_timestamp_ns = _arrival_times.front();
+			_arrival_times.pop_front();
+		}
+	}
+
+	rec.t[WriteTelemetry::Queue] = WriteTelemetry::clock::now();
+
+	// Update queue sizes after the image buffer has been removed from the output queue
+	auto queueSizes = _sink->queueSizes();
+	_num_free = queueSizes.free_queue_length;
+	_num_filled = queueSizes.output_queue_length;
+
+	rec.frame_number = _frame_number++;
+	rec.thread_id[WriteTelemetry::Pop] = WriteTelemetry::current_thread_id();
+	rec.thread_id[WriteTelemetry::Queue] = rec.thread_id[WriteTelemetry::Pop];
+
+	// The buffer is no longer available in the completion, so remember its metadata here
+	auto metaData = buffer->metaData();
+	entry.frame_number = static_cast<uint64_t>(rec.frame_number);
+	entry.device_frame_number = metaData.device_frame_number;
+	entry.device_timestamp_ns = static_cast<int64_t>(metaData.device_timestamp_ns);
+
+	// Syncing is only done for image files, syncing the whole raw stream file after every frame would not measure the frame's write
+	bool sync = _settings.sync_to_disk && _settings.format != SaveFormat::RawStream;
+
+	// Called on one of the frame writer's threads after the image was written
+	auto completion = [this, rec, entry, sync, done = std::move(done)](const ic4_examples::io::WriteResult& result) mutable
+	{
+		// Every frame gets an index entry, so that the entries can be written in frame number order
+		entry.offset = result.offset;
+		entry.size = result.size;
+		entry.flags = result.success ? highspeedcapture::FrameWritten : result.discarded ? highspeedcapture::FrameDiscarded : highspeedcapture::FrameFailed;
+		_index.add(entry);
+
+		if (!result.discarded)
+		{
+			rec.t[WriteTelemetry::Encode] = result.started;
+			rec.t[WriteTelemetry::Sync] = result.finished;
+			rec.t[WriteTelemetry::NUM_STAGES] = result.finished;
+			rec.thread_id[WriteTelemetry::Encode] = WriteTelemetry::current_thread_id();
+			rec.thread_id[WriteTelemetry::Sync] = rec.thread_id[WriteTelemetry::Encode];
+
+			if (!result.success)
+			{
+				qWarning("Failed to write %s: %s", result.path.c_str(), result.message.c_str());
+				_num_failed += 1;
+			}
+			else
+			{
+				// Optionally wait for the file to reach the storage device
+				if (sync)
+				{
+					syncFileToDisk(QString::fromStdString(result.path));
+					rec.t[WriteTelemetry::NUM_STAGES] = WriteTelemetry::clock::now();
+				}
+
+				_telemetry.record(rec);
+
+				// Count number of processed images
+				_num_processed += 1;
+			}
+
+			_notify_stats();
+		}
+
+		// Let the scheduler know that the destination can take another write
+		done();
+	};
+
+	if (_settings.format == SaveFormat::RawStream)
+	{
+		// The raw stream file is created when the first image arrives, because its header contains the image type and pitch
+		if (!_raw_stream_opened && !_raw_stream_failed)
+		{
+			auto filePath = QString("%1/capture.raw").arg(_settings.directory);
+
+			std::string message;
+			if (_writer->open_raw_stream(filePath.toStdString(), buffer->imageType(), buffer->pitch(), message))
+			{
+				_raw_stream_opened = true;
+			}
+			else
+			{
+				// Report the error once, this frame is counted as failed
+				_raw_stream_failed = true;
+				{
+					std::lock_guard lck(_error_mtx);
+					_error_message = QString("Failed to create raw stream file: %1").arg(QString::fromStdString(message));
+				}
+				_capture_failed = true;
+
+				ic4_examples::io::WriteResult result;
+				result.path = filePath.toStdString();
+				result.message = message;
+				result.started = result.finished = ic4_examples::io::clock::now();
+				completion(result);
+				return true;
+			}
+		}
+
+		if (_raw_stream_failed)
+		{
+			// The UI thread stops the acquisition, the images that were already delivered are discarded
+			ic4_examples::io::WriteResult result;
+			result.discarded = true;
+			result.started = result.finished = ic4_examples::io::clock::now();
+			completion(result);
+			return true;
+		}
+
+		if (!_writer->append_raw(std::move(buffer), completion))
+		{
+			ic4_examples::io::WriteResult result;
+			result.message = "Raw stream file is not open";
+			result.started = result.finished = ic4_examples::io::clock::now();
+			completion(result);
+		}
+		return true;
+	}
+
+	auto format = ic4_examples::io::FileFormat::Jpeg;
+	switch (_settings.format)
+	{
+	case SaveFormat::Bitmap:
+		format = ic4_examples::io::FileFormat::Bitmap;
+		break;
+	case SaveFormat::Tiff:
+		format = ic4_examples::io::FileFormat::Tiff;
+		break;
+	default:
+		break;
+	}
+
+	// Generate file path based on settings and frame number
+	auto filePath = QString("%1/image_%2%3").arg(_settings.directory).arg(rec.frame_number).arg(fileExtension(_settings.format));
+
+	_writer->save_file(std::move(buffer), filePath.toStdString(), format, std::move(completion));
+	return true;
+}
+
+void CaptureChannel::discardPending()
+{
+	if (_writer)
+	{
+		_writer->discard_pending();
+	}
+}
+
+bool CaptureChannel::sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& imageType, size_t min_buffers_required)
+{
+	// Calculate the number of buffers that can be stored in this camera's share of the buffer memory
+	auto bpp = ic4::getBitsPerPixel(imageType.pixel_format());
+	auto imageSize = imageType.width() * imageType.height() * bpp / 8;
+	auto numBuffers = _buffer_memory_mib * 1024ll * 1024ll / imageSize;
+
+	if (numBuffers > static_cast<int64_t>(min_buffers_required))
+	{
+		_num_total = numBuffers;
+
+		// Allocate the configured number of buffers.
+		sink.allocAndQueueBuffers(numBuffers);
+	}
+	else
+	{
+		_num_total = min_buffers_required;
+
+		// If we do not call allocAndQueueBuffers, the sink automatically allocates
+		// min_buffers_required buffers for us, no need to do anything.
+	}
+
+	_num_free = _num_total.load();
+	_num_filled = 0;
+
+	return true;
+}
+
+void CaptureChannel::framesQueued(ic4::QueueSink& sink)
+{
+	{
+		std::lock_guard lck(_arrival_mtx);
+
+		// framesQueued is not necessarily called once per frame, so derive the number of new frames from the queue length
+		auto queueSizes = sink.queueSizes();
+		_num_free = queueSizes.free_queue_length;
+		_num_filled = queueSizes.output_queue_length;
+
+		auto now = hostTimestampNs();
+		auto numArrived = _num_popped + queueSizes.output_queue_length;
+		for (; _num_arrived < numArrived; ++_num_arrived)
+		{
+			_arrival_times.push_back(now);
+		}
+	}
+
+	// The images are removed from the output queue by the scheduler, just update the statistics and wake it up
+
+	_scheduler.notify();
+	_notify_stats();
+}
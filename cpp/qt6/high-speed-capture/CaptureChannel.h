@@ -0,0 +1,142 @@
+#pragma once
+
+#include <ic4/ic4.h>
+
+#include "CaptureIndex.h"
+#include "IoScheduler.h"
+#include "WriteTelemetry.h"
+
+#include <async-frame-writer.h>
+
+#include <QString>
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// One camera of the high-speed capture: its grabber, sink, buffer memory budget, frame writer and statistics.
+// The images are removed from the sink's output queue by the IoScheduler, which shares the disk bandwidth between the cameras.
+class CaptureChannel : public ic4::QueueSinkListener, public highspeedcapture::WriteSource
+{
+public:
+	enum class SaveFormat
+	{
+		Jpeg,
+		Bitmap,
+		Tiff,
+		RawStream,
+	};
+
+	struct CaptureSettings
+	{
+		// Directory receiving this camera's images
+		QString directory;
+		SaveFormat format = SaveFormat::Jpeg;
+		bool sync_to_disk = false;
+		// Additionally export the capture index as capture.csv when the capture is finished
+		bool write_csv_index = false;
+		size_t num_writer_threads = 2;
+	};
+
+	// notify_stats is called from various threads whenever the statistics changed
+	CaptureChannel(highspeedcapture::IoScheduler& scheduler, std::function<void()> notify_stats);
+	~CaptureChannel();
+
+	CaptureChannel(const CaptureChannel&) = delete;
+	CaptureChannel& operator=(const CaptureChannel&) = delete;
+
+	ic4::Grabber& grabber() { return _grabber; }
+	const std::shared_ptr<ic4::Display>& display() const { return _display; }
+	void setDisplay(std::shared_ptr<ic4::Display> display) { _display = std::move(display); }
+
+	// Model name and serial number of the opened device
+	QString deviceName();
+	// Name of the sub-directory of the destination directory receiving this camera's images
+	QString directoryName();
+
+	int64_t bufferMemory() const { return _buffer_memory_mib; }
+	void setBufferMemory(int64_t mib) { _buffer_memory_mib = mib; }
+
+	void setDestination(size_t index) { _destination = index; }
+
+	bool isCapturing() const { return _sink != nullptr; }
+
+	// Starts the stream into a new sink and registers the channel with the scheduler
+	void startCapture(const CaptureSettings& settings);
+	// Stops the device, the images already in the sink still have to be written
+	void stopAcquisition();
+	// Waits for the writes that are in progress, closes the raw stream and index files
+	void finishCapture();
+	// Unregisters from the scheduler and stops the stream, optionally restarting the live display
+	void stopCapture(bool restartDisplay);
+
+	// Statistics, can be queried from the UI thread while capturing
+	int64_t numProcessed() const { return _num_processed; }
+	int64_t numFailed() const { return _num_failed; }
+	int64_t numTotal() const { return _num_total; }
+	int64_t numFree() const { return _num_free; }
+	int64_t numFilled() const { return _num_filled; }
+	size_t numPending() const;
+	uint64_t numDropped();
+	const highspeedcapture::WriteTelemetry& telemetry() const { return _telemetry; }
+
+	// Description of the error that made this camera's capture fail, empty if there was none
+	QString errorMessage() const;
+	// Returns true once after the capture failed, the UI thread then stops the acquisition
+	bool takeCaptureFailure() { return _capture_failed.exchange(false); }
+
+public:
+	// highspeedcapture::WriteSource overrides, called by the scheduler thread
+	size_t destination() const final { return _destination; }
+	size_t queuedFrames() const final;
+	bool submitNext(std::function<void()> done) final;
+	void discardPending() final;
+
+private:
+	// ic4::QueueSinkListener overrides
+	bool sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& imageType, size_t min_buffers_required) final;
+	void framesQueued(ic4::QueueSink& sink) final;
+
+private:
+	highspeedcapture::IoScheduler& _scheduler;
+	std::function<void()> _notify_stats;
+
+	ic4::Grabber _grabber;
+	std::shared_ptr<ic4::Display> _display;
+	std::shared_ptr<ic4::QueueSink> _sink;
+
+	int64_t _buffer_memory_mib = 1024;
+	size_t _destination = 0;
+
+	CaptureSettings _settings;
+	bool _raw_stream_opened = false;
+	bool _raw_stream_failed = false;
+	int64_t _frame_number = 0;
+	uint64_t _last_dropped = 0;
+
+	// Host times at which the frames in the sink's output queue arrived, oldest first
+	std::mutex _arrival_mtx;
+	std::deque<int64_t> _arrival_times;
+	uint64_t _num_arrived = 0;
+	uint64_t _num_popped = 0;
+
+	highspeedcapture::CaptureIndexWriter _index;
+
+	std::atomic<int64_t> _num_processed = 0;
+	std::atomic<int64_t> _num_failed = 0;
+	std::atomic<int64_t> _num_total = 0;
+	std::atomic<int64_t> _num_free = 0;
+	std::atomic<int64_t> _num_filled = 0;
+
+	highspeedcapture::WriteTelemetry _telemetry;
+
+	mutable std::mutex _error_mtx;
+	QString _error_message;
+	std::atomic<bool> _capture_failed = false;
+
+	// Declared after everything used by the completion callbacks, so that it is destroyed (and flushed) first
+	std::unique_ptr<ic4_examples::io::AsyncFrameWriter> _writer;
+};
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+#if defined _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace highspeedcapture
+{
+	// Header at the beginning of a capture index file (capture.idx).
+	// The header is followed by one CaptureIndexRecord per frame, record n describes frame number n.
+	struct CaptureIndexHeader
+	{
+		char magic[8];					// "IC4IDX1"
+		uint32_t header_size;			// sizeof(CaptureIndexHeader), offset of the first record
+		uint32_t record_size;			// sizeof(CaptureIndexRecord)
+		uint64_t num_records;			// Set when the index is closed, 0 if the capture was interrupted
+		uint32_t storage;				// CaptureIndexStorage
+		uint32_t reserved;
+		char file_name_prefix[112];		// Image file name is prefix + frame number + suffix, or the raw stream file name
+		char file_name_suffix[112];
+	};
+
+	enum CaptureIndexStorage : uint32_t
+	{
+		// Every frame is stored in a separate image file
+		StorageImageFiles = 0,
+		// All frames are stored in a single raw stream file, at CaptureIndexRecord::offset
+		StorageRawStream = 1,
+	};
+
+	enum CaptureIndexFlags : uint32_t
+	{
+		// The frame was written successfully
+		FrameWritten = 1,
+		// Writing the frame failed
+		FrameFailed = 2,
+		// The frame was discarded before it was written
+		FrameDiscarded = 4,
+	};
+
+	struct CaptureIndexRecord
+	{
+		uint64_t frame_number;			// Frame number within the capture session
+		uint64_t device_frame_number;	// Frame number reported by the device
+		int64_t device_timestamp_ns;	// Timestamp reported by the device
+		int64_t host_timestamp_ns;		// System time at which the frame arrived in the sink, ns since 1970-01-01 UTC
+		uint64_t offset;				// Position in the raw stream file, 0 for image files
+		uint64_t size;					// Number of bytes written
+		uint32_t flags;					// CaptureIndexFlags, 0 if no information about the frame is available
+		uint32_t reserved;
+	};
+
+	static_assert(sizeof(CaptureIndexHeader) == 256, "Unexpected CaptureIndexHeader size");
+	static_assert(sizeof(CaptureIndexRecord) == 56, "Unexpected CaptureIndexRecord size");
+
+	// Writes a capture index file.
+	// Records can be added from any thread and in any order, they are written to the file in frame number order.
+	class CaptureIndexWriter
+	{
+	public:
+		CaptureIndexWriter() = default;
+		CaptureIndexWriter(const CaptureIndexWriter&) = delete;
+		CaptureIndexWriter& operator=(const CaptureIndexWriter&) = delete;
+
+		~CaptureIndexWriter()
+		{
+			close();
+		}
+
+		bool open(const std::filesystem::path& path, CaptureIndexStorage storage, const std::string& prefix, const std::string& suffix)
+		{
+			close();
+
+			std::lock_guard lck(mtx_);
+
+			std::memset(&header_, 0, sizeof(header_));
+			std::memcpy(header_.magic, "IC4IDX1", 8);
+			header_.header_size = sizeof(CaptureIndexHeader);
+			header_.record_size = sizeof(CaptureIndexRecord);
+			header_.storage = storage;
+			std::strncpy(header_.file_name_prefix, prefix.c_str(), sizeof(header_.file_name_prefix) - 1);
+			std::strncpy(header_.file_name_suffix, suffix.c_str(), sizeof(header_.file_name_suffix) - 1);
+
+			out_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+			out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+
+			next_frame_ = 0;
+			out_of_order_.clear();
+			return out_.good();
+		}
+
+		void add(const CaptureIndexRecord& rec)
+		{
+			std::lock_guard lck(mtx_);
+			if (!out_.is_open())
+				return;
+
+			if (rec.frame_number != next_frame_)
+			{
+				// Keep frames completed out of order until the frames before them were added
+				out_of_order_[rec.frame_number] = rec;
+				return;
+			}
+
+			write_record(rec);
+
+			while (!out_of_order_.empty() && out_of_order_.begin()->first == next_frame_)
+			{
+				write_record(out_of_order_.begin()->second);
+				out_of_order_.erase(out_of_order_.begin());
+			}
+		}
+
+		// Writes the remaining records and the number of records into the header
+		bool close()
+		{
+			std::lock_guard lck(mtx_);
+			if (!out_.is_open())
+				return false;
+
+			// Frames that were never added leave gaps, keep record n at the position of frame n
+			for (auto& [frame_number, rec] : out_of_order_)
+			{
+				CaptureIndexRecord missing = {};
+				while (next_frame_ < frame_number)
+				{
+					missing.frame_number = next_frame_;
+					write_record(missing);
+				}
+				write_record(rec);
+			}
+			out_of_order_.clear();
+
+			header_.num_records = next_frame_;
+			out_.seekp(0);
+			out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+			out_.close();
+			return !out_.fail();
+		}
+
+	private:
+		void write_record(const CaptureIndexRecord& rec)
+		{
+			out_.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+			next_frame_ = rec.frame_number + 1;
+		}
+
+		std::mutex mtx_;
+		std::ofstream out_;
+		CaptureIndexHeader header_ = {};
+		uint64_t next_frame_ = 0;
+		std::map<uint64_t, CaptureIndexRecord> out_of_order_;
+	};
+
+	// Memory-maps a capture index file for random access to the frames' metadata
+	class CaptureIndexReader
+	{
+	public:
+		CaptureIndexReader() = default;
+		CaptureIndexReader(const CaptureIndexReader&) = delete;
+		CaptureIndexReader& operator=(const CaptureIndexReader&) = delete;
+
+		~CaptureIndexReader()
+		{
+			close();
+		}
+
+		bool open(const std::filesystem::path& path)
+		{
+			close();
+
+#if defined _WIN32
+			file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file_ == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER file_size = {};
+			GetFileSizeEx(file_, &file_size);
+			size_ = static_cast<size_t>(file_size.QuadPart);
+			if (size_ < sizeof(CaptureIndexHeader))
+			{
+				close();
+				return false;
+			}
+
+			mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data_ = mapping_ ? static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+			fd_ = ::open(path.c_str(), O_RDONLY);
+			if (fd_ < 0)
+				return false;
+
+			struct stat st = {};
+			fstat(fd_, &st);
+			size_ = static_cast<size_t>(st.st_size);
+			if (size_ < sizeof(CaptureIndexHeader))
+			{
+				close();
+				return false;
+			}
+
+			auto* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+			data_ = (p != MAP_FAILED) ? static_cast<const uint8_t*>(p) : nullptr;
+#endif
+			if (data_ == nullptr)
+			{
+				close();
+				return false;
+			}
+
+			const auto& hdr = header();
+			if (std::memcmp(hdr.magic, "IC4IDX1", 8) != 0 || hdr.record_size < sizeof(CaptureIndexRecord) || hdr.header_size > size_)
+			{
+				close();
+				return false;
+			}
+
+			// An interrupted capture has no record count in the header, use all complete records
+			num_records_ = (size_ - hdr.header_size) / hdr.record_size;
+			if (hdr.num_records != 0)
+				num_records_ = (std::min)(num_records_, static_cast<size_t>(hdr.num_records));
+
+			return true;
+		}
+
+		void close()
+		{
+#if defined _WIN32
+			if (data_)
+				UnmapViewOfFile(data_);
+			if (mapping_)
+				CloseHandle(mapping_);
+			if (file_ != INVALID_HANDLE_VALUE)
+				CloseHandle(file_);
+			mapping_ = nullptr;
+			file_ = INVALID_HANDLE_VALUE;
+#else
+			if (data_)
+				munmap(const_cast<uint8_t*>(data_), size_);
+			if (fd_ >= 0)
+				::close(fd_);
+			fd_ = -1;
+#endif
+			data_ = nullptr;
+			size_ = 0;
+			num_records_ = 0;
+		}
+
+		const CaptureIndexHeader& header() const
+		{
+			return *reinterpret_cast<const CaptureIndexHeader*>(data_);
+		}
+
+		size_t size() const { return num_records_; }
+
+		// Returns the record of the specified frame number
+		const CaptureIndexRecord& operator[](size_t frame_number) const
+		{
+			const auto& hdr = header();
+			return *reinterpret_cast<const CaptureIndexRecord*>(data_ + hdr.header_size + frame_number * hdr.record_size);
+		}
+
+		// Returns the frame number of the first written frame with a device timestamp not earlier than timestamp_ns,
+		// or size() if there is no such frame. The device timestamps have to be increasing with the frame number.
+		size_t find_device_timestamp(int64_t timestamp_ns) const
+		{
+			size_t lo = 0;
+			size_t hi = num_records_;
+			while (lo < hi)
+			{
+				auto mid = lo + (hi - lo) / 2;
+				auto ts = timestamp_at_or_after(mid, hi);
+				if (ts < timestamp_ns)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+
+			// Skip frames without data
+			while (lo < num_records_ && !((*this)[lo].flags & FrameWritten))
+				lo += 1;
+			return lo;
+		}
+
+		// Returns the name of the file containing the frame, relative to the index file's directory
+		std::string file_name(const CaptureIndexRecord& rec) const
+		{
+			const auto& hdr = header();
+			std::string prefix(hdr.file_name_prefix, strnlen(hdr.file_name_prefix, sizeof(hdr.file_name_prefix)));
+			if (hdr.storage == StorageRawStream)
+				return prefix;
+
+			std::string suffix(hdr.file_name_suffix, strnlen(hdr.file_name_suffix, sizeof(hdr.file_name_suffix)));
+			return prefix + std::to_string(rec.frame_number) + suffix;
+		}
+
+		bool export_csv(const std::filesystem::path& path) const
+		{
+			std::ofstream out(path, std::ios::out | std::ios::trunc);
+			if (!out)
+				return false;
+
+			out << "frame_number,device_frame_number,device_timestamp_ns,host_timestamp_ns,file,offset,size,status\n";
+			for (size_t i = 0; i < num_records_; ++i)
+			{
+				const auto& rec = (*this)[i];
+				const char* status = (rec.flags & FrameWritten) ? "written" : (rec.flags & FrameFailed) ? "failed" : (rec.flags & FrameDiscarded) ? "discarded" : "missing";
+
+				out << rec.frame_number << ',' << rec.device_frame_number << ',' << rec.device_timestamp_ns << ',' << rec.host_timestamp_ns << ','
+					<< file_name(rec) << ',' << rec.offset << ',' << rec.size << ',' << status << '\n';
+			}
+			return out.good();
+		}
+
+	private:
+		// Timestamp of the first written frame in [index, end), so that the binary search can step over frames without data
+		int64_t timestamp_at_or_after(size_t index, size_t end) const
+		{
+			for (; index < end; ++index)
+			{
+				const auto& rec = (*this)[index];
+				if (rec.flags & FrameWritten)
+					return rec.device_timestamp_ns;
+			}
+			return INT64_MAX;
+		}
+
+		const uint8_t* data_ = nullptr;
+		size_t size_ = 0;
+		size_t num_records_ = 0;
+#if defined _WIN32
+		HANDLE file_ = INVALID_HANDLE_VALUE;
+		HANDLE mapping_ = nullptr;
+#else
+		int fd_ = -1;
+#endif
+	};
+}
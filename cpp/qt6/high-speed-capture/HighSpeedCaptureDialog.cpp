@@ -9,13 +9,14 @@
 #include <QLineEdit>
 #include <QFileDialog>
 #include <QHBoxLayout>
-#include <QIntValidator>
+#include <QHeaderView>
+#include <QSpinBox>
 #include <QCoreApplication>
 #include <QSettings>
 #include <QStandardPaths>
 #include <QDir>
 #include <QByteArray>
-#include <QThread>
+#include <QMessageBox>
 #include <QtConcurrent>
 
 #include <ic4-interop/interop-Qt.h>
@@ -23,25 +24,56 @@
 #include "DeviceSelectionDialog.h"
 #include "PropertyDialog.h"
 
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
 // Event used to notify dialog to update UI
 const QEvent::Type UPDATE_STATS = static_cast<QEvent::Type>(QEvent::User + 1);
 
+// Columns of the camera table
+enum CameraColumn
+{
+	ColumnDevice,
+	ColumnBufferMemory,
+	ColumnDestination,
+	ColumnFreeBuffers,
+	ColumnFilledBuffers,
+	ColumnSaved,
+	ColumnDropped,
+	ColumnWriteErrors,
+	ColumnWriteP99,
+	NUM_COLUMNS
+};
+
 HighSpeedCaptureDialog::HighSpeedCaptureDialog()
 {
 	createUI();
 	readSettings();
+	updateDisplayLayout();
+	updateCameraTable();
 	updateUI();
 }
 
+HighSpeedCaptureDialog::~HighSpeedCaptureDialog()
+{
+	// Destroy the channels before the scheduler, their frame writers report completions to it
+	_channels.clear();
+}
+
 void HighSpeedCaptureDialog::createUI()
 {
 	auto* layout = new QVBoxLayout();
 
 	auto* buttonsLayout = new QHBoxLayout();
 
-	_selectDevice = new QPushButton(tr("&Device"));
-	connect(_selectDevice, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onSelectDevice);
-	buttonsLayout->addWidget(_selectDevice);
+	_addDevice = new QPushButton(tr("Add &Device"));
+	connect(_addDevice, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onAddDevice);
+	buttonsLayout->addWidget(_addDevice);
+
+	_removeDevice = new QPushButton(tr("&Remove Device"));
+	connect(_removeDevice, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onRemoveDevice);
+	buttonsLayout->addWidget(_removeDevice);
 
 	_deviceProperties = new QPushButton(tr("Device &Properties"));
 	connect(_deviceProperties, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onDeviceProperties);
@@ -51,61 +83,74 @@ void HighSpeedCaptureDialog::createUI()
 
 	layout->addLayout(buttonsLayout);
 
-	auto* displayWidget = new ic4interop::Qt::DisplayWidget();
-	displayWidget->setMinimumSize(640, 480);
-	_display = displayWidget->asDisplay();
-	_display->setRenderPosition(ic4::DisplayRenderPosition::StretchCenter);
-	layout->addWidget(displayWidget, 1);
+	// The live displays of all cameras are arranged in a grid
+	auto* displayContainer = new QWidget();
+	displayContainer->setMinimumSize(640, 480);
+	_displayLayout = new QGridLayout();
+	_displayLayout->setContentsMargins(0, 0, 0, 0);
+	displayContainer->setLayout(_displayLayout);
+	layout->addWidget(displayContainer, 1);
+
+	_cameraTable = new QTableWidget(0, NUM_COLUMNS);
+	_cameraTable->setHorizontalHeaderLabels({
+		tr("Device"), tr("Buffer Memory"), tr("Destination"), tr("Free Buffers"), tr("Filled Buffers"),
+		tr("Saved"), tr("Dropped"), tr("Write Errors"), tr("Write p99")
+	});
+	_cameraTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+	_cameraTable->setSelectionMode(QAbstractItemView::SingleSelection);
+	_cameraTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	_cameraTable->verticalHeader()->setVisible(false);
+	_cameraTable->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+	_cameraTable->horizontalHeader()->setStretchLastSection(true);
+	_cameraTable->setMaximumHeight(160);
+	connect(_cameraTable, &QTableWidget::itemSelectionChanged, [this]() { updateUI(); });
+	layout->addWidget(_cameraTable);
 
 	auto* saveGroup = new QGroupBox(tr("Save Images"));
 	auto* saveLayout = new QGridLayout();
 
-	saveLayout->addWidget(new QLabel(tr("Destination Folder")), 0, 0);
-	_destinationDirectory = new QLineEdit();
-	_destinationDirectory->setReadOnly(true);
-	saveLayout->addWidget(_destinationDirectory, 0, 1);
-	_destinationBrowse = new QPushButton(tr("Browse"));
-	saveLayout->addWidget(_destinationBrowse, 0, 2);
-
-	connect(_destinationBrowse, &QPushButton::clicked,
-		[this]()
-		{
-			auto dir = QFileDialog::getExistingDirectory(this, tr("Select Destination Directory"));
-			if (!dir.isEmpty())
-			{
-				_destinationDirectory->setText(dir);
-			}
-		}
-	);
-
-	saveLayout->addWidget(new QLabel(tr("Buffer Memory")), 1, 0);
-
-	auto* bufferMemoryLayout = new QHBoxLayout();
-
-	_bufferMemory = new QLineEdit("4096");
-	_bufferMemory->setMaximumWidth(120);
-	_bufferMemory->setValidator(new QIntValidator());
-	bufferMemoryLayout->addWidget(_bufferMemory);
-	bufferMemoryLayout->addWidget(new QLabel(tr("MiB")));
-	saveLayout->addLayout(bufferMemoryLayout, 1, 1);
-
-	saveLayout->addWidget(new QLabel(tr("Free Buffers")), 2, 0);
-	_freeBuffersProgress = new QProgressBar();
-	saveLayout->addWidget(_freeBuffersProgress, 2, 1);
-	_freeBuffersLabel = new QLabel();
-	saveLayout->addWidget(_freeBuffersLabel, 2, 2);
-
-	saveLayout->addWidget(new QLabel(tr("Filled Buffers")), 3, 0);
-	_filledBuffersProgress = new QProgressBar();
-	saveLayout->addWidget(_filledBuffersProgress, 3, 1);
-	_filledBuffersLabel = new QLabel();
-	saveLayout->addWidget(_filledBuffersLabel, 3, 2);
+	// Cameras are distributed over the destination folders, which should be located on different disks
+	saveLayout->addWidget(new QLabel(tr("Destination Folders")), 0, 0, Qt::AlignTop);
+	_destinations = new QListWidget();
+	_destinations->setMaximumHeight(80);
+	saveLayout->addWidget(_destinations, 0, 1);
+
+	auto* destinationButtonsLayout = new QVBoxLayout();
+	_addDestination = new QPushButton(tr("Add..."));
+	connect(_addDestination, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onAddDestination);
+	destinationButtonsLayout->addWidget(_addDestination);
+	_removeDestination = new QPushButton(tr("Remove"));
+	connect(_removeDestination, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onRemoveDestination);
+	destinationButtonsLayout->addWidget(_removeDestination);
+	destinationButtonsLayout->addStretch();
+	saveLayout->addLayout(destinationButtonsLayout, 0, 2);
+
+	saveLayout->addWidget(new QLabel(tr("File Format")), 1, 0);
+	_fileFormat = new QComboBox();
+	_fileFormat->addItem(tr("JPEG"), static_cast<int>(CaptureChannel::SaveFormat::Jpeg));
+	_fileFormat->addItem(tr("BMP"), static_cast<int>(CaptureChannel::SaveFormat::Bitmap));
+	_fileFormat->addItem(tr("TIFF"), static_cast<int>(CaptureChannel::SaveFormat::Tiff));
+	_fileFormat->addItem(tr("Raw Stream (single file per camera)"), static_cast<int>(CaptureChannel::SaveFormat::RawStream));
+	saveLayout->addWidget(_fileFormat, 1, 1);
+
+	_syncToDisk = new QCheckBox(tr("Flush each image to disk (measures device write time)"));
+	saveLayout->addWidget(_syncToDisk, 2, 1, 1, 2);
+
+	// The binary index capture.idx is always written, the CSV file is meant for spreadsheets and scripts
+	_writeCsvIndex = new QCheckBox(tr("Export frame index as CSV file"));
+	saveLayout->addWidget(_writeCsvIndex, 3, 1, 1, 2);
 
 	_startStop = new QPushButton(tr("&Start"));
 	connect(_startStop, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onStartStop);
 	saveLayout->addWidget(_startStop, 4, 0);
 	_captureInfo = new QLabel();
-	saveLayout->addWidget(_captureInfo, 4, 1, 1, 2);
+	_captureInfo->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+	saveLayout->addWidget(_captureInfo, 4, 1, 2, 2);
+
+	_exportTrace = new QPushButton(tr("Export &Trace..."));
+	_exportTrace->setToolTip(tr("Save the write path timings of the most recent images as a Chrome trace JSON file"));
+	connect(_exportTrace, &QPushButton::clicked, this, &HighSpeedCaptureDialog::onExportTrace);
+	saveLayout->addWidget(_exportTrace, 5, 0, Qt::AlignTop);
 
 	saveGroup->setLayout(saveLayout);
 	layout->addWidget(saveGroup);
@@ -115,30 +160,113 @@ void HighSpeedCaptureDialog::createUI()
 
 void HighSpeedCaptureDialog::updateUI()
 {
-	if (_sink != nullptr) // Presence of sink indicates capture is active
+	bool capturing = isCapturing();
+	bool idle = !capturing && !_cleanup_active;
+
+	_addDevice->setEnabled(idle);
+	_removeDevice->setEnabled(idle && selectedChannel() != nullptr);
+	_addDestination->setEnabled(idle);
+	_removeDestination->setEnabled(idle && _destinations->count() > 1);
+	_fileFormat->setEnabled(idle);
+	_syncToDisk->setEnabled(idle);
+	_writeCsvIndex->setEnabled(idle);
+
+	for (int row = 0; row < _cameraTable->rowCount(); ++row)
+	{
+		if (auto* w = _cameraTable->cellWidget(row, ColumnBufferMemory))
+			w->setEnabled(idle);
+	}
+
+	auto* channel = selectedChannel();
+	_deviceProperties->setEnabled(!_cleanup_active && channel != nullptr && channel->grabber().isDeviceValid());
+
+	if (_cleanup_active) // Remaining images are being written after the capture was stopped
+	{
+		_startStop->setText(tr("Cancel &Remaining"));
+		_startStop->setEnabled(true);
+		return;
+	}
+
+	if (capturing)
 	{
 		_startStop->setText(tr("&Stop"));
-		_selectDevice->setEnabled(false);
-		_bufferMemory->setEnabled(false);
-		_destinationBrowse->setEnabled(false);
+		_startStop->setEnabled(true);
 	}
 	else
 	{
 		_startStop->setText(tr("&Start"));
-		_selectDevice->setEnabled(true);
-		_bufferMemory->setEnabled(true);
-		_destinationBrowse->setEnabled(true);
+
+		bool allValid = !_channels.empty();
+		for (auto& ch : _channels)
+			allValid = allValid && ch->grabber().isDeviceValid();
+
+		_startStop->setEnabled(allValid);
 	}
+}
 
-	if (_grabber.isDeviceValid())
+void HighSpeedCaptureDialog::updateDisplayLayout()
+{
+	// Arrange the displays in a grid that is about as wide as high
+	int columns = 1;
+	while (columns * columns < static_cast<int>(_displayWidgets.size()))
+		columns += 1;
+
+	for (size_t i = 0; i < _displayWidgets.size(); ++i)
 	{
-		_deviceProperties->setEnabled(true);
-		_startStop->setEnabled(true);
+		_displayLayout->removeWidget(_displayWidgets[i]);
+		_displayLayout->addWidget(_displayWidgets[i], static_cast<int>(i) / columns, static_cast<int>(i) % columns);
 	}
-	else
+}
+
+void HighSpeedCaptureDialog::updateCameraTable()
+{
+	// Create rows for new channels
+	if (_cameraTable->rowCount() != static_cast<int>(_channels.size()))
 	{
-		_deviceProperties->setEnabled(false);
-		_startStop->setEnabled(false);
+		_cameraTable->setRowCount(static_cast<int>(_channels.size()));
+
+		for (int row = 0; row < _cameraTable->rowCount(); ++row)
+		{
+			auto* channel = _channels[row].get();
+
+			for (int col = 0; col < NUM_COLUMNS; ++col)
+			{
+				if (_cameraTable->item(row, col) == nullptr)
+					_cameraTable->setItem(row, col, new QTableWidgetItem());
+			}
+
+			auto* bufferMemory = new QSpinBox();
+			bufferMemory->setRange(64, 1024 * 1024);
+			bufferMemory->setSingleStep(256);
+			bufferMemory->setSuffix(" MiB");
+			bufferMemory->setValue(static_cast<int>(channel->bufferMemory()));
+			connect(bufferMemory, QOverload<int>::of(&QSpinBox::valueChanged), [channel](int mib) { channel->setBufferMemory(mib); });
+			_cameraTable->setCellWidget(row, ColumnBufferMemory, bufferMemory);
+		}
+	}
+
+	auto numDestinations = (std::max)(_destinations->count(), 1);
+
+	for (int row = 0; row < _cameraTable->rowCount(); ++row)
+	{
+		auto& channel = *_channels[row];
+
+		_cameraTable->item(row, ColumnDevice)->setText(channel.deviceName());
+
+		auto* destination = _destinations->item(row % numDestinations);
+		_cameraTable->item(row, ColumnDestination)->setText(destination ? destination->text() : QString());
+
+		if (!channel.isCapturing() && !_cleanup_active)
+			continue;
+
+		_cameraTable->item(row, ColumnFreeBuffers)->setText(QString("%1 / %2").arg(channel.numFree()).arg(channel.numTotal()));
+		_cameraTable->item(row, ColumnFilledBuffers)->setText(QString("%1 / %2").arg(channel.numFilled()).arg(channel.numTotal()));
+		_cameraTable->item(row, ColumnSaved)->setText(QString::number(channel.numProcessed()));
+		_cameraTable->item(row, ColumnDropped)->setText(QString::number(channel.numDropped()));
+		_cameraTable->item(row, ColumnWriteErrors)->setText(QString::number(channel.numFailed()));
+
+		const auto& h = channel.telemetry().histogram(highspeedcapture::WriteTelemetry::Encode);
+		_cameraTable->item(row, ColumnWriteP99)->setText(QString("%1 ms").arg(h.percentile_ns(99) / 1e6, 0, 'f', 3));
 	}
 }
 
@@ -147,21 +275,47 @@ void HighSpeedCaptureDialog::readSettings()
 	QSettings settings("The Imaging Source", "HighSpeedCapture Sample Application");
 
 	auto defaultDestination = QString("%1/HighSpeedCapture Sample").arg(QStandardPaths::writableLocation(QStandardPaths::PicturesLocation));
-	auto destinationDirectory = settings.value("DestinationDirectory", defaultDestination).toString();
-	_destinationDirectory->setText(destinationDirectory);
+	auto destinations = settings.value("DestinationDirectories").toStringList();
+	if (destinations.isEmpty())
+	{
+		// Setting of previous versions which only supported a single destination folder
+		destinations << settings.value("DestinationDirectory", defaultDestination).toString();
+	}
+	_destinations->addItems(destinations);
+
+	auto formatIndex = _fileFormat->findData(settings.value("FileFormat", static_cast<int>(CaptureChannel::SaveFormat::Jpeg)).toInt());
+	_fileFormat->setCurrentIndex((std::max)(formatIndex, 0));
 
-	auto bufferMemory = settings.value("BufferMemory", "4096").toString();
-	_bufferMemory->setText(bufferMemory);
+	_syncToDisk->setChecked(settings.value("SyncToDisk", false).toBool());
+	_writeCsvIndex->setChecked(settings.value("WriteCsvIndex", false).toBool());
 
-	auto stateArray = settings.value("Device", QByteArray()).toByteArray();
-	if (!stateArray.isEmpty())
+	auto openChannel = [this](const QByteArray& stateArray, int64_t bufferMemory)
 	{
+		if (stateArray.isEmpty())
+			return;
+
 		std::vector<uint8_t> deviceState(stateArray.begin(), stateArray.end());
 
-		if (_grabber.deviceOpenFromState(deviceState, ic4::Error::Ignore()))
+		auto* channel = addChannel();
+		channel->setBufferMemory(bufferMemory);
+		if (channel->grabber().deviceOpenFromState(deviceState, ic4::Error::Ignore()))
 		{
-			_grabber.streamSetup(_display);
+			channel->grabber().streamSetup(channel->display());
 		}
+	};
+
+	int numDevices = settings.beginReadArray("Devices");
+	for (int i = 0; i < numDevices; ++i)
+	{
+		settings.setArrayIndex(i);
+		openChannel(settings.value("State").toByteArray(), settings.value("BufferMemory", 1024).toLongLong());
+	}
+	settings.endArray();
+
+	if (numDevices == 0)
+	{
+		// Settings of previous versions which only supported a single device
+		openChannel(settings.value("Device", QByteArray()).toByteArray(), settings.value("BufferMemory", "4096").toLongLong());
 	}
 }
 
@@ -169,230 +323,509 @@ void HighSpeedCaptureDialog::saveSettings()
 {
 	QSettings settings("The Imaging Source", "HighSpeedCapture Sample Application");
 
-	settings.setValue("DestinationDirectory", _destinationDirectory->text());
-	settings.setValue("BufferMemory", _bufferMemory->text());
+	QStringList destinations;
+	for (int i = 0; i < _destinations->count(); ++i)
+		destinations << _destinations->item(i)->text();
+
+	settings.setValue("DestinationDirectories", destinations);
+	settings.setValue("FileFormat", _fileFormat->currentData().toInt());
+	settings.setValue("SyncToDisk", _syncToDisk->isChecked());
+	settings.setValue("WriteCsvIndex", _writeCsvIndex->isChecked());
 
-	auto deviceState = _grabber.deviceSaveState(ic4::Error::Ignore());
-	if (!deviceState.empty())
+	settings.beginWriteArray("Devices");
+	int index = 0;
+	for (auto& ch : _channels)
 	{
-		QByteArray stateArray((const char*)deviceState.data(), deviceState.size());
+		auto deviceState = ch->grabber().deviceSaveState(ic4::Error::Ignore());
+		if (deviceState.empty())
+			continue;
+
+		settings.setArrayIndex(index++);
+		settings.setValue("State", QByteArray((const char*)deviceState.data(), deviceState.size()));
+		settings.setValue("BufferMemory", static_cast<qlonglong>(ch->bufferMemory()));
+	}
+	settings.endArray();
+}
+
+CaptureChannel* HighSpeedCaptureDialog::addChannel()
+{
+	auto channel = std::make_unique<CaptureChannel>(_scheduler, [this]() { requestStatsUpdate(); });
+
+	auto* displayWidget = new ic4interop::Qt::DisplayWidget();
+	displayWidget->setMinimumSize(160, 120);
+	auto display = displayWidget->asDisplay();
+	display->setRenderPosition(ic4::DisplayRenderPosition::StretchCenter);
+	channel->setDisplay(display);
+
+	_displayWidgets.push_back(displayWidget);
+	_channels.push_back(std::move(channel));
+
+	return _channels.back().get();
+}
+
+CaptureChannel* HighSpeedCaptureDialog::selectedChannel()
+{
+	auto row = _cameraTable->currentRow();
+	if (row < 0 || row >= static_cast<int>(_channels.size()))
+		return _channels.size() == 1 ? _channels.front().get() : nullptr;
+
+	return _channels[row].get();
+}
 
-		settings.setValue("Device", stateArray);
+bool HighSpeedCaptureDialog::isCapturing() const
+{
+	for (auto& ch : _channels)
+	{
+		if (ch->isCapturing())
+			return true;
 	}
+	return false;
 }
 
-void HighSpeedCaptureDialog::onSelectDevice()
+void HighSpeedCaptureDialog::onAddDevice()
 {
+	auto* channel = addChannel();
+
+	// Do not offer devices that are already used by another channel
+	auto filter = [this, channel](const ic4::DeviceInfo& dev)
+	{
+		for (auto& ch : _channels)
+		{
+			if (ch.get() == channel || !ch->grabber().isDeviceValid())
+				continue;
+
+			auto info = ch->grabber().deviceInfo(ic4::Error::Ignore());
+			if (info.serial() == dev.serial() && info.modelName() == dev.modelName())
+				return false;
+		}
+		return true;
+	};
+
 	// Show device selection dialog
-	// If the user selects a device in this dialog, it will be opened in the grabber
-	DeviceSelectionDialog dlg(this, &_grabber);
+	// If the user selects a device in this dialog, it will be opened in the new channel's grabber
+	DeviceSelectionDialog dlg(this, &channel->grabber(), filter);
 	if (dlg.exec() == QDialog::DialogCode::Accepted)
 	{
 		// If the user selected a device, start preview
-		_grabber.streamSetup(_display);
+		channel->grabber().streamSetup(channel->display());
+	}
+	else
+	{
+		delete _displayWidgets.back();
+		_displayWidgets.pop_back();
+		_channels.pop_back();
 	}
 
+	updateDisplayLayout();
+	updateCameraTable();
 	updateUI();
 }
 
-void HighSpeedCaptureDialog::onDeviceProperties()
+void HighSpeedCaptureDialog::onRemoveDevice()
 {
-	if (_grabber.isDeviceValid())
+	auto* channel = selectedChannel();
+	if (channel == nullptr)
+		return;
+
+	for (size_t i = 0; i < _channels.size(); ++i)
 	{
-		if (_sink != nullptr)  // Presence of sink indicates capture is active
+		if (_channels[i].get() == channel)
 		{
-			// Pass property map so that the dialog cannot restart the stream
-			PropertyDialog dlg(_grabber.devicePropertyMap(), this);
-			dlg.exec();
-		}
-		else
-		{
-			// Pass grabber itself so that the dialog can restart the stream
-			PropertyDialog dlg(_grabber, this);
-			dlg.exec();
+			_cameraTable->removeRow(static_cast<int>(i));
+			_channels.erase(_channels.begin() + i);
+			delete _displayWidgets[i];
+			_displayWidgets.erase(_displayWidgets.begin() + i);
+			break;
 		}
 	}
+
+	updateDisplayLayout();
+	updateCameraTable();
+	updateUI();
+}
+
+void HighSpeedCaptureDialog::onDeviceProperties()
+{
+	auto* channel = selectedChannel();
+	if (channel == nullptr || !channel->grabber().isDeviceValid())
+		return;
+
+	auto title = channel->deviceName();
+
+	if (channel->isCapturing())
+	{
+		// Pass property map so that the dialog cannot restart the stream
+		PropertyDialog dlg(channel->grabber().devicePropertyMap(), this, title);
+		dlg.exec();
+	}
+	else
+	{
+		// Pass grabber itself so that the dialog can restart the stream
+		PropertyDialog dlg(channel->grabber(), this, title);
+		dlg.exec();
+	}
+}
+
+void HighSpeedCaptureDialog::onAddDestination()
+{
+	auto dir = QFileDialog::getExistingDirectory(this, tr("Select Destination Directory"));
+	if (!dir.isEmpty())
+	{
+		_destinations->addItem(dir);
+	}
+
+	updateCameraTable();
+	updateUI();
+}
+
+void HighSpeedCaptureDialog::onRemoveDestination()
+{
+	auto row = _destinations->currentRow();
+	if (row >= 0 && _destinations->count() > 1)
+	{
+		delete _destinations->takeItem(row);
+	}
+
+	updateCameraTable();
+	updateUI();
 }
 
 void HighSpeedCaptureDialog::onStartStop()
 {
-	// The value of _sink indicates whether capture was already started
-	if (_sink == nullptr)
+	if (_cleanup_active)
 	{
-		// Try to create destination directory
-		if (!QDir().mkpath(_destinationDirectory->text()))
-		{
-			QMessageBox msgError;
-			msgError.setText("Failed to create destination directory");
-			msgError.setIcon(QMessageBox::Critical);
-			msgError.exec();
+		// While the remaining images are written, the start/stop button discards them instead
+		cancelCleanup();
+	}
+	else if (!isCapturing())
+	{
+		auto numDestinations = _destinations->count();
+		if (_channels.empty() || numDestinations == 0)
 			return;
+
+		// Assign the cameras to the destination folders in turn, each camera writes into a sub-directory named after its serial number
+		std::vector<QString> directories;
+		for (size_t i = 0; i < _channels.size(); ++i)
+		{
+			auto dir = QString("%1/%2").arg(_destinations->item(static_cast<int>(i % numDestinations))->text()).arg(_channels[i]->directoryName());
+			if (std::find(directories.begin(), directories.end(), dir) != directories.end())
+			{
+				dir += QString("_%1").arg(i);
+			}
+
+			// Try to create destination directory
+			if (!QDir().mkpath(dir))
+			{
+				QMessageBox msgError;
+				msgError.setText(QString("Failed to create destination directory %1").arg(dir));
+				msgError.setIcon(QMessageBox::Critical);
+				msgError.exec();
+				return;
+			}
+
+			directories.push_back(dir);
 		}
 
-		_grabber.streamStop();
+		// Split the encoder threads between the cameras
+		auto numThreads = (std::max)(2u, std::thread::hardware_concurrency() / 2);
+
+		CaptureChannel::CaptureSettings settings;
+		settings.format = static_cast<CaptureChannel::SaveFormat>(_fileFormat->currentData().toInt());
+		settings.sync_to_disk = _syncToDisk->isChecked();
+		settings.write_csv_index = _writeCsvIndex->isChecked();
+		settings.num_writer_threads = (std::max)(size_t(1), numThreads / _channels.size());
 
-		// Create a new QueueSink, calling sink event handlers on this
-		_sink = ic4::QueueSink::create(*this);
+		_scheduler.start();
 
-		// Reset counters
-		_num_processed = 0;
-		_frame_number = 0;
+		for (size_t i = 0; i < _channels.size(); ++i)
+		{
+			settings.directory = directories[i];
 
-		// Start stream into sink
-		_grabber.streamSetup(_sink, _display);
+			_channels[i]->setDestination(i % numDestinations);
+			_channels[i]->startCapture(settings);
+		}
 
 		// Update UI for new program state
+		updateCameraTable();
 		updateUI();
 	}
 	else
 	{
-		// Make sure the start/stop button is not pressed while we wait for the remaining images to be processed
-		_startStop->setEnabled(false);
+		// Stop the devices
+		for (auto& ch : _channels)
+			ch->stopAcquisition();
 
-		// Set wait cursor
-		QApplication::setOverrideCursor(Qt::WaitCursor);
-
-		// Stop the device
-		_grabber.acquisitionStop();
+		// Remember when the cleanup started to be able to calculate the drain rate
+		_cleanupTimer.start();
+		_cleanupStartProcessed = 0;
+		for (auto& ch : _channels)
+			_cleanupStartProcessed += ch->numProcessed();
 
 		// Make sure we don't close the window while the cleanup thread runs
 		_cleanup_active = true;
 
-		// Collect and process remaining delivered buffers on background thread to keep UI responsive
-		QtConcurrent::run(
+		// Switch the start/stop button to "Cancel Remaining"
+		updateUI();
+
+		// Wait for the remaining delivered buffers to be written on background thread to keep UI responsive
+		_cleanupFuture = QtConcurrent::run(
 			[this]()
 			{
-				// Wait for the sink's output queue to become empty
-				// _cancel_cleanup is set when the user tries to just close the program, thus cancelling all further processing
-				while (!_cancel_cleanup)
-				{
-					{
-						std::lock_guard lck(_frames_queued_mtx);
-
-						// Wait for the sink's output queue to be emptied by repeated framesQueued invocations
-						auto qs = _sink->queueSizes();
-						if (qs.output_queue_length == 0)
-							break;
-					}
+				// Wait for the sinks' output queues to be emptied by the scheduler
+				// _scheduler.cancel() is called when the user discards the remaining images or closes the program
+				_scheduler.wait_drained();
 
-					QThread::usleep(1);
-				}
+				// If the remaining images were cancelled, only the writes already in progress are waited for
+				for (auto& ch : _channels)
+					ch->finishCapture();
 
 				// Let the close event handler know we are done
 				_cleanup_active = false;
 			}
-		).then(this, // Get back to the main thread to update UI
+		);
+
+		_cleanupFuture.then(this, // Get back to the main thread to update UI
 			[this]()
 			{
-				// Stop stream
-				_grabber.streamStop();
+				// The window was closed while the remaining images were cancelled, the streams are already stopped
+				if (_closing)
+					return;
+
+				// Show the final result, the stream statistics are reset when the stream is stopped
+				updateCameraTable();
+				auto* channel = selectedChannel();
+				_captureInfo->setText(captureResultText() + (channel ? "\n" + writeTimingsText(*channel) : QString()));
 
-				// Reset sink pointer, indicating no capture in progress
-				_sink = nullptr;
+				// Stop streams, restarting the display unless the program is about to exit
+				for (auto& ch : _channels)
+					ch->stopCapture(!_closeAfterCleanup);
 
-				// Restart stream with just display
-				_grabber.streamSetup(_display);
+				if (_closeAfterCleanup)
+				{
+					// The user chose to let the remaining images be written in the background after closing the window
+					close();
+
+					// Make sure the application exits, even though the window was already hidden
+					QCoreApplication::quit();
+					return;
+				}
 
 				// Update UI for new program state
 				updateUI();
-
-				// Restore normal cursor
-				QApplication::restoreOverrideCursor();
 			}
 		);
-	}	
+	}
 }
 
-void HighSpeedCaptureDialog::customEvent(QEvent* event)
+void HighSpeedCaptureDialog::requestStatsUpdate()
 {
-	if (event->type() == UPDATE_STATS)
+	// Only post one update event at a time, so that multiple cameras at high frame rates do not flood the event queue
+	if (!_stats_update_posted.exchange(true))
 	{
-		int64_t num_total = _num_total.load();
-		int64_t num_filled = _num_filled.load();
-		int64_t num_free = _num_free.load();
-		int64_t num_processed = _num_processed.load();
+		QCoreApplication::postEvent(this, new QEvent(UPDATE_STATS));
+	}
+}
 
-		// Update progress bars and their labels
-		_filledBuffersProgress->setMaximum(num_total);
-		_filledBuffersProgress->setValue(num_filled);
-		_filledBuffersLabel->setText(QString("%1 / %2").arg(num_filled).arg(num_total));
-		_freeBuffersProgress->setMaximum(num_total);
-		_freeBuffersProgress->setValue(num_free);
-		_freeBuffersLabel->setText(QString("%1 / %2").arg(num_free).arg(num_total));
+void HighSpeedCaptureDialog::cancelCleanup()
+{
+	// Stops scheduling images and drops the ones waiting in the frame writers' queues
+	_scheduler.cancel();
+}
 
-		// Update saved/dropped label
-		auto stats = _grabber.streamStatistics();
-		auto numDropped = stats.device_transmission_error + stats.device_underrun + stats.sink_ignored + stats.sink_underrun;
-		_captureInfo->setText(QString("Saved Images: %1 Frames Dropped: %2").arg(num_processed).arg(numDropped));
+QString HighSpeedCaptureDialog::captureResultText()
+{
+	int64_t numProcessed = 0;
+	uint64_t numDropped = 0;
+	int64_t numFailed = 0;
+	for (auto& ch : _channels)
+	{
+		numProcessed += ch->numProcessed();
+		numDropped += ch->numDropped();
+		numFailed += ch->numFailed();
+	}
 
-		event->accept();
+	auto text = QString("Saved Images: %1 Frames Dropped: %2").arg(numProcessed).arg(numDropped);
+	if (numFailed > 0)
+	{
+		text += QString(" Write Errors: %1").arg(numFailed);
 	}
+	for (auto& ch : _channels)
+	{
+		auto error = ch->errorMessage();
+		if (!error.isEmpty())
+			text += QString("\n%1: %2").arg(ch->deviceName(), error);
+	}
+	return text;
 }
 
-void HighSpeedCaptureDialog::closeEvent(QCloseEvent* event)
+QString HighSpeedCaptureDialog::cleanupProgressText(int64_t num_processed, int64_t num_remaining)
 {
-	// Cancel and wait for possible cleanup thread
-	_cancel_cleanup = true;
-	while (_cleanup_active)
+	// Estimate remaining time from the rate at which the output queues were drained so far
+	auto elapsed_ms = _cleanupTimer.elapsed();
+	auto num_drained = num_processed - _cleanupStartProcessed;
+
+	if (elapsed_ms <= 0 || num_drained <= 0)
 	{
-		QThread::usleep(1);
+		return QString("Writing remaining images: %1 left").arg(num_remaining);
 	}
 
-	// Make sure the stream is stopped so that framesQueued is no longer running
-	_grabber.streamStop();
+	double rate = num_drained * 1000.0 / elapsed_ms;
+	double eta_s = num_remaining / rate;
 
-	saveSettings();
-	event->accept();
+	return QString("Writing remaining images: %1 left, %2 images/s, ETA %3 s")
+		.arg(num_remaining)
+		.arg(rate, 0, 'f', 1)
+		.arg(eta_s, 0, 'f', 1);
 }
 
-bool HighSpeedCaptureDialog::sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& imageType, size_t min_buffers_required)
+QString HighSpeedCaptureDialog::writeTimingsText(const CaptureChannel& channel) const
 {
-	// Calculate the number of buffers that can be stored in the configured amount of memory
-	auto bpp = ic4::getBitsPerPixel(imageType.pixel_format());
-	auto imageSize = imageType.width() * imageType.height() * bpp / 8;
-	auto numBuffers = _bufferMemory->text().toInt() * 1024ll * 1024ll / imageSize;
+	QStringList lines;
 
-	if (numBuffers > min_buffers_required)
+	for (int i = 0; i < highspeedcapture::WriteTelemetry::NUM_STAGES; ++i)
 	{
-		_num_total = numBuffers;
-
-		// Allocate the configured number of buffers.
-		sink.allocAndQueueBuffers(numBuffers);
+		auto stage = static_cast<highspeedcapture::WriteTelemetry::Stage>(i);
+		const auto& h = channel.telemetry().histogram(stage);
+		if (h.count() == 0)
+			continue;
+
+		lines << QString("%1: p50 %2 ms, p99 %3 ms, max %4 ms")
+			.arg(highspeedcapture::WriteTelemetry::stage_name(stage))
+			.arg(h.percentile_ns(50) / 1e6, 0, 'f', 3)
+			.arg(h.percentile_ns(99) / 1e6, 0, 'f', 3)
+			.arg(h.max_ns() / 1e6, 0, 'f', 3);
 	}
-	else
+
+	return lines.join("\n");
+}
+
+void HighSpeedCaptureDialog::onExportTrace()
+{
+	auto defaultDir = _destinations->count() > 0 ? _destinations->item(0)->text() : QString();
+	auto fileName = QFileDialog::getSaveFileName(this, tr("Export Trace"), defaultDir + "/trace.json", tr("Chrome Trace Files (*.json)"));
+	if (fileName.isEmpty())
+		return;
+
+	std::ofstream out(fileName.toStdString(), std::ios::out | std::ios::trunc);
+
+	// The events use the real process and thread ids, so that the trace can be aligned with system traces of this process.
+	// The cameras are told apart by the camera name in the events' arguments and in the names of their writer threads.
+	auto pid = static_cast<int64_t>(QCoreApplication::applicationPid());
+	auto processName = QCoreApplication::applicationName().toStdString();
+	std::replace(processName.begin(), processName.end(), '"', '\'');
+	std::replace(processName.begin(), processName.end(), '\\', '/');
+
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"" << processName << "\"}}";
+	bool first = false;
+	for (auto& ch : _channels)
 	{
-		_num_total = min_buffers_required;
+		auto name = ch->deviceName().toStdString();
+		std::replace(name.begin(), name.end(), '"', '\'');
+		std::replace(name.begin(), name.end(), '\\', '/');
 
-		// If we do not call allocAndQueueBuffers, the sink automatically allocates
-		// min_buffers_required buffers for us, no need to do anything.
-	}	
+		ch->telemetry().writeChromeTraceEvents(out, pid, name, first);
+	}
+	out << "\n]}\n";
 
-	return true;
+	if (!out.good())
+	{
+		QMessageBox::critical(this, {}, tr("Failed to write trace file"));
+	}
 }
 
-void HighSpeedCaptureDialog::framesQueued(ic4::QueueSink& sink)
+void HighSpeedCaptureDialog::customEvent(QEvent* event)
 {
-	std::lock_guard lck(_frames_queued_mtx);
-
+	if (event->type() == UPDATE_STATS)
 	{
-		// The first call to popOutputBuffer in framesQueued is guaranteed to not fail
-		auto buffer = sink.popOutputBuffer();
+		// Allow the next update to be posted
+		_stats_update_posted = false;
+
+		// A camera whose images cannot be written stops delivering images, the other cameras keep capturing
+		for (auto& ch : _channels)
+		{
+			if (ch->takeCaptureFailure() && ch->isCapturing())
+				ch->stopAcquisition();
+		}
+
+		updateCameraTable();
+
+		int64_t num_processed = 0;
+		int64_t num_remaining = 0;
+		for (auto& ch : _channels)
+		{
+			num_processed += ch->numProcessed();
+			// Images still queued in the frame writer have to be written as well
+			num_remaining += ch->numFilled() + static_cast<int64_t>(ch->numPending());
+		}
 
-		// Generate file path based on settings and frame number
-		auto filePath = QString("%1/image_%2.jpeg").arg(_destinationDirectory->text()).arg(_frame_number++);
+		auto* channel = selectedChannel();
+		auto timings = channel ? "\n" + writeTimingsText(*channel) : QString();
+
+		// Update saved/dropped label, or show the progress of writing the remaining images
+		if (_cleanup_active)
+		{
+			_captureInfo->setText(cleanupProgressText(num_processed, num_remaining) + timings);
+		}
+		else if (isCapturing())
+		{
+			_captureInfo->setText(captureResultText() + timings);
+		}
 
-		// Save image
-		ic4::imageBufferSaveAsJpeg(*buffer, filePath.toStdString());
+		event->accept();
+	}
+}
+
+void HighSpeedCaptureDialog::closeEvent(QCloseEvent* event)
+{
+	if (_cleanup_active)
+	{
+		int64_t num_remaining = 0;
+		for (auto& ch : _channels)
+			num_remaining += ch->numFilled() + static_cast<int64_t>(ch->numPending());
+
+		// Let the user decide what happens to the images that were not written yet
+		QMessageBox msg(this);
+		msg.setIcon(QMessageBox::Question);
+		msg.setText(QString("%1 images have not been written to the destination folders yet.").arg(num_remaining));
+		auto* cancelRemaining = msg.addButton(tr("Cancel Remaining"), QMessageBox::DestructiveRole);
+		auto* continueInBackground = msg.addButton(tr("Continue in Background"), QMessageBox::AcceptRole);
+		msg.addButton(QMessageBox::Cancel);
+		msg.exec();
+
+		if (msg.clickedButton() == continueInBackground)
+		{
+			// Hide the window, the cleanup continuation closes it once all images are written
+			_closeAfterCleanup = true;
+			hide();
+			event->ignore();
+			return;
+		}
+		if (msg.clickedButton() != cancelRemaining)
+		{
+			event->ignore();
+			return;
+		}
 
-		// Count number of processed images
-		_num_processed += 1;
+		// Discard remaining images and wait for the cleanup thread to exit
+		cancelCleanup();
+		_cleanupFuture.waitForFinished();
 	}
+	else if (isCapturing())
+	{
+		// Closing while capturing discards the images that were not written yet
+		cancelCleanup();
+		for (auto& ch : _channels)
+			ch->finishCapture();
+	}
+
+	// Make sure the streams are stopped and the scheduler no longer accesses the sinks
+	for (auto& ch : _channels)
+		ch->stopCapture(false);
 
-	// Update queue sizes after the image buffer has been returned to the sink
-	auto queueSizes = _sink->queueSizes();
-	_num_free = queueSizes.free_queue_length;
-	_num_filled = queueSizes.output_queue_length;
+	saveSettings();
 
-	// Send stats update event to main thread
-	QCoreApplication::postEvent(this, new QEvent(UPDATE_STATS));
-}
\ No newline at end of file
+	// The cleanup continuation may still be queued, it must not restart the display streams
+	_closing = true;
+	event->accept();
+}
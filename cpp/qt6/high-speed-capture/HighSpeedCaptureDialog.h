@@ -1,33 +1,60 @@
 
 #include <ic4/ic4.h>
 
+#include "CaptureChannel.h"
+#include "IoScheduler.h"
+
 #include <QDialog>
 #include <QLineEdit>
 #include <QPushButton>
-#include <QProgressBar>
 #include <QLabel>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QListWidget>
+#include <QTableWidget>
+#include <QGridLayout>
+#include <QFuture>
+#include <QElapsedTimer>
 
 #include <cstdint>
 #include <atomic>
-#include <mutex>
+#include <memory>
+#include <vector>
 
-class HighSpeedCaptureDialog : public QDialog, public ic4::QueueSinkListener
+class HighSpeedCaptureDialog : public QDialog
 {
 public:
 	HighSpeedCaptureDialog();
+	~HighSpeedCaptureDialog();
 
 private:
 	void createUI();
 	void updateUI();
+	void updateDisplayLayout();
+	void updateCameraTable();
 
 	void readSettings();
 	void saveSettings();
 
 private:
 	// UI event handlers
-	void onSelectDevice();
+	void onAddDevice();
+	void onRemoveDevice();
 	void onDeviceProperties();
+	void onAddDestination();
+	void onRemoveDestination();
 	void onStartStop();
+	void onExportTrace();
+
+private:
+	CaptureChannel* addChannel();
+	CaptureChannel* selectedChannel();
+	bool isCapturing() const;
+	void requestStatsUpdate();
+	void cancelCleanup();
+	QString captureResultText();
+	QString cleanupProgressText(int64_t num_processed, int64_t num_remaining);
+	QString writeTimingsText(const CaptureChannel& channel) const;
 
 private:
 	// Qt event overrides
@@ -35,35 +62,32 @@ private:
 	void closeEvent(QCloseEvent* event) override;
 
 private:
-	// ic4::QueueSinkListener overrides
-	bool sinkConnected(ic4::QueueSink& sink, const ic4::ImageType& imageType, size_t min_buffers_required) final;
-	void framesQueued(ic4::QueueSink& sink) final;
-
-private:
-	ic4::Grabber _grabber;
-	std::shared_ptr<ic4::Display> _display;
-	std::shared_ptr<ic4::QueueSink> _sink;
-	int _frame_number = 0;
-
-	std::mutex _frames_queued_mtx;
+	// Shares the disk bandwidth between the cameras, has to outlive the channels
+	highspeedcapture::IoScheduler _scheduler;
+	std::vector<std::unique_ptr<CaptureChannel>> _channels;
+	std::vector<QWidget*> _displayWidgets;
 
-	std::atomic<int64_t> _num_processed = 0;
-	std::atomic<int64_t> _num_total = 0;
-	std::atomic<int64_t> _num_free = 0;
-	std::atomic<int64_t> _num_filled = 0;
-
-	std::atomic<bool> _cancel_cleanup = false;
+	std::atomic<bool> _stats_update_posted = false;
 	std::atomic<bool> _cleanup_active = false;
 
-	QPushButton* _selectDevice = nullptr;
+	QFuture<void> _cleanupFuture;
+	QElapsedTimer _cleanupTimer;
+	int64_t _cleanupStartProcessed = 0;
+	bool _closeAfterCleanup = false;
+	bool _closing = false;
+
+	QPushButton* _addDevice = nullptr;
+	QPushButton* _removeDevice = nullptr;
 	QPushButton* _deviceProperties = nullptr;
-	QLineEdit* _destinationDirectory = nullptr;
-	QPushButton* _destinationBrowse = nullptr;
-	QLineEdit* _bufferMemory = nullptr;
-	QProgressBar* _freeBuffersProgress = nullptr;
-	QLabel* _freeBuffersLabel = nullptr;
-	QProgressBar* _filledBuffersProgress = nullptr;
-	QLabel* _filledBuffersLabel = nullptr;
+	QGridLayout* _displayLayout = nullptr;
+	QTableWidget* _cameraTable = nullptr;
+	QListWidget* _destinations = nullptr;
+	QPushButton* _addDestination = nullptr;
+	QPushButton* _removeDestination = nullptr;
+	QComboBox* _fileFormat = nullptr;
+	QCheckBox* _syncToDisk = nullptr;
+	QCheckBox* _writeCsvIndex = nullptr;
 	QPushButton* _startStop = nullptr;
 	QLabel* _captureInfo = nullptr;
-};
\ No newline at end of file
+	QPushButton* _exportTrace = nullptr;
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace highspeedcapture
+{
+	// A producer of frames to be written by the IoScheduler, e.g. a camera's QueueSink
+	class WriteSource
+	{
+	public:
+		virtual ~WriteSource() = default;
+
+		// Index of the destination (directory or disk) the source writes to
+		virtual size_t destination() const = 0;
+		// Number of frames waiting to be submitted
+		virtual size_t queuedFrames() const = 0;
+		// Submits the next waiting frame for writing, done has to be called once the write has completed.
+		// Returns false if no frame was waiting.
+		virtual bool submitNext(std::function<void()> done) = 0;
+		// Drops the frames that were submitted, but not started yet
+		virtual void discardPending() = 0;
+	};
+
+	// Decides which source is allowed to write next, so that multiple cameras share the available disk bandwidth.
+	//
+	// The frames stay in their sources (the cameras' sink output queues) until they are scheduled. The scheduler
+	// takes one frame from every source in turn, as long as fewer than max_in_flight writes are outstanding on the
+	// source's destination. A camera producing more data than its share of the disk can take fills up its own
+	// buffers, instead of delaying the other cameras' writes.
+	class IoScheduler
+	{
+	public:
+		explicit IoScheduler(size_t max_in_flight = 32)
+			: max_in_flight_((std::max)(max_in_flight, size_t(1)))
+		{
+			thread_ = std::thread([this] { run(); });
+		}
+
+		~IoScheduler()
+		{
+			{
+				std::lock_guard lck(mtx_);
+				stop_ = true;
+			}
+			work_cv_.notify_all();
+			thread_.join();
+		}
+
+		IoScheduler(const IoScheduler&) = delete;
+		IoScheduler& operator=(const IoScheduler&) = delete;
+
+		// Maximum number of outstanding writes per destination
+		size_t max_in_flight() const { return max_in_flight_; }
+
+		void add_source(WriteSource* source)
+		{
+			{
+				std::lock_guard lck(sources_mtx_);
+				if (std::find(sources_.begin(), sources_.end(), source) == sources_.end())
+					sources_.push_back(source);
+			}
+			notify();
+		}
+
+		// After this function returns, the scheduler no longer calls into the source
+		void remove_source(WriteSource* source)
+		{
+			std::lock_guard lck(sources_mtx_);
+			sources_.erase(std::remove(sources_.begin(), sources_.end(), source), sources_.end());
+		}
+
+		// Has to be called when a source has new frames available
+		void notify()
+		{
+			{
+				std::lock_guard lck(mtx_);
+				epoch_ += 1;
+			}
+			work_cv_.notify_all();
+		}
+
+		// Allows scheduling frames again after cancel
+		void start()
+		{
+			std::lock_guard lck(mtx_);
+			cancelled_ = false;
+		}
+
+		// Stops scheduling frames and discards the writes that were not started yet
+		void cancel()
+		{
+			{
+				std::lock_guard lck(mtx_);
+				cancelled_ = true;
+			}
+			drained_cv_.notify_all();
+
+			std::lock_guard lck(sources_mtx_);
+			for (auto* source : sources_)
+				source->discardPending();
+		}
+
+		// Waits until all sources are empty and all writes have completed.
+		// Returns false if cancel was called.
+		bool wait_drained()
+		{
+			std::unique_lock lck(mtx_);
+			drained_cv_.wait(lck,
+				[this]
+				{
+					return cancelled_ || (scanned_epoch_ == epoch_ && backlog_ == 0 && total_in_flight_ == 0);
+				}
+			);
+			return !cancelled_;
+		}
+
+		// Number of writes that were submitted, but have not completed yet
+		size_t in_flight() const
+		{
+			std::lock_guard lck(mtx_);
+			return total_in_flight_;
+		}
+
+	private:
+		bool try_reserve(size_t destination)
+		{
+			std::lock_guard lck(mtx_);
+			if (cancelled_)
+				return false;
+
+			if (destination >= in_flight_.size())
+				in_flight_.resize(destination + 1);
+			if (in_flight_[destination] >= max_in_flight_)
+				return false;
+
+			in_flight_[destination] += 1;
+			total_in_flight_ += 1;
+			return true;
+		}
+
+		// Called when the source had no frame after all, there is no new work for the scheduler
+		void unreserve(size_t destination)
+		{
+			std::lock_guard lck(mtx_);
+			in_flight_[destination] -= 1;
+			total_in_flight_ -= 1;
+		}
+
+		// Called from the sources' write completions, which frees a slot on the destination
+		void complete(size_t destination)
+		{
+			{
+				std::lock_guard lck(mtx_);
+				in_flight_[destination] -= 1;
+				total_in_flight_ -= 1;
+				epoch_ += 1;
+			}
+			work_cv_.notify_all();
+			drained_cv_.notify_all();
+		}
+
+		void run()
+		{
+			while (true)
+			{
+				uint64_t epoch = 0;
+				{
+					std::lock_guard lck(mtx_);
+					if (stop_)
+						return;
+					epoch = epoch_;
+				}
+
+				bool submitted = false;
+				size_t backlog = 0;
+				{
+					std::lock_guard lck(sources_mtx_);
+
+					// Visit every source once per round, starting with a different one each round
+					auto n = sources_.size();
+					for (size_t k = 0; k < n; ++k)
+					{
+						auto* source = sources_[(next_ + k) % n];
+						auto destination = source->destination();
+
+						if (try_reserve(destination))
+						{
+							if (source->submitNext([this, destination] { complete(destination); }))
+								submitted = true;
+							else
+								unreserve(destination);
+						}
+
+						backlog += source->queuedFrames();
+					}
+					if (n > 0)
+						next_ = (next_ + 1) % n;
+				}
+
+				std::unique_lock lck(mtx_);
+				backlog_ = backlog;
+				scanned_epoch_ = epoch;
+				drained_cv_.notify_all();
+
+				// If a frame was submitted, there could be more, otherwise sleep until a source has new frames or a write completes
+				if (!submitted)
+				{
+					work_cv_.wait(lck, [this, epoch] { return stop_ || epoch_ != epoch; });
+				}
+			}
+		}
+
+	private:
+		const size_t max_in_flight_;
+
+		mutable std::mutex mtx_;
+		std::condition_variable work_cv_;
+		std::condition_variable drained_cv_;
+		bool stop_ = false;
+		bool cancelled_ = false;
+		uint64_t epoch_ = 0;
+		uint64_t scanned_epoch_ = 0;
+		size_t backlog_ = 0;
+		std::vector<size_t> in_flight_;
+		size_t total_in_flight_ = 0;
+
+		// Locked while the scheduler calls into the sources, never locked while holding mtx_
+		std::mutex sources_mtx_;
+		std::vector<WriteSource*> sources_;
+		size_t next_ = 0;
+
+		std::thread thread_;
+	};
+}
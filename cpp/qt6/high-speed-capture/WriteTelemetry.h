@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined _WIN32
+#include <Windows.h>
+#include <intrin.h>
+#else
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace highspeedcapture
+{
+	// Histogram of durations with logarithmically spaced buckets.
+	// Each power of two is split into 4 sub-buckets, so percentiles are accurate to about 20%.
+	// Recording is a few instructions and lock-free, reading is possible from any thread while recording.
+	class LatencyHistogram
+	{
+	public:
+		static constexpr int SUB_BUCKET_BITS = 2;
+		static constexpr int NUM_BUCKETS = 48 << SUB_BUCKET_BITS;
+
+		void record(uint64_t ns)
+		{
+			buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+			count_.fetch_add(1, std::memory_order_relaxed);
+			sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+			auto prev_max = max_ns_.load(std::memory_order_relaxed);
+			while (ns > prev_max && !max_ns_.compare_exchange_weak(prev_max, ns, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		void reset()
+		{
+			for (auto& b : buckets_)
+				b.store(0, std::memory_order_relaxed);
+			count_ = 0;
+			sum_ns_ = 0;
+			max_ns_ = 0;
+		}
+
+		uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+		uint64_t max_ns() const { return max_ns_.load(std::memory_order_relaxed); }
+
+		double mean_ns() const
+		{
+			auto n = count();
+			return n ? static_cast<double>(sum_ns_.load(std::memory_order_relaxed)) / n : 0.0;
+		}
+
+		// Returns the upper bound of the bucket containing the requested percentile (0..100)
+		uint64_t percentile_ns(double p) const
+		{
+			auto n = count();
+			if (n == 0)
+				return 0;
+
+			auto target = static_cast<uint64_t>(n * p / 100.0);
+			uint64_t seen = 0;
+			for (int i = 0; i < NUM_BUCKETS; ++i)
+			{
+				seen += buckets_[i].load(std::memory_order_relaxed);
+				if (seen > target)
+					return (std::min)(bucket_upper_bound(i), max_ns());
+			}
+			return max_ns();
+		}
+
+	private:
+		static int bucket_index(uint64_t ns)
+		{
+			if (ns < (1u << SUB_BUCKET_BITS))
+				return static_cast<int>(ns);
+
+			int msb = 63 - count_leading_zeros(ns);
+			int sub = static_cast<int>((ns >> (msb - SUB_BUCKET_BITS)) & ((1u << SUB_BUCKET_BITS) - 1));
+			int index = ((msb - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub;
+			return (std::min)(index, NUM_BUCKETS - 1);
+		}
+
+		static uint64_t bucket_upper_bound(int index)
+		{
+			if (index < (1 << SUB_BUCKET_BITS))
+				return index;
+
+			int msb = (index >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+			uint64_t sub = index & ((1 << SUB_BUCKET_BITS) - 1);
+			return ((((1ull << SUB_BUCKET_BITS) | sub) + 1) << (msb - SUB_BUCKET_BITS)) - 1;
+		}
+
+		static int count_leading_zeros(uint64_t v)
+		{
+#if defined _MSC_VER
+			unsigned long index = 0;
+			_BitScanReverse64(&index, v);
+			return 63 - static_cast<int>(index);
+#else
+			return __builtin_clzll(v);
+#endif
+		}
+
+		std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets_ = {};
+		std::atomic<uint64_t> count_ = 0;
+		std::atomic<uint64_t> sum_ns_ = 0;
+		std::atomic<uint64_t> max_ns_ = 0;
+	};
+
+	// Collects per-frame timings of the write path:
+	// - Pop: Removing the buffer from the sink's output queue
+	// - Queue: Waiting in the frame writer's queue for a worker thread
+	// - Encode/Write: Encoding the image and writing the file (done in a single call by the IC4 library),
+	//   or writing the raw image data to the raw stream file
+	// - Sync: Flushing the written file to the storage device (optional)
+	//
+	// The timings are aggregated in histograms for the UI, and the most recent frames are kept
+	// in a ring buffer that can be exported as a Chrome trace JSON file (chrome://tracing, ui.perfetto.dev).
+	class WriteTelemetry
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		enum Stage
+		{
+			Pop,
+			Queue,
+			Encode,
+			Sync,
+			NUM_STAGES
+		};
+
+		static const char* stage_name(Stage stage)
+		{
+			switch (stage)
+			{
+			case Pop:		return "Pop";
+			case Queue:		return "Queue";
+			case Encode:	return "Encode/Write";
+			case Sync:		return "Sync";
+			default:		return "";
+			}
+		}
+
+		struct FrameRecord
+		{
+			int64_t frame_number = 0;
+			// Thread that executed each stage
+			std::array<uint64_t, NUM_STAGES> thread_id = {};
+			// Stage boundaries, a stage that was skipped has the same start and end time
+			std::array<clock::time_point, NUM_STAGES + 1> t = {};
+		};
+
+		explicit WriteTelemetry(size_t trace_capacity = 256 * 1024)
+			: trace_(trace_capacity)
+		{
+		}
+
+		void reset()
+		{
+			for (auto& h : histograms_)
+				h.reset();
+
+			std::lock_guard lck(trace_mtx_);
+			trace_next_ = 0;
+			trace_size_ = 0;
+		}
+
+		void record(const FrameRecord& rec)
+		{
+			for (int i = 0; i < NUM_STAGES; ++i)
+			{
+				if (rec.t[i + 1] != rec.t[i])
+				{
+					auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(rec.t[i + 1] - rec.t[i]).count();
+					histograms_[i].record(static_cast<uint64_t>(ns));
+				}
+			}
+
+			std::lock_guard lck(trace_mtx_);
+			trace_[trace_next_] = rec;
+			trace_next_ = (trace_next_ + 1) % trace_.size();
+			trace_size_ = (std::min)(trace_size_ + 1, trace_.size());
+		}
+
+		const LatencyHistogram& histogram(Stage stage) const
+		{
+			return histograms_[stage];
+		}
+
+		// Writes the recorded frames as complete ("X") events in the Chrome trace event format,
+		// the queue wait time is written as async ("b"/"e") events.
+		// Timestamps are taken from the monotonic clock and thread ids are the operating system's ids, which allows aligning them
+		// with system traces of the same process. Several cameras write into the same process, so every event is tagged with
+		// camera_name, and the threads that only write this camera's frames are named after it.
+		// camera_name must not contain characters that need escaping in JSON.
+		// first has to be true for the first event of the "traceEvents" array, and is updated when events were written.
+		void writeChromeTraceEvents(std::ostream& out, int64_t process_id, const std::string& camera_name, bool& first) const
+		{
+			auto to_us = [](clock::duration d)
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1000.0;
+			};
+
+			std::lock_guard lck(trace_mtx_);
+
+			// The writer threads belong to this camera's frame writer, the pop thread is shared by all cameras
+			std::vector<uint64_t> writer_threads;
+
+			size_t begin = (trace_next_ + trace_.size() - trace_size_) % trace_.size();
+			for (size_t n = 0; n < trace_size_; ++n)
+			{
+				const auto& rec = trace_[(begin + n) % trace_.size()];
+
+				for (int i = 0; i < NUM_STAGES; ++i)
+				{
+					if (rec.t[i + 1] == rec.t[i])
+						continue;
+
+					if (!first)
+						out << ",\n";
+					first = false;
+
+					auto name = stage_name(static_cast<Stage>(i));
+					auto ts = to_us(rec.t[i].time_since_epoch());
+					auto dur = to_us(rec.t[i + 1] - rec.t[i]);
+
+					if (i == Queue)
+					{
+						// Waiting in the queue overlaps with other frames on the same thread, use an async event pair.
+						// The frame numbers of the cameras overlap, so the id includes the camera name.
+						out << "{\"name\":\"" << name << "\",\"cat\":\"write-path\",\"ph\":\"b\",\"id\":\"" << camera_name << "/" << rec.frame_number
+							<< "\",\"ts\":" << std::fixed << ts << ",\"pid\":" << process_id << ",\"tid\":" << rec.thread_id[i]
+							<< ",\"args\":{\"camera\":\"" << camera_name << "\",\"frame\":" << rec.frame_number << "}},\n"
+							<< "{\"name\":\"" << name << "\",\"cat\":\"write-path\",\"ph\":\"e\",\"id\":\"" << camera_name << "/" << rec.frame_number
+							<< "\",\"ts\":" << std::fixed << ts + dur << ",\"pid\":" << process_id << ",\"tid\":" << rec.thread_id[i] << "}";
+						continue;
+					}
+
+					if (i != Pop && std::find(writer_threads.begin(), writer_threads.end(), rec.thread_id[i]) == writer_threads.end())
+						writer_threads.push_back(rec.thread_id[i]);
+
+					out << "{\"name\":\"" << name << "\""
+						<< ",\"cat\":\"write-path\",\"ph\":\"X\""
+						<< ",\"ts\":" << std::fixed << ts
+						<< ",\"dur\":" << dur
+						<< ",\"pid\":" << process_id
+						<< ",\"tid\":" << rec.thread_id[i]
+						<< ",\"args\":{\"camera\":\"" << camera_name << "\",\"frame\":" << rec.frame_number << "}}";
+				}
+			}
+
+			for (auto tid : writer_threads)
+			{
+				if (!first)
+					out << ",\n";
+				first = false;
+
+				out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << process_id << ",\"tid\":" << tid
+					<< ",\"args\":{\"name\":\"" << camera_name << " writer\"}}";
+			}
+		}
+
+		// Returns the operating system's id of the calling thread, to match thread ids in system traces
+		static uint64_t current_thread_id()
+		{
+#if defined _WIN32
+			return GetCurrentThreadId();
+#elif defined __linux__
+			return static_cast<uint64_t>(syscall(SYS_gettid));
+#else
+			return 0;
+#endif
+		}
+
+	private:
+		std::array<LatencyHistogram, NUM_STAGES> histograms_;
+
+		mutable std::mutex trace_mtx_;
+		std::vector<FrameRecord> trace_;
+		size_t trace_next_ = 0;
+		size_t trace_size_ = 0;
+	};
+}